@@ -431,6 +431,12 @@ class RqlQuery(object):
     def avg(self, *args):
         return Avg(self, *[func_wrap(arg) for arg in args])
 
+    def approx_count_distinct(self, *args):
+        return ApproxCountDistinct(self, *[func_wrap(arg) for arg in args])
+
+    def approx_quantile(self, *args):
+        return ApproxQuantile(self, *[func_wrap(arg) for arg in args])
+
     def min(self, *args, **kwargs):
         return Min(self, *[func_wrap(arg) for arg in args], **kwargs)
 
@@ -1310,6 +1316,16 @@ class Avg(RqlMethodQuery):
     st = 'avg'
 
 
+class ApproxCountDistinct(RqlMethodQuery):
+    tt = pTerm.APPROX_COUNT_DISTINCT
+    st = 'approx_count_distinct'
+
+
+class ApproxQuantile(RqlMethodQuery):
+    tt = pTerm.APPROX_QUANTILE
+    st = 'approx_quantile'
+
+
 class Min(RqlMethodQuery):
     tt = pTerm.MIN
     st = 'min'
@@ -2,9 +2,12 @@
 #ifndef ARCH_IO_CONCURRENCY_HPP_
 #define ARCH_IO_CONCURRENCY_HPP_
 
+#include <errno.h>
 #include <pthread.h>
 
+#include "config/args.hpp"
 #include "errors.hpp"
+#include "time.hpp"
 
 // Class that wraps a pthread mutex
 class system_mutex_t {
@@ -55,6 +58,23 @@ public:
         int res = pthread_cond_wait(&c, &mutex->m);
         guarantee_xerr(res == 0, res, "Could not wait on pthread cond.");
     }
+    // Like `wait()`, but gives up after `nanos` nanoseconds.
+    void timed_wait(system_mutex_t *mutex, int64_t nanos) {
+#ifdef _WIN32
+        DWORD ms = static_cast<DWORD>((nanos + MILLION - 1) / MILLION);
+        BOOL res = SleepConditionVariableCS(&c, &mutex->m, ms);
+        guarantee(res || GetLastError() == ERROR_TIMEOUT,
+                  "Could not wait on pthread cond.");
+#else
+        timespec deadline = clock_realtime();
+        int64_t deadline_nanos = deadline.tv_nsec + nanos;
+        deadline.tv_sec += deadline_nanos / BILLION;
+        deadline.tv_nsec = deadline_nanos % BILLION;
+        int res = pthread_cond_timedwait(&c, &mutex->m, &deadline);
+        guarantee_xerr(res == 0 || res == ETIMEDOUT, res,
+                       "Could not wait on pthread cond.");
+#endif
+    }
     void signal() {
         int res = pthread_cond_signal(&c);
         guarantee_xerr(res == 0, res, "Could not signal pthread cond.");
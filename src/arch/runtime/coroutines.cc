@@ -167,7 +167,10 @@ coro_t::coro_t() :
     current_thread_(linux_thread_pool_t::get_thread_id()),
     notified_(false),
     waiting_(false),
-    protected_stack_lru_entry_(this)
+    protected_stack_lru_entry_(this),
+    cpu_counter_(nullptr),
+    resumed_at_(ticks_t{0}),
+    query_resources_scope_(nullptr)
 #ifndef NDEBUG
     , selfname_number(get_thread_id().threadnum + MAX_THREADS *
           // The comma here is the comma operator, to implement the semantics
@@ -276,6 +279,9 @@ void coro_t::run() {
         PROFILER_CORO_RESUME;
         coro->action_wrapper.run();
         PROFILER_CORO_YIELD(0);
+        rassert(coro->cpu_counter_ == nullptr, "A coroutine finished with a CPU counter.");
+        rassert(coro->query_resources_scope_ == nullptr,
+                "A coroutine finished with a query resources scope.");
 #ifndef NDEBUG
         TLS_get_cglobals()->running_coroutine_counts[coro->coroutine_type]--;
         TLS_get_cglobals()->active_coroutines.erase(coro);
@@ -359,6 +365,7 @@ void coro_t::wait() {   /* class method */
 
     rassert(!self()->waiting_);
     self()->waiting_ = true;
+    self()->charge_cpu_counter();
 
     PROFILER_CORO_YIELD(1);
     if (TLS_get_cglobals()->prev_coro) {
@@ -372,6 +379,45 @@ void coro_t::wait() {   /* class method */
     rassert(self());
     rassert(self()->waiting_);
     self()->waiting_ = false;
+    self()->restart_cpu_counter();
+}
+
+ticks_t *coro_t::set_cpu_counter(ticks_t *counter) {
+    charge_cpu_counter();
+    ticks_t *previous = cpu_counter_;
+    cpu_counter_ = counter;
+    if (cpu_counter_ != nullptr) {
+        resumed_at_ = get_ticks();
+    }
+    return previous;
+}
+
+ql::query_resources_scope_t *coro_t::set_query_resources_scope(
+        ql::query_resources_scope_t *scope) {
+    ql::query_resources_scope_t *previous = query_resources_scope_;
+    query_resources_scope_ = scope;
+    return previous;
+}
+
+ticks_t coro_t::running_ticks() const {
+    if (cpu_counter_ == nullptr) {
+        return ticks_t{0};
+    }
+    return ticks_t{get_ticks().nanos - resumed_at_.nanos};
+}
+
+void coro_t::charge_cpu_counter() {
+    if (cpu_counter_ != nullptr) {
+        ticks_t now = get_ticks();
+        cpu_counter_->nanos += now.nanos - resumed_at_.nanos;
+        resumed_at_ = now;
+    }
+}
+
+void coro_t::restart_cpu_counter() {
+    if (cpu_counter_ != nullptr) {
+        resumed_at_ = get_ticks();
+    }
 }
 
 void coro_t::yield() {  /* class method */
@@ -402,8 +448,12 @@ void coro_t::notify_now_deprecated() {
     TLS_get_cglobals()->assert_finite_coro_waiting_counter = 0;
 #endif
 
-    if (coro_t::self() != nullptr) {
+    /* The coroutine we switch away from doesn't go through `wait()`, so we have to
+    stop charging it for the time here. */
+    coro_t *caller = coro_t::self();
+    if (caller != nullptr) {
         PROFILER_CORO_YIELD(1);
+        caller->charge_cpu_counter();
     }
     coro_t *prev_prev_coro = TLS_get_cglobals()->prev_coro;
     TLS_get_cglobals()->prev_coro = TLS_get_cglobals()->current_coro;
@@ -418,8 +468,10 @@ void coro_t::notify_now_deprecated() {
     rassert(TLS_get_cglobals()->current_coro == this);
     TLS_get_cglobals()->current_coro = TLS_get_cglobals()->prev_coro;
     TLS_get_cglobals()->prev_coro = prev_prev_coro;
-    if (coro_t::self() != nullptr) {
+    if (caller != nullptr) {
+        rassert(coro_t::self() == caller);
         PROFILER_CORO_RESUME;
+        caller->restart_cpu_counter();
     }
 
 #ifndef NDEBUG
@@ -27,6 +27,10 @@ threadnum_t get_thread_id();
 struct coro_globals_t;
 class coro_t;
 
+namespace ql {
+class query_resources_scope_t;
+}  // namespace ql
+
 
 struct coro_profiler_mixin_t {
 #ifdef ENABLE_CORO_PROFILER
@@ -159,6 +163,26 @@ public:
         return linux_thread_message_t::get_priority();
     }
 
+    /* While a coroutine has a CPU counter, the time it spends running is added to
+    the counter whenever it stops running, and when the counter gets replaced.
+    `set_cpu_counter()` returns the previous counter (or `nullptr`), which the
+    caller should put back when it's done. */
+    ticks_t *set_cpu_counter(ticks_t *counter);
+    bool has_cpu_counter() const { return cpu_counter_ != nullptr; }
+
+    /* How long the coroutine has been running since it last got the CPU.  Only
+    tracked while it has a CPU counter. */
+    ticks_t running_ticks() const;
+
+    /* The `ql::query_resources_scope_t` that the coroutine's datum allocations are
+    charged to, if any.  `set_query_resources_scope()` returns the previous one, like
+    `set_cpu_counter()`. */
+    ql::query_resources_scope_t *query_resources_scope() const {
+        return query_resources_scope_;
+    }
+    ql::query_resources_scope_t *set_query_resources_scope(
+        ql::query_resources_scope_t *scope);
+
     /* Copies the backtrace from the time of spawning the coroutine into
     `buffer_out`, which has to be allocated before calling the function.
     `size` must contain the maximum number of entries to store.
@@ -179,6 +203,11 @@ private:
     // Generates a spawn-time backtrace and stores it into `spawn_backtrace`.
     void grab_spawn_backtrace();
 
+    // Adds the time since `resumed_at_` to `*cpu_counter_`, if there is one.
+    void charge_cpu_counter();
+    // Starts counting from now again, when the coroutine gets the CPU back.
+    void restart_cpu_counter();
+
     // Performs a context switch from `current_context` to this coroutine.
     // Also enables stack-overflow protection on this coroutine.
     void switch_to_coro_with_protection(coro_context_ref_t *current_context);
@@ -230,6 +259,10 @@ private:
     /* Used to eventually unprotect the coroutine if it has been inactive for a while. */
     coro_lru_entry_t protected_stack_lru_entry_;
 
+    ticks_t *cpu_counter_;
+    ticks_t resumed_at_;
+    ql::query_resources_scope_t *query_resources_scope_;
+
 #ifndef NDEBUG
     int64_t selfname_number;
     std::string coroutine_type;
@@ -7,6 +7,7 @@
 #include <functional>
 
 #include "arch/runtime/coroutines.hpp"
+#include "btree/leaf_node.hpp"
 #include "concurrency/auto_drainer.hpp"
 #include "concurrency/semaphore.hpp"
 #include "concurrency/fifo_enforcer.hpp"
@@ -38,11 +39,14 @@ static const int yield_interval = 100;
 class concurrent_traversal_adapter_t : public depth_first_traversal_callback_t {
 public:
 
-    explicit concurrent_traversal_adapter_t(concurrent_traversal_callback_t *cb,
-                                            cond_t *failure_cond)
+    concurrent_traversal_adapter_t(concurrent_traversal_callback_t *cb,
+                                   const key_range_t &range,
+                                   cond_t *failure_cond)
         : semaphore_(concurrent_traversal::initial_semaphore_capacity, 0.5),
           sink_waiters_(0),
           cb_(cb),
+          range_(range),
+          counts_pairs_only_(cb->counts_pairs_only()),
           failure_cond_(failure_cond),
           yield_counter(0) { }
 
@@ -55,6 +59,52 @@ public:
         return continue_bool_t::CONTINUE;
     }
 
+    continue_bool_t handle_pre_leaf(
+            const counted_t<counted_buf_lock_and_read_t> &buf,
+            const btree_key_t *,
+            const btree_key_t *,
+            signal_t *,
+            bool *skip_out) {
+        if (!counts_pairs_only_) {
+            *skip_out = false;
+            return continue_bool_t::CONTINUE;
+        }
+        *skip_out = true;
+
+        const leaf_node_t *lnode =
+            static_cast<const leaf_node_t *>(buf->read->get_data_read());
+        size_t count = 0;
+        for (auto it = leaf::inclusive_lower_bound(range_.left.btree_key(), *lnode);
+             it != leaf::end(*lnode); ++it) {
+            // range_.right is exclusive
+            if (!range_.right.unbounded &&
+                btree_key_cmp((*it).first, range_.right.key().btree_key()) >= 0) {
+                break;
+            }
+            ++count;
+        }
+
+        // There's no `handle_pair()` to yield for us.
+        yield_counter += static_cast<int>(count);
+        if (yield_counter >= concurrent_traversal::yield_interval) {
+            coro_t::yield();
+            yield_counter = 0;
+        }
+
+        continue_bool_t done;
+        try {
+            done = count == 0
+                ? continue_bool_t::CONTINUE
+                : cb_->handle_pair_count(count);
+        } catch (const interrupted_exc_t &) {
+            done = continue_bool_t::ABORT;
+        }
+        if (done == continue_bool_t::ABORT) {
+            failure_cond_->pulse_if_not_already_pulsed();
+        }
+        return done;
+    }
+
     void handle_pair_coro(scoped_key_value_t *fragile_keyvalue,
                           semaphore_acq_t *fragile_acq,
                           fifo_enforcer_write_token_t token,
@@ -124,6 +174,9 @@ private:
 
     concurrent_traversal_callback_t *cb_;
 
+    const key_range_t range_;
+    const bool counts_pairs_only_;
+
     // Signals when the query has failed, when we should give up all hope in executing
     // the query.
     cond_t *failure_cond_;
@@ -186,7 +239,7 @@ continue_bool_t btree_concurrent_traversal(
     cond_t failure_cond;
     bool failure_seen;
     {
-        concurrent_traversal_adapter_t adapter(cb, &failure_cond);
+        concurrent_traversal_adapter_t adapter(cb, range, &failure_cond);
         cond_t non_interruptor;
         failure_seen = (continue_bool_t::ABORT == btree_depth_first_traversal(
             superblock, range, &adapter, access_t::read, direction, release_superblock,
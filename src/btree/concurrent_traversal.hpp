@@ -54,6 +54,16 @@ public:
             concurrent_traversal_fifo_enforcer_signal_t waiter)
             THROWS_ONLY(interrupted_exc_t) = 0;
 
+    /* Callbacks that only count the pairs can return `true` here. In that case
+    `handle_pair()` is never called; instead `handle_pair_count()` gets the number of
+    live pairs within the traversal range of each leaf, which spares us loading the
+    pairs one by one. The calls happen in traversal order. */
+    virtual bool counts_pairs_only() { return false; }
+    virtual continue_bool_t handle_pair_count(UNUSED size_t count)
+            THROWS_ONLY(interrupted_exc_t) {
+        unreachable();
+    }
+
     virtual profile::trace_t *get_trace() THROWS_NOTHING { return nullptr; }
 
 protected:
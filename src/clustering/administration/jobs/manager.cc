@@ -100,7 +100,9 @@ void jobs_manager_t::on_get_job_reports(
                         server_id,
                         query_cache->get_client_addr_port(),
                         std::move(render),
-                        query_cache->get_user_context());
+                        query_cache->get_user_context(),
+                        ticks_to_secs(pair.second->resources.cpu_time),
+                        pair.second->resources.allocated_bytes);
                 }
             }
         }
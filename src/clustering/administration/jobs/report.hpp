@@ -140,7 +140,9 @@ public:
             server_id_t const &server_id,
             ip_and_port_t const &client_addr_port,
             std::string const &query,
-            auth::user_context_t const &user_context);
+            auth::user_context_t const &user_context,
+            double cpu_time,
+            uint64_t allocated_bytes);
 
     void merge_derived(query_job_report_t const &job_report);
 
@@ -154,6 +156,9 @@ public:
     ip_and_port_t client_addr_port;
     std::string query;
     auth::user_context_t user_context;
+    // In seconds.
+    double cpu_time;
+    uint64_t allocated_bytes;
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(query_job_report_t);
 
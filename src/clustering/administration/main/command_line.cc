@@ -1633,6 +1633,11 @@ options::help_section_t get_cpu_options(std::vector<options::option_t> *options_
                                              options::OPTIONAL,
                                              strprintf("%d", get_cpu_count())));
     help.add("-c [ --cores ] n", "the number of cores to use");
+    options_out->push_back(options::option_t(options::names_t("--js-in-process"),
+                                             options::OPTIONAL_NO_PARAMETER));
+    help.add("--js-in-process", "evaluate `r.js` on the server's own threads instead "
+             "of in separate worker processes.  This is faster, but a script that "
+             "misbehaves can stall other queries on its thread until it times out.");
     return help;
 }
 
@@ -2107,7 +2112,8 @@ int main_rethinkdb_serve(int argc, char *argv[]) {
                                 std::vector<std::string>(argv, argv + argc),
                                 join_delay_secs.value_or(0),
                                 node_reconnect_timeout_secs.value_or(cluster_defaults::reconnect_timeout),
-                                tls_configs);
+                                tls_configs,
+                                exists_option(opts, "--js-in-process"));
 
         const file_direct_io_mode_t direct_io_mode = parse_direct_io_mode_option(opts);
 
@@ -2210,7 +2216,8 @@ int main_rethinkdb_proxy(int argc, char *argv[]) {
                                 std::vector<std::string>(argv, argv + argc),
                                 join_delay_secs.value_or(0),
                                 node_reconnect_timeout_secs.value_or(cluster_defaults::reconnect_timeout),
-                                tls_configs);
+                                tls_configs,
+                                exists_option(opts, "--js-in-process"));
 
         bool result;
         run_in_thread_pool(
@@ -2400,7 +2407,8 @@ int main_rethinkdb_porcelain(int argc, char *argv[]) {
                                 std::vector<std::string>(argv, argv + argc),
                                 join_delay_secs.value_or(0),
                                 node_reconnect_timeout_secs.value_or(cluster_defaults::reconnect_timeout),
-                                tls_configs);
+                                tls_configs,
+                                exists_option(opts, "--js-in-process"));
 
         const file_direct_io_mode_t direct_io_mode = parse_direct_io_mode_option(opts);
 
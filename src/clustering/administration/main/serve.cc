@@ -112,8 +112,8 @@ bool do_serve(io_backender_t *io_backender,
     try {
         /* `extproc_pool` spawns several subprocesses that can be used to run tasks that
         we don't want to run in the main RethinkDB process, such as Javascript
-        evaluations. */
-        extproc_pool_t extproc_pool(get_num_threads());
+        evaluations (unless `--js-in-process` is given). */
+        extproc_pool_t extproc_pool(get_num_threads(), serve_info.js_in_process);
 
         /* `thread_pool_log_writer_t` automatically registers itself. While it exists,
         log messages will be written using the event loop instead of blocking. */
@@ -282,7 +282,9 @@ bool do_serve(io_backender_t *io_backender,
                               nullptr,   /* we'll fill this in later */
                               semilattice_manager_auth.get_root_view(),
                               &get_global_perfmon_collection(),
-                              serve_info.reql_http_proxy);
+                              serve_info.reql_http_proxy,
+                              io_backender,
+                              base_path);
         {
             /* Extract a subview of the directory with all the table meta manager
             business cards. */
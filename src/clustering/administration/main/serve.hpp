@@ -119,7 +119,8 @@ public:
                  std::vector<std::string> &&_argv,
                  const int _join_delay_secs,
                  const int _node_reconnect_timeout_secs,
-                 tls_configs_t _tls_configs) :
+                 tls_configs_t _tls_configs,
+                 bool _js_in_process) :
         joins(std::move(_joins)),
         reql_http_proxy(std::move(_reql_http_proxy)),
         web_assets(std::move(_web_assets)),
@@ -128,7 +129,8 @@ public:
         config_file(_config_file),
         argv(std::move(_argv)),
         join_delay_secs(_join_delay_secs),
-        node_reconnect_timeout_secs(_node_reconnect_timeout_secs)
+        node_reconnect_timeout_secs(_node_reconnect_timeout_secs),
+        js_in_process(_js_in_process)
     {
         tls_configs = _tls_configs;
     }
@@ -150,6 +152,8 @@ public:
     int join_delay_secs;
     int node_reconnect_timeout_secs;
     tls_configs_t tls_configs;
+    /* Whether `r.js` runs in the server process instead of in extproc workers. */
+    bool js_in_process;
 };
 
 /* This has been factored out from `command_line.hpp` because it takes a very
@@ -150,6 +150,58 @@
 #define COROUTINE_STACK_SIZE                      131072
 #endif
 
+// A changefeed server collects the changes for each client for up to
+// `CHANGEFEED_BATCH_WINDOW_MS` milliseconds, or until it has
+// `CHANGEFEED_MAX_BATCH_SIZE` of them, and then sends them in one cluster message.
+#define CHANGEFEED_BATCH_WINDOW_MS                5
+#define CHANGEFEED_MAX_BATCH_SIZE                 256
+
+// Once a feed has asked for tokens, a changefeed server keeps up to
+// `CHANGEFEED_LOG_SIZE` changes, taking up to `CHANGEFEED_LOG_MAX_BYTES`, around for
+// feeds that resume from a token.  It drops them `CHANGEFEED_LOG_KEEP_MS`
+// milliseconds after the last feed with tokens is gone.  The changes are only kept
+// in memory, so tokens can't be resumed from after a server restarts.
+#define CHANGEFEED_LOG_SIZE                       4096
+#define CHANGEFEED_LOG_MAX_BYTES                  (16 * MEGABYTE)
+#define CHANGEFEED_LOG_KEEP_MS                    (5 * 60 * 1000)
+
+// How many rows beyond the limit an `order_by.limit` changefeed keeps on each shard,
+// so that it can replace the rows that drop out of the top without reading them
+// from disk.
+#define CHANGEFEED_LIMIT_SPARE_ROWS               64
+
+// With `--js-in-process`, each thread's V8 heap may hold up to
+// `JS_IN_PROCESS_HEAP_LIMIT` bytes before the script running on it gets stopped.
+// Scripts run on a coroutine with at least `JS_IN_PROCESS_MIN_STACK` bytes of stack
+// left, of which V8 leaves `JS_IN_PROCESS_STACK_MARGIN` for the C++ code it calls.
+// A script that runs for longer than `JS_IN_PROCESS_MAX_RUN_MS` gets stopped and
+// moved to an extproc worker, where it can be interrupted.
+#define JS_IN_PROCESS_HEAP_LIMIT                  (64 * MEGABYTE)
+#define JS_IN_PROCESS_MIN_STACK                   (96 * KILOBYTE)
+#define JS_IN_PROCESS_STACK_MARGIN                (16 * KILOBYTE)
+#define JS_IN_PROCESS_MAX_RUN_MS                  50
+
+// `r.http` runs at most `HTTP_MAX_REQUESTS_PER_HOST` requests to the same host at a
+// time from each thread.  Each thread caches up to `HTTP_CACHE_SIZE` responses that
+// the servers allow to be cached, skipping any larger than `HTTP_CACHE_MAX_ENTRY_SIZE`
+// bytes.  Each extproc worker keeps up to `HTTP_WORKER_MAX_CONNECTIONS` connections
+// open for later requests.
+#define HTTP_MAX_REQUESTS_PER_HOST                16
+#define HTTP_CACHE_SIZE                           256
+#define HTTP_CACHE_MAX_ENTRY_SIZE                 (1 * MEGABYTE)
+#define HTTP_WORKER_MAX_CONNECTIONS               16
+
+// Each thread caches up to `REGEX_CACHE_SIZE` compiled regexes for `match`, as long as
+// their programs (estimated at `REGEX_CACHE_BYTES_PER_INSTRUCTION` bytes per
+// instruction) take no more than `REGEX_CACHE_MAX_BYTES` together.
+#define REGEX_CACHE_SIZE                          64
+#define REGEX_CACHE_MAX_BYTES                     (4 * MEGABYTE)
+#define REGEX_CACHE_BYTES_PER_INSTRUCTION         16
+
+// A query yields to the other coroutines on its thread at the next term it evaluates
+// once it has been running for `QUERY_TIME_SLICE_MS` milliseconds without a break.
+#define QUERY_TIME_SLICE_MS                       2
+
 
 /**
  * Message scheduler configuration
@@ -16,9 +16,7 @@ internal_disk_backed_queue_t::internal_disk_backed_queue_t(io_backender_t *io_ba
                                                            perfmon_collection_t *stats_parent)
     : perfmon_membership(stats_parent, &perfmon_collection,
                          filename.permanent_path().c_str()),
-      queue_size(0),
-      head_block_id(NULL_BLOCK_ID),
-      tail_block_id(NULL_BLOCK_ID),
+      queues(1),
       file_opener(new filepath_file_opener_t(filename, io_backender)) {
     log_serializer_t::create(file_opener.get(),
                                   log_serializer_t::static_config_t());
@@ -61,30 +59,37 @@ void internal_disk_backed_queue_t::push(const write_message_t &wm) {
     // There's no need for hard durability with an unlinked dbq file.
     txn_t txn(cache_conn.get(), write_durability_t::SOFT, 2);
 
-    push_single(&txn, wm);
+    push_single(&txn, &queues[0], wm);
 
     txn.commit();
 }
 
 void internal_disk_backed_queue_t::push(const scoped_array_t<write_message_t> &wms) {
+    push(0, wms);
+}
+
+void internal_disk_backed_queue_t::push(size_t queue_id,
+                                        const scoped_array_t<write_message_t> &wms) {
     mutex_t::acq_t mutex_acq(&mutex);
+    guarantee(queue_id < queues.size());
 
     // There's no need for hard durability with an unlinked dbq file.
     txn_t txn(cache_conn.get(), write_durability_t::SOFT, 2);
 
     for (size_t i = 0; i < wms.size(); ++i) {
-        push_single(&txn, wms[i]);
+        push_single(&txn, &queues[queue_id], wms[i]);
     }
 
     txn.commit();
 }
 
-void internal_disk_backed_queue_t::push_single(txn_t *txn, const write_message_t &wm) {
-    if (head_block_id == NULL_BLOCK_ID) {
-        add_block_to_head(txn);
+void internal_disk_backed_queue_t::push_single(txn_t *txn, queue_t *queue,
+                                               const write_message_t &wm) {
+    if (queue->head_block_id == NULL_BLOCK_ID) {
+        add_block_to_head(txn, queue);
     }
 
-    auto _head = make_scoped<buf_lock_t>(buf_parent_t(txn), head_block_id,
+    auto _head = make_scoped<buf_lock_t>(buf_parent_t(txn), queue->head_block_id,
                                          access_t::write);
     auto write = make_scoped<buf_write_t>(_head.get());
     queue_block_t *head = static_cast<queue_block_t *>(write->get_data_write());
@@ -101,8 +106,8 @@ void internal_disk_backed_queue_t::push_single(txn_t *txn, const write_message_t
         head = nullptr;
         write.reset();
         _head.reset();
-        add_block_to_head(txn);
-        _head.init(new buf_lock_t(buf_parent_t(txn), head_block_id,
+        add_block_to_head(txn, queue);
+        _head.init(new buf_lock_t(buf_parent_t(txn), queue->head_block_id,
                                   access_t::write));
         write.init(new buf_write_t(_head.get()));
         head = static_cast<queue_block_t *>(write->get_data_write());
@@ -112,18 +117,23 @@ void internal_disk_backed_queue_t::push_single(txn_t *txn, const write_message_t
            blob.refsize(cache->max_block_size()));
     head->data_size += blob.refsize(cache->max_block_size());
 
-    queue_size++;
+    queue->size++;
 }
 
 void internal_disk_backed_queue_t::pop(buffer_group_viewer_t *viewer) {
-    guarantee(size() != 0);
+    pop(0, viewer);
+}
+
+void internal_disk_backed_queue_t::pop(size_t queue_id, buffer_group_viewer_t *viewer) {
+    guarantee(size(queue_id) != 0);
     mutex_t::acq_t mutex_acq(&mutex);
+    queue_t *queue = &queues[queue_id];
 
     char buffer[DBQ_MAX_REF_SIZE];
     // No need for hard durability with an unlinked dbq file.
     txn_t txn(cache_conn.get(), write_durability_t::SOFT, 2);
 
-    buf_lock_t _tail(buf_parent_t(&txn), tail_block_id, access_t::write);
+    buf_lock_t _tail(buf_parent_t(&txn), queue->tail_block_id, access_t::write);
 
     /* Grab the data from the blob and delete it. */
     {
@@ -164,42 +174,52 @@ void internal_disk_backed_queue_t::pop(buffer_group_viewer_t *viewer) {
 
     blob.clear(buf_parent_t(&_tail));
 
-    queue_size--;
+    queue->size--;
 
     _tail.reset_buf_lock();
 
     /* If that was the last blob in this block move on to the next one. */
     if (live_data_offset == data_size) {
-        remove_block_from_tail(&txn);
+        remove_block_from_tail(&txn, queue);
     }
 
     txn.commit();
 }
 
 bool internal_disk_backed_queue_t::empty() {
-    return queue_size == 0;
+    return queues[0].size == 0;
 }
 
 int64_t internal_disk_backed_queue_t::size() {
-    return queue_size;
+    return queues[0].size;
+}
+
+size_t internal_disk_backed_queue_t::add_queue() {
+    queues.push_back(queue_t());
+    return queues.size() - 1;
+}
+
+int64_t internal_disk_backed_queue_t::size(size_t queue_id) {
+    guarantee(queue_id < queues.size());
+    return queues[queue_id].size;
 }
 
-void internal_disk_backed_queue_t::add_block_to_head(txn_t *txn) {
+void internal_disk_backed_queue_t::add_block_to_head(txn_t *txn, queue_t *queue) {
     buf_lock_t _new_head(buf_parent_t(txn), alt_create_t::create);
     buf_write_t write(&_new_head);
     queue_block_t *new_head = static_cast<queue_block_t *>(write.get_data_write());
-    if (head_block_id == NULL_BLOCK_ID) {
-        rassert(tail_block_id == NULL_BLOCK_ID);
-        head_block_id = tail_block_id = _new_head.block_id();
+    if (queue->head_block_id == NULL_BLOCK_ID) {
+        rassert(queue->tail_block_id == NULL_BLOCK_ID);
+        queue->head_block_id = queue->tail_block_id = _new_head.block_id();
     } else {
-        buf_lock_t _old_head(buf_parent_t(txn), head_block_id,
+        buf_lock_t _old_head(buf_parent_t(txn), queue->head_block_id,
                              access_t::write);
         buf_write_t old_write(&_old_head);
         queue_block_t *old_head
             = static_cast<queue_block_t *>(old_write.get_data_write());
         rassert(old_head->next == NULL_BLOCK_ID);
         old_head->next = _new_head.block_id();
-        head_block_id = _new_head.block_id();
+        queue->head_block_id = _new_head.block_id();
     }
 
     new_head->next = NULL_BLOCK_ID;
@@ -207,9 +227,9 @@ void internal_disk_backed_queue_t::add_block_to_head(txn_t *txn) {
     new_head->live_data_offset = 0;
 }
 
-void internal_disk_backed_queue_t::remove_block_from_tail(txn_t *txn) {
-    rassert(tail_block_id != NULL_BLOCK_ID);
-    buf_lock_t _old_tail(buf_parent_t(txn), tail_block_id,
+void internal_disk_backed_queue_t::remove_block_from_tail(txn_t *txn, queue_t *queue) {
+    rassert(queue->tail_block_id != NULL_BLOCK_ID);
+    buf_lock_t _old_tail(buf_parent_t(txn), queue->tail_block_id,
                          access_t::write);
 
     {
@@ -217,10 +237,10 @@ void internal_disk_backed_queue_t::remove_block_from_tail(txn_t *txn) {
         queue_block_t *old_tail = static_cast<queue_block_t *>(old_write.get_data_write());
 
         if (old_tail->next == NULL_BLOCK_ID) {
-            rassert(head_block_id == _old_tail.block_id());
-            tail_block_id = head_block_id = NULL_BLOCK_ID;
+            rassert(queue->head_block_id == _old_tail.block_id());
+            queue->tail_block_id = queue->head_block_id = NULL_BLOCK_ID;
         } else {
-            tail_block_id = old_tail->next;
+            queue->tail_block_id = old_tail->next;
         }
     }
 
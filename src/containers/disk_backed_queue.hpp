@@ -41,6 +41,10 @@ protected:
     DISABLE_COPYING(buffer_group_viewer_t);
 };
 
+/* An `internal_disk_backed_queue_t` keeps its elements in a temporary file.  Besides
+the default queue, further independent queues can be added with `add_queue`; they all
+share the file and the cache, so having many of them doesn't take more memory or file
+descriptors than having one. */
 class internal_disk_backed_queue_t {
 public:
     internal_disk_backed_queue_t(io_backender_t *io_backender, const serializer_filepath_t& filename, perfmon_collection_t *stats_parent);
@@ -55,10 +59,27 @@ public:
 
     int64_t size();
 
+    // Adds another queue to the file and returns its id.  The default queue has id 0.
+    size_t add_queue();
+
+    void push(size_t queue_id, const scoped_array_t<write_message_t> &values);
+    void pop(size_t queue_id, buffer_group_viewer_t *viewer);
+    int64_t size(size_t queue_id);
+
 private:
-    void add_block_to_head(txn_t *txn);
-    void remove_block_from_tail(txn_t *txn);
-    void push_single(txn_t *txn, const write_message_t &value);
+    struct queue_t {
+        queue_t()
+            : size(0), head_block_id(NULL_BLOCK_ID), tail_block_id(NULL_BLOCK_ID) { }
+        int64_t size;
+        // The end we push onto.
+        block_id_t head_block_id;
+        // The end we pop from.
+        block_id_t tail_block_id;
+    };
+
+    void add_block_to_head(txn_t *txn, queue_t *queue);
+    void remove_block_from_tail(txn_t *txn, queue_t *queue);
+    void push_single(txn_t *txn, queue_t *queue, const write_message_t &value);
 
     mutex_t mutex;
 
@@ -67,12 +88,7 @@ private:
     perfmon_collection_t perfmon_collection;
     perfmon_membership_t perfmon_membership;
 
-    int64_t queue_size;
-
-    // The end we push onto.
-    block_id_t head_block_id;
-    // The end we pop from.
-    block_id_t tail_block_id;
+    std::vector<queue_t> queues;
 
     scoped_ptr_t<serializer_file_opener_t> file_opener;
     scoped_ptr_t<log_serializer_t> serializer;
@@ -54,6 +54,33 @@ public:
         }
     }
 
+    // Removes the least recently used entry, moving its value to `*value_out` if
+    // that's not null.  Returns false if the cache is empty.
+    bool evict_oldest(V *value_out = nullptr) {
+        if (list_.empty()) {
+            return false;
+        }
+        list_iterator evictee = list_.begin();
+        if (value_out != nullptr) {
+            *value_out = std::move(evictee->second);
+        }
+        DEBUG_VAR size_t count = map_.erase(evictee->first);
+        rassert(count == 1);
+        list_.pop_front();
+        return true;
+    }
+
+    // Returns true if the key was present and got removed.
+    bool erase(const K &key) {
+        auto it = map_.find(key);
+        if (it == map_.end()) {
+            return false;
+        }
+        list_.erase(it->second);
+        map_.erase(it);
+        return true;
+    }
+
 private:
     using list_iterator = typename std::list<std::pair<K, V>>::iterator;
 
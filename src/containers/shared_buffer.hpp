@@ -87,6 +87,10 @@ public:
         return (buf->size() - offset) / sizeof(T);
     }
 
+    // The buffer we point into, and the offset into it in bytes.
+    const counted_t<const shared_buf_t> &get_buf() const { return buf; }
+    size_t get_offset() const { return offset; }
+
 private:
     counted_t<const shared_buf_t> buf;
     size_t offset;
@@ -3,7 +3,8 @@
 #include "extproc/extproc_pool.hpp"
 #include "extproc/extproc_spawner.hpp"
 
-extproc_pool_t::extproc_pool_t(size_t worker_count) :
+extproc_pool_t::extproc_pool_t(size_t worker_count, bool js_in_process) :
+    js_in_process_(js_in_process),
     ct_interruptors(&interruptor),
     worker_cnt(0),
     prev_worker_cnt(0),
@@ -21,6 +22,10 @@ extproc_pool_t::~extproc_pool_t() {
     interruptor.pulse();
 }
 
+bool extproc_pool_t::js_in_process() const {
+    return js_in_process_;
+}
+
 cross_thread_semaphore_t<extproc_worker_t> *extproc_pool_t::get_worker_semaphore() {
     return &worker_semaphore;
 }
@@ -18,9 +18,13 @@
 class extproc_pool_t : public home_thread_mixin_t,
                        public repeating_timer_callback_t {
 public:
-    explicit extproc_pool_t(size_t worker_count);
+    // With `js_in_process`, `r.js` runs on the calling thread instead of in one of the
+    //  workers (see `js_job_t`).
+    explicit extproc_pool_t(size_t worker_count, bool js_in_process = false);
     ~extproc_pool_t();
 
+    bool js_in_process() const;
+
     // Get the signal for the current thread that will indicate when this object is being
     //  destroyed, make sure to combine with any other interruptors or shutdown may hang
     signal_t *get_shutdown_signal();
@@ -42,6 +46,8 @@ public:
     };
 
 private:
+    const bool js_in_process_;
+
     // The interruptor to be pulsed when shutting down
     cond_t interruptor;
 
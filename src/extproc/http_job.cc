@@ -11,6 +11,7 @@
 
 #include <limits>
 
+#include "config/args.hpp"
 #include "containers/archive/boost_types.hpp"
 #include "containers/archive/stl_types.hpp"
 #include "extproc/extproc_job.hpp"
@@ -68,6 +69,14 @@ public:
         return curl_handle;
     }
 
+    // Tries to create the handle again if that failed before.
+    CURL *get_or_init() {
+        if (curl_handle == nullptr) {
+            curl_handle = curl_easy_init();
+        }
+        return curl_handle;
+    }
+
 private:
     CURL *curl_handle;
 };
@@ -534,30 +543,50 @@ void set_default_opts(CURL *curl_handle,
     // Enable cookies - needed for multiple requests like redirects or digest auth
     exc_setopt(curl_handle, CURLOPT_COOKIEFILE, "", "COOKIEFILE");
 
+    // libcurl keeps the connections of a handle open after a request, so that later
+    // requests to the same hosts can reuse them.
+    exc_setopt(curl_handle, CURLOPT_MAXCONNECTS,
+               static_cast<long>(HTTP_WORKER_MAX_CONNECTIONS), // NOLINT(runtime/int)
+               "MAX CONNECTS");
+
     // Use the proxy set when launched
     if (!proxy.empty()) {
         exc_setopt(curl_handle, CURLOPT_PROXY, proxy.c_str(), "PROXY");
     }
 }
 
+// Each worker process uses the same curl handle for all its requests, which keeps
+// its connections alive between them.  The options and cookies of the previous
+// request are cleared before each new one.
+CURL *get_worker_curl_handle() {
+    static scoped_curl_handle_t curl_handle;
+    if (curl_handle.get() != nullptr) {
+        curl_easy_reset(curl_handle.get());
+        curl_easy_setopt(curl_handle.get(), CURLOPT_COOKIELIST, "ALL");
+    }
+    // A handle that failed to initialize is created again on the next request,
+    // instead of failing every request this worker gets.
+    return curl_handle.get_or_init();
+}
+
 // TODO: implement streaming API support
 void perform_http(http_opts_t *opts, http_result_t *res_out) {
-    scoped_curl_handle_t curl_handle;
+    CURL *curl_handle = get_worker_curl_handle();
     curl_data_t curl_data;
 
-    if (curl_handle.get() == nullptr) {
+    if (curl_handle == nullptr) {
         res_out->error.assign("initialization");
         return;
     }
 
-    set_default_opts(curl_handle.get(), opts->proxy, curl_data);
-    transfer_opts(opts, curl_handle.get(), &curl_data);
+    set_default_opts(curl_handle, opts->proxy, curl_data);
+    transfer_opts(opts, curl_handle, &curl_data);
 
     CURLcode curl_res = CURLE_OK;
     long response_code = 0; // NOLINT(runtime/int)
     for (uint64_t attempts = 0; attempts < opts->attempts; ++attempts) {
         // Do the HTTP operation, then check for errors
-        curl_res = curl_easy_perform(curl_handle.get());
+        curl_res = curl_easy_perform(curl_handle);
 
         if (curl_res == CURLE_SEND_ERROR ||
             curl_res == CURLE_RECV_ERROR ||
@@ -569,7 +598,7 @@ void perform_http(http_opts_t *opts, http_result_t *res_out) {
             return;
         }
 
-        curl_res = curl_easy_getinfo(curl_handle.get(),
+        curl_res = curl_easy_getinfo(curl_handle,
                                      CURLINFO_RESPONSE_CODE,
                                      &response_code);
 
@@ -610,7 +639,7 @@ void perform_http(http_opts_t *opts, http_result_t *res_out) {
         res_out->error = strprintf("status code %ld", response_code);
     } else {
         parse_header(header_data, res_out);
-        save_cookies(curl_handle.get(), res_out);
+        save_cookies(curl_handle, res_out);
 
         // If this was a HEAD request, we should not be handling data, just return R_NULL
         // so the user knows the request succeeded
@@ -626,7 +655,7 @@ void perform_http(http_opts_t *opts, http_result_t *res_out) {
             {
                 std::string content_type;
                 char *content_type_buffer = nullptr;
-                curl_easy_getinfo(curl_handle.get(),
+                curl_easy_getinfo(curl_handle,
                                   CURLINFO_CONTENT_TYPE,
                                   &content_type_buffer);
 
@@ -1,17 +1,29 @@
 // Copyright 2010-2014 RethinkDB, all rights reserved.
 #include "extproc/http_runner.hpp"
 
+#include <ctype.h>
+
+#include <map>
+
 #include "extproc/http_job.hpp"
 #include "containers/archive/stl_types.hpp"
+#include "containers/lru_cache.hpp"
 #include "arch/timing.hpp"
+#include "concurrency/interruptor.hpp"
+#include "concurrency/new_semaphore.hpp"
+#include "config/args.hpp"
 #include "protocol_api.hpp"
+#include "rdb_protocol/serialize_datum.hpp"
+#include "thread_local.hpp"
+#include "time.hpp"
+#include "utils.hpp"
 
 RDB_IMPL_SERIALIZABLE_4_FOR_CLUSTER(http_result_t, header, body, cookies, error);
 RDB_IMPL_SERIALIZABLE_3_SINCE_v1_13(http_opts_t::http_auth_t, type, username, password);
-RDB_IMPL_SERIALIZABLE_16(http_opts_t,
+RDB_IMPL_SERIALIZABLE_17(http_opts_t,
                          auth, method, result_format, url, proxy, url_params,
                          header, cookies, data, form_data, limits, version, timeout_ms,
-                         attempts, max_redirects, verify);
+                         attempts, max_redirects, verify, cache);
 INSTANTIATE_SERIALIZABLE_FOR_CLUSTER(http_opts_t);
 
 std::string http_method_to_str(http_method_t method) {
@@ -42,7 +54,8 @@ http_opts_t::http_opts_t() :
     timeout_ms(30000),
     attempts(5),
     max_redirects(1),
-    verify(true) { }
+    verify(true),
+    cache(true) { }
 
 http_opts_t::http_auth_t::http_auth_t() :
     type(http_auth_type_t::NONE),
@@ -68,17 +81,268 @@ void http_opts_t::http_auth_t::make_digest_auth(std::string &&user,
     password.assign(std::move(pass));
 }
 
+optional<uint64_t> http_cache_max_age(const ql::datum_t &header) {
+    if (!header.has() || header.get_type() != ql::datum_t::R_OBJECT) {
+        return r_nullopt;
+    }
+    // Responses that set cookies are meant for whoever made the request.
+    if (header.get_field("set-cookie", ql::NOTHROW).has()) {
+        return r_nullopt;
+    }
+    ql::datum_t vary = header.get_field("vary", ql::NOTHROW);
+    if (vary.has() && vary.get_type() == ql::datum_t::R_STR
+        && vary.as_str().to_std().find('*') != std::string::npos) {
+        return r_nullopt;
+    }
+    ql::datum_t cache_control = header.get_field("cache-control", ql::NOTHROW);
+    if (!cache_control.has() || cache_control.get_type() != ql::datum_t::R_STR) {
+        return r_nullopt;
+    }
+
+    std::string value = cache_control.as_str().to_std();
+    for (size_t i = 0; i < value.length(); ++i) {
+        value[i] = tolower(value[i]);
+    }
+    optional<uint64_t> max_age;
+    optional<uint64_t> shared_max_age;
+    size_t start = 0;
+    while (start <= value.length()) {
+        size_t end = value.find(',', start);
+        if (end == std::string::npos) {
+            end = value.length();
+        }
+        std::string directive = value.substr(start, end - start);
+        start = end + 1;
+
+        directive.erase(0, directive.find_first_not_of(" \t"));
+        directive.erase(directive.find_last_not_of(" \t") + 1);
+        if (directive == "no-store" || directive == "no-cache"
+            || directive == "private") {
+            return r_nullopt;
+        }
+        size_t equals = directive.find('=');
+        if (equals == std::string::npos) {
+            continue;
+        }
+        std::string name = directive.substr(0, equals);
+        std::string arg = directive.substr(equals + 1);
+        if (arg.length() >= 2 && arg.front() == '"' && arg.back() == '"') {
+            arg = arg.substr(1, arg.length() - 2);
+        }
+        uint64_t secs;
+        if (!strtou64_strict(arg, 10, &secs)) {
+            continue;
+        }
+        // We're a cache shared between queries, so `s-maxage` wins.
+        if (name == "max-age") {
+            max_age.set(secs);
+        } else if (name == "s-maxage") {
+            shared_max_age.set(secs);
+        }
+    }
+    optional<uint64_t> res = shared_max_age.has_value() ? shared_max_age : max_age;
+    if (!res.has_value()) {
+        return r_nullopt;
+    }
+    // A response that came from another cache has already been around for `Age`
+    // seconds of its lifetime.
+    ql::datum_t age = header.get_field("age", ql::NOTHROW);
+    uint64_t age_secs;
+    if (age.has() && age.get_type() == ql::datum_t::R_STR
+        && strtou64_strict(age.as_str().to_std(), 10, &age_secs)) {
+        if (age_secs >= *res) {
+            return r_nullopt;
+        }
+        res.set(*res - age_secs);
+    }
+    if (*res == 0) {
+        return r_nullopt;
+    }
+    return res;
+}
+
+// Only plain `GET` requests get cached, unless the query passed `cache: false`.
+// Anything that could make the response depend on who is asking (auth, cookies) or
+// that changes it (data) rules caching out.
+bool is_cacheable_request(const http_opts_t &opts) {
+    return opts.cache
+        && opts.method == http_method_t::GET
+        && opts.auth.type == http_auth_type_t::NONE
+        && opts.cookies.empty()
+        && opts.data.empty()
+        && opts.form_data.empty();
+}
+
+// Everything that affects the response of a cacheable request, or how we parse it.
+std::string http_cache_key(const http_opts_t &opts) {
+    std::string key;
+    auto append = [&key](const std::string &str) {
+        key += strprintf("%zu:", str.length());
+        key += str;
+    };
+    append(opts.url);
+    append(opts.url_params.has() ? opts.url_params.print() : std::string());
+    for (const std::string &line : opts.header) {
+        append(line);
+    }
+    append(opts.proxy);
+    key += strprintf("|%d|%d|%zu|%" PRIu32 "|%d",
+                     static_cast<int>(opts.result_format),
+                     static_cast<int>(opts.version),
+                     opts.limits.array_size_limit(),
+                     opts.max_redirects,
+                     opts.verify ? 1 : 0);
+    return key;
+}
+
+// The `r.http` state of a thread: the cached responses, and the requests running
+// for each host.
+class http_thread_state_t {
+public:
+    struct cache_entry_t {
+        http_result_t result;
+        microtime_t expiration;
+    };
+
+    struct host_t {
+        host_t() : slots(HTTP_MAX_REQUESTS_PER_HOST), users(0) { }
+        new_semaphore_t slots;
+        size_t users;
+    };
+
+    http_thread_state_t() : cache(HTTP_CACHE_SIZE) { }
+
+    lru_cache_t<std::string, cache_entry_t> cache;
+    std::map<std::string, host_t *> hosts;
+};
+
+TLS_with_init(http_thread_state_t *, http_thread_state, nullptr);
+
+http_thread_state_t *get_http_thread_state() {
+    if (TLS_get_http_thread_state() == nullptr) {
+        TLS_set_http_thread_state(new http_thread_state_t());
+    }
+    return TLS_get_http_thread_state();
+}
+
+// The host (and port) part of a URL, which is what libcurl reuses connections for.
+std::string url_host(const std::string &url) {
+    size_t start = url.find("://");
+    start = (start == std::string::npos) ? 0 : start + 3;
+    size_t end = url.find_first_of("/?#", start);
+    std::string host = url.substr(start, end == std::string::npos
+                                             ? std::string::npos : end - start);
+    size_t at = host.rfind('@');
+    if (at != std::string::npos) {
+        host.erase(0, at + 1);
+    }
+    for (size_t i = 0; i < host.length(); ++i) {
+        host[i] = tolower(host[i]);
+    }
+    return host;
+}
+
+// A place in line for one of the host's `HTTP_MAX_REQUESTS_PER_HOST` slots on this
+// thread.  A host is forgotten once nobody is using or waiting for its slots.
+class http_host_slot_t {
+public:
+    explicit http_host_slot_t(const std::string &_host)
+        : state(get_http_thread_state()), host(_host) {
+        http_thread_state_t::host_t *&entry = state->hosts[host];
+        if (entry == nullptr) {
+            entry = new http_thread_state_t::host_t();
+        }
+        ++entry->users;
+        in_line.init(&entry->slots, 1);
+    }
+
+    ~http_host_slot_t() {
+        in_line.reset();
+        auto it = state->hosts.find(host);
+        guarantee(it != state->hosts.end());
+        if (--it->second->users == 0) {
+            delete it->second;
+            state->hosts.erase(it);
+        }
+    }
+
+    const signal_t *acquisition_signal() const {
+        return in_line.acquisition_signal();
+    }
+
+private:
+    http_thread_state_t *state;
+    const std::string host;
+    new_semaphore_in_line_t in_line;
+
+    DISABLE_COPYING(http_host_slot_t);
+};
+
+void maybe_cache_result(http_thread_state_t *state,
+                        const std::string &key,
+                        const http_result_t &res) {
+    if (!res.error.empty() || !res.cookies.empty()) {
+        return;
+    }
+    optional<uint64_t> max_age = http_cache_max_age(res.header);
+    if (!max_age.has_value()) {
+        return;
+    }
+    size_t size = 0;
+    if (res.body.has()) {
+        size += ql::datum_serialized_size(res.body,
+                                          ql::check_datum_serialization_errors_t::NO);
+    }
+    if (size > HTTP_CACHE_MAX_ENTRY_SIZE) {
+        return;
+    }
+    // Nobody means to cache anything for longer than a year.
+    const uint64_t max_secs = 365 * 24 * 60 * 60;
+    http_thread_state_t::cache_entry_t entry;
+    entry.result = res;
+    entry.expiration = current_microtime() + std::min(*max_age, max_secs) * MILLION;
+    state->cache.erase(key);
+    state->cache.insert(key, std::move(entry));
+}
+
+bool lookup_cached_result(http_thread_state_t *state,
+                          const std::string &key,
+                          http_result_t *res_out) {
+    http_thread_state_t::cache_entry_t *entry;
+    if (!state->cache.lookup(key, &entry)) {
+        return false;
+    }
+    if (entry->expiration <= current_microtime()) {
+        state->cache.erase(key);
+        return false;
+    }
+    *res_out = entry->result;
+    return true;
+}
+
 http_runner_t::http_runner_t(extproc_pool_t *_pool) :
     pool(_pool) { }
 
 void http_runner_t::http(const http_opts_t &opts,
                          http_result_t *res_out,
                          signal_t *interruptor) {
+    assert_thread();
+    http_thread_state_t *state = get_http_thread_state();
+    std::string cache_key;
+    if (is_cacheable_request(opts)) {
+        cache_key = http_cache_key(opts);
+        if (lookup_cached_result(state, cache_key, res_out)) {
+            return;
+        }
+    }
+
+    http_host_slot_t host_slot(url_host(opts.url));
+    wait_interruptible(host_slot.acquisition_signal(), interruptor);
+
     signal_timer_t timeout;
     wait_any_t combined_interruptor(interruptor, &timeout);
     http_job_t job(pool, &combined_interruptor);
 
-    assert_thread();
     timeout.start(opts.timeout_ms);
 
     try {
@@ -96,4 +360,8 @@ void http_runner_t::http(const http_opts_t &opts,
         job.worker_error();
         throw;
     }
+
+    if (!cache_key.empty()) {
+        maybe_cache_result(state, cache_key, *res_out);
+    }
 }
@@ -12,6 +12,7 @@
 #include <boost/variant.hpp>
 
 #include "containers/counted.hpp"
+#include "containers/optional.hpp"
 #include "rdb_protocol/datum.hpp"
 #include "concurrency/signal.hpp"
 #include "extproc/extproc_job.hpp"
@@ -117,13 +118,24 @@ struct http_opts_t {
     uint32_t max_redirects;
 
     bool verify;
+
+    // Whether the response may come from, and go into, the thread's cache.
+    bool cache;
 };
 
 RDB_DECLARE_SERIALIZABLE(http_opts_t);
 RDB_DECLARE_SERIALIZABLE(http_opts_t::http_auth_t);
 
+// How many seconds a response with the given (parsed) header may be cached for,
+// according to its `Cache-Control` and `Age` headers.  Responses without a
+// `Cache-Control` header, that don't allow caching or that set cookies get
+// `r_nullopt`.
+optional<uint64_t> http_cache_max_age(const ql::datum_t &header);
+
 
-// A handle to a running "HTTP fetcher" job.
+// A handle to a running "HTTP fetcher" job.  Requests that are allowed to be cached
+// may be answered from the thread's cache without running a job, and each thread
+// only runs a limited number of requests to the same host at a time.
 class http_runner_t : public home_thread_mixin_t {
 public:
     explicit http_runner_t(extproc_pool_t *_pool);
@@ -6,14 +6,22 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+#include <iterator>
 #include <limits>
 
+#include "arch/io/concurrency.hpp"
+#include "arch/runtime/coroutines.hpp"
+#include "config/args.hpp"
 #include "containers/archive/boost_types.hpp"
 #include "containers/archive/stl_types.hpp"
+#include "containers/optional.hpp"
 #include "extproc/extproc_job.hpp"
 #include "math.hpp"
 #include "rdb_protocol/pseudo_time.hpp"
 #include "rdb_protocol/configured_limits.hpp"
+#include "thread_local.hpp"
+#include "time.hpp"
 #include "utils.hpp"
 
 const js_id_t MIN_ID = 1;
@@ -34,76 +42,261 @@ v8::Handle<v8::Value> js_from_datum(const ql::datum_t &datum,
 #ifdef V8_NEEDS_BUFFER_ALLOCATOR
 class array_buffer_allocator_t : public v8::ArrayBuffer::Allocator {
 public:
+    // Buffers larger than `_limit` bytes fail with a `RangeError`, unless it is 0.
+    explicit array_buffer_allocator_t(size_t _limit) : limit(_limit) { }
     void *Allocate(size_t length) {
+        if (limit != 0 && length > limit) {
+            return nullptr;
+        }
         void *data = rmalloc(length);
         memset(data, 0, length);
         return data;
     }
     void *AllocateUninitialized(size_t length) {
+        if (limit != 0 && length > limit) {
+            return nullptr;
+        }
         return rmalloc(length);
     }
     void Free(void *data, UNUSED size_t length) {
         free(data);
     }
+private:
+    const size_t limit;
 };
 #endif
 
-// Each worker process should have a single instance of this class before using the v8 API
+// Each thread that evaluates JavaScript needs an instance of this class before using
+// the v8 API.  That is the only thread of a worker process, or any thread of the
+// server if the extproc pool runs JavaScript in-process.
 class js_instance_t {
 public:
     static void run_other_tasks();
-    static void maybe_initialize_v8();
+    // Scripts get stopped once the thread's heap grows past `heap_limit` bytes,
+    // unless it is 0.
+    static void maybe_initialize_v8(size_t heap_limit = 0);
     static v8::Isolate *isolate();
 
+    // Lets V8 use the stack of the current coroutine down to
+    // `JS_IN_PROCESS_STACK_MARGIN` bytes above its end.
+    static void set_stack_limit();
+
+    // Whether a script was stopped because of the heap limit since the last call.
+    static bool check_heap_limit_hit();
+
 private:
-    js_instance_t();
+    explicit js_instance_t(size_t heap_limit);
     ~js_instance_t();
 
-    static js_instance_t *instance;
+    // V8 itself is set up only once per process.
+    static v8::Platform *platform();
+
+    static void on_gc(v8::Isolate *isolate, v8::GCType type, v8::GCCallbackFlags flags);
+#if V8_MAJOR_VERSION > 6 || (V8_MAJOR_VERSION == 6 && V8_MINOR_VERSION >= 5)
+    static size_t on_near_heap_limit(void *instance, size_t current_heap_limit,
+                                     size_t initial_heap_limit);
+#endif
 
     v8::Isolate *isolate_;
 
-    scoped_ptr_t<v8::Platform> platform;
+    const size_t heap_limit;
+    bool heap_limit_hit;
 #ifdef V8_NEEDS_BUFFER_ALLOCATOR
     array_buffer_allocator_t array_buffer_allocator;
 #endif
 };
 
-js_instance_t *js_instance_t::instance = nullptr;
+TLS_with_init(js_instance_t *, js_instance, nullptr);
 
-js_instance_t::js_instance_t() {
-    v8::V8::InitializeICU();
-    platform.init(v8::platform::CreateDefaultPlatform());
-    v8::V8::InitializePlatform(platform.get());
-    v8::V8::Initialize();
+js_instance_t::js_instance_t(size_t _heap_limit) :
+    heap_limit(_heap_limit), heap_limit_hit(false)
 #ifdef V8_NEEDS_BUFFER_ALLOCATOR
+    , array_buffer_allocator(_heap_limit)
+#endif
+    {
+    platform();
     v8::Isolate::CreateParams params;
+#ifdef V8_NEEDS_BUFFER_ALLOCATOR
     params.array_buffer_allocator = &array_buffer_allocator;
-    isolate_ = v8::Isolate::New(params);
-#else
-    isolate_ = v8::Isolate::New();
 #endif
+    if (heap_limit != 0) {
+        // V8 aborts the process once the heap reaches its maximum size.  The
+        // maximum is twice our limit, so that there is room for stopping the script
+        // when it goes over the limit.
+        params.constraints.set_max_old_space_size(
+            static_cast<int>(2 * heap_limit / MEGABYTE));
+    }
+    isolate_ = v8::Isolate::New(params);
     isolate_->Enter();
+    if (heap_limit != 0) {
+        isolate_->AddGCEpilogueCallback(&js_instance_t::on_gc);
+#if V8_MAJOR_VERSION > 6 || (V8_MAJOR_VERSION == 6 && V8_MINOR_VERSION >= 5)
+        isolate_->AddNearHeapLimitCallback(&js_instance_t::on_near_heap_limit, this);
+#endif
+    }
 }
 
 js_instance_t::~js_instance_t() {
     isolate_->Exit();
     isolate_->Dispose();
-    v8::V8::Dispose();
-    v8::V8::ShutdownPlatform();
 }
 
+v8::Platform *js_instance_t::platform() {
+    static v8::Platform *const instance = []() {
+        v8::V8::InitializeICU();
+        v8::Platform *p = v8::platform::CreateDefaultPlatform();
+        v8::V8::InitializePlatform(p);
+        v8::V8::Initialize();
+        return p;
+    }();
+    return instance;
+}
+
+void js_instance_t::on_gc(v8::Isolate *isolate, v8::GCType, v8::GCCallbackFlags) {
+    js_instance_t *instance = TLS_get_js_instance();
+    v8::HeapStatistics stats;
+    isolate->GetHeapStatistics(&stats);
+    if (stats.used_heap_size() > instance->heap_limit) {
+        instance->heap_limit_hit = true;
+        isolate->TerminateExecution();
+    }
+}
+
+#if V8_MAJOR_VERSION > 6 || (V8_MAJOR_VERSION == 6 && V8_MINOR_VERSION >= 5)
+// Called when a single allocation would take the heap to its maximum size, which
+// the GC epilogue doesn't get to see.
+size_t js_instance_t::on_near_heap_limit(void *instance_ptr,
+                                         size_t current_heap_limit,
+                                         size_t) {
+    js_instance_t *instance = static_cast<js_instance_t *>(instance_ptr);
+    instance->heap_limit_hit = true;
+    instance->isolate_->TerminateExecution();
+    // Give the script room to unwind.
+    return current_heap_limit + instance->heap_limit;
+}
+#endif
+
 void js_instance_t::run_other_tasks() {
-    v8::platform::PumpMessageLoop(instance->platform.get(), isolate());
+    v8::platform::PumpMessageLoop(platform(), isolate());
 }
 
 v8::Isolate *js_instance_t::isolate() {
-    return instance->isolate_;
+    return TLS_get_js_instance()->isolate_;
+}
+
+void js_instance_t::maybe_initialize_v8(size_t heap_limit) {
+    if (TLS_get_js_instance() == nullptr) {
+        TLS_set_js_instance(new js_instance_t(heap_limit));
+    }
 }
 
-void js_instance_t::maybe_initialize_v8() {
-    if (instance == nullptr) {
-        instance = new js_instance_t;
+void js_instance_t::set_stack_limit() {
+    coro_t *self = coro_t::self();
+    if (self == nullptr) {
+        return;
+    }
+    char here;
+    size_t free_space = self->get_stack()->free_space_below(&here);
+    guarantee(free_space > JS_IN_PROCESS_STACK_MARGIN);
+    isolate()->SetStackLimit(
+        reinterpret_cast<uintptr_t>(&here) - free_space + JS_IN_PROCESS_STACK_MARGIN);
+}
+
+bool js_instance_t::check_heap_limit_hit() {
+    js_instance_t *instance = TLS_get_js_instance();
+    bool hit = instance->heap_limit_hit;
+    instance->heap_limit_hit = false;
+    return hit;
+}
+
+// Stops in-process scripts that run past their timeout.  A script blocks the thread
+// it runs on, timers included, so this needs a thread of its own.
+class js_watchdog_t {
+public:
+    static js_watchdog_t *get();
+
+    // Returns an id to pass to `disarm`.
+    uint64_t arm(v8::Isolate *isolate, uint64_t timeout_ms);
+    // Returns true if the script got stopped.  Once this returns, the watchdog leaves
+    // the isolate alone.
+    bool disarm(uint64_t id);
+
+private:
+    struct deadline_t {
+        v8::Isolate *isolate;
+        int64_t nanos;
+        bool fired;
+    };
+
+    js_watchdog_t();
+    static void *run(void *self);
+
+    system_mutex_t mutex;
+    system_cond_t cond;
+    uint64_t next_id;
+    std::map<uint64_t, deadline_t> deadlines;
+};
+
+js_watchdog_t *js_watchdog_t::get() {
+    // Lives until the process exits.
+    static js_watchdog_t *const instance = new js_watchdog_t();
+    return instance;
+}
+
+js_watchdog_t::js_watchdog_t() : next_id(0) {
+    pthread_t thread;
+    int res = pthread_create(&thread, nullptr, &js_watchdog_t::run, this);
+    guarantee_xerr(res == 0, res, "Could not create JavaScript watchdog thread.");
+#ifndef _WIN32
+    res = pthread_detach(thread);
+    guarantee_xerr(res == 0, res, "Could not detach JavaScript watchdog thread.");
+#endif
+}
+
+uint64_t js_watchdog_t::arm(v8::Isolate *isolate, uint64_t timeout_ms) {
+    system_mutex_t::lock_t lock(&mutex);
+    uint64_t id = next_id++;
+    deadline_t deadline;
+    deadline.isolate = isolate;
+    deadline.nanos = get_ticks().nanos + static_cast<int64_t>(timeout_ms) * MILLION;
+    deadline.fired = false;
+    deadlines.insert(std::make_pair(id, deadline));
+    cond.signal();
+    return id;
+}
+
+bool js_watchdog_t::disarm(uint64_t id) {
+    system_mutex_t::lock_t lock(&mutex);
+    auto it = deadlines.find(id);
+    guarantee(it != deadlines.end());
+    bool fired = it->second.fired;
+    deadlines.erase(it);
+    return fired;
+}
+
+void *js_watchdog_t::run(void *self_ptr) {
+    js_watchdog_t *self = static_cast<js_watchdog_t *>(self_ptr);
+    system_mutex_t::lock_t lock(&self->mutex);
+    for (;;) {
+        int64_t now = get_ticks().nanos;
+        optional<int64_t> next;
+        for (auto &pair : self->deadlines) {
+            deadline_t *deadline = &pair.second;
+            if (deadline->fired) {
+                continue;
+            }
+            if (deadline->nanos <= now) {
+                deadline->fired = true;
+                deadline->isolate->TerminateExecution();
+            } else if (!next.has_value() || deadline->nanos < *next) {
+                next.set(deadline->nanos);
+            }
+        }
+        if (next.has_value()) {
+            self->cond.timed_wait(&self->mutex, *next - now);
+        } else {
+            self->cond.wait(&self->mutex);
+        }
     }
 }
 
@@ -125,6 +318,8 @@ public:
     js_result_t call(js_id_t id, const std::vector<ql::datum_t> &args,
                      const ql::configured_limits_t &limits);
     void release(js_id_t id);
+    // Returns an id that no value of this environment will ever have.
+    js_id_t reserve_id();
     void run_other_tasks(uint64_t task_counter);
 
 private:
@@ -151,23 +346,241 @@ public:
 enum js_task_t {
     TASK_EVAL,
     TASK_CALL,
+    TASK_CALL_BATCH,
     TASK_RELEASE,
     TASK_EXIT
 };
 
 // The job_t runs in the context of the main rethinkdb process
-js_job_t::js_job_t(extproc_pool_t *pool, signal_t *interruptor,
+js_job_t::js_job_t(extproc_pool_t *_pool, signal_t *_interruptor,
                    const ql::configured_limits_t &_limits) :
-    extproc_job(pool, &worker_fn, interruptor), limits(_limits) { }
+    pool(_pool), interruptor(_interruptor), local_timed_out(false), limits(_limits) {
+    if (pool->js_in_process()) {
+        js_instance_t::maybe_initialize_v8(JS_IN_PROCESS_HEAP_LIMIT);
+        local_env.init(new js_env_t());
+    } else {
+        extproc_job.init(new extproc_job_t(pool, &worker_fn, interruptor));
+    }
+}
+
+js_job_t::~js_job_t() { }
+
+bool js_job_t::run_in_process(const std::function<js_result_t()> &fn,
+                              uint64_t timeout_ms,
+                              bool can_move,
+                              js_result_t *result_out) {
+    if (interruptor->is_pulsed()) {
+        throw interrupted_exc_t();
+    }
+
+    // The script blocks the thread, so nothing can interrupt it.  Scripts that we can
+    // move to a worker only get to run for a short while here.
+    const uint64_t run_ms = can_move
+        ? std::min<uint64_t>(timeout_ms, JS_IN_PROCESS_MAX_RUN_MS)
+        : timeout_ms;
+
+    js_result_t result;
+    // V8 checks its stack usage against a fixed address, which we have to set again
+    // for every coroutine.
+    bool stopped = call_with_enough_stack<bool>([&]() {
+        js_instance_t::set_stack_limit();
+        js_watchdog_t *watchdog = js_watchdog_t::get();
+        uint64_t deadline = watchdog->arm(js_instance_t::isolate(), run_ms);
+        try {
+            result = fn();
+        } catch (const std::exception &e) {
+            result = std::string(e.what());
+        }
+        return watchdog->disarm(deadline);
+    }, JS_IN_PROCESS_MIN_STACK);
+    local_timed_out = stopped && run_ms == timeout_ms;
+
+    bool heap_limit_hit = js_instance_t::check_heap_limit_hit();
+    if (heap_limit_hit) {
+        js_instance_t::isolate()->LowMemoryNotification();
+    }
+    if (stopped || heap_limit_hit) {
+        // The termination might not have been used up by the script.
+        js_instance_t::isolate()->CancelTerminateExecution();
+    }
+    js_instance_t::run_other_tasks();
+
+    if (local_timed_out) {
+        throw interrupted_exc_t();
+    }
+    if (heap_limit_hit) {
+        *result_out = strprintf("JavaScript query ran out of memory (the limit is %lld "
+                                "MB per thread).", JS_IN_PROCESS_HEAP_LIMIT / MEGABYTE);
+        return true;
+    }
+    if (stopped) {
+        return false;
+    }
+    *result_out = std::move(result);
+    return true;
+}
+
+void js_job_t::maybe_start_worker() {
+    if (!extproc_job.has()) {
+        extproc_job.init(new extproc_job_t(pool, &worker_fn, interruptor));
+    }
+}
+
+js_result_t js_job_t::eval(const std::string &source, uint64_t timeout_ms) {
+    if (!local_env.has()) {
+        return worker_eval(source);
+    }
+
+    js_result_t result;
+    if (!run_in_process([&]() { return local_env->eval(source, limits); },
+                        timeout_ms, true, &result)) {
+        maybe_start_worker();
+        result = worker_eval(source);
+        js_id_t *worker_id = boost::get<js_id_t>(&result);
+        if (worker_id != nullptr) {
+            // The function only exists in the worker.
+            js_id_t id = local_env->reserve_id();
+            worker_funcs.insert(std::make_pair(id, worker_func_t{*worker_id, false}));
+            result = id;
+        }
+        return result;
+    }
+
+    js_id_t *id = boost::get<js_id_t>(&result);
+    if (id != nullptr) {
+        local_recipes.insert(std::make_pair(*id, recipe_t{source, {}}));
+    }
+    return result;
+}
+
+js_result_t js_job_t::make_in_worker(const recipe_t &recipe) {
+    js_result_t result = worker_eval(recipe.source);
+    for (const auto &args : recipe.calls) {
+        js_id_t *id = boost::get<js_id_t>(&result);
+        if (id == nullptr) {
+            return result;
+        }
+        js_id_t parent_id = *id;
+        result = worker_call(parent_id, args);
+        worker_release(parent_id);
+    }
+    return result;
+}
+
+js_result_t js_job_t::adopt_worker_result(js_result_t result) {
+    js_id_t *worker_id = boost::get<js_id_t>(&result);
+    if (worker_id != nullptr) {
+        js_id_t id = local_env->reserve_id();
+        worker_funcs.insert(std::make_pair(id, worker_func_t{*worker_id, false}));
+        result = id;
+    }
+    return result;
+}
+
+js_result_t js_job_t::call(js_id_t id, const std::vector<ql::datum_t> &args,
+                           uint64_t timeout_ms) {
+    if (!local_env.has()) {
+        return worker_call(id, args);
+    }
+
+    auto worker_func = worker_funcs.find(id);
+    if (worker_func != worker_funcs.end()) {
+        return adopt_worker_result(worker_call(worker_func->second.worker_id, args));
+    }
+
+    // Every function we compiled has a recipe, including the ones that other
+    // functions returned, so they all get stopped after `JS_IN_PROCESS_MAX_RUN_MS`.
+    auto recipe = local_recipes.find(id);
+    js_result_t result;
+    if (run_in_process([&]() { return local_env->call(id, args, limits); },
+                       timeout_ms, recipe != local_recipes.end(), &result)) {
+        js_id_t *returned_id = boost::get<js_id_t>(&result);
+        if (returned_id != nullptr && recipe != local_recipes.end()) {
+            recipe_t returned_recipe = recipe->second;
+            returned_recipe.calls.push_back(args);
+            local_recipes.insert(std::make_pair(*returned_id,
+                                                std::move(returned_recipe)));
+        }
+        return result;
+    }
+
+    // The function is too slow to run on the server's thread.  We make it again in
+    // the worker, where it stays for as long as this job lives, and run the call
+    // again there.
+    maybe_start_worker();
+    result = make_in_worker(recipe->second);
+    js_id_t *worker_id = boost::get<js_id_t>(&result);
+    if (worker_id == nullptr) {
+        return std::string("JavaScript function could not be moved to a worker.");
+    }
+    worker_funcs.insert(std::make_pair(id, worker_func_t{*worker_id, true}));
+    return adopt_worker_result(worker_call(*worker_id, args));
+}
+
+std::vector<js_result_t> js_job_t::call_batch(
+        js_id_t id,
+        const std::vector<std::vector<ql::datum_t> > &args_batch,
+        uint64_t timeout_ms) {
+    if (!local_env.has()) {
+        return worker_call_batch(id, args_batch, timeout_ms);
+    }
+
+    // There is no channel to save round trips on, unless the function has been moved
+    // to the worker.
+    std::vector<js_result_t> results;
+    results.reserve(args_batch.size());
+    local_timed_out = false;
+    for (size_t i = 0; i < args_batch.size(); ++i) {
+        auto worker_func = worker_funcs.find(id);
+        if (worker_func != worker_funcs.end()) {
+            std::vector<std::vector<ql::datum_t> > rest(args_batch.begin() + i,
+                                                        args_batch.end());
+            std::vector<js_result_t> rest_results =
+                worker_call_batch(worker_func->second.worker_id, rest, timeout_ms);
+            for (auto &&rest_result : rest_results) {
+                results.push_back(adopt_worker_result(std::move(rest_result)));
+            }
+            break;
+        }
+        results.push_back(call(id, args_batch[i], timeout_ms));
+    }
+    return results;
+}
+
+void js_job_t::release(js_id_t id) {
+    if (!local_env.has()) {
+        worker_release(id);
+        return;
+    }
 
-js_result_t js_job_t::eval(const std::string &source) {
+    bool has_local_value = true;
+    auto worker_func = worker_funcs.find(id);
+    if (worker_func != worker_funcs.end()) {
+        has_local_value = worker_func->second.has_local_value;
+        js_id_t worker_id = worker_func->second.worker_id;
+        worker_funcs.erase(worker_func);
+        worker_release(worker_id);
+    }
+    local_recipes.erase(id);
+    if (has_local_value) {
+        local_env->release(id);
+    }
+}
+
+void js_job_t::exit() {
+    if (extproc_job.has()) {
+        worker_exit();
+    }
+}
+
+js_result_t js_job_t::worker_eval(const std::string &source) {
     js_task_t task = js_task_t::TASK_EVAL;
     write_message_t wm;
     wm.append(&task, sizeof(task));
     serialize<cluster_version_t::LATEST_OVERALL>(&wm, source);
     serialize<cluster_version_t::LATEST_OVERALL>(&wm, limits);
     {
-        int res = send_write_message(extproc_job.write_stream(), &wm);
+        int res = send_write_message(extproc_job->write_stream(), &wm);
         if (res != 0) {
             throw extproc_worker_exc_t("failed to send data to the worker");
         }
@@ -175,7 +588,7 @@ js_result_t js_job_t::eval(const std::string &source) {
 
     js_result_t result;
     archive_result_t res
-        = deserialize<cluster_version_t::LATEST_OVERALL>(extproc_job.read_stream(),
+        = deserialize<cluster_version_t::LATEST_OVERALL>(extproc_job->read_stream(),
                                                          &result);
     if (bad(res)) {
         throw extproc_worker_exc_t(strprintf("failed to deserialize eval result from worker "
@@ -184,7 +597,7 @@ js_result_t js_job_t::eval(const std::string &source) {
     return result;
 }
 
-js_result_t js_job_t::call(js_id_t id, const std::vector<ql::datum_t> &args) {
+js_result_t js_job_t::worker_call(js_id_t id, const std::vector<ql::datum_t> &args) {
     js_task_t task = js_task_t::TASK_CALL;
     write_message_t wm;
     wm.append(&task, sizeof(task));
@@ -192,7 +605,7 @@ js_result_t js_job_t::call(js_id_t id, const std::vector<ql::datum_t> &args) {
     serialize<cluster_version_t::LATEST_OVERALL>(&wm, args);
     serialize<cluster_version_t::LATEST_OVERALL>(&wm, limits);
     {
-        int res = send_write_message(extproc_job.write_stream(), &wm);
+        int res = send_write_message(extproc_job->write_stream(), &wm);
         if (res != 0) {
             throw extproc_worker_exc_t("failed to send data to the worker");
         }
@@ -200,7 +613,7 @@ js_result_t js_job_t::call(js_id_t id, const std::vector<ql::datum_t> &args) {
 
     js_result_t result;
     archive_result_t res
-        = deserialize<cluster_version_t::LATEST_OVERALL>(extproc_job.read_stream(),
+        = deserialize<cluster_version_t::LATEST_OVERALL>(extproc_job->read_stream(),
                                                          &result);
     if (bad(res)) {
         throw extproc_worker_exc_t(strprintf("failed to deserialize call result from worker "
@@ -209,13 +622,53 @@ js_result_t js_job_t::call(js_id_t id, const std::vector<ql::datum_t> &args) {
     return result;
 }
 
-void js_job_t::release(js_id_t id) {
+std::vector<js_result_t> js_job_t::worker_call_batch(
+        js_id_t id,
+        const std::vector<std::vector<ql::datum_t> > &args_batch,
+        uint64_t timeout_ms) {
+    js_task_t task = js_task_t::TASK_CALL_BATCH;
+    write_message_t wm;
+    wm.append(&task, sizeof(task));
+    serialize<cluster_version_t::LATEST_OVERALL>(&wm, id);
+    serialize<cluster_version_t::LATEST_OVERALL>(&wm, args_batch);
+    serialize<cluster_version_t::LATEST_OVERALL>(&wm, limits);
+    serialize<cluster_version_t::LATEST_OVERALL>(&wm, timeout_ms);
+    {
+        int res = send_write_message(extproc_job->write_stream(), &wm);
+        if (res != 0) {
+            throw extproc_worker_exc_t("failed to send data to the worker");
+        }
+    }
+
+    std::vector<js_result_t> results;
+    bool timed_out;
+    archive_result_t res
+        = deserialize<cluster_version_t::LATEST_OVERALL>(extproc_job->read_stream(),
+                                                         &results);
+    if (!bad(res)) {
+        res = deserialize<cluster_version_t::LATEST_OVERALL>(extproc_job->read_stream(),
+                                                             &timed_out);
+    }
+    if (bad(res)) {
+        throw extproc_worker_exc_t(strprintf("failed to deserialize call batch result "
+                                             "from worker (%s)",
+                                             archive_result_as_str(res)));
+    }
+    if (timed_out ? results.size() >= args_batch.size()
+                  : results.size() != args_batch.size()) {
+        throw extproc_worker_exc_t("worker returned the wrong number of results");
+    }
+    local_timed_out = timed_out;
+    return results;
+}
+
+void js_job_t::worker_release(js_id_t id) {
     js_task_t task = js_task_t::TASK_RELEASE;
     write_message_t wm;
     wm.append(&task, sizeof(task));
     serialize<cluster_version_t::LATEST_OVERALL>(&wm, id);
     {
-        int res = send_write_message(extproc_job.write_stream(), &wm);
+        int res = send_write_message(extproc_job->write_stream(), &wm);
         if (res != 0) {
             throw extproc_worker_exc_t("failed to send data to the worker");
         }
@@ -224,7 +677,7 @@ void js_job_t::release(js_id_t id) {
     // Wait for a response so we don't flood the job with requests
     bool dummy_result;
     archive_result_t res
-        = deserialize<cluster_version_t::LATEST_OVERALL>(extproc_job.read_stream(),
+        = deserialize<cluster_version_t::LATEST_OVERALL>(extproc_job->read_stream(),
                                                          &dummy_result);
     // dummy_result should always be true
     if (bad(res) || !dummy_result) {
@@ -233,12 +686,12 @@ void js_job_t::release(js_id_t id) {
     }
 }
 
-void js_job_t::exit() {
+void js_job_t::worker_exit() {
     js_task_t task = js_task_t::TASK_EXIT;
     write_message_t wm;
     wm.append(&task, sizeof(task));
     {
-        int res = send_write_message(extproc_job.write_stream(), &wm);
+        int res = send_write_message(extproc_job->write_stream(), &wm);
         if (res != 0) {
             throw extproc_worker_exc_t("failed to send data to the worker");
         }
@@ -247,7 +700,7 @@ void js_job_t::exit() {
     // Wait for a response so we don't flood the job with requests
     bool dummy_result;
     archive_result_t res
-        = deserialize<cluster_version_t::LATEST_OVERALL>(extproc_job.read_stream(),
+        = deserialize<cluster_version_t::LATEST_OVERALL>(extproc_job->read_stream(),
                                                          &dummy_result);
     // dummy_result should always be true
     if (bad(res) || !dummy_result) {
@@ -257,7 +710,13 @@ void js_job_t::exit() {
 }
 
 void js_job_t::worker_error() {
-    extproc_job.worker_error();
+    if (extproc_job.has()) {
+        extproc_job->worker_error();
+    }
+}
+
+bool js_job_t::timed_out() const {
+    return local_timed_out;
 }
 
 void js_env_t::run_other_tasks(uint64_t task_counter) {
@@ -341,6 +800,62 @@ bool run_call(read_stream_t *stream_in,
     return send_js_result(stream_out, js_result);
 }
 
+bool run_call_batch(read_stream_t *stream_in,
+                    write_stream_t *stream_out,
+                    js_env_t *js_env,
+                    uint64_t task_counter) {
+    js_id_t id;
+    std::vector<std::vector<ql::datum_t> > args_batch;
+    ql::configured_limits_t limits;
+    uint64_t timeout_ms;
+    {
+        archive_result_t res
+            = deserialize<cluster_version_t::LATEST_OVERALL>(stream_in, &id);
+        if (bad(res)) { return false; }
+        res = deserialize<cluster_version_t::LATEST_OVERALL>(stream_in, &args_batch);
+        if (bad(res)) { return false; }
+        res = deserialize<cluster_version_t::LATEST_OVERALL>(stream_in, &limits);
+        if (bad(res)) { return false; }
+        res = deserialize<cluster_version_t::LATEST_OVERALL>(stream_in, &timeout_ms);
+        if (bad(res)) { return false; }
+    }
+    // Keeps the deadline from overflowing.
+    timeout_ms = std::min<uint64_t>(timeout_ms,
+                                    std::numeric_limits<int64_t>::max() / MILLION);
+
+    // The server only times out the batch as a whole, so every call gets its own
+    // deadline here.  We stop at the first call that runs into it.
+    js_watchdog_t *watchdog = js_watchdog_t::get();
+    std::vector<js_result_t> js_results;
+    js_results.reserve(args_batch.size());
+    bool timed_out = false;
+    for (const auto &args : args_batch) {
+        js_result_t js_result;
+        uint64_t deadline = watchdog->arm(js_instance_t::isolate(), timeout_ms);
+        try {
+            js_result = js_env->call(id, args, limits);
+        } catch (const std::exception &e) {
+            js_result = e.what();
+        } catch (...) {
+            js_result = std::string("encountered an unknown exception");
+        }
+        if (watchdog->disarm(deadline)) {
+            js_instance_t::isolate()->CancelTerminateExecution();
+            timed_out = true;
+            break;
+        }
+        js_results.push_back(std::move(js_result));
+    }
+
+    js_env->run_other_tasks(task_counter);
+
+    write_message_t wm;
+    serialize<cluster_version_t::LATEST_OVERALL>(&wm, js_results);
+    serialize<cluster_version_t::LATEST_OVERALL>(&wm, timed_out);
+    int res = send_write_message(stream_out, &wm);
+    return res == 0;
+}
+
 bool run_release(read_stream_t *stream_in,
                  write_stream_t *stream_out,
                  js_env_t *js_env,
@@ -385,6 +900,11 @@ bool js_job_t::worker_fn(read_stream_t *stream_in, write_stream_t *stream_out) {
                 return false;
             }
             break;
+        case TASK_CALL_BATCH:
+            if (!run_call_batch(stream_in, stream_out, &js_env, task_counter)) {
+                return false;
+            }
+            break;
         case TASK_RELEASE:
             if (!run_release(stream_in, stream_out, &js_env, task_counter)) {
                 return false;
@@ -401,6 +921,10 @@ bool js_job_t::worker_fn(read_stream_t *stream_in, write_stream_t *stream_out) {
 
 static void append_caught_error(std::string *err_out, const v8::TryCatch &try_catch) {
     if (!try_catch.HasCaught()) return;
+    if (try_catch.HasTerminated()) {
+        err_out->append("JavaScript execution was terminated.");
+        return;
+    }
 
     v8::String::Utf8Value exception(try_catch.Exception());
     const char *message = *exception;
@@ -549,12 +1073,22 @@ js_result_t js_env_t::call(js_id_t id,
     return result;
 }
 
+js_id_t js_env_t::reserve_id() {
+    guarantee(next_id < MAX_ID);
+    return next_id++;
+}
+
 void js_env_t::release(js_id_t id) {
     guarantee(id < next_id);
     size_t num_erased = values.erase(id);
     guarantee(1 == num_erased);
 }
 
+// Getters and `toString` methods can throw, and in-process scripts can get stopped in
+// the middle of a conversion.
+static const char *const conversion_error =
+    "Exception while converting to ql::datum_t.";
+
 // TODO: Is there a better way of detecting circular references than a recursion limit?
 ql::datum_t js_make_datum(const v8::Handle<v8::Value> &value,
                           int recursion_limit,
@@ -573,7 +1107,10 @@ ql::datum_t js_make_datum(const v8::Handle<v8::Value> &value,
 
     if (value->IsString()) {
         v8::Handle<v8::String> string = value->ToString();
-        guarantee(!string.IsEmpty());
+        if (string.IsEmpty()) {
+            err_out->assign(conversion_error);
+            return result;
+        }
 
         size_t length = string->Utf8Length();
         scoped_array_t<char> temp_buffer(length);
@@ -595,7 +1132,10 @@ ql::datum_t js_make_datum(const v8::Handle<v8::Value> &value,
 
             for (uint32_t i = 0; i < arrayh->Length(); ++i) {
                 v8::Handle<v8::Value> elth = arrayh->Get(i);
-                guarantee(!elth.IsEmpty());
+                if (elth.IsEmpty()) {
+                    err_out->assign(conversion_error);
+                    return result;
+                }
 
                 ql::datum_t item = js_make_datum(elth, recursion_limit, limits, err_out);
                 if (!item.has()) {
@@ -618,18 +1158,33 @@ ql::datum_t js_make_datum(const v8::Handle<v8::Value> &value,
         } else {
             // Treat it as a dictionary.
             v8::Handle<v8::Object> objh = value->ToObject();
-            guarantee(!objh.IsEmpty());
+            if (objh.IsEmpty()) {
+                err_out->assign(conversion_error);
+                return result;
+            }
             v8::Handle<v8::Array> properties = objh->GetPropertyNames();
-            guarantee(!properties.IsEmpty());
+            if (properties.IsEmpty()) {
+                err_out->assign(conversion_error);
+                return result;
+            }
 
             ql::datum_object_builder_t builder;
 
             uint32_t len = properties->Length();
             for (uint32_t i = 0; i < len; ++i) {
-                v8::Handle<v8::String> keyh = properties->Get(i)->ToString();
-                guarantee(!keyh.IsEmpty());
-                v8::Handle<v8::Value> valueh = objh->Get(keyh);
-                guarantee(!valueh.IsEmpty());
+                v8::Handle<v8::Value> propertyh = properties->Get(i);
+                v8::Handle<v8::String> keyh;
+                if (!propertyh.IsEmpty()) {
+                    keyh = propertyh->ToString();
+                }
+                v8::Handle<v8::Value> valueh;
+                if (!keyh.IsEmpty()) {
+                    valueh = objh->Get(keyh);
+                }
+                if (valueh.IsEmpty()) {
+                    err_out->assign(conversion_error);
+                    return result;
+                }
 
                 ql::datum_t item = js_make_datum(valueh, recursion_limit, limits, err_out);
 
@@ -2,35 +2,110 @@
 #ifndef EXTPROC_JS_JOB_HPP_
 #define EXTPROC_JS_JOB_HPP_
 
+#include <functional>
+#include <map>
 #include <string>
 #include <vector>
 
 #include "utils.hpp"
 #include "containers/archive/archive.hpp"
 #include "containers/counted.hpp"
+#include "containers/scoped.hpp"
 #include "concurrency/signal.hpp"
 #include "extproc/extproc_pool.hpp"
 #include "extproc/extproc_job.hpp"
 #include "extproc/js_runner.hpp"
 #include "rdb_protocol/datum.hpp"
 
+class js_env_t;
+
+// Runs `r.js` code in an extproc worker, or, if the pool was created with
+// `js_in_process`, directly on the calling thread.  In-process evaluations use a V8
+// isolate per thread and don't have to copy the arguments and results through a
+// pipe, but a script blocks its thread and can't be interrupted while it runs.  So
+// scripts that run for longer than `JS_IN_PROCESS_MAX_RUN_MS` get stopped and run
+// again in a worker, where the job keeps running them from then on.
 class js_job_t {
 public:
     js_job_t(extproc_pool_t *pool, signal_t *interruptor,
              const ql::configured_limits_t &limits);
+    ~js_job_t();
 
-    js_result_t eval(const std::string &source);
-    js_result_t call(js_id_t id, const std::vector<ql::datum_t> &args);
+    // The extproc worker enforces `timeout_ms` through the interruptor, so only
+    // in-process evaluations use it.  They throw `interrupted_exc_t` on a timeout.
+    js_result_t eval(const std::string &source, uint64_t timeout_ms);
+    js_result_t call(js_id_t id, const std::vector<ql::datum_t> &args,
+                     uint64_t timeout_ms);
+    // Calls the function once for every element of `args_batch`, with a single
+    // message to and from the worker.  Each call gets `timeout_ms` on its own.  If
+    // one of them runs into it, the results stop before that call and `timed_out()`
+    // returns true.
+    std::vector<js_result_t> call_batch(
+        js_id_t id,
+        const std::vector<std::vector<ql::datum_t> > &args_batch,
+        uint64_t timeout_ms);
     void release(js_id_t id);
     void exit();
 
     // Marks the extproc worker as errored to simplify cleanup later
     void worker_error();
 
+    // Whether the last `eval`, `call` or `call_batch` ran into its timeout, either
+    // in-process or for a call of a batch in the worker.
+    bool timed_out() const;
+
 private:
     static bool worker_fn(read_stream_t *stream_in, write_stream_t *stream_out);
 
-    extproc_job_t extproc_job;
+    // Returns false if the script ran for too long and got stopped.  If `can_move`
+    // is false, the script gets to use its whole timeout instead.  That's only the
+    // case for functions we can't make again in the worker.
+    bool run_in_process(const std::function<js_result_t()> &fn,
+                        uint64_t timeout_ms,
+                        bool can_move,
+                        js_result_t *result_out);
+    void maybe_start_worker();
+
+    // How to make a function that `local_env` has compiled again in the worker:
+    // evaluate `source`, then call the result with each of `calls` in turn.  The
+    // calls are there for functions that other functions returned.
+    struct recipe_t {
+        std::string source;
+        std::vector<std::vector<ql::datum_t> > calls;
+    };
+    // Returns the worker's id of the function, or the error or value we got instead.
+    js_result_t make_in_worker(const recipe_t &recipe);
+    // Gives the functions that the worker returns ids in `local_env`.
+    js_result_t adopt_worker_result(js_result_t result);
+
+    js_result_t worker_eval(const std::string &source);
+    js_result_t worker_call(js_id_t id, const std::vector<ql::datum_t> &args);
+    std::vector<js_result_t> worker_call_batch(
+        js_id_t id,
+        const std::vector<std::vector<ql::datum_t> > &args_batch,
+        uint64_t timeout_ms);
+    void worker_release(js_id_t id);
+    void worker_exit();
+
+    extproc_pool_t *pool;
+
+    // At least one of these is set.  Without `local_env`, ids are the worker's ids.
+    scoped_ptr_t<extproc_job_t> extproc_job;
+    scoped_ptr_t<js_env_t> local_env;
+
+    // How to make the functions `local_env` has compiled, in case they have to be
+    // moved to the worker.
+    std::map<js_id_t, recipe_t> local_recipes;
+    // Functions that run in the worker, by their id in `local_env`.
+    struct worker_func_t {
+        js_id_t worker_id;
+        // False if the function never ran in-process.
+        bool has_local_value;
+    };
+    std::map<js_id_t, worker_func_t> worker_funcs;
+
+    signal_t *interruptor;
+    bool local_timed_out;
     ql::configured_limits_t limits;
     DISABLE_COPYING(js_job_t);
 };
@@ -3,8 +3,11 @@
 
 #include <inttypes.h>   // For PRIu64
 
+#include <algorithm>
+#include <limits>
 #include <map>
 
+#include "config/args.hpp"
 #include "extproc/js_job.hpp"
 #include "time.hpp"
 #include "utils.hpp"
@@ -130,11 +133,12 @@ js_result_t js_runner_t::eval(const std::string &source,
     bool is_timeout = false;
     try {
         try {
-            result = job_data->js_job.eval(source);
+            result = job_data->js_job.eval(source, config.timeout_ms);
         } catch (...) {
             // This inner try-catch block deals with cleanup after an exception, but due
             // to this we must store whether we triggered the timeout signal.
-            is_timeout = job_data->js_timeout.get_signal()->is_pulsed();
+            is_timeout = job_data->js_timeout.get_signal()->is_pulsed()
+                || job_data->js_job.timed_out();
 
             // Sentry must be destroyed before the js_timeout
             sentry.reset();
@@ -189,11 +193,12 @@ js_result_t js_runner_t::call(const std::string &source,
     bool is_timeout = false;
     try {
         try {
-            result = job_data->js_job.call(*fn_id, args);
+            result = job_data->js_job.call(*fn_id, args, config.timeout_ms);
         } catch (...) {
             // This inner try-catch block deals with cleanup after an exception, but due
             // to this we must store whether we triggered the timeout signal.
-            is_timeout = job_data->js_timeout.get_signal()->is_pulsed();
+            is_timeout = job_data->js_timeout.get_signal()->is_pulsed()
+                || job_data->js_job.timed_out();
 
             // Sentry must be destroyed before the js_timeout
             sentry.reset();
@@ -225,6 +230,78 @@ js_result_t js_runner_t::call(const std::string &source,
     return result;
 }
 
+std::vector<js_result_t> js_runner_t::call_batch(
+        const std::string &source,
+        const std::vector<std::vector<ql::datum_t> > &args_batch,
+        const req_config_t &config) {
+    assert_thread();
+    guarantee(job_data.has());
+
+    // This will retrieve the function from the cache if it's there, or re-eval it
+    js_result_t fn_result = eval(source, config);
+    js_id_t *fn_id = boost::get<js_id_t>(&fn_result);
+    if (fn_id == nullptr) {
+        if (boost::get<ql::datum_t>(&fn_result) != nullptr) {
+            fn_result = strprintf("Javascript query `%s` returned a value when it should "
+                                  "have returned a function.", source.c_str());
+        }
+        return std::vector<js_result_t>(args_batch.size(), fn_result);
+    }
+
+    // The timeout applies to each call, and `js_job_t` enforces it per call.  This
+    // is only a backstop for when that doesn't work (e.g. a stuck worker).  The cap
+    // keeps the timer from overflowing.
+    const uint64_t max_timeout_ms = std::numeric_limits<int64_t>::max() / MILLION;
+    uint64_t batch_timeout_ms = std::min(config.timeout_ms, max_timeout_ms);
+    if (args_batch.size() > 1) {
+        batch_timeout_ms = batch_timeout_ms <= max_timeout_ms / args_batch.size()
+            ? batch_timeout_ms * args_batch.size()
+            : max_timeout_ms;
+    }
+
+    object_buffer_t<js_timeout_t::sentry_t> sentry;
+    sentry.create(&job_data->js_timeout, batch_timeout_ms);
+
+    std::vector<js_result_t> results;
+    bool is_timeout = false;
+    try {
+        try {
+            results = job_data->js_job.call_batch(*fn_id, args_batch, config.timeout_ms);
+        } catch (...) {
+            // See `call()`.
+            is_timeout = job_data->js_timeout.get_signal()->is_pulsed()
+                || job_data->js_job.timed_out();
+            sentry.reset();
+            job_data->js_job.worker_error();
+            job_data.reset();
+
+            throw;
+        }
+    } catch (interrupted_exc_t const &e) {
+        if (is_timeout) {
+            return std::vector<js_result_t>(
+                args_batch.size(),
+                strprintf(
+                    "JavaScript query `%s` timed out after %" PRIu64 ".%03" PRIu64
+                    " seconds.",
+                    source.c_str(), config.timeout_ms / 1000, config.timeout_ms % 1000));
+        } else {
+            throw;
+        }
+    }
+
+    if (job_data->js_job.timed_out()) {
+        // The call after the last result ran into the timeout, and the rest didn't run.
+        results.resize(
+            args_batch.size(),
+            strprintf(
+                "JavaScript query `%s` timed out after %" PRIu64 ".%03" PRIu64
+                " seconds.",
+                source.c_str(), config.timeout_ms / 1000, config.timeout_ms % 1000));
+    }
+    return results;
+}
+
 void js_runner_t::cache_id(js_id_t id, const std::string &source) {
     guarantee(job_data.has());
     guarantee(id != INVALID_ID);
@@ -57,6 +57,14 @@ public:
                      const std::vector<ql::datum_t> &args,
                      const req_config_t &config);
 
+    // Calls a previously compiled function once for every element of `args_batch`,
+    // in a single round trip to the worker.  `config.timeout_ms` applies to each
+    // call, so the batch as a whole may take that much time per call.
+    std::vector<js_result_t> call_batch(
+        const std::string &source,
+        const std::vector<std::vector<ql::datum_t> > &args_batch,
+        const req_config_t &config);
+
 private:
     static const size_t CACHE_SIZE;
 
@@ -21,7 +21,8 @@ void cfeed_artificial_table_backend_t::machinery_t::send_all_change(
                 index_vals_t(),
                 pkey,
                 old_val,
-                new_val}));
+                new_val,
+                0}));
 }
 
 void cfeed_artificial_table_backend_t::machinery_t::send_all_stop() {
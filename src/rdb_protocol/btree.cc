@@ -31,6 +31,7 @@
 #include "rdb_protocol/serialize_datum_onto_blob.hpp"
 #include "rdb_protocol/shards.hpp"
 #include "rdb_protocol/table_common.hpp"
+#include "rdb_protocol/terminal_workers.hpp"
 
 #include "debug.hpp"
 
@@ -642,7 +643,8 @@ public:
                region_t region,
                store_key_t last_key,
                sorting_t _sorting,
-               require_sindexes_t require_sindex_val)
+               require_sindexes_t require_sindex_val,
+               ql::terminal_workers_t *_workers = nullptr)
         : env(_env),
           batcher(make_scoped<ql::batcher_t>(batchspec.to_batcher())),
           sorting(_sorting),
@@ -652,11 +654,13 @@ public:
                                         std::move(last_key),
                                         sorting,
                                         batcher.get(),
-                                        require_sindex_val)) {
+                                        require_sindex_val)),
+          workers(_workers) {
         for (size_t i = 0; i < _transforms.size(); ++i) {
             transformers.push_back(ql::make_op(_transforms[i]));
         }
         guarantee(transformers.size() == _transforms.size());
+        pushdown = ql::make_row_pushdown(_transforms, accumulator->uses_val());
     }
     job_data_t(job_data_t &&) = default;
 
@@ -670,6 +674,12 @@ private:
     std::vector<scoped_ptr_t<ql::op_t> > transformers;
     sorting_t sorting;
     scoped_ptr_t<ql::accumulator_t> accumulator;
+    // Which fields of a row the transformations need, if they can do with less
+    // than the whole row.
+    optional<ql::row_pushdown_t> pushdown;
+    // If set, the rows are evaluated by the workers instead of `transformers` and
+    // `accumulator`.
+    ql::terminal_workers_t *workers;
 };
 
 class rget_io_data_t {
@@ -695,6 +705,11 @@ public:
         const optional<std::string> &skey_left,
         concurrent_traversal_fifo_enforcer_signal_t waiter)
         THROWS_ONLY(interrupted_exc_t);
+    // True if we're just counting the rows of the primary index, so we don't need
+    // to look at them one by one.  We still visit every leaf in the range, since
+    // internal nodes don't know how many rows are below them.
+    bool counts_pairs_only() const;
+    continue_bool_t handle_pair_count(size_t count, size_t default_copies);
     void finish(continue_bool_t last_cb) THROWS_ONLY(interrupted_exc_t);
 private:
     const rget_io_data_t io; // How do get data in/out.
@@ -702,10 +717,18 @@ private:
     const optional<rget_sindex_data_t> sindex; // Optional sindex information.
 
     scoped_ptr_t<ql::env_t> sindex_env;
+    // If both the transformations and the sindex function only look at some fields
+    // of the row, these are all of them.  Those fields are then all we copy out of
+    // the sindex entry, unless a row passes the pushed down predicates and the
+    // transformations need all of it.
+    optional<std::vector<datum_string_t> > sindex_pushdown_fields;
 
     // State for internal bookkeeping.
     bool bad_init;
     optional<std::string> last_truncated_secondary_for_abort;
+    // Declared before `disabler` so that it reports its counts after the trace has
+    // been re-enabled.
+    profile::materialization_counter_t materializations;
     scoped_ptr_t<profile::disabler_t> disabler;
     scoped_ptr_t<profile::sampler_t> sampler;
 };
@@ -729,6 +752,13 @@ public:
             skey_left,
             std::move(waiter));
     }
+    virtual bool counts_pairs_only() {
+        return cb->counts_pairs_only();
+    }
+    virtual continue_bool_t handle_pair_count(size_t count)
+        THROWS_ONLY(interrupted_exc_t) {
+        return cb->handle_pair_count(count, copies);
+    }
 private:
     rget_cb_t *cb;
     size_t copies;
@@ -741,7 +771,8 @@ rget_cb_t::rget_cb_t(rget_io_data_t &&_io,
     : io(std::move(_io)),
       job(std::move(_job)),
       sindex(std::move(_sindex)),
-      bad_init(false) {
+      bad_init(false),
+      materializations(job.env->trace) {
 
     if (sindex) {
         // Secondary index functions are deterministic (so no need for an
@@ -750,6 +781,14 @@ rget_cb_t::rget_cb_t(rget_io_data_t &&_io,
         sindex_env.init(new ql::env_t(job.env->interruptor,
                                       ql::return_empty_normal_batches_t::NO,
                                       sindex->func_reql_version));
+        if (job.pushdown.has_value()) {
+            std::vector<datum_string_t> fields = job.pushdown->fields;
+            if (sindex->func->arg_fields_only(&fields)) {
+                std::sort(fields.begin(), fields.end());
+                fields.erase(std::unique(fields.begin(), fields.end()), fields.end());
+                sindex_pushdown_fields.set(std::move(fields));
+            }
+        }
     }
 
     // We must disable profiler events for subtasks, because multiple instances
@@ -760,7 +799,28 @@ rget_cb_t::rget_cb_t(rget_io_data_t &&_io,
                                         job.env->trace));
 }
 
+bool rget_cb_t::counts_pairs_only() const {
+    return !sindex
+        && job.transformers.empty()
+        && job.accumulator->counts_rows_only();
+}
+
+continue_bool_t rget_cb_t::handle_pair_count(size_t count, size_t default_copies) {
+    if (bad_init || boost::get<ql::exc_t>(&io.response->result) != nullptr) {
+        return continue_bool_t::ABORT;
+    }
+    io.slice->stats.pm_keys_read.record(count);
+    io.slice->stats.pm_total_keys_read += count;
+    materializations.record(profile::materialization_t::SKIPPED_ROW, count);
+    job.accumulator->add_count(count * default_copies);
+    return continue_bool_t::CONTINUE;
+}
+
 void rget_cb_t::finish(continue_bool_t last_cb) THROWS_ONLY(interrupted_exc_t) {
+    if (job.workers != nullptr) {
+        job.workers->finish(job.accumulator.get(), last_cb, &io.response->result);
+        return;
+    }
     job.accumulator->finish(last_cb, &io.response->result);
 }
 
@@ -776,6 +836,7 @@ continue_bool_t rget_cb_t::handle_pair(
     // STUFF THAT CAN HAPPEN OUT OF ORDER GOES HERE //
     //////////////////////////////////////////////////
     sampler->new_sample();
+    profile::materialization_scope_t materialization_scope(&materializations);
     if (bad_init || boost::get<ql::exc_t>(&io.response->result) != nullptr) {
         return continue_bool_t::ABORT;
     }
@@ -787,13 +848,45 @@ continue_bool_t rget_cb_t::handle_pair(
     lazy_btree_val_t row(static_cast<const rdb_value_t *>(keyvalue.value()),
                          keyvalue.expose_buf());
     ql::datum_t val;
+    // What we evaluate the sindex function on.  Either the whole row or the fields
+    // in `sindex_pushdown_fields`.
+    ql::datum_t sindex_row;
     // Count stats whether or not we deserialize the value
     io.slice->stats.pm_keys_read.record();
     io.slice->stats.pm_total_keys_read += 1;
+    // Set if a pushed down `filter` rejected the row before it got loaded.
+    bool rejected = false;
+    if (job.pushdown.has_value() && (!sindex || sindex_pushdown_fields.has_value())) {
+        // Try to get away with copying just the fields the transformations (and the
+        // sindex function) look at out of the blob.
+        ql::datum_t partial_row = row.get_fields(
+            sindex ? *sindex_pushdown_fields : job.pushdown->fields);
+        if (sindex) {
+            sindex_row = partial_row;
+        }
+        bool passes;
+        if (partial_row.has() && job.pushdown->check(partial_row, &passes)) {
+            if (!passes) {
+                rejected = true;
+            } else if (job.pushdown->partial_rows_suffice) {
+                val = std::move(partial_row);
+                materializations.record(profile::materialization_t::PARTIAL_ROW);
+            }
+        }
+    }
     // We only load the value if we actually use it (`count` does not).
-    if (job.accumulator->uses_val() || job.transformers.size() != 0 || sindex) {
+    if ((!rejected && !val.has()
+         && (job.accumulator->uses_val() || job.transformers.size() != 0))
+        || (sindex && !sindex_row.has())) {
         val = row.get();
+        materializations.record(profile::materialization_t::FULL_ROW);
+        if (sindex && !sindex_row.has()) {
+            sindex_row = val;
+        }
     } else {
+        if (!val.has()) {
+            materializations.record(profile::materialization_t::SKIPPED_ROW);
+        }
         row.reset();
     }
     guarantee(!row.references_parent());
@@ -857,7 +950,7 @@ continue_bool_t rget_cb_t::handle_pair(
         auto lazy_sindex_val = [&]() -> ql::datum_t {
             if (sindex && !sindex_val_cache.has()) {
                 sindex_val_cache =
-                    sindex->func->call(sindex_env.get(), val)->as_datum();
+                    sindex->func->call(sindex_env.get(), sindex_row)->as_datum();
                 if (sindex->multi == sindex_multi_bool_t::MULTI
                     && sindex_val_cache.get_type() == ql::datum_t::R_ARRAY) {
                     uint64_t tag = ql::datum_t::extract_tag(key).get();
@@ -976,10 +1069,25 @@ continue_bool_t rget_cb_t::handle_pair(
             }
         }
 
-        ql::groups_t data = {{ql::datum_t(), ql::datums_t(copies, val)}};
+        if (job.workers != nullptr) {
+            // A rejected row would have been filtered out by the transformations.
+            if (rejected) {
+                return continue_bool_t::CONTINUE;
+            }
+            return job.workers->add_row(val, copies)
+                ? continue_bool_t::CONTINUE
+                : continue_bool_t::ABORT;
+        }
 
-        for (auto it = job.transformers.begin(); it != job.transformers.end(); ++it) {
-            (**it)(job.env, &data, lazy_sindex_val);
+        ql::groups_t data;
+        // A rejected row would have been filtered out by the transformations.
+        if (!rejected) {
+            data = {{ql::datum_t(), ql::datums_t(copies, val)}};
+            for (auto it = job.transformers.begin();
+                 it != job.transformers.end();
+                 ++it) {
+                (**it)(job.env, &data, lazy_sindex_val);
+            }
         }
         // We need lots of extra data for the accumulation because we might be
         // accumulating `rget_item_t`s for a batch.
@@ -1026,6 +1134,8 @@ void rdb_rget_slice(
         "Do range scan on primary index.",
         ql_env->trace);
 
+    scoped_ptr_t<ql::terminal_workers_t> workers =
+        ql::terminal_workers_t::maybe_make(ql_env, transforms, terminal);
     rget_cb_t callback(
         rget_io_data_t(response, slice),
         job_data_t(ql_env,
@@ -1037,7 +1147,8 @@ void rdb_rget_slice(
                        ? range.left
                        : range.right.key_or_max(),
                    sorting,
-                   require_sindexes_t::NO),
+                   require_sindexes_t::NO,
+                   workers.get()),
         r_nullopt);
 
     direction_t direction = reversed(sorting) ? BACKWARD : FORWARD;
@@ -1443,7 +1554,8 @@ void rdb_modification_report_cb_t::on_mod_report(
                         new_cfeed_keys,
                         report.primary_key,
                         report.info.deleted.first,
-                        report.info.added.first}),
+                        report.info.added.first,
+                        0 /* `send_all` sets the log position */}),
                 report.primary_key,
                 cfeed_stamp_spot,
                 cserver.second);
@@ -0,0 +1,382 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "rdb_protocol/bytecode.hpp"
+
+#include "math.hpp"
+#include "rdb_protocol/error.hpp"
+#include "rdb_protocol/ql2proto.hpp"
+#include "rdb_protocol/term_storage.hpp"
+
+namespace ql {
+
+class bytecode_compiler_t {
+public:
+    explicit bytecode_compiler_t(const std::vector<sym_t> &_arg_names)
+        : arg_names(_arg_names),
+          program(new bytecode_program_t()),
+          arg_loads(0) {
+        program->num_args = arg_names.size();
+    }
+
+    counted_t<const bytecode_program_t> compile(const raw_term_t &body) {
+        uint16_t result;
+        if (!alloc_register(&result) || !compile_expr(body, result)) {
+            return counted_t<const bytecode_program_t>();
+        }
+        emit(bytecode_op_t::RETURN, 0, result, 0);
+        if (program->code.size() > bytecode_program_t::MAX_INSTRUCTIONS) {
+            return counted_t<const bytecode_program_t>();
+        }
+        // Every load of the argument was immediately followed by a field access.
+        program->only_reads_arg_fields = program->num_args == 1
+            && arg_loads == program->arg_fields.size();
+        return counted_t<const bytecode_program_t>(program.release());
+    }
+
+private:
+    MUST_USE bool alloc_register(uint16_t *reg_out) {
+        if (program->num_registers >= bytecode_program_t::MAX_REGISTERS) {
+            return false;
+        }
+        *reg_out = program->num_registers++;
+        return true;
+    }
+
+    uint16_t add_constant(datum_t d) {
+        program->constants.push_back(std::move(d));
+        return program->constants.size() - 1;
+    }
+
+    size_t emit(bytecode_op_t op, uint16_t dst, uint16_t a, uint16_t b) {
+        program->code.push_back(bytecode_instr_t{op, dst, a, b});
+        return program->code.size() - 1;
+    }
+
+    void emit_load_arg(uint16_t dst, uint16_t index) {
+        emit(bytecode_op_t::LOAD_ARG, dst, index, 0);
+        ++arg_loads;
+    }
+
+    void patch_jumps(const std::vector<size_t> &jumps) {
+        for (size_t pc : jumps) {
+            program->code[pc].b = program->code.size();
+        }
+    }
+
+    // Only `GET_FIELD` and `BRACKET` may carry an optarg, the internal
+    // `_NO_RECURSE_` flag, which doesn't matter for objects.
+    static bool has_unsupported_optargs(const raw_term_t &t) {
+        bool ret = false;
+        t.each_optarg([&](const raw_term_t &, const std::string &name) {
+                if (name != "_NO_RECURSE_"
+                    || (t.type() != Term::GET_FIELD && t.type() != Term::BRACKET)) {
+                    ret = true;
+                }
+            });
+        return ret;
+    }
+
+    MUST_USE bool compile_expr(const raw_term_t &t, uint16_t dst) {
+        if (t.type() != Term::DATUM && has_unsupported_optargs(t)) {
+            return false;
+        }
+        switch (static_cast<int>(t.type())) {
+        case Term::DATUM:
+            emit(bytecode_op_t::LOAD_CONST, dst,
+                 add_constant(t.datum(configured_limits_t::unlimited,
+                                      reql_version_t::LATEST)), 0);
+            return true;
+        case Term::VAR:
+            return compile_var(t, dst);
+        case Term::IMPLICIT_VAR:
+            if (!function_emits_implicit_variable(arg_names)) {
+                return false;
+            }
+            emit_load_arg(dst, 0);
+            return true;
+        case Term::GET_FIELD: // fallthru
+        case Term::BRACKET:
+            return compile_get_field(t, dst);
+        case Term::EQ:
+            return compile_comparison(t, bytecode_op_t::EQ, false, dst);
+        case Term::NE:
+            return compile_comparison(t, bytecode_op_t::EQ, true, dst);
+        case Term::LT:
+            return compile_comparison(t, bytecode_op_t::LT, false, dst);
+        case Term::LE:
+            return compile_comparison(t, bytecode_op_t::LE, false, dst);
+        case Term::GT:
+            return compile_comparison(t, bytecode_op_t::GT, false, dst);
+        case Term::GE:
+            return compile_comparison(t, bytecode_op_t::GE, false, dst);
+        case Term::NOT:
+            if (t.num_args() != 1 || !compile_expr(t.arg(0), dst)) {
+                return false;
+            }
+            emit(bytecode_op_t::NOT, dst, dst, 0);
+            return true;
+        case Term::AND:
+            return compile_short_circuit(t, bytecode_op_t::JUMP_IF_FALSE, true, dst);
+        case Term::OR:
+            return compile_short_circuit(t, bytecode_op_t::JUMP_IF_TRUE, false, dst);
+        case Term::ADD:
+            return compile_arith(t, bytecode_op_t::ADD, dst);
+        case Term::SUB:
+            return compile_arith(t, bytecode_op_t::SUB, dst);
+        case Term::MUL:
+            return compile_arith(t, bytecode_op_t::MUL, dst);
+        case Term::DIV:
+            return compile_arith(t, bytecode_op_t::DIV, dst);
+        default:
+            return false;
+        }
+    }
+
+    MUST_USE bool compile_var(const raw_term_t &t, uint16_t dst) {
+        if (t.num_args() != 1 || t.arg(0).type() != Term::DATUM) {
+            return false;
+        }
+        datum_t d = t.arg(0).datum();
+        if (d.get_type() != datum_t::R_NUM) {
+            return false;
+        }
+        int64_t varname;
+        if (!number_as_integer(d.as_num(), &varname)) {
+            return false;
+        }
+        // Variables captured from an enclosing scope aren't supported.
+        for (size_t i = 0; i < arg_names.size(); ++i) {
+            if (arg_names[i].value == varname) {
+                emit_load_arg(dst, i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    MUST_USE bool compile_get_field(const raw_term_t &t, uint16_t dst) {
+        if (t.num_args() != 2 || t.arg(1).type() != Term::DATUM) {
+            return false;
+        }
+        datum_t key = t.arg(1).datum(configured_limits_t::unlimited,
+                                     reql_version_t::LATEST);
+        // `bracket` with a number is `nth`, which we don't support.
+        if (key.get_type() != datum_t::R_STR || !compile_expr(t.arg(0), dst)) {
+            return false;
+        }
+        if (t.arg(0).type() == Term::VAR || t.arg(0).type() == Term::IMPLICIT_VAR) {
+            program->arg_fields.push_back(key.as_str());
+        }
+        emit(bytecode_op_t::GET_FIELD, dst, dst, add_constant(key));
+        return true;
+    }
+
+    // Mirrors `predicate_term_t`: arguments are evaluated left to right and we stop
+    // at the first pair that doesn't satisfy the predicate.  `ne` is `eq` inverted.
+    MUST_USE bool compile_comparison(const raw_term_t &t, bytecode_op_t op,
+                                     bool invert, uint16_t dst) {
+        if (t.num_args() < 2) {
+            return false;
+        }
+        uint16_t lhs;
+        if (!alloc_register(&lhs) || !compile_expr(t.arg(0), lhs)) {
+            return false;
+        }
+        std::vector<size_t> exits;
+        for (size_t i = 1; i < t.num_args(); ++i) {
+            uint16_t rhs;
+            if (!alloc_register(&rhs) || !compile_expr(t.arg(i), rhs)) {
+                return false;
+            }
+            emit(op, dst, lhs, rhs);
+            if (i + 1 < t.num_args()) {
+                exits.push_back(emit(bytecode_op_t::JUMP_IF_FALSE, 0, dst, 0));
+            }
+            lhs = rhs;
+        }
+        patch_jumps(exits);
+        if (invert) {
+            emit(bytecode_op_t::NOT, dst, dst, 0);
+        }
+        return true;
+    }
+
+    // Mirrors `and_term_t` and `or_term_t`: the result is the last evaluated
+    // argument, or `empty_value` if there are no arguments.
+    MUST_USE bool compile_short_circuit(const raw_term_t &t, bytecode_op_t jump,
+                                        bool empty_value, uint16_t dst) {
+        if (t.num_args() == 0) {
+            emit(bytecode_op_t::LOAD_CONST, dst,
+                 add_constant(datum_t::boolean(empty_value)), 0);
+            return true;
+        }
+        std::vector<size_t> exits;
+        for (size_t i = 0; i < t.num_args(); ++i) {
+            if (!compile_expr(t.arg(i), dst)) {
+                return false;
+            }
+            if (i + 1 < t.num_args()) {
+                exits.push_back(emit(jump, 0, dst, 0));
+            }
+        }
+        patch_jumps(exits);
+        return true;
+    }
+
+    MUST_USE bool compile_arith(const raw_term_t &t, bytecode_op_t op, uint16_t dst) {
+        if (t.num_args() < 1 || !compile_expr(t.arg(0), dst)) {
+            return false;
+        }
+        for (size_t i = 1; i < t.num_args(); ++i) {
+            uint16_t rhs;
+            if (!alloc_register(&rhs) || !compile_expr(t.arg(i), rhs)) {
+                return false;
+            }
+            emit(op, dst, dst, rhs);
+        }
+        return true;
+    }
+
+    const std::vector<sym_t> &arg_names;
+    scoped_ptr_t<bytecode_program_t> program;
+    // How many times the arguments were loaded, see `only_reads_arg_fields`.
+    size_t arg_loads;
+
+    DISABLE_COPYING(bytecode_compiler_t);
+};
+
+counted_t<const bytecode_program_t> compile_bytecode(
+        const std::vector<sym_t> &arg_names,
+        const raw_term_t &body) {
+    bytecode_compiler_t compiler(arg_names);
+    counted_t<const bytecode_program_t> program = compiler.compile(body);
+    // A lone datum or variable gains nothing over the tree walker.
+    if (program.has() && program->num_instructions() <= 2) {
+        return counted_t<const bytecode_program_t>();
+    }
+    return program;
+}
+
+bool bytecode_program_t::arg_fields_only(std::vector<datum_string_t> *fields_out) const {
+    if (!only_reads_arg_fields) {
+        return false;
+    }
+    fields_out->insert(fields_out->end(), arg_fields.begin(), arg_fields.end());
+    return true;
+}
+
+bool bytecode_program_t::run(const std::vector<datum_t> &args, datum_t *out) const {
+    if (args.size() != num_args) {
+        return false;
+    }
+    try {
+        return run_unchecked(args, out);
+    } catch (const base_exc_t &) {
+        // The tree walker will throw the same error, with a proper backtrace.
+        return false;
+    }
+}
+
+bool bytecode_program_t::run_unchecked(const std::vector<datum_t> &args,
+                                       datum_t *out) const {
+    datum_t regs[MAX_REGISTERS];
+    const bytecode_instr_t *const start = code.data();
+    const bytecode_instr_t *ip = start;
+    for (;;) {
+        const bytecode_instr_t &instr = *ip++;
+        switch (instr.op) {
+        case bytecode_op_t::LOAD_CONST:
+            regs[instr.dst] = constants[instr.a];
+            break;
+        case bytecode_op_t::LOAD_ARG:
+            regs[instr.dst] = args[instr.a];
+            break;
+        case bytecode_op_t::GET_FIELD: {
+            const datum_t &obj = regs[instr.a];
+            // Sequences, pseudotypes and non-objects all need the tree walker's
+            // polymorphic `get_field` (or its error message).
+            if (obj.get_type() != datum_t::R_OBJECT || obj.is_ptype()) {
+                return false;
+            }
+            datum_t field = obj.get_field(constants[instr.b].as_str(), NOTHROW);
+            if (!field.has()) {
+                return false;
+            }
+            regs[instr.dst] = std::move(field);
+        } break;
+        case bytecode_op_t::EQ:
+            regs[instr.dst] = datum_t::boolean(regs[instr.a] == regs[instr.b]);
+            break;
+        case bytecode_op_t::LT:
+            regs[instr.dst] = datum_t::boolean(regs[instr.a].cmp(regs[instr.b]) < 0);
+            break;
+        case bytecode_op_t::LE:
+            regs[instr.dst] = datum_t::boolean(regs[instr.a].cmp(regs[instr.b]) <= 0);
+            break;
+        case bytecode_op_t::GT:
+            regs[instr.dst] = datum_t::boolean(regs[instr.a].cmp(regs[instr.b]) > 0);
+            break;
+        case bytecode_op_t::GE:
+            regs[instr.dst] = datum_t::boolean(regs[instr.a].cmp(regs[instr.b]) >= 0);
+            break;
+        case bytecode_op_t::NOT:
+            regs[instr.dst] = datum_t::boolean(!regs[instr.a].as_bool());
+            break;
+        case bytecode_op_t::ADD: // fallthru
+        case bytecode_op_t::SUB: // fallthru
+        case bytecode_op_t::MUL: // fallthru
+        case bytecode_op_t::DIV: {
+            const datum_t &lhs = regs[instr.a];
+            const datum_t &rhs = regs[instr.b];
+            // Times, strings and arrays have their own rules for these operators.
+            if (lhs.get_type() != datum_t::R_NUM || rhs.get_type() != datum_t::R_NUM) {
+                return false;
+            }
+            double res;
+            switch (instr.op) {
+            case bytecode_op_t::ADD: res = lhs.as_num() + rhs.as_num(); break;
+            case bytecode_op_t::SUB: res = lhs.as_num() - rhs.as_num(); break;
+            case bytecode_op_t::MUL: res = lhs.as_num() * rhs.as_num(); break;
+            case bytecode_op_t::DIV:
+                if (rhs.as_num() == 0) {
+                    return false;
+                }
+                res = lhs.as_num() / rhs.as_num();
+                break;
+            case bytecode_op_t::LOAD_CONST:
+            case bytecode_op_t::LOAD_ARG:
+            case bytecode_op_t::GET_FIELD:
+            case bytecode_op_t::EQ:
+            case bytecode_op_t::LT:
+            case bytecode_op_t::LE:
+            case bytecode_op_t::GT:
+            case bytecode_op_t::GE:
+            case bytecode_op_t::NOT:
+            case bytecode_op_t::JUMP_IF_FALSE:
+            case bytecode_op_t::JUMP_IF_TRUE:
+            case bytecode_op_t::RETURN:
+            default: unreachable();
+            }
+            if (!risfinite(res)) {
+                return false;
+            }
+            regs[instr.dst] = datum_t(res);
+        } break;
+        case bytecode_op_t::JUMP_IF_FALSE:
+            if (!regs[instr.a].as_bool()) {
+                ip = start + instr.b;
+            }
+            break;
+        case bytecode_op_t::JUMP_IF_TRUE:
+            if (regs[instr.a].as_bool()) {
+                ip = start + instr.b;
+            }
+            break;
+        case bytecode_op_t::RETURN:
+            *out = std::move(regs[instr.a]);
+            return true;
+        default: unreachable();
+        }
+    }
+}
+
+}  // namespace ql
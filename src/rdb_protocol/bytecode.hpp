@@ -0,0 +1,99 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#ifndef RDB_PROTOCOL_BYTECODE_HPP_
+#define RDB_PROTOCOL_BYTECODE_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "containers/counted.hpp"
+#include "rdb_protocol/datum.hpp"
+#include "rdb_protocol/sym.hpp"
+
+namespace ql {
+
+class raw_term_t;
+
+/* Simple function bodies like `r.row('status').eq('x').and(r.row('age').gt(30))`
+   are evaluated once per row by filters and maps, and walking the `term_t` tree for
+   them (argument vectors, `val_t` allocations, scope lookups) costs much more than
+   the comparisons themselves.  `compile_bytecode` lowers such bodies into a flat
+   register-based program that `bytecode_program_t::run` executes in a tight loop.
+
+   Only a small, deterministic subset of terms is supported (datums, function
+   arguments, field access, comparisons, `and`/`or`/`not` and numeric arithmetic).
+   The interpreter never raises a ReQL error itself: whenever it encounters anything
+   unusual (a missing field, a type mismatch, a non-finite result) it gives up, and
+   the caller re-evaluates the function with the regular term tree, which produces
+   the exact same result or error it always did. */
+
+enum class bytecode_op_t : uint8_t {
+    LOAD_CONST,     // dst = constants[a]
+    LOAD_ARG,       // dst = args[a]
+    GET_FIELD,      // dst = regs[a].get_field(constants[b])
+    EQ,             // dst = regs[a] == regs[b]
+    LT,             // dst = regs[a] < regs[b]
+    LE,             // dst = regs[a] <= regs[b]
+    GT,             // dst = regs[a] > regs[b]
+    GE,             // dst = regs[a] >= regs[b]
+    NOT,            // dst = !regs[a].as_bool()
+    ADD,            // dst = regs[a] + regs[b] (numbers only)
+    SUB,            // dst = regs[a] - regs[b] (numbers only)
+    MUL,            // dst = regs[a] * regs[b] (numbers only)
+    DIV,            // dst = regs[a] / regs[b] (numbers only)
+    JUMP_IF_FALSE,  // if (!regs[a].as_bool()) { pc = b; }
+    JUMP_IF_TRUE,   // if (regs[a].as_bool()) { pc = b; }
+    RETURN          // return regs[a]
+};
+
+struct bytecode_instr_t {
+    bytecode_op_t op;
+    uint16_t dst;
+    uint16_t a;
+    uint16_t b;
+};
+
+class bytecode_program_t : public slow_atomic_countable_t<bytecode_program_t> {
+public:
+    // Programs needing more registers or instructions than this are not compiled.
+    static const size_t MAX_REGISTERS = 32;
+    static const size_t MAX_INSTRUCTIONS = 1024;
+
+    // Runs the program on the function arguments `args`.  Returns false if the
+    // program bailed out, in which case the caller must fall back to evaluating
+    // the term tree.  `*out` is only set when true is returned.
+    MUST_USE bool run(const std::vector<datum_t> &args, datum_t *out) const;
+
+    size_t num_instructions() const { return code.size(); }
+
+    // Returns true if the program takes a single argument and only ever looks at
+    // top-level fields of it, and appends the names of those fields to
+    // `*fields_out`.  The program then behaves the same on an object holding just
+    // those fields as it does on the whole argument.
+    MUST_USE bool arg_fields_only(std::vector<datum_string_t> *fields_out) const;
+
+private:
+    friend class bytecode_compiler_t;
+    bytecode_program_t()
+        : num_registers(0), num_args(0), only_reads_arg_fields(false) { }
+
+    bool run_unchecked(const std::vector<datum_t> &args, datum_t *out) const;
+
+    std::vector<bytecode_instr_t> code;
+    std::vector<datum_t> constants;
+    size_t num_registers;
+    size_t num_args;
+    bool only_reads_arg_fields;
+    std::vector<datum_string_t> arg_fields;
+
+    DISABLE_COPYING(bytecode_program_t);
+};
+
+// Returns an empty pointer if `body` uses a term the bytecode doesn't support.
+counted_t<const bytecode_program_t> compile_bytecode(
+        const std::vector<sym_t> &arg_names,
+        const raw_term_t &body);
+
+}  // namespace ql
+
+#endif  // RDB_PROTOCOL_BYTECODE_HPP_
@@ -3,12 +3,14 @@
 
 #include <queue>
 
+#include "arch/timing.hpp"
 #include "btree/reql_specific.hpp"
 #include "clustering/administration/auth/user_context.hpp"
 #include "clustering/administration/tables/name_resolver.hpp"
 #include "concurrency/cross_thread_signal.hpp"
 #include "concurrency/interruptor.hpp"
 #include "containers/archive/boost_types.hpp"
+#include "containers/archive/vector_stream.hpp"
 #include "rdb_protocol/artificial_table/backend.hpp"
 #include "rdb_protocol/btree.hpp"
 #include "rdb_protocol/env.hpp"
@@ -16,6 +18,7 @@
 #include "rdb_protocol/geo/intersection.hpp"
 #include "rdb_protocol/protocol.hpp"
 #include "rdb_protocol/response.hpp"
+#include "rdb_protocol/serialize_datum.hpp"
 #include "rdb_protocol/val.hpp"
 #include "rpc/mailbox/typed.hpp"
 
@@ -70,6 +73,7 @@ struct change_val_t {
                  optional<indexed_datum_t> _new_val
                  DEBUG_ONLY(, optional<std::string> _sindex))
         : source_stamp(std::move(_source_stamp)),
+          log_position(0),
           pkey(_pkey),
           old_val(std::move(_old_val)),
           new_val(std::move(_new_val))
@@ -82,6 +86,8 @@ struct change_val_t {
         }
     }
     std::pair<uuid_u, uint64_t> source_stamp;
+    // The position of the change in the change log of the `server_t`.
+    uint64_t log_position;
     store_key_t pkey;
     optional<indexed_datum_t> old_val;
     optional<indexed_datum_t> new_val;
@@ -310,18 +316,175 @@ optional<datum_t> apply_ops(
     }
 }
 
+// Returns only `fields` of `row`, or all of it if it's not an ordinary object.
+datum_t project_row(const datum_t &row, const std::vector<datum_string_t> &fields) {
+    if (!row.has() || row.get_type() != datum_t::R_OBJECT || row.is_ptype()) {
+        return row;
+    }
+    std::vector<std::pair<datum_string_t, datum_t> > pairs;
+    for (const datum_string_t &field : fields) {
+        datum_t val = row.get_field(field, NOTHROW);
+        if (val.has()) {
+            pairs.push_back(std::make_pair(field, std::move(val)));
+        }
+    }
+    return datum_t(std::move(pairs));
+}
+
+// A `change_filter_t` compiled so that `send_all` can run it on every change.  It
+// errs on the side of sending a change; the subscription makes the final call.
+class server_t::filter_t {
+public:
+    explicit filter_t(change_filter_t &&_filter)
+        : filter(std::move(_filter)) {
+        if (!filter.range.has_value()) {
+            guarantee(filter.pkey.has_value());
+            return;
+        }
+        const keyspec_t::range_t &range = *filter.range;
+        if (!range.sindex.has_value()) {
+            store_keys = range.datumspec.primary_key_map();
+            if (!store_keys.has_value()) {
+                store_key_range.set(
+                    range.datumspec.covering_range().to_primary_keyrange());
+            }
+        }
+        if (!range.transforms.empty()) {
+            // The transformations are deterministic, so they don't need anything
+            // from the environment of the query.
+            env = make_scoped<env_t>(&non_interruptor,
+                                     return_empty_normal_batches_t::NO,
+                                     reql_version_t::LATEST);
+            for (const auto &transform : range.transforms) {
+                ops.push_back(make_op(transform));
+            }
+            optional<row_pushdown_t> pushdown =
+                make_row_pushdown(range.transforms, true);
+            if (pushdown.has_value() && pushdown->partial_rows_suffice) {
+                fields.set(std::move(pushdown->fields));
+            }
+        }
+    }
+
+    bool squash() const { return filter.squash; }
+
+    bool wants(const msg_t::change_t &change) {
+        if (filter.pkey.has_value()) {
+            return change.pkey == *filter.pkey;
+        }
+        if (!in_range(change)) {
+            return false;
+        }
+        if (ops.empty()) {
+            return true;
+        }
+        // This mirrors how `msg_visitor_t` turns the change into elements for a
+        // range subscription.
+        const datum_t null = datum_t::null();
+        datum_t old_val = null, new_val = null;
+        if (change.old_val.has()) {
+            if (optional<datum_t> d = apply_ops(change.old_val, ops, env.get(), datum_t())) {
+                old_val = *d;
+            }
+        }
+        if (change.new_val.has()) {
+            if (optional<datum_t> d = apply_ops(change.new_val, ops, env.get(), datum_t())) {
+                new_val = *d;
+            }
+        }
+        if (filter.range->sindex.has_value()) {
+            // The row might have moved in or out of the index range.
+            return old_val != null || new_val != null;
+        }
+        return old_val != new_val;
+    }
+
+    // Set if the transformations only look at these fields of the rows.
+    optional<std::vector<datum_string_t> > fields;
+
+private:
+    bool in_range(const msg_t::change_t &change) const {
+        const keyspec_t::range_t &range = *filter.range;
+        if (!range.sindex.has_value()) {
+            if (store_keys.has_value()) {
+                return store_keys->count(change.pkey) != 0;
+            }
+            return store_key_range->contains_key(change.pkey);
+        }
+        auto any_copies = [&](const index_vals_t &index_vals) {
+            auto it = index_vals.find(*range.sindex);
+            if (it != index_vals.end()) {
+                for (const auto &pair : it->second) {
+                    if (range.datumspec.copies(pair.first) != 0) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        };
+        return any_copies(change.old_indexes) || any_copies(change.new_indexes);
+    }
+
+    const change_filter_t filter;
+    optional<std::map<store_key_t, uint64_t> > store_keys;
+    optional<key_range_t> store_key_range;
+
+    cond_t non_interruptor;
+    scoped_ptr_t<env_t> env;
+    std::vector<scoped_ptr_t<op_t> > ops;
+
+    DISABLE_COPYING(filter_t);
+};
+
+// The messages a `server_t` sends to a client in one go.  A batch covers the
+// stamps from `first_stamp` up to but not including `end_stamp`, so the client can
+// tell when it has all the messages before a batch, but there are no messages for
+// the stamps of the changes we squashed.
+struct stamped_batch_t {
+    uuid_u server_uuid;
+    uint64_t first_stamp;
+    uint64_t end_stamp;
+    std::vector<std::pair<uint64_t, msg_t> > msgs;
+};
+
+RDB_MAKE_SERIALIZABLE_4(stamped_batch_t, server_uuid, first_stamp, end_stamp, msgs);
+
+server_stats_t::server_stats_t(perfmon_collection_t *parent)
+    : collection(),
+      membership(parent, &collection, "changefeeds"),
+      pm_batch_size(secs_to_ticks(1), false),
+      pm_batch_latency(secs_to_ticks(1), false),
+      pm_batches_sent(secs_to_ticks(1)),
+      pm_membership(&collection,
+                    &pm_batch_size, "batch_size",
+                    &pm_batch_latency, "batch_latency",
+                    &pm_batches_sent, "batches_sent",
+                    &pm_changes_squashed, "changes_squashed") { }
+
 server_t::client_info_t::client_info_t()
     : limit_clients(),
-      limit_clients_lock(new rwlock_t()) { }
+      limit_clients_lock(new rwlock_t()),
+      squash(false),
+      filters_lock(new rwlock_t()),
+      batch_start(0),
+      batch_started_at(),
+      flush_scheduled(false) { }
 
 server_t::server_t(mailbox_manager_t *_manager, store_t *_parent)
     : uuid(generate_uuid()),
       manager(_manager),
       parent(_parent),
+      log_position(0),
+      keep_log(false),
+      change_log_size(0),
+      log_subs(0),
+      log_subs_gone_at(get_ticks()),
       stop_mailbox(manager,
                    std::bind(&server_t::stop_mailbox_cb, this, ph::_1, ph::_2)),
       limit_stop_mailbox(manager, std::bind(&server_t::limit_stop_mailbox_cb,
-                                            this, ph::_1, ph::_2, ph::_3, ph::_4)) { }
+                                            this, ph::_1, ph::_2, ph::_3, ph::_4)),
+      filter_stop_mailbox(manager, std::bind(&server_t::filter_stop_mailbox_cb,
+                                             this, ph::_1, ph::_2, ph::_3)) { }
 
 server_t::~server_t() { }
 
@@ -387,6 +550,111 @@ void server_t::limit_stop_mailbox_cb(signal_t *,
     }
 }
 
+void server_t::filter_stop_mailbox_cb(signal_t *,
+                                      client_t::addr_t addr,
+                                      uuid_u sub) {
+    scoped_ptr_t<filter_t> destroyable_filter;
+    auto_drainer_t::lock_t lock(&drainer);
+    rwlock_in_line_t spot(&clients_lock, access_t::read);
+    spot.read_signal()->wait_lazily_unordered();
+    auto it = clients.find(addr);
+    // The client might have already been removed, and the subscription might
+    // never have gotten to register its filter with us.
+    if (it != clients.end()) {
+        client_info_t *info = &it->second;
+        rwlock_acq_t acq(info->filters_lock.get(), access_t::write);
+        auto ft = info->filters.find(sub);
+        if (ft != info->filters.end()) {
+            destroyable_filter = std::move(ft->second);
+            info->filters.erase(ft);
+            update_projection(info);
+        }
+        note_log_subs_gone(info->log_subs.erase(sub));
+    }
+}
+
+void server_t::note_log_subs_gone(size_t count) {
+    if (count != 0) {
+        guarantee(log_subs >= count);
+        log_subs -= count;
+        if (log_subs == 0) {
+            log_subs_gone_at = get_ticks();
+        }
+    }
+}
+
+void server_t::add_filter(
+        const client_t::addr_t &addr,
+        change_filter_t &&filter,
+        const auto_drainer_t::lock_t &keepalive) {
+    keepalive.assert_is_holding(&drainer);
+    // Compiling the filter can't block, but we do it before taking any locks
+    // anyway.
+    uuid_u sub = filter.sub;
+    auto compiled = make_scoped<filter_t>(std::move(filter));
+    rwlock_acq_t client_acq(&clients_lock, access_t::read);
+    auto it = clients.find(addr);
+    // It's entirely possible the peer disconnected by the time we got here.
+    if (it != clients.end()) {
+        client_info_t *info = &it->second;
+        rwlock_acq_t acq(info->filters_lock.get(), access_t::write);
+        // With multiple shards per btree we're called once per shard.
+        if (info->filters.count(sub) == 0) {
+            info->filters[sub] = std::move(compiled);
+            update_projection(info);
+        }
+    }
+}
+
+void server_t::update_projection(client_info_t *info) {
+    info->squash = !info->filters.empty();
+    for (const auto &pair : info->filters) {
+        info->squash &= pair.second->squash();
+    }
+    std::vector<datum_string_t> fields;
+    for (const auto &pair : info->filters) {
+        if (!pair.second->fields.has_value()) {
+            info->projection.reset();
+            return;
+        }
+        fields.insert(fields.end(),
+                      pair.second->fields->begin(),
+                      pair.second->fields->end());
+    }
+    if (info->filters.empty()) {
+        info->projection.reset();
+        return;
+    }
+    std::sort(fields.begin(), fields.end());
+    fields.erase(std::unique(fields.begin(), fields.end()), fields.end());
+    info->projection.set(std::move(fields));
+}
+
+bool server_t::client_wants(client_info_t *info,
+                            const msg_t::change_t &change,
+                            optional<msg_t> *projected_out) {
+    // The filters may yield while they run, so we need the lock to keep
+    // `filters` from changing under us.
+    rwlock_acq_t acq(info->filters_lock.get(), access_t::read);
+    bool wanted = false;
+    for (const auto &pair : info->filters) {
+        if (pair.second->wants(change)) {
+            wanted = true;
+            break;
+        }
+    }
+    if (wanted && info->projection.has_value()) {
+        projected_out->set(msg_t(msg_t::change_t{
+            change.old_indexes,
+            change.new_indexes,
+            change.pkey,
+            project_row(change.old_val, *info->projection),
+            project_row(change.new_val, *info->projection),
+            change.log_position}));
+    }
+    return wanted;
+}
+
 void server_t::add_client(
         const client_t::addr_t &addr,
         region_t region,
@@ -477,28 +745,18 @@ void server_t::add_client_cb(
     auto it = clients.find(addr);
     // We can be removed more than once safely (e.g. in the case of oversharding).
     if (it != clients.end()) {
+        // This also sends whatever is still pending for the client.
         send_one_with_lock(&*it, msg_t(msg_t::stop_t()), keepalive);
     }
     coro_spot.write_signal()->wait_lazily_unordered();
-    size_t erased = clients.erase(addr);
+    it = clients.find(addr);
     // This is true even if we have multiple shards per btree because
     // `add_client` only spawns one of us.
-    guarantee(erased == 1);
+    guarantee(it != clients.end());
+    note_log_subs_gone(it->second.log_subs.size());
+    clients.erase(it);
 }
 
-struct stamped_msg_t {
-    stamped_msg_t() { }
-    stamped_msg_t(uuid_u _server_uuid, uint64_t _stamp, msg_t _submsg)
-        : server_uuid(std::move(_server_uuid)),
-          stamp(_stamp),
-          submsg(std::move(_submsg)) { }
-    uuid_u server_uuid;
-    uint64_t stamp;
-    msg_t submsg;
-};
-
-RDB_MAKE_SERIALIZABLE_3(stamped_msg_t, server_uuid, stamp, submsg);
-
 // This function takes a `lock_t` to make sure you have one.  (We can't just
 // always acquire a drainer lock before sending because we sometimes send a
 // `stop_t` during destruction, and you can't acquire a drain lock on a draining
@@ -508,18 +766,141 @@ void server_t::send_one_with_lock(
         msg_t msg,
         const auto_drainer_t::lock_t &keepalive) {
     keepalive.assert_is_holding(&drainer);
-    uint64_t stamp;
+    // We send `stop_t` right away because the client is about to be removed.
+    const bool is_stop = boost::get<msg_t::stop_t>(&msg.op) != nullptr;
+    optional<stamped_batch_t> batch;
     {
         // We don't need a write lock as long as we make sure the coroutine
         // doesn't block between reading and updating the stamp.
         ASSERT_NO_CORO_WAITING;
-        stamp = client->second.stamp++;
+        if (enqueue(client, std::move(msg), keepalive) || is_stop) {
+            batch.set(take_batch(&client->second));
+        }
+    }
+    if (batch.has_value()) {
+        send(manager, client->first, *batch);
+    }
+}
+
+bool server_t::enqueue(std::pair<const client_t::addr_t, client_info_t> *client,
+                       msg_t &&msg,
+                       const auto_drainer_t::lock_t &keepalive) {
+    ASSERT_NO_CORO_WAITING;
+    client_info_t *info = &client->second;
+    if (info->pending.empty()) {
+        info->batch_start = info->stamp;
+        info->batch_started_at = get_ticks();
+    }
+    const uint64_t stamp = info->stamp++;
+    bool dropped = false;
+    msg_t::change_t *change = boost::get<msg_t::change_t>(&msg.op);
+    if (change != nullptr && info->squash) {
+        auto it = info->squashable.find(change->pkey);
+        if (it != info->squashable.end()) {
+            // The subscriptions only care about where the row started and where it
+            // ended up, so the earlier change gets folded into this one.
+            optional<msg_t> *prev = &info->pending[it->second].second;
+            msg_t::change_t *prev_change = boost::get<msg_t::change_t>(&(*prev)->op);
+            guarantee(prev_change != nullptr);
+            change->old_indexes = std::move(prev_change->old_indexes);
+            change->old_val = std::move(prev_change->old_val);
+            prev->reset();
+            info->squashable.erase(it);
+            parent->changefeed_stats.pm_changes_squashed += 1;
+            // If the row was created and deleted again there's nothing to send.
+            dropped = !change->old_val.has() && !change->new_val.has();
+        }
+        if (!dropped) {
+            info->squashable[change->pkey] = info->pending.size();
+        }
+    }
+    if (!dropped) {
+        info->pending.push_back(std::make_pair(stamp, make_optional(std::move(msg))));
+    }
+
+    if (info->pending.size() >= CHANGEFEED_MAX_BATCH_SIZE) {
+        return true;
+    }
+    if (!info->flush_scheduled) {
+        info->flush_scheduled = true;
+        coro_t::spawn_sometime(
+            std::bind(&server_t::flush_cb, this, client->first, keepalive));
+    }
+    return false;
+}
+
+stamped_batch_t server_t::take_batch(client_info_t *info) {
+    ASSERT_NO_CORO_WAITING;
+    stamped_batch_t batch;
+    batch.server_uuid = uuid;
+    batch.first_stamp = info->batch_start;
+    batch.end_stamp = info->stamp;
+    batch.msgs.reserve(info->pending.size());
+    for (auto &&pair : info->pending) {
+        if (pair.second.has_value()) {
+            batch.msgs.push_back(std::make_pair(pair.first, std::move(*pair.second)));
+        }
+    }
+    info->pending.clear();
+    info->squashable.clear();
+
+    server_stats_t *stats = &parent->changefeed_stats;
+    stats->pm_batch_size.record(batch.msgs.size());
+    stats->pm_batch_latency.record(ticks_to_secs(
+        ticks_t{get_ticks().nanos - info->batch_started_at.nanos}));
+    stats->pm_batches_sent.record();
+    return batch;
+}
+
+void server_t::flush_cb(client_t::addr_t addr, auto_drainer_t::lock_t keepalive) {
+    keepalive.assert_is_holding(&drainer);
+    try {
+        nap(CHANGEFEED_BATCH_WINDOW_MS, keepalive.get_drain_signal());
+    } catch (const interrupted_exc_t &) {
+        // We're shutting down, so we send what we have right away.
+    }
+    optional<stamped_batch_t> batch;
+    {
+        rwlock_acq_t acq(&clients_lock, access_t::read);
+        auto it = clients.find(addr);
+        if (it == clients.end()) {
+            // The client was removed, and `add_client_cb` sent the batch.
+            return;
+        }
+        ASSERT_NO_CORO_WAITING;
+        it->second.flush_scheduled = false;
+        // The batch might have been sent already because it filled up.
+        if (!it->second.pending.empty()) {
+            batch.set(take_batch(&it->second));
+        }
+    }
+    if (batch.has_value()) {
+        send(manager, addr, *batch);
+    }
+}
+
+// An estimate of the memory a change in the change log takes.
+static size_t change_size(const msg_t::change_t &change) {
+    size_t size = sizeof(change) + change.pkey.size();
+    for (const datum_t *val : {&change.old_val, &change.new_val}) {
+        if (val->has()) {
+            size += datum_serialized_size(*val, check_datum_serialization_errors_t::NO);
+        }
+    }
+    for (const index_vals_t *vals : {&change.old_indexes, &change.new_indexes}) {
+        for (const auto &pair : *vals) {
+            size += pair.first.size();
+            for (const index_pair_t &index_pair : pair.second) {
+                size += index_pair.second.size() + datum_serialized_size(
+                    index_pair.first, check_datum_serialization_errors_t::NO);
+            }
+        }
     }
-    send(manager, client->first, stamped_msg_t(uuid, stamp, std::move(msg)));
+    return size;
 }
 
 void server_t::send_all(
-        const msg_t &msg,
+        msg_t msg,
         const store_key_t &key,
         rwlock_in_line_t *stamp_spot,
         const auto_drainer_t::lock_t &keepalive) {
@@ -527,22 +908,66 @@ void server_t::send_all(
     stamp_spot->guarantee_is_for_lock(&parent->cfeed_stamp_lock);
     stamp_spot->write_signal()->wait_lazily_unordered();
 
+    msg_t::change_t *change = boost::get<msg_t::change_t>(&msg.op);
+    if (change != nullptr) {
+        change->log_position = ++log_position;
+        if (keep_log
+            && log_subs == 0
+            && get_ticks().nanos - log_subs_gone_at.nanos
+               > static_cast<int64_t>(CHANGEFEED_LOG_KEEP_MS) * MILLION) {
+            keep_log = false;
+            change_log.clear();
+            change_log_size = 0;
+        }
+        if (keep_log) {
+            size_t size = change_size(*change);
+            change_log.push_back(log_entry_t{log_position, size, *change});
+            change_log_size += size;
+            while (change_log.size() > CHANGEFEED_LOG_SIZE
+                   || change_log_size > CHANGEFEED_LOG_MAX_BYTES) {
+                change_log_size -= change_log.front().size;
+                change_log.pop_front();
+            }
+        }
+    }
+
     rwlock_acq_t acq(&clients_lock, access_t::read);
-    std::map<client_t::addr_t, uint64_t> stamps;
+    // The clients that want the message, along with the projected message for
+    // those whose subscriptions only look at some fields of the rows.  Running the
+    // filters may block, so we stamp the message afterwards.
+    std::vector<std::pair<std::pair<const client_t::addr_t, client_info_t> *,
+                          optional<msg_t> > > sends;
     for (auto &&pair : clients) {
-        // We don't need a write lock as long as we make sure the coroutine
-        // doesn't block between reading and updating the stamp.
-        ASSERT_NO_CORO_WAITING;
         if (std::any_of(pair.second.regions.begin(),
                         pair.second.regions.end(),
                         std::bind(&region_contains_key, ph::_1, std::cref(key)))) {
-            stamps[pair.first] = pair.second.stamp++;
+            optional<msg_t> projected;
+            if (change == nullptr
+                || client_wants(&pair.second, *change, &projected)) {
+                sends.push_back(std::make_pair(&pair, std::move(projected)));
+            }
+        }
+    }
+    // The message usually just goes into the clients' pending batches, which
+    // `flush_cb` sends later, but we send the batches that fill up right away.
+    std::vector<std::pair<client_t::addr_t, stamped_batch_t> > full_batches;
+    {
+        // We don't need a write lock as long as we make sure the coroutine
+        // doesn't block between reading and updating the stamps.
+        ASSERT_NO_CORO_WAITING;
+        for (auto &&pair : sends) {
+            if (enqueue(pair.first,
+                        pair.second.has_value() ? std::move(*pair.second) : msg_t(msg),
+                        keepalive)) {
+                full_batches.push_back(std::make_pair(
+                    pair.first->first, take_batch(&pair.first->second)));
+            }
         }
     }
     acq.reset();
     stamp_spot->reset(); // Done stamping, no need to hold onto it while we send.
-    for (const auto &pair : stamps) {
-        send(manager, pair.first, stamped_msg_t(uuid, pair.second, msg));
+    for (const auto &pair : full_batches) {
+        send(manager, pair.first, pair.second);
     }
 }
 
@@ -554,9 +979,16 @@ server_t::limit_addr_t server_t::get_limit_stop_addr() {
     return limit_stop_mailbox.get_address();
 }
 
+server_t::filter_addr_t server_t::get_filter_stop_addr() {
+    return filter_stop_mailbox.get_address();
+}
+
 optional<uint64_t> server_t::get_stamp(
         const client_t::addr_t &addr,
-        const auto_drainer_t::lock_t &keepalive) {
+        const auto_drainer_t::lock_t &keepalive,
+        log_read_t *log_out,
+        const uuid_u &log_sub,
+        const optional<uint64_t> &since) {
     keepalive.assert_is_holding(&drainer);
     rwlock_acq_t stamp_acq(&parent->cfeed_stamp_lock, access_t::read);
     rwlock_acq_t client_acq(&clients_lock, access_t::read);
@@ -564,6 +996,36 @@ optional<uint64_t> server_t::get_stamp(
     if (it == clients.end()) {
         return r_nullopt;
     } else {
+        // Whoever asks for the stamp is going to look at the table as of this
+        // stamp, so we can't squash changes from before it with ones after it.
+        it->second.squashable.clear();
+        if (log_out != nullptr) {
+            // The read lock on the stamp lock keeps `send_all` from adding to the
+            // log, so the changes after `log_out->position` are exactly the ones
+            // the subscription gets from this stamp on.
+            keep_log = true;
+            if (it->second.log_subs.insert(log_sub).second) {
+                ++log_subs;
+            }
+            log_out->position = log_position;
+            log_out->replay.reset();
+            if (since.has_value() && *since <= log_position) {
+                // The log has every change since it was turned on, apart from the
+                // ones that were pushed out of it.
+                uint64_t oldest = change_log.empty()
+                    ? log_position + 1
+                    : change_log.front().position;
+                if (*since + 1 >= oldest) {
+                    std::vector<msg_t::change_t> replay;
+                    for (const auto &entry : change_log) {
+                        if (entry.position > *since) {
+                            replay.push_back(entry.change);
+                        }
+                    }
+                    log_out->replay.set(std::move(replay));
+                }
+            }
+        }
         return make_optional(it->second.stamp);
     }
 }
@@ -872,6 +1334,7 @@ limit_manager_t::limit_manager_t(
       spec(std::move(_spec)),
       gt(std::move(_gt)),
       item_queue(gt),
+      spare(gt),
       aborted(false) {
     guarantee(clients_lock->read_signal()->is_pulsed());
 
@@ -941,6 +1404,7 @@ public:
                   const keyspec_t::limit_t *_spec,
                   sorting_t _sorting,
                   optional<item_t> _start,
+                  size_t _n,
                   const item_queue_t *_item_queue)
         : env(_env),
           ops(_ops),
@@ -948,6 +1412,7 @@ public:
           spec(_spec),
           sorting(_sorting),
           start(std::move(_start)),
+          n(_n),
           item_queue(_item_queue) { }
 
     std::vector<item_t> operator()(const primary_ref_t &ref) {
@@ -971,7 +1436,6 @@ public:
         case sorting_t::UNORDERED: // fallthru
         default: unreachable();
         }
-        size_t n = spec->limit - item_queue->size();
         rdb_rget_slice(
             ref.btree,
             region_t(),
@@ -1026,7 +1490,7 @@ public:
                 [](const datum_range_t &) { return true; },
                 [](const std::map<datum_t, uint64_t> &) { return false; }));
         datum_range_t srange = spec->range.datumspec.covering_range();
-        size_t n = spec->limit - item_queue->size();
+        size_t n = this->n;
         if (start) {
             datum_t dstart = start->second.first;
             switch (sorting) {
@@ -1103,18 +1567,39 @@ private:
     const keyspec_t::limit_t *spec;
     sorting_t sorting;
     optional<item_t> start;
+    // How many rows to read after `start`.
+    size_t n;
     const item_queue_t *item_queue;
 };
 
 std::vector<item_t> limit_manager_t::read_more(
     const boost::variant<primary_ref_t, sindex_ref_t> &ref,
-    const optional<item_t> &start) {
+    const optional<item_t> &start,
+    size_t n) {
     guarantee(item_queue.size() < spec.limit);
     ref_visitor_t visitor(
-        env.get(), &ops, &region.inner, &spec, spec.range.sorting, start, &item_queue);
+        env.get(), &ops, &region.inner, &spec, spec.range.sorting, start, n,
+        &item_queue);
     return boost::apply_visitor(visitor, ref);
 }
 
+void limit_manager_t::truncate_to_spare(item_queue_t *real_added,
+                                        std::set<std::string> *real_deleted) {
+    for (auto &&pair : item_queue.pop_top(spec.limit)) {
+        auto it = real_added->find_id(pair.first);
+        if (it != real_added->end()) {
+            real_added->erase(it);
+        } else {
+            bool inserted = real_deleted->insert(pair.first).second;
+            guarantee(inserted);
+        }
+        bool inserted = spare.insert(std::move(pair)).second;
+        guarantee(inserted);
+    }
+    // Dropping the rows at the far end keeps `spare` free of gaps.
+    spare.truncate_top(CHANGEFEED_LIMIT_SPARE_ROWS);
+}
+
 void limit_manager_t::commit(
     rwlock_in_line_t *spot,
     const boost::variant<primary_ref_t, sindex_ref_t> &sindex_ref) THROWS_NOTHING {
@@ -1123,14 +1608,15 @@ void limit_manager_t::commit(
         return;
     }
 
-    // Before we delete anything, we get the boundary between the active set and
-    // the data that didn't make it into the set.  Anything <= that according to
-    // our ordering could never be kicked out of the set because of a read from
-    // disk.
+    // Before we delete anything, we get the boundary between the rows we have in
+    // memory (the active set and the spare rows) and the data that didn't make it
+    // into either.  Anything <= that according to our ordering could never be
+    // kicked out of the set because of a read from disk.
     optional<item_t> active_boundary;
-    auto item_queue_it = item_queue.begin();
-    if (item_queue_it != item_queue.end()) {
-        active_boundary.set(**item_queue_it);
+    if (spare.size() != 0) {
+        active_boundary.set(**spare.begin());
+    } else if (item_queue.size() != 0) {
+        active_boundary.set(**item_queue.begin());
     }
 
     item_queue_t real_added(gt);
@@ -1140,6 +1626,8 @@ void limit_manager_t::commit(
         if (data_deleted) {
             bool inserted = real_deleted.insert(id).second;
             guarantee(inserted);
+        } else {
+            UNUSED bool spare_deleted = spare.del_id(id);
         }
     }
     deleted.clear();
@@ -1162,23 +1650,27 @@ void limit_manager_t::commit(
     }
     added.clear();
 
-    std::vector<std::string> truncated = item_queue.truncate_top(spec.limit);
-    for (auto &&id : truncated) {
-        auto it = real_added.find_id(id);
-        if (it != real_added.end()) {
-            real_added.erase(it);
-        } else {
-            bool inserted = real_deleted.insert(std::move(id)).second;
-            guarantee(inserted);
-        }
+    truncate_to_spare(&real_added, &real_deleted);
+
+    // Most of the time the rows we lost can be replaced with spare ones.
+    while (item_queue.size() < spec.limit && spare.size() != 0) {
+        item_t pair = spare.pop_bottom();
+        bool inserted = item_queue.insert(pair).second;
+        guarantee(inserted);
+        inserted = real_added.insert(std::move(pair)).second;
+        guarantee(inserted);
     }
 
     bool anything_on_disk = real_deleted.size() != 0 || added_on_disk;
     if (item_queue.size() < spec.limit && anything_on_disk) {
+        // We're out of spare rows, so we read enough to refill them as well.
+        guarantee(spare.size() == 0);
         std::vector<item_t> s;
         optional<exc_t> exc;
         try {
-            s = read_more(sindex_ref, active_boundary);
+            s = read_more(sindex_ref,
+                          active_boundary,
+                          spec.limit - item_queue.size() + CHANGEFEED_LIMIT_SPARE_ROWS);
         } catch (const exc_t &e) {
             exc.set(e);
         }
@@ -1196,18 +1688,8 @@ void limit_manager_t::commit(
                 guarantee(added_insert);
             }
         }
-        // We need to truncate again because `read_more` may read too much in
-        // the secondary index case.
-        std::vector<std::string> read_trunc = item_queue.truncate_top(spec.limit);
-        for (auto &&id : read_trunc) {
-            auto it = real_added.find_id(id);
-            if (it != real_added.end()) {
-                real_added.erase(it);
-            } else {
-                bool inserted = real_deleted.insert(std::move(id)).second;
-                guarantee(inserted);
-            }
-        }
+        // The rows beyond the limit become the new spare rows.
+        truncate_to_spare(&real_added, &real_deleted);
     }
     std::set<std::string> remaining_deleted;
     for (auto &&id : real_deleted) {
@@ -1258,9 +1740,9 @@ RDB_IMPL_SERIALIZABLE_3(msg_t::limit_change_t, sub, old_key, new_val);
 INSTANTIATE_SERIALIZABLE_FOR_CLUSTER(msg_t::limit_change_t);
 RDB_IMPL_SERIALIZABLE_2(msg_t::limit_stop_t, sub, exc);
 INSTANTIATE_SERIALIZABLE_FOR_CLUSTER(msg_t::limit_stop_t);
-RDB_IMPL_SERIALIZABLE_5(
+RDB_IMPL_SERIALIZABLE_6(
     msg_t::change_t,
-    old_indexes, new_indexes, pkey, old_val, new_val);
+    old_indexes, new_indexes, pkey, old_val, new_val, log_position);
 INSTANTIATE_SERIALIZABLE_FOR_CLUSTER(msg_t::change_t);
 RDB_IMPL_SERIALIZABLE_0_SINCE_v1_13(msg_t::stop_t);
 
@@ -1451,6 +1933,65 @@ datum_t add_type(datum_t &&datum, change_type_t type) {
                         datum_t(type_string)}}});
 }
 
+// Where a feed is in the change log of a `server_t`: every change up to `position`
+// has been delivered, and so have the first `delivered` elements of the change
+// after it (a change gives a feed more than one element with multi indexes).
+struct token_position_t {
+    uint64_t position;
+    uint64_t delivered;
+};
+
+// A token is an object that maps the uuids of the `server_t`s of the table to their
+// `token_position_t`.  That's a number if `delivered` is 0, and an array of
+// `position` and `delivered` otherwise.
+datum_t add_token(datum_t &&datum,
+                  const std::map<uuid_u, token_position_t> &positions) {
+    std::map<datum_string_t, datum_t> token;
+    for (const auto &pair : positions) {
+        datum_t position(static_cast<double>(pair.second.position));
+        token[datum_string_t(uuid_to_str(pair.first))] = pair.second.delivered == 0
+            ? position
+            : datum_t(std::vector<datum_t>{
+                    position, datum_t(static_cast<double>(pair.second.delivered))},
+                datum_t::no_array_size_limit_check_t());
+    }
+    return datum.merge(
+        datum_t{
+            std::map<datum_string_t, datum_t>{
+                std::pair<datum_string_t, datum_t>{
+                    datum_string_t("token"),
+                        datum_t(std::move(token))}}});
+}
+
+std::map<uuid_u, token_position_t> parse_token(const datum_t &token) {
+    rcheck_datum(token.get_type() == datum_t::R_OBJECT, base_exc_t::LOGIC,
+                 strprintf("Expected a changefeed token (an OBJECT) for `since` "
+                           "but found %s.", token.get_type_name().c_str()));
+    auto is_count = [](const datum_t &d) {
+        return d.get_type() == datum_t::R_NUM && d.as_num() >= 0;
+    };
+    std::map<uuid_u, token_position_t> positions;
+    for (size_t i = 0; i < token.obj_size(); ++i) {
+        auto pair = token.get_pair(i);
+        uuid_u server;
+        datum_t position = pair.second;
+        datum_t delivered = datum_t(0.0);
+        if (position.get_type() == datum_t::R_ARRAY && position.arr_size() == 2) {
+            delivered = position.get(1);
+            position = position.get(0);
+        }
+        rcheck_datum(str_to_uuid(pair.first.to_std(), &server)
+                     && is_count(position)
+                     && is_count(delivered),
+                     base_exc_t::LOGIC,
+                     strprintf("Invalid changefeed token `%s`.",
+                               token.print().c_str()));
+        positions[server] = token_position_t{static_cast<uint64_t>(position.as_int()),
+                                             static_cast<uint64_t>(delivered.as_int())};
+    }
+    return positions;
+}
+
 datum_t subscription_t::maybe_add_type(datum_t &&datum, change_type_t type) {
     if (!include_types) {
         return std::move(datum);
@@ -1535,6 +2076,18 @@ datum_t change_val_to_change(
     return res;
 }
 
+// Subscriptions that would register the same filter share it, so the filter is
+// compared by its serialization (without the id).
+std::string filter_key_of(change_filter_t filter) {
+    filter.sub = nil_uuid();
+    write_message_t wm;
+    serialize<cluster_version_t::CLUSTER>(&wm, filter);
+    vector_stream_t stream;
+    int res = send_write_message(&stream, &wm);
+    guarantee(res == 0);
+    return std::string(stream.vector().begin(), stream.vector().end());
+}
+
 enum class init_squashing_queue_t { NO, YES };
 class flat_sub_t : public subscription_t {
 public:
@@ -1551,6 +2104,7 @@ public:
     virtual void add_el(
         const uuid_u &shard_uuid,
         uint64_t stamp,
+        uint64_t log_position,
         const store_key_t &pkey,
         const optional<std::string> &DEBUG_ONLY(sindex),
         optional<indexed_datum_t> old_val,
@@ -1562,12 +2116,14 @@ public:
             // update step and always pass it through.  (This supports cases
             // like `.get_all(1, 1)`).
             last_stamp = stamp_pair;
-            queue->add(change_val_t(
+            change_val_t change_val(
                 std::make_pair(shard_uuid, stamp),
                 pkey,
                 std::move(old_val),
                 std::move(new_val)
-                DEBUG_ONLY(, sindex)));
+                DEBUG_ONLY(, sindex));
+            change_val.log_position = log_position;
+            queue->add(std::move(change_val));
             if (queue->size() > limits.changefeed_queue_size()) {
                 skipped += queue->size();
                 queue->clear();
@@ -1588,6 +2144,10 @@ public:
     change_val_t pop_change_val() { return queue->pop(); }
     const change_val_t &peek_change_val() { return queue->peek(); }
     bool active() { return !exc; }
+    // Identifies our `change_filter_t` on the `server_t`s.  Subscriptions with the
+    // same `filter_key` share the filter; the `feed_t` hands out the id.
+    uuid_u filter_id;
+    std::string filter_key;
 protected:
     // The queue of changes we've accumulated since the last time we were read from.
     scoped_ptr_t<maybe_squashing_queue_t> queue;
@@ -1654,6 +2214,13 @@ protected:
 private:
     virtual void maybe_remove_feed() = 0;
     virtual void stop_limit_sub(limit_sub_t *sub) = 0;
+    virtual void stop_filter(const uuid_u &filter_id) = 0;
+
+    // Identical range and point subscriptions share their `change_filter_t` on the
+    // `server_t`s, so the servers check every change against each distinct
+    // subscription only once.  These must be called on the home thread.
+    uuid_u acquire_filter(const std::string &filter_key);
+    void release_filter(const std::string &filter_key);
 
     void add_sub_with_lock(
         rwlock_t *rwlock, const std::function<void()> &f) THROWS_NOTHING;
@@ -1688,6 +2255,9 @@ private:
     rwlock_t range_subs_lock;
     std::map<uuid_u, std::vector<std::set<limit_sub_t *> > > limit_subs;
     rwlock_t limit_subs_lock;
+    // The id of each shared filter and the number of subscriptions using it, by
+    // `filter_key`.
+    std::map<std::string, std::pair<uuid_u, size_t> > shared_filters;
 
     // This stores the latest stamps we've received.  It's OK for this to
     // be a tiny bit behind what we've sent the subs.
@@ -1739,16 +2309,18 @@ public:
 private:
     virtual void maybe_remove_feed() { client->maybe_remove_feed(client_lock, table_id); }
     virtual void stop_limit_sub(limit_sub_t *sub);
+    virtual void stop_filter(const uuid_u &filter_id);
 
-    void mailbox_cb(signal_t *interruptor, stamped_msg_t msg);
+    void mailbox_cb(signal_t *interruptor, stamped_batch_t batch);
     void constructor_cb();
 
     auto_drainer_t::lock_t client_lock;
     client_t *client;
     namespace_id_t table_id;
     mailbox_manager_t *manager;
-    mailbox_t<stamped_msg_t> mailbox;
+    mailbox_t<stamped_batch_t> mailbox;
     std::vector<server_t::addr_t> stop_addrs;
+    std::vector<server_t::filter_addr_t> filter_stop_addrs;
     std::vector<scoped_ptr_t<disconnect_watcher_t> > disconnect_watchers;
 
     struct queue_t {
@@ -1756,11 +2328,12 @@ private:
         rwlock_t lock;
         uint64_t next;
         struct lt_t {
-            bool operator()(const stamped_msg_t &left, const stamped_msg_t &right) {
-                return left.stamp > right.stamp; // We want the min val to be on top.
+            bool operator()(const stamped_batch_t &left, const stamped_batch_t &right) {
+                // We want the min val to be on top.
+                return left.first_stamp > right.first_stamp;
             }
         };
-        std::priority_queue<stamped_msg_t, std::vector<stamped_msg_t>, lt_t> map;
+        std::priority_queue<stamped_batch_t, std::vector<stamped_batch_t>, lt_t> map;
     };
     // Maps from a `server_t`'s uuid_u.  We don't need a lock for this because
     // the set of `uuid_u`s never changes after it's initialized.
@@ -1804,6 +2377,7 @@ real_feed_t::real_feed_t(auto_drainer_t::lock_t _client_lock,
         for (auto it = resp->addrs.begin(); it != resp->addrs.end(); ++it) {
             stop_addrs.push_back(std::move(*it));
         }
+        filter_stop_addrs.assign(resp->filter_addrs.begin(), resp->filter_addrs.end());
 
         std::set<peer_id_t> peers;
         for (auto it = stop_addrs.begin(); it != stop_addrs.end(); ++it) {
@@ -1825,10 +2399,11 @@ real_feed_t::real_feed_t(auto_drainer_t::lock_t _client_lock,
 #ifndef NDEBUG
             for (size_t i = 0; i < queues.size()-1; ++i) {
                 res.first->second->map.push(
-                    stamped_msg_t(
+                    stamped_batch_t{
                         server_uuid,
                         std::numeric_limits<uint64_t>::max() - i,
-                        msg_t()));
+                        std::numeric_limits<uint64_t>::max() - i,
+                        std::vector<std::pair<uint64_t, msg_t> >()});
             }
 #endif
         }
@@ -1993,6 +2568,7 @@ public:
           state(state_t::INITIALIZING),
           sent_state(state_t::NONE),
           include_initial(false) {
+        filter_key = filter_key_of(make_filter());
         _feed->add_point_sub(this, store_key_t(pkey.print_primary()));
     }
     virtual ~point_sub_t() {
@@ -2062,7 +2638,10 @@ public:
         read_response_t read_resp;
         nif->read(
             env->get_user_context(),
-            read_t(changefeed_point_stamp_t{addr, store_key_t(pkey.print_primary())},
+            read_t(changefeed_point_stamp_t{
+                       addr,
+                       store_key_t(pkey.print_primary()),
+                       make_optional(make_filter())},
                    profile_bool_t::DONT_PROFILE, read_mode_t::SINGLE),
             &read_resp,
             order_token_t::ignore,
@@ -2135,6 +2714,13 @@ public:
         return make_counted<stream_t<subscription_t> >(std::move(self), bt);
     }
 private:
+    change_filter_t make_filter() const {
+        return change_filter_t{filter_id,
+                               make_optional(store_key_t(pkey.print_primary())),
+                               r_nullopt,
+                               squash};
+    }
+
     datum_t pkey;
     optional<change_val_t> initial_val;
     uint64_t stamp;
@@ -2155,6 +2741,37 @@ counted_t<splice_stream_t> make_splice_stream(Args &&...args) {
     return make_counted<splice_stream_t>(std::forward<Args>(args)...);
 }
 
+// Whether `transforms` give the same results on every server, so that the
+// `server_t`s can run them to filter changes.  (The transformations of a
+// changefeed may use `r.now` or geospatial terms, which don't.)
+bool transforms_run_anywhere(const std::vector<transform_variant_t> &transforms) {
+    for (const auto &transform : transforms) {
+        const wire_func_t *f = nullptr;
+        if (const map_wire_func_t *map = boost::get<map_wire_func_t>(&transform)) {
+            f = map;
+        } else if (const filter_wire_func_t *filter
+                       = boost::get<filter_wire_func_t>(&transform)) {
+            if (filter->default_filter_val.has_value()
+                && !filter->default_filter_val->compile_wire_func()
+                        ->is_deterministic().test(single_server_t::no,
+                                                  constant_now_t::no)) {
+                return false;
+            }
+            f = &filter->filter_func;
+        } else if (const concatmap_wire_func_t *concatmap
+                       = boost::get<concatmap_wire_func_t>(&transform)) {
+            f = concatmap;
+        } else {
+            return false;
+        }
+        if (!f->compile_wire_func()->is_deterministic().test(single_server_t::no,
+                                                              constant_now_t::no)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 class range_sub_t : public flat_sub_t {
 public:
     // Throws QL exceptions.
@@ -2165,6 +2782,8 @@ public:
                 const datum_t &_squash,
                 bool _include_states,
                 bool _include_types,
+                bool _include_tokens,
+                const datum_t &_since,
                 env_t *outer_env,
                 keyspec_t::range_t _spec)
         // We don't turn on squashing until later for range subs.  (We need to
@@ -2180,15 +2799,35 @@ public:
           spec(std::move(_spec)),
           state(state_t::READY),
           sent_state(state_t::NONE),
-          artificial_include_initial(false) {
+          artificial_include_initial(false),
+          include_tokens(_include_tokens || _since.has()) {
+        if (_since.has()) {
+            since.set(parse_token(_since));
+        }
         env = make_env(outer_env);
         for (const auto &transform : spec.transforms) {
             ops.push_back(make_op(transform));
         }
+        transforms_run_anywhere_ = transforms_run_anywhere(spec.transforms);
+        if (has_ops() && transforms_run_anywhere_) {
+            // The results of the transforms also depend on the parts of `env` they
+            // can see (the global optargs, `r.now`, the limits and the ReQL
+            // version), so those are part of the key too.
+            write_message_t wm;
+            serialize<cluster_version_t::CLUSTER>(&wm, spec.transforms);
+            serialize<cluster_version_t::CLUSTER>(&wm, env->get_serializable_env());
+            serialize<cluster_version_t::CLUSTER>(&wm, env->limits());
+            serialize<cluster_version_t::CLUSTER>(&wm, env->reql_version());
+            vector_stream_t stream;
+            int res = send_write_message(&stream, &wm);
+            guarantee(res == 0);
+            ops_key.set(std::string(stream.vector().begin(), stream.vector().end()));
+        }
         store_keys = spec.datumspec.primary_key_map();
         if (!store_keys.has_value()) {
             store_key_range.set(spec.datumspec.covering_range().to_primary_keyrange());
         }
+        filter_key = filter_key_of(make_filter());
         _feed->add_range_sub(this);
     }
     feed_type_t cfeed_type() const final { return feed_type_t::stream; }
@@ -2223,6 +2862,9 @@ public:
     }
 
     bool has_ops() { return ops.size() != 0; }
+    // Set if `apply_ops` gives the same results as it does for every other
+    // subscription with the same key, so they can share the results.
+    const optional<std::string> &shared_ops_key() const { return ops_key; }
 
     optional<datum_t> apply_ops(datum_t val) {
         guarantee(active());
@@ -2242,6 +2884,26 @@ public:
     optional<datum_t> maybe_apply_ops(datum_t val) {
         return has_ops() ? apply_ops(std::move(val)) : make_optional(std::move(val));
     }
+    // Sets `*old_out` and `*new_out` to the rows of `change` after our
+    // transformations (or to `null` if there's no row or it was filtered out).
+    // Returns false if the transformations stopped the subscription.
+    bool transformed_vals(const msg_t::change_t &change,
+                          datum_t *old_out,
+                          datum_t *new_out) {
+        *old_out = *new_out = datum_t::null();
+        if (change.new_val.has()) {
+            if (optional<datum_t> d = maybe_apply_ops(change.new_val)) {
+                *new_out = *d;
+            }
+        }
+        if (!active()) return false;
+        if (change.old_val.has()) {
+            if (optional<datum_t> d = maybe_apply_ops(change.old_val)) {
+                *old_out = *d;
+            }
+        }
+        return active();
+    }
 
     bool update_stamp(const uuid_u &uuid, uint64_t new_stamp) final {
         guarantee(active());
@@ -2272,10 +2934,31 @@ public:
                 vals_to_change(datum_t(), d, true),
                 change_type_t::INITIAL);
         }
-        return change_val_to_change(pop_change_val(),
-                                    false,
-                                    false,
-                                    include_types);
+        change_val_t change_val = pop_change_val();
+        datum_t change = change_val_to_change(change_val,
+                                              false,
+                                              false,
+                                              include_types);
+        if (!include_tokens) {
+            return change;
+        }
+        // If the change gave us more elements that are still queued, we aren't
+        // done with it yet, and the token counts the elements we've delivered.
+        token_position_t *position = &positions[change_val.source_stamp.first];
+        bool more = false;
+        if (has_change_val()) {
+            const change_val_t &next = peek_change_val();
+            more = next.source_stamp.first == change_val.source_stamp.first
+                && next.log_position == change_val.log_position;
+        }
+        if (!more) {
+            *position = token_position_t{change_val.log_position, 0};
+        } else if (position->position + 1 == change_val.log_position) {
+            position->delivered += 1;
+        } else {
+            *position = token_position_t{change_val.log_position - 1, 1};
+        }
+        return add_token(std::move(change), positions);
     }
     bool has_el() final {
         return (include_states && state != sent_state)
@@ -2304,11 +2987,23 @@ public:
         assert_thread();
         r_sanity_check(self.get() == this);
 
+        // The stamp read also tells the `server_t`s which changes we want.
+        changefeed_stamp_t stamp(addr);
+        stamp.filter.set(make_filter());
+        if (include_tokens) {
+            std::map<uuid_u, uint64_t> resume_from;
+            if (since.has_value()) {
+                for (const auto &pair : *since) {
+                    resume_from[pair.first] = pair.second.position;
+                }
+            }
+            stamp.resume_from.set(std::move(resume_from));
+        }
         read_response_t read_resp;
         // Note that we use the `outer_env`'s interruptor for the read.
         nif->read(
             outer_env->get_user_context(),
-            read_t(changefeed_stamp_t(addr),
+            read_t(std::move(stamp),
                    profile_bool_t::DONT_PROFILE,
                    read_mode_t::SINGLE),
             &read_resp, order_token_t::ignore, outer_env->interruptor);
@@ -2334,6 +3029,9 @@ public:
         queue->purge_below(purge_stamps);
         rcheck_datum(orig_stamps.size() != 0, base_exc_t::RESUMABLE_OP_FAILED,
                      "Empty start stamps.  Did you just reshard?");
+        if (include_tokens) {
+            start_from_log(*resp->stamp_infos);
+        }
 
         if (maybe_src) {
             // Nothing can happen between constructing the new `scoped_ptr_t` and
@@ -2358,6 +3056,8 @@ public:
         backtrace_id_t bt) {
         assert_thread();
         r_sanity_check(self.get() == this);
+        rcheck_datum(!include_tokens, base_exc_t::LOGIC,
+                     "Cannot include tokens for changefeeds on system tables.");
 
         artificial_include_initial = include_initial;
 
@@ -2396,10 +3096,20 @@ private:
                 nullptr/*don't profile*/);
     }
 
+    change_filter_t make_filter() const {
+        change_filter_t filter{filter_id, r_nullopt, make_optional(spec), squash};
+        if (!transforms_run_anywhere_) {
+            filter.range->transforms.clear();
+        }
+        return filter;
+    }
+
     scoped_ptr_t<env_t> env;
     std::vector<scoped_ptr_t<op_t> > ops;
+    bool transforms_run_anywhere_;
+    optional<std::string> ops_key;
 
-    // The stamp (see `stamped_msg_t`) associated with our `changefeed_stamp_t`
+    // The stamp (see `stamped_batch_t`) associated with our `changefeed_stamp_t`
     // read.  We use these to make sure we don't see changes from writes before
     // our subscription.
     std::map<uuid_u, uint64_t> orig_stamps, next_stamps;
@@ -2410,6 +3120,15 @@ private:
     std::vector<datum_t> artificial_initial_vals;
     bool artificial_include_initial;
 
+    // Sets the starting `positions` from the stamp read, and queues the changes
+    // we missed since `since`.  Defined after `msg_visitor_t`.
+    void start_from_log(const std::map<uuid_u, shard_stamp_info_t> &stamp_infos);
+    // Whether we add a token to the changes, the token we resume from, and the
+    // position in the change log of each `server_t` that the next token has.
+    const bool include_tokens;
+    optional<std::map<uuid_u, token_position_t> > since;
+    std::map<uuid_u, token_position_t> positions;
+
     auto_drainer_t *get_drainer() final { return &drainer; }
     auto_drainer_t drainer;
 };
@@ -2802,6 +3521,12 @@ public:
     auto_drainer_t drainer;
 };
 
+void real_feed_t::stop_filter(const uuid_u &filter_id) {
+    for (const auto &addr : filter_stop_addrs) {
+        send(manager, addr, mailbox.get_address(), filter_id);
+    }
+}
+
 void real_feed_t::stop_limit_sub(limit_sub_t *sub) {
     for (const auto &addr : sub->stop_addrs) {
         send(manager, addr,
@@ -2809,6 +3534,71 @@ void real_feed_t::stop_limit_sub(limit_sub_t *sub) {
     }
 }
 
+// Calls `add` with the sindex and the old and new elements of every change that
+// `change` makes to `sub`, given the rows after `sub`'s transformations.
+template<class F>
+void range_change_els(range_sub_t *sub,
+                      const msg_t::change_t &change,
+                      const datum_t &old_val,
+                      const datum_t &new_val,
+                      bool trivial,
+                      const F &add) {
+    datum_t null = datum_t::null();
+    optional<std::string> sindex = sub->sindex();
+    if (sindex) {
+        std::vector<indexed_datum_t> old_idxs, new_idxs;
+        auto old_it = change.old_indexes.find(*sindex);
+        if (old_it != change.old_indexes.end()) {
+            for (const auto &idx : old_it->second) {
+                for (size_t i = 0; i < sub->copies(idx.first); ++i) {
+                    old_idxs.push_back(
+                        indexed_datum_t(old_val, make_optional(idx.second)));
+                }
+            }
+        }
+        auto new_it = change.new_indexes.find(*sindex);
+        if (new_it != change.new_indexes.end()) {
+            for (const auto &idx : new_it->second) {
+                for (size_t i = 0; i < sub->copies(idx.first); ++i) {
+                    new_idxs.push_back(
+                        indexed_datum_t(new_val, make_optional(idx.second)));
+                }
+            }
+        }
+        while (old_idxs.size() > 0 && new_idxs.size() > 0) {
+            if (!trivial) {
+                add(sindex,
+                    make_optional(std::move(old_idxs.back())),
+                    make_optional(std::move(new_idxs.back())));
+            }
+            old_idxs.pop_back();
+            new_idxs.pop_back();
+        }
+        while (old_idxs.size() > 0) {
+            guarantee(new_idxs.size() == 0);
+            if (old_val != null) {
+                add(sindex, make_optional(std::move(old_idxs.back())), r_nullopt);
+            }
+            old_idxs.pop_back();
+        }
+        while (new_idxs.size() > 0) {
+            guarantee(old_idxs.size() == 0);
+            if (new_val != null) {
+                add(sindex, r_nullopt, make_optional(std::move(new_idxs.back())));
+            }
+            new_idxs.pop_back();
+        }
+    } else {
+        if (!trivial) {
+            for (size_t i = 0; i < sub->copies(change.pkey); ++i) {
+                add(sindex,
+                    make_optional(indexed_datum_t(old_val, r_nullopt)),
+                    make_optional(indexed_datum_t(new_val, r_nullopt)));
+            }
+        }
+    }
+}
+
 class msg_visitor_t : public boost::static_visitor<void> {
 public:
     msg_visitor_t(feed_t *_feed, const auto_drainer_t::lock_t *_lock,
@@ -2837,101 +3627,53 @@ public:
     }
     void operator()(const msg_t::change_t &change) const {
         datum_t null = datum_t::null();
+        // Subscriptions with the same transformations get the same transformed
+        // values, so we only compute them once per thread.
+        std::vector<std::map<std::string, std::pair<datum_t, datum_t> > >
+            transformed(get_num_threads());
 
         feed->each_range_sub(*lock, [&](range_sub_t *sub) {
             datum_t new_val = null, old_val = null;
             if (!sub->active()) return;
             bool trivial = false;
             if (sub->has_ops()) {
-                if (change.new_val.has()) {
-                    if (optional<datum_t> d = sub->apply_ops(change.new_val)) {
-                        new_val = *d;
-                    }
-                }
-                if (!sub->active()) return;
-                if (change.old_val.has()) {
-                    if (optional<datum_t> d = sub->apply_ops(change.old_val)) {
-                        old_val = *d;
+                const optional<std::string> &ops_key = sub->shared_ops_key();
+                auto *memo = &transformed[get_thread_id().threadnum];
+                auto it = ops_key.has_value() ? memo->find(*ops_key) : memo->end();
+                if (it != memo->end()) {
+                    new_val = it->second.first;
+                    old_val = it->second.second;
+                } else {
+                    if (!sub->transformed_vals(change, &old_val, &new_val)) return;
+                    if (ops_key.has_value()) {
+                        memo->insert(std::make_pair(*ops_key,
+                                                    std::make_pair(new_val, old_val)));
                     }
                 }
-                if (!sub->active()) return;
                 // Duplicate values are caught before being written to disk and
                 // don't generate a `mod_report`, but if we have transforms the
                 // values might have changed.
                 trivial = (new_val == old_val);
             } else {
                 guarantee(change.old_val.has() || change.new_val.has());
-                if (change.new_val.has()) {
-                    new_val = change.new_val;
-                }
-                if (change.old_val.has()) {
-                    old_val = change.old_val;
-                }
+                if (!sub->transformed_vals(change, &old_val, &new_val)) return;
             }
             ASSERT_NO_CORO_WAITING;
-            optional<std::string> sindex = sub->sindex();
-            if (sindex) {
-                std::vector<indexed_datum_t> old_idxs, new_idxs;
-                auto old_it = change.old_indexes.find(*sindex);
-                if (old_it != change.old_indexes.end()) {
-                    for (const auto &idx : old_it->second) {
-                        for (size_t i = 0; i < sub->copies(idx.first); ++i) {
-                            old_idxs.push_back(
-                                indexed_datum_t(old_val, make_optional(idx.second)));
-                        }
-                    }
-                }
-                auto new_it = change.new_indexes.find(*sindex);
-                if (new_it != change.new_indexes.end()) {
-                    for (const auto &idx : new_it->second) {
-                        for (size_t i = 0; i < sub->copies(idx.first); ++i) {
-                            new_idxs.push_back(
-                                indexed_datum_t(new_val, make_optional(idx.second)));
-                        }
-                    }
-                }
-                while (old_idxs.size() > 0 && new_idxs.size() > 0) {
-                    if (!trivial) {
-                        sub->add_el(server_uuid, stamp, change.pkey, sindex,
-                                    make_optional(std::move(old_idxs.back())),
-                                    make_optional(std::move(new_idxs.back())));
-                    }
-                    old_idxs.pop_back();
-                    new_idxs.pop_back();
-                }
-                while (old_idxs.size() > 0) {
-                    guarantee(new_idxs.size() == 0);
-                    if (old_val != null) {
-                        sub->add_el(server_uuid, stamp, change.pkey, sindex,
-                                    make_optional(std::move(old_idxs.back())),
-                                    r_nullopt);
-                    }
-                    old_idxs.pop_back();
-                }
-                while (new_idxs.size() > 0) {
-                    guarantee(old_idxs.size() == 0);
-                    if (new_val != null) {
-                        sub->add_el(server_uuid, stamp, change.pkey, sindex,
-                                    r_nullopt,
-                                    make_optional(std::move(new_idxs.back())));
-                    }
-                    new_idxs.pop_back();
-                }
-            } else {
-                if (!trivial) {
-                    for (size_t i = 0; i < sub->copies(change.pkey); ++i) {
-                        sub->add_el(server_uuid, stamp, change.pkey, sindex,
-                                    make_optional(indexed_datum_t(old_val, r_nullopt)),
-                                    make_optional(indexed_datum_t(new_val, r_nullopt)));
-                    }
-                }
-            }
+            range_change_els(
+                sub, change, old_val, new_val, trivial,
+                [&](const optional<std::string> &sindex,
+                    optional<indexed_datum_t> &&old_el,
+                    optional<indexed_datum_t> &&new_el) {
+                    sub->add_el(server_uuid, stamp, change.log_position, change.pkey,
+                                sindex, std::move(old_el), std::move(new_el));
+                });
         });
         feed->on_point_sub(
             change.pkey,
             *lock,
             [&](point_sub_t *sub) {
-                sub->add_el(server_uuid, stamp, change.pkey, r_nullopt,
+                sub->add_el(server_uuid, stamp, change.log_position, change.pkey,
+                            r_nullopt,
                             change.old_val.has()
                                 ? optional<indexed_datum_t>(
                                         indexed_datum_t(change.old_val, r_nullopt))
@@ -2962,7 +3704,74 @@ void msg_visit(feed_t *feed,
     feed->update_stamps(server_uuid, stamp);
 }
 
-void real_feed_t::mailbox_cb(signal_t *, stamped_msg_t msg) {
+void range_sub_t::start_from_log(
+        const std::map<uuid_u, shard_stamp_info_t> &stamp_infos) {
+    std::vector<change_val_t> replayed;
+    for (const auto &pair : stamp_infos) {
+        guarantee(pair.second.log.has_value());
+        const log_read_t &log = *pair.second.log;
+        if (!since.has_value()) {
+            positions[pair.first] = token_position_t{log.position, 0};
+            continue;
+        }
+        auto it = since->find(pair.first);
+        rcheck_datum(it != since->end() && log.replay.has_value(),
+                     base_exc_t::OP_FAILED,
+                     "The changes since the given token are no longer available.  "
+                     "(The table may have been resharded or its servers restarted, "
+                     "or there were too many changes since.)  Use `include_initial` "
+                     "to get the current values instead.");
+        positions[pair.first] = it->second;
+        for (const msg_t::change_t &change : *log.replay) {
+            datum_t old_val, new_val;
+            if (!transformed_vals(change, &old_val, &new_val)) return;
+            // The elements of a change come out in the same order every time, so we
+            // skip the ones of the first change that were already delivered.
+            uint64_t to_skip = change.log_position == it->second.position + 1
+                ? it->second.delivered
+                : 0;
+            range_change_els(
+                this, change, old_val, new_val, has_ops() && old_val == new_val,
+                [&](const optional<std::string> &DEBUG_ONLY(sindex),
+                    optional<indexed_datum_t> &&old_el,
+                    optional<indexed_datum_t> &&new_el) {
+                    if (to_skip != 0) {
+                        --to_skip;
+                        return;
+                    }
+                    // The stamp doesn't matter since these never get purged.
+                    change_val_t change_val(
+                        std::make_pair(pair.first, 0),
+                        change.pkey,
+                        std::move(old_el),
+                        std::move(new_el)
+                        DEBUG_ONLY(, sindex));
+                    change_val.log_position = change.log_position;
+                    replayed.push_back(std::move(change_val));
+                });
+        }
+    }
+    if (replayed.size() != 0) {
+        // The changes from after the stamp that we've queued already go after the
+        // ones we replay.
+        ASSERT_NO_CORO_WAITING;
+        scoped_ptr_t<maybe_squashing_queue_t> live = std::move(queue);
+        queue = make_scoped<nonsquashing_queue_t>();
+        for (auto &&change_val : replayed) {
+            queue->add(std::move(change_val));
+        }
+        while (live->size() != 0) {
+            queue->add(live->pop());
+        }
+        if (queue->size() > limits.changefeed_queue_size()) {
+            skipped += queue->size();
+            queue->clear();
+        }
+        maybe_signal_cond();
+    }
+}
+
+void real_feed_t::mailbox_cb(signal_t *, stamped_batch_t batch) {
     // We stop receiving messages when detached (we're only receiving
     // messages because we haven't managed to get a message to the
     // stop mailboxes for some of the primary replicas yet).  This also stops
@@ -2979,7 +3788,7 @@ void real_feed_t::mailbox_cb(signal_t *, stamped_msg_t msg) {
         if (!lock.get_drain_signal()->is_pulsed()) {
             // We don't need a lock for this because the set of `uuid_u`s never
             // changes after it's initialized.
-            auto it = queues.find(msg.server_uuid);
+            auto it = queues.find(batch.server_uuid);
             guarantee(it != queues.end());
             queue_t *queue = it->second.get();
             guarantee(queue != NULL);
@@ -2989,17 +3798,23 @@ void real_feed_t::mailbox_cb(signal_t *, stamped_msg_t msg) {
             if (detached) return;
 
             // Add us to the queue.
-            guarantee(msg.stamp >= queue->next);
-            queue->map.push(std::move(msg));
+            guarantee(batch.first_stamp >= queue->next);
+            queue->map.push(std::move(batch));
 
             // Read as much as we can from the queue (this enforces ordering.)
-            while (queue->map.size() != 0 && queue->map.top().stamp == queue->next) {
+            while (queue->map.size() != 0
+                   && queue->map.top().first_stamp == queue->next) {
+                const stamped_batch_t &cur = queue->map.top();
+                for (const auto &pair : cur.msgs) {
+                    if (detached) return;
+                    msg_visitor_t visitor(this, &lock, cur.server_uuid, pair.first);
+                    boost::apply_visitor(visitor, pair.second.op);
+                }
                 if (detached) return;
-                const stamped_msg_t &curmsg = queue->map.top();
-                msg_visit(this, &lock,
-                          curmsg.server_uuid, curmsg.stamp, curmsg.submsg.op);
+                // Updating the stamps is expensive, so we only do it once per batch.
+                update_stamps(cur.server_uuid, cur.end_stamp - 1);
+                queue->next = cur.end_stamp;
                 queue->map.pop();
-                queue->next += 1;
             }
         }
     }
@@ -3424,6 +4239,8 @@ RDB_MAKE_SERIALIZABLE_4_FOR_CLUSTER(
 RDB_MAKE_SERIALIZABLE_0_FOR_CLUSTER(keyspec_t::empty_t);
 RDB_MAKE_SERIALIZABLE_2_FOR_CLUSTER(keyspec_t::limit_t, range, limit);
 RDB_MAKE_SERIALIZABLE_1_FOR_CLUSTER(keyspec_t::point_t, key);
+RDB_MAKE_SERIALIZABLE_4_FOR_CLUSTER(change_filter_t, sub, pkey, range, squash);
+RDB_MAKE_SERIALIZABLE_2_FOR_CLUSTER(log_read_t, position, replay);
 
 void feed_t::add_sub_with_lock(
     rwlock_t *rwlock, const std::function<void()> &f) THROWS_NOTHING {
@@ -3499,9 +4316,34 @@ size_t map_del_sub(Map *map, const Key &key, Sub *sub) THROWS_NOTHING {
     return erased;
 }
 
+uuid_u feed_t::acquire_filter(const std::string &filter_key) {
+    assert_thread();
+    auto it = shared_filters.find(filter_key);
+    if (it == shared_filters.end()) {
+        it = shared_filters.insert(
+            std::make_pair(filter_key, std::make_pair(generate_uuid(), 0))).first;
+    }
+    it->second.second += 1;
+    return it->second.first;
+}
+
+void feed_t::release_filter(const std::string &filter_key) {
+    assert_thread();
+    auto it = shared_filters.find(filter_key);
+    guarantee(it != shared_filters.end() && it->second.second > 0);
+    it->second.second -= 1;
+    if (it->second.second == 0) {
+        // A later subscription with the same filter gets a new id, so this can't
+        // unregister its filter if it overtakes the stop message.
+        stop_filter(it->second.first);
+        shared_filters.erase(it);
+    }
+}
+
 // If this throws we might leak the increment to `num_subs`.
 void feed_t::add_point_sub(point_sub_t *sub, const store_key_t &key) THROWS_NOTHING {
     add_sub_with_lock(&point_subs_lock, [this, sub, &key]() {
+            sub->filter_id = acquire_filter(sub->filter_key);
             map_add_sub(&point_subs, key, sub);
         });
 }
@@ -3509,6 +4351,7 @@ void feed_t::add_point_sub(point_sub_t *sub, const store_key_t &key) THROWS_NOTH
 // Can't throw because it's called in a destructor.
 void feed_t::del_point_sub(point_sub_t *sub, const store_key_t &key) THROWS_NOTHING {
     del_sub_with_lock(&point_subs_lock, [this, sub, &key]() {
+            release_filter(sub->filter_key);
             return map_del_sub(&point_subs, key, sub);
         });
 }
@@ -3516,6 +4359,7 @@ void feed_t::del_point_sub(point_sub_t *sub, const store_key_t &key) THROWS_NOTH
 // If this throws we might leak the increment to `num_subs`.
 void feed_t::add_range_sub(range_sub_t *sub) THROWS_NOTHING {
     add_sub_with_lock(&range_subs_lock, [this, sub]() {
+            sub->filter_id = acquire_filter(sub->filter_key);
             auto pair = range_subs[sub->home_thread().threadnum].insert(sub);
             guarantee(pair.second);
         });
@@ -3524,6 +4368,7 @@ void feed_t::add_range_sub(range_sub_t *sub) THROWS_NOTHING {
 // Can't throw because it's called in a destructor.
 void feed_t::del_range_sub(range_sub_t *sub) THROWS_NOTHING {
     del_sub_with_lock(&range_subs_lock, [this, sub]() {
+            release_filter(sub->filter_key);
             return range_subs[sub->home_thread().threadnum].erase(sub);
         });
 }
@@ -3771,6 +4616,8 @@ scoped_ptr_t<subscription_t> new_sub(
                 ss->squash,
                 ss->include_states,
                 ss->include_types,
+                ss->include_tokens,
+                ss->since,
                 env,
                 range);
         }
@@ -3787,6 +4634,8 @@ scoped_ptr_t<subscription_t> new_sub(
                 ss->include_types);
         }
         subscription_t *operator()(const keyspec_t::limit_t &limit) const {
+            rcheck_datum(!ss->include_tokens && !ss->since.has(), base_exc_t::LOGIC,
+                         "Cannot include tokens for limit subs.");
             return new limit_sub_t(
                 env->get_rdb_ctx(),
                 env->get_user_context(),
@@ -3801,6 +4650,8 @@ scoped_ptr_t<subscription_t> new_sub(
         subscription_t *operator()(const keyspec_t::point_t &point) const {
             rcheck_datum(!ss->include_offsets, base_exc_t::LOGIC,
                          "Cannot include offsets for point subs.");
+            rcheck_datum(!ss->include_tokens && !ss->since.has(), base_exc_t::LOGIC,
+                         "Cannot include tokens for point subs.");
             return new point_sub_t(
                 env->get_rdb_ctx(),
                 env->get_user_context(),
@@ -3834,7 +4685,8 @@ streamspec_t::streamspec_t(counted_t<datum_stream_t> _maybe_src,
     include_types(std::move(_include_types)),
     limits(std::move(_limits)),
     squash(std::move(_squash)),
-    spec(std::move(_spec)) { }
+    spec(std::move(_spec)),
+    include_tokens(false) { }
 
 counted_t<datum_stream_t> client_t::new_stream(
     env_t *env,
@@ -3994,6 +4846,8 @@ public:
     NORETURN virtual void stop_limit_sub(limit_sub_t *) {
         crash("Limit subscriptions are not supported on artificial feeds.");
     }
+    // Artificial tables send every change to every subscription.
+    virtual void stop_filter(const uuid_u &) { }
 private:
     artificial_t *parent;
     auto_drainer_t drainer;
@@ -6,6 +6,7 @@
 #include <exception>
 #include <functional>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 #include <utility>
@@ -22,6 +23,7 @@
 #include "containers/counted.hpp"
 #include "containers/lifetime.hpp"
 #include "containers/scoped.hpp"
+#include "perfmon/perfmon.hpp"
 #include "protocol_api.hpp"
 #include "rdb_protocol/datum.hpp"
 #include "rdb_protocol/datumspec.hpp"
@@ -103,6 +105,9 @@ struct msg_t {
         `new_val` is an empty `datum_t`. */
         datum_t old_val;
         datum_t new_val;
+        // The position of the change in the `server_t`'s change log (see
+        // `server_t::get_stamp`).  Set by `server_t::send_all`.
+        uint64_t log_position;
         RDB_DECLARE_ME_SERIALIZABLE(change_t);
     };
     struct stop_t {
@@ -130,9 +135,9 @@ struct msg_t {
 RDB_DECLARE_SERIALIZABLE(msg_t);
 
 class real_feed_t;
-struct stamped_msg_t;
+struct stamped_batch_t;
 
-typedef mailbox_addr_t<stamped_msg_t> client_addr_t;
+typedef mailbox_addr_t<stamped_batch_t> client_addr_t;
 
 struct keyspec_t {
     struct range_t {
@@ -187,6 +192,10 @@ struct streamspec_t {
     configured_limits_t limits;
     datum_t squash;
     keyspec_t::spec_t spec;
+    // Whether every change should carry a token that `since` accepts, and the token
+    // to resume from, if any.  Only supported for range subscriptions.
+    bool include_tokens;
+    datum_t since;
     streamspec_t(counted_t<datum_stream_t> _maybe_src,
                  std::string _table_name,
                  bool _include_offsets,
@@ -202,6 +211,34 @@ RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(keyspec_t::empty_t);
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(keyspec_t::limit_t);
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(keyspec_t::point_t);
 
+// Tells a `server_t` which changes a range or point subscription is interested in,
+// so that it can drop the changes none of the subscriptions of a client want
+// before they're sent.  Subscriptions register it with the stamp read they do when
+// they start, and unregister it when they're destroyed.
+struct change_filter_t {
+    uuid_u sub;
+    // Set for point subscriptions.
+    optional<store_key_t> pkey;
+    // Set for range subscriptions.  The transformations are left out unless they
+    // give the same results on every server.
+    optional<keyspec_t::range_t> range;
+    // Whether the subscription squashes changes, in which case it doesn't mind if
+    // we squash them before sending them.
+    bool squash;
+};
+RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(change_filter_t);
+
+// What a `server_t` tells a subscription that wants to resume from (or later
+// return) a position in its change log.
+struct log_read_t {
+    // The position of the last change the server sent before the stamp.
+    uint64_t position;
+    // The changes after the position the subscription asked for, or empty if the
+    // server no longer has all of them.
+    optional<std::vector<msg_t::change_t> > replay;
+};
+RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(log_read_t);
+
 // The `client_t` exists on the server handling the changefeed query, in the
 // `rdb_context_t`.  When a query subscribes to the changes on a table, it
 // should call `new_stream`.  The `client_t` will give it back a stream of rows.
@@ -360,6 +397,27 @@ public:
         guarantee(data.size() == index.size());
         return ret;
     }
+    // Like `truncate_top`, but returns the whole entries.
+    std::vector<std::pair<Id, std::pair<Key, Val> > > pop_top(size_t n) {
+        std::vector<std::pair<Id, std::pair<Key, Val> > > ret;
+        while (index.size() > n) {
+            ret.push_back(std::move(**index.begin()));
+            data.erase(*index.begin());
+            index.erase(index.begin());
+        }
+        guarantee(data.size() == index.size());
+        return ret;
+    }
+    // Removes and returns the entry at the other end from `top`.
+    std::pair<Id, std::pair<Key, Val> > pop_bottom() {
+        guarantee(size() != 0);
+        auto it = std::prev(index.end());
+        std::pair<Id, std::pair<Key, Val> > ret = **it;
+        data.erase(*it);
+        index.erase(it);
+        guarantee(data.size() == index.size());
+        return ret;
+    }
 };
 
 class limit_order_t {
@@ -436,7 +494,12 @@ private:
     // Can throw `exc_t` exceptions if an error occurs while reading from disk.
     std::vector<item_t> read_more(
         const boost::variant<primary_ref_t, sindex_ref_t> &ref,
-        const optional<item_t> &start);
+        const optional<item_t> &start,
+        size_t n);
+    // Moves the entries `item_queue` has beyond the limit to `spare`, and records
+    // the ones the client has to hear about in `real_added` or `real_deleted`.
+    void truncate_to_spare(item_queue_t *real_added,
+                           std::set<std::string> *real_deleted);
     void send(msg_t &&msg);
 
     scoped_ptr_t<env_t> env;
@@ -449,6 +512,10 @@ private:
 
     limit_order_t gt;
     item_queue_t item_queue;
+    // Up to `CHANGEFEED_LIMIT_SPARE_ROWS` rows that come right after the ones in
+    // `item_queue`, with no gaps in between, so that we can replace the rows that
+    // get deleted from the top `n` without reading from disk.
+    item_queue_t spare;
 
     std::map<std::string, std::pair<datum_t, datum_t> > added;
     std::set<std::string> deleted;
@@ -459,6 +526,24 @@ public:
     auto_drainer_t drainer;
 };
 
+// The stats of the `server_t`s of a `store_t`, which go into the store's perfmon
+// collection.
+class server_stats_t {
+public:
+    explicit server_stats_t(perfmon_collection_t *parent);
+
+    perfmon_collection_t collection;
+    perfmon_membership_t membership;
+    // How many changes each batch we send holds.
+    perfmon_sampler_t pm_batch_size;
+    // How long the first change of each batch waited before we sent it, in
+    // seconds.
+    perfmon_sampler_t pm_batch_latency;
+    perfmon_rate_monitor_t pm_batches_sent;
+    perfmon_counter_t pm_changes_squashed;
+    perfmon_multi_membership_t pm_membership;
+};
+
 // There is one `server_t` per `store_t`, and it is used to send changes that
 // occur on that `store_t` to any subscribed `real_feed_t`s contained in a
 // `client_t`.
@@ -467,6 +552,7 @@ public:
     typedef server_addr_t addr_t;
     typedef mailbox_addr_t<client_t::addr_t, optional<std::string>, uuid_u>
         limit_addr_t;
+    typedef mailbox_addr_t<client_t::addr_t, uuid_u> filter_addr_t;
     explicit server_t(mailbox_manager_t *_manager, store_t *_parent);
     ~server_t();
     void add_client(
@@ -487,15 +573,29 @@ public:
         const auto_drainer_t::lock_t &keepalive);
     // `key` should be non-NULL if there is a key associated with the message.
     void send_all(
-        const msg_t &msg,
+        msg_t msg,
         const store_key_t &key,
         rwlock_in_line_t *stamp_spot,
         const auto_drainer_t::lock_t &keepalive);
+    // Called before the stamp of a new subscription is read, so that the
+    // subscription gets all the changes it wants from that stamp on.
+    void add_filter(
+        const client_t::addr_t &addr,
+        change_filter_t &&filter,
+        const auto_drainer_t::lock_t &keepalive);
     addr_t get_stop_addr();
     limit_addr_t get_limit_stop_addr();
+    filter_addr_t get_filter_stop_addr();
+    // If `log_out` is non-NULL, we also fill it in with the position of the last
+    // change we sent, and with the changes after position `since` if we still have
+    // them.  Asking for the log turns it on until some time after subscription
+    // `log_sub` and all the other ones that asked for it are gone.
     optional<uint64_t> get_stamp(
         const client_t::addr_t &addr,
-        const auto_drainer_t::lock_t &keepalive);
+        const auto_drainer_t::lock_t &keepalive,
+        log_read_t *log_out = nullptr,
+        const uuid_u &log_sub = nil_uuid(),
+        const optional<uint64_t> &since = r_nullopt);
     uuid_u get_uuid();
     // `f` will be called with a read lock on `clients` and a write lock on the
     // limit manager.
@@ -514,7 +614,11 @@ public:
     auto_drainer_t::lock_t get_keepalive();
 private:
     friend class limit_manager_t;
+    class filter_t;
     void stop_mailbox_cb(signal_t *interruptor, client_t::addr_t addr);
+    void filter_stop_mailbox_cb(signal_t *interruptor,
+                                client_t::addr_t addr,
+                                uuid_u sub);
     void limit_stop_mailbox_cb(signal_t *interruptor,
                                client_t::addr_t addr,
                                optional<std::string> sindex,
@@ -523,6 +627,7 @@ private:
         signal_t *stopped,
         client_t::addr_t addr,
         auto_drainer_t::lock_t keepalive);
+    void flush_cb(client_t::addr_t addr, auto_drainer_t::lock_t keepalive);
 
     // The UUID of the server, used so that `real_feed_t`s can enforce on ordering on
     // changefeed messages on a per-server basis (and drop changefeed messages
@@ -538,9 +643,38 @@ private:
         std::map<optional<std::string>,
                  std::vector<scoped_ptr_t<limit_manager_t>>> limit_clients;
         scoped_ptr_t<rwlock_t> limit_clients_lock;
+        // The filters of the client's range and point subscriptions, by
+        // subscription.  We only send the client the changes one of them wants.
+        std::map<uuid_u, scoped_ptr_t<filter_t> > filters;
+        // The fields of the rows that all of those subscriptions look at, if none
+        // of them needs whole rows.  We only send the client these fields.
+        optional<std::vector<datum_string_t> > projection;
+        // Whether all of those subscriptions squash changes.
+        bool squash;
+        scoped_ptr_t<rwlock_t> filters_lock;
+
+        // The stamped messages we haven't sent to the client yet.  They have the
+        // stamps from `batch_start` to `stamp`, except for the ones we squashed,
+        // which are left empty or dropped.
+        std::vector<std::pair<uint64_t, optional<msg_t> > > pending;
+        uint64_t batch_start;
+        ticks_t batch_started_at;
+        // The positions in `pending` of the changes we can still squash, by
+        // primary key.
+        std::map<store_key_t, size_t> squashable;
+        bool flush_scheduled;
+        // The client's subscriptions that asked for the change log.
+        std::set<uuid_u> log_subs;
     };
     std::map<client_t::addr_t, client_info_t> clients;
 
+    // Returns false if none of the client's subscriptions wants `change`.  Sets
+    // `*projected_out` if they only want some fields of the rows.
+    bool client_wants(client_info_t *info,
+                      const msg_t::change_t &change,
+                      optional<msg_t> *projected_out);
+    static void update_projection(client_info_t *info);
+
     void prune_dead_limit(
         auto_drainer_t::lock_t *stealable_lock,
         scoped_ptr_t<rwlock_in_line_t> *stealable_clients_read_lock,
@@ -551,6 +685,13 @@ private:
     void send_one_with_lock(std::pair<const client_t::addr_t, client_info_t> *client,
                             msg_t msg,
                             const auto_drainer_t::lock_t &lock);
+    // Stamps `msg` and adds it to the client's pending batch.  This doesn't
+    // block.  Returns true if the batch is full and should be sent right away.
+    MUST_USE bool enqueue(std::pair<const client_t::addr_t, client_info_t> *client,
+                          msg_t &&msg,
+                          const auto_drainer_t::lock_t &keepalive);
+    // Takes the client's pending batch.  This doesn't block.
+    stamped_batch_t take_batch(client_info_t *info);
 
     // Controls access to `clients`.  A `server_t` needs to read `clients` when:
     // * `send_all` is called
@@ -566,6 +707,28 @@ private:
     // We need access to the stamp lock that exists on the parent.
     store_t *parent;
 
+    // Every change we send gets the next log position.  Once a subscription has
+    // asked for the log, we also keep the last changes (see `CHANGEFEED_LOG_SIZE`),
+    // so that feeds can resume from a position they've seen.  The log only lives in
+    // memory, and the server gets a new `uuid` when it restarts, so tokens don't
+    // survive a restart.  These are protected by `cfeed_stamp_lock`.
+    struct log_entry_t {
+        uint64_t position;
+        // An estimate of the memory the change takes.
+        size_t size;
+        msg_t::change_t change;
+    };
+    uint64_t log_position;
+    bool keep_log;
+    std::deque<log_entry_t> change_log;
+    size_t change_log_size;
+    // How many subscriptions asked for the log, over all the clients, and when the
+    // last one of them went away.  We drop the log `CHANGEFEED_LOG_KEEP_MS` after
+    // that, so that feeds can still resume after a short disconnect.
+    size_t log_subs;
+    ticks_t log_subs_gone_at;
+    void note_log_subs_gone(size_t count);
+
     auto_drainer_t drainer;
     // Clients send a message to this mailbox with their address when they want
     // to unsubscribe.  The callback of this mailbox acquires the drainer, so it
@@ -575,6 +738,9 @@ private:
     // changefeed.
     mailbox_t<client_t::addr_t, optional<std::string>, uuid_u>
         limit_stop_mailbox;
+    // Clients send a message to this mailbox to unregister the filter of a
+    // particular range or point changefeed.
+    mailbox_t<client_t::addr_t, uuid_u> filter_stop_mailbox;
 };
 
 class artificial_feed_t;
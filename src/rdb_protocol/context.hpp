@@ -15,6 +15,7 @@
 #include "containers/optional.hpp"
 #include "containers/scoped.hpp"
 #include "containers/uuid.hpp"
+#include "paths.hpp"
 #include "perfmon/perfmon.hpp"
 #include "protocol_api.hpp"
 #include "rdb_protocol/changefeed.hpp"
@@ -45,6 +46,7 @@ ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(
 class auth_semilattice_metadata_t;
 class ellipsoid_spec_t;
 class extproc_pool_t;
+class io_backender_t;
 class name_string_t;
 class namespace_interface_t;
 template <class> class cross_thread_watchable_variable_t;
@@ -468,7 +470,9 @@ public:
         std::shared_ptr<semilattice_read_view_t<auth_semilattice_metadata_t>>
             auth_semilattice_view,
         perfmon_collection_t *global_stats,
-        const std::string &_reql_http_proxy);
+        const std::string &_reql_http_proxy,
+        io_backender_t *_io_backender,
+        const base_path_t &_base_path);
 
     ~rdb_context_t();
 
@@ -479,6 +483,11 @@ public:
 
     const std::string reql_http_proxy;
 
+    // Used to spill large sorts to temporary files in `base_path`.  These are
+    // `nullptr` and empty on proxies and in unit tests, which can't spill.
+    io_backender_t *const io_backender;
+    const base_path_t base_path;
+
     class stats_t {
     public:
         explicit stats_t(perfmon_collection_t *global_stats);
@@ -5,6 +5,7 @@
 #include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <algorithm>
 #include <cmath>
@@ -25,10 +26,12 @@
 #include "rdb_protocol/datum_stream/array.hpp"
 #include "rdb_protocol/env.hpp"
 #include "rdb_protocol/error.hpp"
+#include "rdb_protocol/profile.hpp"
 #include "rdb_protocol/pseudo_binary.hpp"
 #include "rdb_protocol/pseudo_geometry.hpp"
 #include "rdb_protocol/pseudo_literal.hpp"
 #include "rdb_protocol/pseudo_time.hpp"
+#include "rdb_protocol/query_resources.hpp"
 #include "rdb_protocol/serialize_datum.hpp"
 #include "rdb_protocol/shards.hpp"
 #include "parsing/utf8.hpp"
@@ -330,26 +333,36 @@ datum_t::datum_t(std::vector<datum_t> &&_array,
                  const configured_limits_t &limits)
     : data(std::move(_array)) {
     rcheck_array_size(*data.r_array, limits);
+    record_datum_allocation(data.r_array->capacity() * sizeof(datum_t));
 }
 
 datum_t::datum_t(std::vector<datum_t> &&_array,
-                 no_array_size_limit_check_t) : data(std::move(_array)) { }
+                 no_array_size_limit_check_t) : data(std::move(_array)) {
+    record_datum_allocation(data.r_array->capacity() * sizeof(datum_t));
+}
 
 datum_t::datum_t(std::map<datum_string_t, datum_t> &&_object,
                  const std::set<std::string> &allowed_pts)
     : data(to_sorted_vec(std::move(_object))) {
+    record_datum_allocation(
+        data.r_object->capacity() * sizeof(std::pair<datum_string_t, datum_t>));
     maybe_sanitize_ptype(allowed_pts);
 }
 
 datum_t::datum_t(std::vector<std::pair<datum_string_t, datum_t> > &&_object,
                  const std::set<std::string> &allowed_pts)
     : data(std::move(_object)) {
+    record_datum_allocation(
+        data.r_object->capacity() * sizeof(std::pair<datum_string_t, datum_t>));
     maybe_sanitize_ptype(allowed_pts);
 }
 
 datum_t::datum_t(std::map<datum_string_t, datum_t> &&_object,
                  no_sanitize_ptype_t)
-    : data(to_sorted_vec(std::move(_object))) { }
+    : data(to_sorted_vec(std::move(_object))) {
+    record_datum_allocation(
+        data.r_object->capacity() * sizeof(std::pair<datum_string_t, datum_t>));
+}
 
 std::vector<std::pair<datum_string_t, datum_t> > datum_t::to_sorted_vec(
         std::map<datum_string_t, datum_t> &&map) {
@@ -476,8 +489,8 @@ datum_t to_datum(const rapidjson::Value &json, const configured_limits_t &limits
                  ++it) {
                 fail_if_invalid(it->name.GetString(),
                                 it->name.GetStringLength());
-                datum_string_t key(it->name.GetStringLength(),
-                                   it->name.GetString());
+                datum_string_t key = intern_datum_string(it->name.GetStringLength(),
+                                                         it->name.GetString());
                 bool dup = builder.add(key, to_datum(it->value, limits, reql_version));
                 rcheck_datum(!dup, base_exc_t::LOGIC,
                              strprintf("Duplicate key %s in JSON.",
@@ -1486,18 +1499,28 @@ std::pair<datum_string_t, datum_t> datum_t::unchecked_get_pair(size_t index) con
     }
 }
 
+datum_string_t datum_t::unchecked_get_key(size_t index) const {
+    if (data.get_internal_type() == internal_type_t::BUF_R_OBJECT) {
+        const size_t offset = datum_get_element_offset(data.buf_ref, index);
+        return datum_string_t(data.buf_ref.make_child(offset));
+    } else {
+        r_sanity_check(data.get_internal_type() == internal_type_t::R_OBJECT);
+        return (*data.r_object)[index].first;
+    }
+}
+
 datum_t datum_t::get_field(const datum_string_t &key, throw_bool_t throw_bool) const {
-    // Use binary search on top of unchecked_get_pair()
+    // Use binary search on top of unchecked_get_key(), so that we only deserialize
+    // the value we're looking for.
     size_t range_beg = 0;
     // The obj_size() also makes sure that this has the right type (R_OBJECT)
     size_t range_end = obj_size();
     while (range_beg < range_end) {
         const size_t center = range_beg + ((range_end - range_beg) / 2);
-        auto center_pair = unchecked_get_pair(center);
-        const int cmp_res = key.compare(center_pair.first);
+        const int cmp_res = key.compare(unchecked_get_key(center));
         if (cmp_res == 0) {
             // Found it
-            return center_pair.second;
+            return unchecked_get_pair(center).second;
         } else if (cmp_res < 0) {
             range_end = center;
         } else {
@@ -1697,8 +1720,12 @@ datum_t datum_t::default_merge_unchecked_stack(const datum_t &rhs) const {
         return rhs.drop_literals(&encountered_literal);
     }
 
-    datum_object_builder_t d(*this);
     const size_t rhs_sz = rhs.obj_size();
+    if (rhs_sz == 0) {
+        // Nothing to merge in, so there's no need to unpack a buffer-backed object.
+        return *this;
+    }
+    datum_object_builder_t d(*this);
     for (size_t i = 0; i < rhs_sz; ++i) {
         auto pair = rhs.unchecked_get_pair(i);
         datum_t sub_lhs = d.try_get(pair.first);
@@ -1739,8 +1766,11 @@ datum_t datum_t::custom_merge_unchecked_stack(const datum_t &rhs,
                        merge_resoluter_t f,
                        const configured_limits_t &limits,
                        std::set<std::string> *conditions_out) const {
-    datum_object_builder_t d(*this);
     const size_t rhs_sz = rhs.obj_size();
+    if (rhs_sz == 0) {
+        return *this;
+    }
+    datum_object_builder_t d(*this);
     for (size_t i = 0; i < rhs_sz; ++i) {
         auto pair = rhs.unchecked_get_pair(i);
         datum_t left = get_field(pair.first, NOTHROW);
@@ -1770,7 +1800,25 @@ int derived_cmp(T a, T b) {
     return a < b ? -1 : 1;
 }
 
+bool datum_t::same_serialization(const datum_t &rhs) const {
+    const internal_type_t internal_type = data.get_internal_type();
+    if (internal_type != rhs.data.get_internal_type()
+        || (internal_type != internal_type_t::BUF_R_OBJECT
+            && internal_type != internal_type_t::BUF_R_ARRAY)) {
+        return false;
+    }
+    const size_t size = datum_get_array_serialized_size(data.buf_ref);
+    return size == datum_get_array_serialized_size(rhs.data.buf_ref)
+        && memcmp(data.buf_ref.get(), rhs.data.buf_ref.get(), size) == 0;
+}
+
 int datum_t::cmp_unchecked_stack(const datum_t &rhs) const {
+    // Rows read from disk are often compared to (copies of) themselves, e.g. by
+    // `distinct` or when checking whether a write changed anything.  Identical
+    // serializations always compare equal, so we don't have to unpack them.
+    if (same_serialization(rhs)) {
+        return 0;
+    }
     bool lhs_ptype = is_ptype() && !pseudo_compares_as_obj();
     bool rhs_ptype = rhs.is_ptype() && !rhs.pseudo_compares_as_obj();
     if (lhs_ptype && rhs_ptype) {
@@ -1811,13 +1859,12 @@ int datum_t::cmp_unchecked_stack(const datum_t &rhs) const {
         const size_t sz = obj_size();
         const size_t rhs_sz = rhs.obj_size();
         while (i < sz && i2 < rhs_sz) {
-            auto pair = unchecked_get_pair(i);
-            auto pair2 = rhs.unchecked_get_pair(i2);
-            int key_cmpval = pair.first.compare(pair2.first);
+            int key_cmpval = unchecked_get_key(i).compare(rhs.unchecked_get_key(i2));
             if (key_cmpval != 0) {
                 return key_cmpval;
             }
-            int val_cmpval = pair.second.cmp(pair2.second);
+            int val_cmpval =
+                unchecked_get_pair(i).second.cmp(rhs.unchecked_get_pair(i2).second);
             if (val_cmpval != 0) {
                 return val_cmpval;
             }
@@ -1840,6 +1887,66 @@ int datum_t::cmp(const datum_t &rhs) const {
         });
 }
 
+static size_t hash_combine(size_t seed, size_t hash) {
+    return seed ^ (hash + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+
+size_t datum_t::hash_unchecked_stack() const {
+    // This has to mirror `cmp_unchecked_stack`.
+    if (is_ptype() && !pseudo_compares_as_obj()) {
+        if (get_type() == R_BINARY) {
+            return hash_combine(R_BINARY, as_binary().hash());
+        } else if (get_reql_type() == pseudo::time_string) {
+            // Times compare by their epoch time only, not by their timezone.
+            return hash_combine(
+                R_OBJECT, datum_t(pseudo::time_to_epoch_time(*this)).hash());
+        }
+        // `cmp` fails for these, so equal hashes will make the caller fail as well.
+        return hash_combine(R_OBJECT, datum_string_t(get_reql_type()).hash());
+    }
+
+    const size_t type_hash = static_cast<size_t>(get_type());
+    switch (get_type()) {
+    case R_NULL: // fallthru
+    case MINVAL: // fallthru
+    case MAXVAL: return type_hash;
+    case R_BOOL: return hash_combine(type_hash, as_bool());
+    case R_NUM: {
+        // `0.0` and `-0.0` compare equal.
+        const double num = as_num() == 0 ? 0.0 : as_num();
+        return hash_combine(type_hash, std::hash<double>()(num));
+    }
+    case R_STR: return hash_combine(type_hash, as_str().hash());
+    case R_ARRAY: {
+        size_t res = type_hash;
+        const size_t sz = arr_size();
+        for (size_t i = 0; i < sz; ++i) {
+            res = hash_combine(res, unchecked_get(i).hash());
+        }
+        return res;
+    }
+    case R_OBJECT: {
+        size_t res = type_hash;
+        const size_t sz = obj_size();
+        for (size_t i = 0; i < sz; ++i) {
+            auto pair = unchecked_get_pair(i);
+            res = hash_combine(res, pair.first.hash());
+            res = hash_combine(res, pair.second.hash());
+        }
+        return res;
+    }
+    case R_BINARY: // This should be handled by the ptype code above
+    case UNINITIALIZED: // fallthru
+    default: unreachable();
+    }
+}
+
+size_t datum_t::hash() const {
+    return call_with_enough_stack_datum<size_t>([&] {
+            return this->hash_unchecked_stack();
+        });
+}
+
 bool datum_t::operator==(const datum_t &rhs) const { return cmp(rhs) == 0; }
 bool datum_t::operator!=(const datum_t &rhs) const { return cmp(rhs) != 0; }
 bool datum_t::operator<(const datum_t &rhs) const { return cmp(rhs) < 0; }
@@ -1893,7 +2000,8 @@ datum_t to_datum(const Datum *d, const configured_limits_t &limits,
         const int count = d->r_object_size();
         for (int i = 0; i < count; ++i) {
             const Datum_AssocPair *ap = &d->r_object(i);
-            datum_string_t key(ap->key());
+            datum_string_t key = intern_datum_string(ap->key().size(),
+                                                     ap->key().data());
             fail_if_invalid(ap->key());
             auto res = map.insert(std::make_pair(key,
                                                  to_datum(&ap->val(), limits,
@@ -2044,9 +2152,14 @@ datum_t stats_merge(UNUSED const datum_string_t &key,
 }
 
 datum_object_builder_t::datum_object_builder_t(const datum_t &copy_from) {
+    if (copy_from.get_buf_ref() != NULL) {
+        profile::record_materialization(profile::materialization_t::OBJECT);
+    }
+    // The pairs come sorted, so each one goes at the end of the map.  The values
+    // of a buffer-backed object stay references into its buffer.
     const size_t copy_from_sz = copy_from.obj_size();
     for (size_t i = 0; i < copy_from_sz; ++i) {
-        map.insert(copy_from.get_pair(i));
+        map.insert(map.end(), copy_from.get_pair(i));
     }
 }
 
@@ -2171,6 +2284,9 @@ datum_t datum_object_builder_t::to_datum(
 datum_array_builder_t::datum_array_builder_t(const datum_t &copy_from,
                                              const configured_limits_t &_limits)
     : limits(_limits) {
+    if (copy_from.get_buf_ref() != NULL) {
+        profile::record_materialization(profile::materialization_t::ARRAY);
+    }
     const size_t copy_from_sz = copy_from.arr_size();
     vector.reserve(copy_from_sz);
     for (size_t i = 0; i < copy_from_sz; ++i) {
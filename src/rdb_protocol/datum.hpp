@@ -317,6 +317,10 @@ public:
     // alphabetically by type name.
     int cmp(const datum_t &rhs) const;
 
+    // Returns the same hash for any two data for which `cmp` returns 0, so that
+    // data can be put into hash tables.
+    size_t hash() const;
+
     // operator== and operator!= don't take a reql_version_t, unlike other comparison
     // functions, because we know (by inspection) that the behavior of cmp() hasn't
     // changed with respect to the question of equality vs. inequality.
@@ -376,6 +380,10 @@ private:
     // For internal use to improve performance.
     std::pair<datum_string_t, datum_t> unchecked_get_pair(size_t index) const;
     datum_t unchecked_get(size_t) const;
+    // Like unchecked_get_pair(index).first, but doesn't deserialize the value.
+    datum_string_t unchecked_get_key(size_t index) const;
+    // Returns true if both datums are backed by byte-identical serializations.
+    bool same_serialization(const datum_t &rhs) const;
 
     datum_t default_merge_unchecked_stack(const datum_t &rhs) const;
     datum_t custom_merge_unchecked_stack(const datum_t &rhs,
@@ -400,6 +408,7 @@ private:
         std::string *str_out) const;
 
     int cmp_unchecked_stack(const datum_t &rhs) const;
+    size_t hash_unchecked_stack() const;
 
     int pseudo_cmp(const datum_t &rhs) const;
     bool pseudo_compares_as_obj() const;
@@ -1,13 +1,17 @@
 // Copyright 2010-2015 RethinkDB, all rights reserved.
 #include "rdb_protocol/datum_stream.hpp"
 
+#include <array>
 #include <map>
 
+#include "containers/disk_backed_queue.hpp"
 #include "rdb_protocol/batching.hpp"
 #include "rdb_protocol/datum_stream/array.hpp"
 #include "rdb_protocol/datum_stream/eq_join.hpp"
+#include "rdb_protocol/datum_stream/external_sort.hpp"
 #include "rdb_protocol/datum_stream/fold.hpp"
 #include "rdb_protocol/datum_stream/indexed_sort.hpp"
+#include "rdb_protocol/datum_stream/join.hpp"
 #include "rdb_protocol/datum_stream/lazy.hpp"
 #include "rdb_protocol/datum_stream/map.hpp"
 #include "rdb_protocol/datum_stream/offsets_of.hpp"
@@ -1622,6 +1626,669 @@ indexed_sort_datum_stream_t::next_raw_batch(env_t *env, const batchspec_t &batch
     return ret;
 }
 
+// Creates a temporary file in the data directory that queries can spill data to.
+static internal_disk_backed_queue_t *make_spill_file(env_t *env,
+                                                     const char *prefix,
+                                                     perfmon_collection_t *stats) {
+    rdb_context_t *rdb_ctx = env->get_rdb_ctx();
+    return new internal_disk_backed_queue_t(
+        rdb_ctx->io_backender,
+        serializer_filepath_t(rdb_ctx->base_path,
+                              prefix + uuid_to_str(generate_uuid())),
+        stats);
+}
+
+// EXTERNAL_SORT_DATUM_STREAM_T
+static datum_t pop_spilled_datum(internal_disk_backed_queue_t *spill, size_t queue_id) {
+    datum_t d;
+    deserializing_viewer_t<datum_t> viewer(&d);
+    spill->pop(queue_id, &viewer);
+    return d;
+}
+
+// Merges a number of runs with a heap.  Earlier runs win ties, which keeps the sort
+// stable.
+class external_sort_datum_stream_t::merger_t {
+public:
+    merger_t(env_t *env,
+             profile::sampler_t *sampler,
+             internal_disk_backed_queue_t *_spill,
+             const std::vector<size_t> &queue_ids,
+             const lt_cmp_func_t &_lt_cmp)
+        : spill(_spill), lt_cmp(_lt_cmp) {
+        for (size_t i = 0; i < queue_ids.size(); ++i) {
+            if (spill->size(queue_ids[i]) != 0) {
+                heap.push_back(
+                    entry_t{pop_spilled_datum(spill, queue_ids[i]), i, queue_ids[i]});
+            }
+        }
+        std::make_heap(heap.begin(), heap.end(), comparator(env, sampler));
+    }
+
+    bool empty() const { return heap.empty(); }
+
+    // Returns the smallest element that hasn't been returned yet.
+    datum_t pop(env_t *env, profile::sampler_t *sampler) {
+        r_sanity_check(!heap.empty());
+        auto cmp = comparator(env, sampler);
+        std::pop_heap(heap.begin(), heap.end(), cmp);
+        datum_t ret = std::move(heap.back().head);
+        if (spill->size(heap.back().queue_id) != 0) {
+            heap.back().head = pop_spilled_datum(spill, heap.back().queue_id);
+            std::push_heap(heap.begin(), heap.end(), cmp);
+        } else {
+            heap.pop_back();
+        }
+        return ret;
+    }
+
+private:
+    struct entry_t {
+        datum_t head;
+        size_t order;
+        size_t queue_id;
+    };
+
+    // `std::make_heap` and friends put the greatest element first, so this returns
+    // true if `a` has to come out after `b`.
+    std::function<bool(const entry_t &, const entry_t &)>
+    comparator(env_t *env, profile::sampler_t *sampler) {
+        return [this, env, sampler](const entry_t &a, const entry_t &b) {
+            if (lt_cmp(env, sampler, b.head, a.head)) {
+                return true;
+            }
+            return !lt_cmp(env, sampler, a.head, b.head) && a.order > b.order;
+        };
+    }
+
+    internal_disk_backed_queue_t *spill;
+    const lt_cmp_func_t &lt_cmp;
+    std::vector<entry_t> heap;
+
+    DISABLE_COPYING(merger_t);
+};
+
+const size_t external_sort_datum_stream_t::MAX_MERGE_FAN_IN;
+
+external_sort_datum_stream_t::external_sort_datum_stream_t(
+    lt_cmp_func_t _lt_cmp, backtrace_id_t _bt)
+    : eager_datum_stream_t(_bt), lt_cmp(std::move(_lt_cmp)) { }
+
+external_sort_datum_stream_t::~external_sort_datum_stream_t() { }
+
+bool external_sort_datum_stream_t::can_spill(env_t *env) {
+    return env->get_rdb_ctx() != nullptr
+        && env->get_rdb_ctx()->io_backender != nullptr;
+}
+
+size_t external_sort_datum_stream_t::new_queue(env_t *env) {
+    if (!spill.has()) {
+        spill.init(make_spill_file(env, "sort_", &perfmon_collection));
+        // The spill file comes with a queue already.
+        return 0;
+    }
+    if (!free_queues.empty()) {
+        size_t queue_id = free_queues.back();
+        free_queues.pop_back();
+        return queue_id;
+    }
+    return spill->add_queue();
+}
+
+// Writes `data` to the end of a queue and clears it.
+static void push_spilled_datums(internal_disk_backed_queue_t *spill,
+                                size_t queue_id,
+                                std::vector<datum_t> *data) {
+    // Write the data in chunks, so that we don't need a transaction per datum.
+    const size_t CHUNK_SIZE = 1024;
+    for (size_t i = 0; i < data->size(); i += CHUNK_SIZE) {
+        scoped_array_t<write_message_t> wms(std::min(CHUNK_SIZE, data->size() - i));
+        for (size_t j = 0; j < wms.size(); ++j) {
+            serialize<cluster_version_t::LATEST_OVERALL>(&wms[j], (*data)[i + j]);
+            (*data)[i + j].reset();
+        }
+        spill->push(queue_id, wms);
+    }
+    data->clear();
+}
+
+void external_sort_datum_stream_t::write_run(size_t queue_id,
+                                             std::vector<datum_t> *data) {
+    push_spilled_datums(spill.get(), queue_id, data);
+}
+
+void external_sort_datum_stream_t::merge_runs(env_t *env, size_t begin) {
+    r_sanity_check(begin < runs.size());
+    profile::sampler_t sampler("Merging sorted runs on disk.", env->trace);
+    std::vector<size_t> queue_ids;
+    size_t level = 0;
+    for (size_t i = begin; i < runs.size(); ++i) {
+        queue_ids.push_back(runs[i].queue_id);
+        level = std::max(level, runs[i].level + 1);
+    }
+    const size_t out = new_queue(env);
+    {
+        merger_t merger(env, &sampler, spill.get(), queue_ids, lt_cmp);
+        std::vector<datum_t> chunk;
+        while (!merger.empty()) {
+            chunk.push_back(merger.pop(env, &sampler));
+            if (chunk.size() == 1024 || merger.empty()) {
+                write_run(out, &chunk);
+                if (env->interruptor->is_pulsed()) {
+                    throw interrupted_exc_t();
+                }
+            }
+        }
+    }
+    free_queues.insert(free_queues.end(), queue_ids.begin(), queue_ids.end());
+    runs.resize(begin);
+    runs.push_back(run_t{out, level});
+}
+
+void external_sort_datum_stream_t::add_run(env_t *env, std::vector<datum_t> &&data) {
+    r_sanity_check(can_spill(env));
+    r_sanity_check(!merger.has());
+    {
+        profile::sampler_t sampler("Sorting in-memory.", env->trace);
+        std::stable_sort(data.begin(), data.end(),
+                         std::bind(lt_cmp, env, &sampler, ph::_1, ph::_2));
+    }
+    {
+        profile::starter_t starter("Writing sorted run to disk.", env->trace);
+        const size_t queue_id = new_queue(env);
+        write_run(queue_id, &data);
+        runs.push_back(run_t{queue_id, 0});
+    }
+    // Runs only ever get merged with their neighbours, so that ties are still
+    // broken by the order of the input.  The levels of the runs never increase from
+    // the first run to the last one.
+    for (;;) {
+        size_t same_level = 0;
+        while (same_level < runs.size()
+               && runs[runs.size() - 1 - same_level].level == runs.back().level) {
+            ++same_level;
+        }
+        if (same_level < MAX_MERGE_FAN_IN) {
+            break;
+        }
+        merge_runs(env, runs.size() - MAX_MERGE_FAN_IN);
+    }
+}
+
+bool external_sort_datum_stream_t::is_exhausted() const {
+    if (merger.has() ? !merger->empty() : !runs.empty()) {
+        return false;
+    }
+    return batch_cache_exhausted();
+}
+feed_type_t external_sort_datum_stream_t::cfeed_type() const {
+    return feed_type_t::not_feed;
+}
+bool external_sort_datum_stream_t::is_infinite() const {
+    return false;
+}
+
+std::vector<datum_t>
+external_sort_datum_stream_t::next_raw_batch(env_t *env, const batchspec_t &batchspec) {
+    std::vector<datum_t> ret;
+    batcher_t batcher = batchspec.to_batcher();
+
+    if (!merger.has()) {
+        // Bring the number of runs down to at most `MAX_MERGE_FAN_IN`.
+        while (runs.size() > MAX_MERGE_FAN_IN) {
+            merge_runs(env, runs.size()
+                            - std::min(MAX_MERGE_FAN_IN,
+                                       runs.size() - MAX_MERGE_FAN_IN + 1));
+        }
+        profile::sampler_t sampler("Merging sorted runs.", env->trace);
+        std::vector<size_t> queue_ids;
+        for (const run_t &run : runs) {
+            queue_ids.push_back(run.queue_id);
+        }
+        merger.init(new merger_t(env, &sampler, spill.get(), queue_ids, lt_cmp));
+    }
+
+    profile::sampler_t sampler("Merging sorted runs.", env->trace);
+    while (!batcher.should_send_batch() && !merger->empty()) {
+        datum_t d = merger->pop(env, &sampler);
+        batcher.note_el(d);
+        ret.push_back(std::move(d));
+    }
+    return ret;
+}
+
+// JOIN_DATUM_STREAM_T
+static datum_t make_join_row(const datum_t &left, const datum_t &right) {
+    datum_object_builder_t builder;
+    bool conflict = builder.add("left", left);
+    if (right.has()) {
+        conflict |= builder.add("right", right);
+    }
+    guarantee(!conflict);
+    return std::move(builder).to_datum();
+}
+
+/* Once the right sequence of an equality join turns out to be bigger than the array
+   size limit, both sides get written to disk, and then split into partitions by the
+   hash of their keys.  Each partition is joined on its own, with a hash table on its
+   right rows, or by scanning them again for every left row if too many of them have
+   the same key.  The joined rows of every partition are tagged with the position of
+   their left row, and merging the partitions by that position puts them back into
+   the order of the left rows. */
+class join_datum_stream_t::spilled_join_t {
+public:
+    spilled_join_t(env_t *env, const join_datum_stream_t *_parent)
+        : parent(_parent),
+          spill(make_spill_file(env, "join_", &perfmon_collection)),
+          staged{spill->add_queue(), spill->add_queue()} { }
+
+    // Writes rows to disk as they are, before we know how many partitions we need.
+    void stage(env_t *env, side_t side, std::vector<datum_t> *rows) {
+        push_spilled_datums(spill.get(), staged[side], rows);
+        if (env->interruptor->is_pulsed()) {
+            throw interrupted_exc_t();
+        }
+    }
+
+    // Splits the staged rows into partitions that are small enough to be joined in
+    // memory, unless many rows have the same key, and joins them.
+    void join(env_t *env) {
+        const size_t limit = env->limits().array_size_limit();
+        const size_t num_partitions =
+            clamp<size_t>(2 * spill->size(staged[RIGHT]) / limit + 1, 1, 1024);
+        for (size_t i = 0; i < num_partitions; ++i) {
+            partitions.push_back({{spill->add_queue(), spill->add_queue()}});
+        }
+        // Buffers a few rows per partition, so that we don't write them one by one.
+        const size_t max_buffered = std::max<size_t>(1, 8192 / num_partitions);
+        for (side_t side : {LEFT, RIGHT}) {
+            const counted_t<const func_t> &key_func =
+                side == LEFT ? parent->left_key : parent->right_key;
+            std::vector<std::vector<datum_t> > buffers(num_partitions);
+            uint64_t position = 0;
+            while (spill->size(staged[side]) != 0) {
+                datum_t row = pop_spilled_datum(spill.get(), staged[side]);
+                datum_t key = key_func->call(env, row)->as_datum();
+                size_t p = optional_datum_hash_t()(key) % num_partitions;
+                std::vector<datum_t> entry{key, row};
+                if (side == LEFT) {
+                    entry.push_back(datum_t(static_cast<double>(position++)));
+                }
+                buffers[p].push_back(datum_t(std::move(entry),
+                                             datum_t::no_array_size_limit_check_t()));
+                if (buffers[p].size() >= max_buffered) {
+                    push_spilled_datums(spill.get(), partitions[p][side], &buffers[p]);
+                    if (env->interruptor->is_pulsed()) {
+                        throw interrupted_exc_t();
+                    }
+                }
+            }
+            for (size_t p = 0; p < num_partitions; ++p) {
+                push_spilled_datums(spill.get(), partitions[p][side], &buffers[p]);
+            }
+        }
+
+        for (size_t p = 0; p < num_partitions; ++p) {
+            join_partition(env, p);
+            if (spill->size(outputs[p]) != 0) {
+                heap.push_back(entry_t{pop_spilled_datum(spill.get(), outputs[p]), p});
+            }
+        }
+        std::make_heap(heap.begin(), heap.end(), &entry_t::comes_after);
+    }
+
+    bool is_exhausted() const {
+        return heap.empty();
+    }
+
+    // Returns the joined rows in the order of their left rows.
+    void next_rows(env_t *env, const batchspec_t &batchspec, std::vector<datum_t> *out) {
+        batcher_t batcher = batchspec.to_batcher();
+        while (!batcher.should_send_batch() && !heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), &entry_t::comes_after);
+            datum_t row = heap.back().head.get(1);
+            const size_t output = outputs[heap.back().partition];
+            if (spill->size(output) != 0) {
+                heap.back().head = pop_spilled_datum(spill.get(), output);
+                std::push_heap(heap.begin(), heap.end(), &entry_t::comes_after);
+            } else {
+                heap.pop_back();
+            }
+            batcher.note_el(row);
+            out->push_back(std::move(row));
+        }
+        if (env->interruptor->is_pulsed()) {
+            throw interrupted_exc_t();
+        }
+    }
+
+private:
+    // Writes the joined rows of partition `p` to `outputs[p]`, as `[position, row]`
+    // pairs in the order of their left rows.
+    void join_partition(env_t *env, size_t p) {
+        const size_t left_queue = partitions[p][LEFT];
+        const size_t right_queue = partitions[p][RIGHT];
+        outputs.push_back(spill->add_queue());
+
+        const bool in_memory = static_cast<size_t>(spill->size(right_queue))
+            <= env->limits().array_size_limit();
+        std::vector<datum_t> right_rows;
+        std::unordered_map<datum_t,
+                           std::vector<size_t>,
+                           optional_datum_hash_t,
+                           optional_datum_equal_t> index;
+        if (in_memory) {
+            while (spill->size(right_queue) != 0) {
+                datum_t pair = pop_spilled_datum(spill.get(), right_queue);
+                index[pair.get(0)].push_back(right_rows.size());
+                right_rows.push_back(pair.get(1));
+            }
+        }
+
+        std::vector<datum_t> joined;
+        while (spill->size(left_queue) != 0) {
+            datum_t entry = pop_spilled_datum(spill.get(), left_queue);
+            const datum_t key = entry.get(0);
+            const datum_t left = entry.get(1);
+            const datum_t position = entry.get(2);
+            bool matched = false;
+            auto emit = [&](const datum_t &right) {
+                joined.push_back(
+                    datum_t(std::vector<datum_t>{position, make_join_row(left, right)},
+                            datum_t::no_array_size_limit_check_t()));
+            };
+            if (in_memory) {
+                auto it = index.find(key);
+                if (it != index.end()) {
+                    for (size_t i : it->second) {
+                        emit(right_rows[i]);
+                    }
+                    matched = true;
+                }
+            } else {
+                matched = scan_right(right_queue, key, emit);
+            }
+            if (parent->outer && !matched) {
+                emit(datum_t());
+            }
+            if (joined.size() >= 1024) {
+                push_spilled_datums(spill.get(), outputs[p], &joined);
+                if (env->interruptor->is_pulsed()) {
+                    throw interrupted_exc_t();
+                }
+            }
+        }
+        push_spilled_datums(spill.get(), outputs[p], &joined);
+    }
+
+    // Calls `emit` on every row of `queue` with the key `key`, and puts the rows back
+    // in the same order.  Returns true if there were any.
+    template <class callable_t>
+    bool scan_right(size_t queue, const datum_t &key, const callable_t &emit) {
+        bool matched = false;
+        std::vector<datum_t> scanned;
+        for (int64_t i = spill->size(queue); i > 0; --i) {
+            datum_t pair = pop_spilled_datum(spill.get(), queue);
+            if (optional_datum_equal_t()(pair.get(0), key)) {
+                emit(pair.get(1));
+                matched = true;
+            }
+            scanned.push_back(std::move(pair));
+            if (scanned.size() >= 1024) {
+                push_spilled_datums(spill.get(), queue, &scanned);
+            }
+        }
+        push_spilled_datums(spill.get(), queue, &scanned);
+        return matched;
+    }
+
+    struct entry_t {
+        // The next `[position, row]` pair of `outputs[partition]`.
+        datum_t head;
+        size_t partition;
+
+        // `std::make_heap` puts the greatest element first, so this returns true if
+        // `a` has to come out after `b`.  No two partitions share a left row.
+        static bool comes_after(const entry_t &a, const entry_t &b) {
+            return a.head.get(0).as_num() > b.head.get(0).as_num();
+        }
+    };
+
+    const join_datum_stream_t *parent;
+    perfmon_collection_t perfmon_collection;
+    scoped_ptr_t<internal_disk_backed_queue_t> spill;
+
+    // The queues of the staged rows, and of the partitions, for each side.  The
+    // partitions hold `[key, row]` pairs for the right side and
+    // `[key, row, position]` triples for the left side.
+    const std::array<size_t, 2> staged;
+    std::vector<std::array<size_t, 2> > partitions;
+    // The joined rows of every partition.
+    std::vector<size_t> outputs;
+    std::vector<entry_t> heap;
+
+    DISABLE_COPYING(spilled_join_t);
+};
+
+join_datum_stream_t::join_datum_stream_t(counted_t<datum_stream_t> left,
+                                         counted_t<const func_t> _right_func,
+                                         counted_t<datum_stream_t> _right,
+                                         counted_t<const func_t> _predicate,
+                                         counted_t<const func_t> _left_key,
+                                         counted_t<const func_t> _right_key,
+                                         bool _outer)
+    : wrapper_datum_stream_t(left),
+      right_func(std::move(_right_func)),
+      right(std::move(_right)),
+      predicate(std::move(_predicate)),
+      left_key(std::move(_left_key)),
+      right_key(std::move(_right_key)),
+      outer(_outer),
+      started(false),
+      use_index(false),
+      streaming(false),
+      current_matched(false) {
+    guarantee(right_func.has() != right.has());
+    guarantee(left_key.has() == right_key.has());
+}
+
+join_datum_stream_t::~join_datum_stream_t() { }
+
+bool join_datum_stream_t::is_exhausted() const {
+    if (spilled.has()) {
+        return spilled->is_exhausted() && batch_cache_exhausted();
+    }
+    return source->is_exhausted() && pending_left.empty() && batch_cache_exhausted();
+}
+
+void join_datum_stream_t::load_right(env_t *env, std::vector<datum_t> *first_left) {
+    r_sanity_check(!started);
+    started = true;
+    if (!right.has()) {
+        right = right_func->call(env)->as_seq(env);
+    }
+    if (right->is_infinite()) {
+        rcheck(right_func.has(), base_exc_t::LOGIC,
+               "Cannot use an infinite stream as the right side of a join.");
+        start_streaming();
+        return;
+    }
+    batchspec_t batchspec = batchspec_t::user(batch_type_t::TERMINAL, env);
+    for (;;) {
+        std::vector<datum_t> batch = right->next_batch(env, batchspec);
+        if (batch.empty()) {
+            break;
+        }
+        std::move(batch.begin(), batch.end(), std::back_inserter(right_rows));
+        if (right_rows.size() > env->limits().array_size_limit()) {
+            // Only equality joins can be split into partitions.
+            if (left_key.has()
+                && external_sort_datum_stream_t::can_spill(env)
+                && !source->is_infinite()) {
+                spill(env, first_left);
+            } else if (right_func.has()) {
+                start_streaming();
+            } else {
+                // We can't evaluate a right sequence from `r.args` again.
+                rcheck_array_size(right_rows, env->limits());
+            }
+            return;
+        }
+    }
+    right.reset();
+
+    if (left_key.has()) {
+        use_index = true;
+        for (size_t i = 0; i < right_rows.size(); ++i) {
+            datum_t key;
+            try {
+                key = right_key->call(env, right_rows[i])->as_datum();
+            } catch (const base_exc_t &) {
+                // Comparing every pair of rows will produce the same error that the
+                // predicate always produced.
+                use_index = false;
+                right_index.clear();
+                break;
+            }
+            right_index[key].push_back(i);
+        }
+    }
+}
+
+void join_datum_stream_t::spill(env_t *env, std::vector<datum_t> *first_left) {
+    r_sanity_check(!source->is_infinite());
+    profile::starter_t starter("Writing join inputs to disk.", env->trace);
+    spilled.init(new spilled_join_t(env, this));
+    batchspec_t batchspec = batchspec_t::user(batch_type_t::TERMINAL, env);
+    spilled->stage(env, RIGHT, &right_rows);
+    for (;;) {
+        std::vector<datum_t> batch = right->next_batch(env, batchspec);
+        if (batch.empty()) {
+            break;
+        }
+        spilled->stage(env, RIGHT, &batch);
+    }
+    right.reset();
+    spilled->stage(env, LEFT, first_left);
+    for (;;) {
+        std::vector<datum_t> batch = source->next_batch(env, batchspec);
+        if (batch.empty()) {
+            break;
+        }
+        spilled->stage(env, LEFT, &batch);
+    }
+    spilled->join(env);
+}
+
+void join_datum_stream_t::start_streaming() {
+    streaming = true;
+    right.reset();
+    right_rows.clear();
+    right_rows.shrink_to_fit();
+}
+
+void join_datum_stream_t::join_row(env_t *env,
+                                   const datum_t &left,
+                                   std::vector<datum_t> *out) {
+    if (use_index) {
+        if (right_rows.empty()) {
+            return;
+        }
+        auto it = right_index.find(left_key->call(env, left)->as_datum());
+        if (it != right_index.end()) {
+            for (size_t i : it->second) {
+                out->push_back(make_join_row(left, right_rows[i]));
+            }
+        }
+    } else {
+        for (const auto &row : right_rows) {
+            if (predicate->call(env, left, row)->as_bool()) {
+                out->push_back(make_join_row(left, row));
+            }
+        }
+    }
+}
+
+void join_datum_stream_t::stream_rows(env_t *env,
+                                      const batchspec_t &batchspec,
+                                      std::vector<datum_t> *out) {
+    batcher_t batcher = batchspec.to_batcher();
+    while (!batcher.should_send_batch()) {
+        if (pending_left.empty()) {
+            std::vector<datum_t> v = source->next_batch(env, batchspec);
+            if (v.empty()) {
+                break;
+            }
+            std::move(v.begin(), v.end(), std::back_inserter(pending_left));
+        }
+        const datum_t &left = pending_left.front();
+        if (!current_right.has()) {
+            current_right = right_func->call(env)->as_seq(env);
+            current_matched = false;
+        }
+        std::vector<datum_t> batch = current_right->next_batch(env, batchspec);
+        if (batch.empty()) {
+            if (outer && !current_matched) {
+                out->push_back(make_join_row(left, datum_t()));
+                batcher.note_el(out->back());
+            }
+            current_right.reset();
+            pending_left.pop_front();
+            continue;
+        }
+        for (const auto &row : batch) {
+            if (predicate->call(env, left, row)->as_bool()) {
+                out->push_back(make_join_row(left, row));
+                batcher.note_el(out->back());
+                current_matched = true;
+            }
+        }
+        // An infinite right sequence might never match anything.
+        if (env->interruptor->is_pulsed()) {
+            throw interrupted_exc_t();
+        }
+    }
+}
+
+std::vector<datum_t>
+join_datum_stream_t::next_raw_batch(env_t *env, const batchspec_t &batchspec) {
+    std::vector<datum_t> ret;
+    profile::sampler_t sampler("Joining.", env->trace);
+    if (spilled.has()) {
+        spilled->next_rows(env, batchspec, &ret);
+        return ret;
+    }
+    if (streaming) {
+        stream_rows(env, batchspec, &ret);
+        return ret;
+    }
+    while (ret.size() == 0) {
+        std::vector<datum_t> v = source->next_batch(env, batchspec);
+        if (v.size() == 0) break;
+        if (!started) {
+            load_right(env, &v);
+            if (spilled.has()) {
+                spilled->next_rows(env, batchspec, &ret);
+                return ret;
+            }
+            if (streaming) {
+                std::move(v.begin(), v.end(), std::back_inserter(pending_left));
+                stream_rows(env, batchspec, &ret);
+                return ret;
+            }
+        }
+        for (const auto &left : v) {
+            size_t old_size = ret.size();
+            join_row(env, left, &ret);
+            if (outer && ret.size() == old_size) {
+                ret.push_back(make_join_row(left, datum_t()));
+            }
+            sampler.new_sample();
+        }
+    }
+    return ret;
+}
+
 // ORDERED_DISTINCT_DATUM_STREAM_T
 ordered_distinct_datum_stream_t::ordered_distinct_datum_stream_t(
     counted_t<datum_stream_t> _source) : wrapper_datum_stream_t(_source) { }
@@ -0,0 +1,76 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#ifndef RDB_PROTOCOL_DATUM_STREAM_EXTERNAL_SORT_HPP_
+#define RDB_PROTOCOL_DATUM_STREAM_EXTERNAL_SORT_HPP_
+
+#include <functional>
+#include <vector>
+
+#include "perfmon/core.hpp"
+#include "rdb_protocol/datum_stream.hpp"
+
+class internal_disk_backed_queue_t;
+class rdb_context_t;
+
+namespace ql {
+
+/* An unindexed `orderBy` on more data than fits into an array sorts the data in runs
+   of at most `array_limit` elements each, which get spilled to a temporary file on
+   disk.  All runs share the one file.  Whenever `MAX_MERGE_FAN_IN` runs of the same
+   size have piled up, they get merged into one bigger run, so there are never more
+   than a few dozen runs and each element is only rewritten a logarithmic number of
+   times.  `external_sort_datum_stream_t` then lazily merges the remaining runs.  The
+   sort is stable, just like the in-memory one: ties are broken by the order of the
+   runs. */
+class external_sort_datum_stream_t : public eager_datum_stream_t {
+public:
+    typedef std::function<bool(env_t *,  // NOLINT(readability/casting)
+                               profile::sampler_t *,
+                               const datum_t &,
+                               const datum_t &)> lt_cmp_func_t;
+
+    external_sort_datum_stream_t(lt_cmp_func_t _lt_cmp, backtrace_id_t bt);
+    ~external_sort_datum_stream_t();
+
+    // Returns true if the server can spill sorts to disk.  Proxies can't.
+    static bool can_spill(env_t *env);
+
+    // Sorts `data` and writes it to disk as the next run.
+    void add_run(env_t *env, std::vector<datum_t> &&data);
+
+    virtual bool is_exhausted() const;
+    virtual feed_type_t cfeed_type() const;
+    virtual bool is_infinite() const;
+
+    static const size_t MAX_MERGE_FAN_IN = 16;
+
+private:
+    // A sorted run, stored in one of the queues of `spill`.  A run of level `n + 1`
+    // is the result of merging `MAX_MERGE_FAN_IN` runs of level `n`.
+    struct run_t {
+        size_t queue_id;
+        size_t level;
+    };
+    class merger_t;
+
+    virtual bool is_array() const { return false; }
+    virtual std::vector<datum_t>
+    next_raw_batch(env_t *env, const batchspec_t &batchspec);
+
+    size_t new_queue(env_t *env);
+    void write_run(size_t queue_id, std::vector<datum_t> *data);
+    // Merges `runs[begin]` to the last run into a single run.
+    void merge_runs(env_t *env, size_t begin);
+
+    lt_cmp_func_t lt_cmp;
+    perfmon_collection_t perfmon_collection;
+    scoped_ptr_t<internal_disk_backed_queue_t> spill;
+    // The queues of `spill` that are empty and can be used for new runs.
+    std::vector<size_t> free_queues;
+    std::vector<run_t> runs;
+    // The final merge, which gets set up by the first call to `next_raw_batch`.
+    scoped_ptr_t<merger_t> merger;
+};
+
+}  // namespace ql
+
+#endif  // RDB_PROTOCOL_DATUM_STREAM_EXTERNAL_SORT_HPP_
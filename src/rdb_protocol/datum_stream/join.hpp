@@ -0,0 +1,89 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#ifndef RDB_PROTOCOL_DATUM_STREAM_JOIN_HPP_
+#define RDB_PROTOCOL_DATUM_STREAM_JOIN_HPP_
+
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "containers/scoped.hpp"
+#include "rdb_protocol/datum_stream.hpp"
+#include "rdb_protocol/datum_utils.hpp"
+
+namespace ql {
+
+/* `inner_join` and `outer_join` used to be rewritten into a `concat_map` that
+   evaluated the right sequence again, and called the predicate on every row of it,
+   for every left row.  `join_datum_stream_t` reads the right sequence once and keeps
+   it in memory.  If the predicate is an equality between an expression of the left
+   row and one of the right row (`left_key` and `right_key`), the right rows are put
+   into a hash table by their key and every left row only looks at the rows with the
+   same key.  The rows come out in the same order as before.
+
+   If the right sequence of an equality join doesn't fit into an array, both
+   sequences get spilled to disk and joined in partitions (see `spilled_join_t`).
+   Other joins with such a right sequence, and joins with an infinite one, fall back
+   to evaluating the right sequence again for every left row, like the rewrite did. */
+class join_datum_stream_t : public wrapper_datum_stream_t {
+public:
+    // Exactly one of `right_func` (which evaluates the right sequence) and `right`
+    // must be given.  `left_key` and `right_key` are either both empty or not.
+    join_datum_stream_t(counted_t<datum_stream_t> left,
+                        counted_t<const func_t> right_func,
+                        counted_t<datum_stream_t> right,
+                        counted_t<const func_t> predicate,
+                        counted_t<const func_t> left_key,
+                        counted_t<const func_t> right_key,
+                        bool outer);
+    ~join_datum_stream_t();
+
+private:
+    enum side_t { LEFT = 0, RIGHT = 1 };
+    class spilled_join_t;
+
+    virtual bool is_exhausted() const;
+    std::vector<datum_t>
+    next_raw_batch(env_t *env, const batchspec_t &batchspec);
+
+    // Reads the right sequence into `right_rows`, and builds `right_index` if we
+    // have keys.  If the right sequence is too big, spills both sequences to disk
+    // instead, starting with `first_left`.
+    void load_right(env_t *env, std::vector<datum_t> *first_left);
+    void spill(env_t *env, std::vector<datum_t> *first_left);
+    void start_streaming();
+    // Appends the joined rows for `left` to `out`.
+    void join_row(env_t *env, const datum_t &left, std::vector<datum_t> *out);
+    // Appends the joined rows of the pending left rows to `out`, evaluating the right
+    // sequence again for each of them.
+    void stream_rows(env_t *env, const batchspec_t &batchspec, std::vector<datum_t> *out);
+
+    counted_t<const func_t> right_func;
+    counted_t<datum_stream_t> right;
+    counted_t<const func_t> predicate;
+    counted_t<const func_t> left_key, right_key;
+    bool outer;
+
+    bool started;
+    std::vector<datum_t> right_rows;
+    // Maps a key to the indices of the right rows that have it, in order.
+    bool use_index;
+    std::unordered_map<datum_t,
+                       std::vector<size_t>,
+                       optional_datum_hash_t,
+                       optional_datum_equal_t> right_index;
+
+    // Set if the right sequence is evaluated again for every left row.  The left
+    // rows we haven't finished yet are in `pending_left`, and the right sequence of
+    // the first one is `current_right`.
+    bool streaming;
+    std::deque<datum_t> pending_left;
+    counted_t<datum_stream_t> current_right;
+    bool current_matched;
+
+    // Set once the sequences have been spilled to disk.
+    scoped_ptr_t<spilled_join_t> spilled;
+};
+
+}  // namespace ql
+
+#endif  // RDB_PROTOCOL_DATUM_STREAM_JOIN_HPP_
@@ -13,21 +13,33 @@
 #include "containers/archive/varint.hpp"
 #include "containers/scoped.hpp"
 #include "debug.hpp"
+#include "rdb_protocol/query_resources.hpp"
+#include "thread_local.hpp"
 #include "utils.hpp"
 
+static_assert(sizeof(const shared_buf_t *) + sizeof(uint32_t)
+                  <= datum_string_t::MAX_INLINE_SIZE,
+              "datum_string_t::storage_ is too small for a shared buffer reference");
+static_assert(datum_string_t::MAX_INLINE_SIZE < UINT8_MAX,
+              "datum_string_t's tag can't hold the size of inline strings");
+static_assert(sizeof(datum_string_t) == 16,
+              "datum_string_t shouldn't make datum_t any bigger");
+
 datum_string_t::datum_string_t() {
-    init(0, "");
+    set_tag(0);
 }
 
 datum_string_t::datum_string_t(size_t _size, const char *_data) {
     init(_size, _data);
 }
 
-datum_string_t::datum_string_t(const shared_buf_ref_t<char> &_ref)
-    : data_(_ref) { }
+datum_string_t::datum_string_t(const shared_buf_ref_t<char> &_ref) {
+    init_shared(shared_buf_ref_t<char>(_ref));
+}
 
-datum_string_t::datum_string_t(shared_buf_ref_t<char> &&_ref)
-    : data_(std::move(_ref)) { }
+datum_string_t::datum_string_t(shared_buf_ref_t<char> &&_ref) {
+    init_shared(std::move(_ref));
+}
 
 datum_string_t::datum_string_t(const char *c_str) {
     init(strlen(c_str), c_str);
@@ -37,25 +49,126 @@ datum_string_t::datum_string_t(const std::string &str) {
     init(str.size(), str.data());
 }
 
+datum_string_t::datum_string_t(const datum_string_t &copyee) {
+    assign_copy(copyee);
+}
+
+datum_string_t::datum_string_t(datum_string_t &&movee) noexcept {
+    assign_move(std::move(movee));
+}
+
+datum_string_t::~datum_string_t() {
+    destruct();
+}
+
+datum_string_t &datum_string_t::operator=(const datum_string_t &copyee) {
+    if (this != &copyee) {
+        destruct();
+        assign_copy(copyee);
+    }
+    return *this;
+}
+
+datum_string_t &datum_string_t::operator=(datum_string_t &&movee) noexcept {
+    if (this != &movee) {
+        destruct();
+        assign_move(std::move(movee));
+    }
+    return *this;
+}
+
 void datum_string_t::init(size_t _size, const char *_data) {
+    if (_size <= MAX_INLINE_SIZE) {
+        memcpy(storage_, _data, _size);
+        set_tag(static_cast<uint8_t>(_size));
+        return;
+    }
     const size_t str_offset = varint_uint64_serialized_size(_size);
     counted_t<shared_buf_t> buffer = shared_buf_t::create(str_offset + _size);
+    ql::record_datum_allocation(str_offset + _size);
     serialize_varint_uint64_into_buf(_size, reinterpret_cast<uint8_t *>(buffer->data()));
     memcpy(buffer->data() + str_offset, _data, _size);
-    data_ = shared_buf_ref_t<char>(std::move(buffer), 0);
+    init_shared(shared_buf_ref_t<char>(std::move(buffer), 0));
+}
+
+void datum_string_t::init_shared(shared_buf_ref_t<char> &&ref) {
+    if (ref.get_offset() > std::numeric_limits<uint32_t>::max()) {
+        // The offset doesn't fit, so we copy the string into a buffer of its own.
+        uint64_t str_size = 0;
+        buffer_read_stream_t data_stream(ref.get(), ref.get_safety_boundary());
+        guarantee_deserialization(deserialize_varint_uint64(&data_stream, &str_size),
+                                  "wire_string size");
+        const size_t data_offset = varint_uint64_serialized_size(str_size);
+        ref.guarantee_in_boundary(data_offset + str_size);
+        init(static_cast<size_t>(str_size), ref.get() + data_offset);
+        return;
+    }
+    const shared_buf_t *buf = ref.get_buf().get();
+    const uint32_t offset = static_cast<uint32_t>(ref.get_offset());
+    counted_add_ref(buf);
+    memcpy(storage_, &buf, sizeof(buf));
+    memcpy(storage_ + sizeof(buf), &offset, sizeof(offset));
+    set_tag(SHARED_TAG);
+}
+
+const shared_buf_t *datum_string_t::shared_buf() const {
+    const shared_buf_t *buf;
+    memcpy(&buf, storage_, sizeof(buf));
+    return buf;
+}
+
+size_t datum_string_t::shared_offset() const {
+    uint32_t offset;
+    memcpy(&offset, storage_ + sizeof(const shared_buf_t *), sizeof(offset));
+    return offset;
+}
+
+const char *datum_string_t::shared_data() const {
+    return shared_buf()->data(shared_offset());
+}
+
+size_t datum_string_t::shared_safety_boundary() const {
+    const shared_buf_t *buf = shared_buf();
+    rassert(buf->size() >= shared_offset());
+    return buf->size() - shared_offset();
+}
+
+void datum_string_t::assign_copy(const datum_string_t &copyee) {
+    if (copyee.is_shared()) {
+        counted_add_ref(copyee.shared_buf());
+    }
+    memcpy(storage_, copyee.storage_, sizeof(storage_));
+}
+
+void datum_string_t::assign_move(datum_string_t &&movee) noexcept {
+    memcpy(storage_, movee.storage_, sizeof(storage_));
+    // Leave `movee` as an empty string, which doesn't hold the buffer anymore.
+    movee.set_tag(0);
+}
+
+void datum_string_t::destruct() {
+    if (is_shared()) {
+        counted_release(shared_buf());
+    }
 }
 
 const char *datum_string_t::data() const {
+    if (!is_shared()) {
+        return storage_;
+    }
     const size_t str_size = size();
     size_t data_offset = varint_uint64_serialized_size(str_size);
-    data_.guarantee_in_boundary(data_offset + str_size);
-    return data_.get() + data_offset;
+    guarantee(shared_safety_boundary() >= data_offset + str_size);
+    return shared_data() + data_offset;
 }
 
 size_t datum_string_t::size() const {
+    if (!is_shared()) {
+        return tag();
+    }
     uint64_t res = 0;
     static_assert(sizeof(uint8_t) == sizeof(char), "sizeof(uint8_t) != sizeof(char)");
-    buffer_read_stream_t data_stream(data_.get(), data_.get_safety_boundary());
+    buffer_read_stream_t data_stream(shared_data(), shared_safety_boundary());
     guarantee_deserialization(deserialize_varint_uint64(&data_stream, &res),
                               "wire_string size");
     guarantee(res <= static_cast<uint64_t>(std::numeric_limits<size_t>::max()));
@@ -89,6 +202,19 @@ int datum_string_t::compare(size_t other_size, const char *other_data) const {
     }
 }
 
+static size_t hash_bytes(size_t size, const char *data) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ static_cast<uint8_t>(data[i])) * 1099511628211ull;
+    }
+    return static_cast<size_t>(hash);
+}
+
+size_t datum_string_t::hash() const {
+    return hash_bytes(size(), data());
+}
+
 bool datum_string_t::operator==(const char *other) const {
     return compare(strlen(other), other) == 0;
 }
@@ -126,8 +252,15 @@ std::string datum_string_t::to_std() const {
 datum_string_t concat(const datum_string_t &a, const datum_string_t &b) {
     const size_t a_size = a.size();
     const size_t b_size = b.size();
+    if (a_size + b_size <= datum_string_t::MAX_INLINE_SIZE) {
+        char buf[datum_string_t::MAX_INLINE_SIZE];
+        memcpy(buf, a.data(), a_size);
+        memcpy(buf + a_size, b.data(), b_size);
+        return datum_string_t(a_size + b_size, buf);
+    }
     const size_t str_offset = varint_uint64_serialized_size(a_size + b_size);
     counted_t<shared_buf_t> buf = shared_buf_t::create(str_offset + a_size + b_size);
+    ql::record_datum_allocation(str_offset + a_size + b_size);
     serialize_varint_uint64_into_buf(a_size + b_size,
                                      reinterpret_cast<uint8_t *>(buf->data(0)));
     memcpy(buf->data(str_offset), a.data(), a.size());
@@ -135,6 +268,29 @@ datum_string_t concat(const datum_string_t &a, const datum_string_t &b) {
     return datum_string_t(shared_buf_ref_t<char>(std::move(buf), 0));
 }
 
+// Only keys of moderate length are worth keeping around.
+const size_t MAX_INTERNED_SIZE = 128;
+const size_t INTERNED_CACHE_SIZE = 256;
+
+// A direct-mapped cache of recently interned strings, indexed by their hash.
+TLS_with_init(datum_string_t *, interned_datum_strings, nullptr);
+
+datum_string_t intern_datum_string(size_t size, const char *data) {
+    if (size <= datum_string_t::MAX_INLINE_SIZE || size > MAX_INTERNED_SIZE) {
+        return datum_string_t(size, data);
+    }
+    datum_string_t *cache = TLS_get_interned_datum_strings();
+    if (cache == nullptr) {
+        // This is never freed, like the rest of the thread's state.
+        cache = new datum_string_t[INTERNED_CACHE_SIZE];
+        TLS_set_interned_datum_strings(cache);
+    }
+    datum_string_t *entry = &cache[hash_bytes(size, data) % INTERNED_CACHE_SIZE];
+    if (entry->size() != size || memcmp(entry->data(), data, size) != 0) {
+        *entry = datum_string_t(size, data);
+    }
+    return *entry;
+}
 
 void debug_print(printf_buffer_t *buf, const datum_string_t &s) {
     debug_print_quoted_string(buf, reinterpret_cast<const uint8_t *>(s.data()),
@@ -2,6 +2,8 @@
 #ifndef RDB_PROTOCOL_DATUM_STRING_HPP_
 #define RDB_PROTOCOL_DATUM_STRING_HPP_
 
+#include <stdint.h>
+
 #include <string>
 
 #include "containers/archive/archive.hpp"
@@ -12,14 +14,27 @@
  * - it can be efficiently serialized and deserialized
  * - it can contain any character, including '\0'
  *
- * Underneath `datum_string_t` uses a `shared_buf_ref_t`. This makes it
- * relatively cheap to copy.
+ * Strings of up to `MAX_INLINE_SIZE` characters are stored inline, so that the
+ * short keys and values that make up most documents don't need a heap allocation
+ * and an atomic reference count each.  Longer strings (and strings pointing into
+ * an existing serialization) point into a `shared_buf_t`, which makes them
+ * relatively cheap to copy.  Either way a `datum_string_t` takes 16 bytes, so that
+ * it doesn't make `datum_t` any bigger.
  */
 class datum_string_t {
 public:
+    static const size_t MAX_INLINE_SIZE = 15;
+
     // Creates an empty datum_string_t
     datum_string_t();
 
+    datum_string_t(const datum_string_t &copyee);
+    datum_string_t(datum_string_t &&movee) noexcept;
+    ~datum_string_t();
+
+    datum_string_t &operator=(const datum_string_t &copyee);
+    datum_string_t &operator=(datum_string_t &&movee) noexcept;
+
     // Creates a datum_string_t with its content copied from _data
     datum_string_t(size_t _size, const char *_data);
 
@@ -43,6 +58,9 @@ public:
 
     int compare(const datum_string_t &other) const;
 
+    // Hashes the contents of the string.
+    size_t hash() const;
+
     // Short cut for comparing to C-strings and STD strings
     bool operator==(const char *other) const;
     bool operator!=(const char *other) const;
@@ -56,16 +74,39 @@ public:
     std::string to_std() const;
 
 private:
+    static const uint8_t SHARED_TAG = UINT8_MAX;
+
     void init(size_t _size, const char *_data);
+    void init_shared(shared_buf_ref_t<char> &&ref);
+    void assign_copy(const datum_string_t &copyee);
+    void assign_move(datum_string_t &&movee) noexcept;
+    void destruct();
     int compare(size_t other_size, const char *other_data) const;
 
-    // Contains the length of the string in varint encoding, followed by the actual
-    // string content.
-    shared_buf_ref_t<char> data_;
+    uint8_t tag() const { return static_cast<uint8_t>(storage_[MAX_INLINE_SIZE]); }
+    void set_tag(uint8_t tag) { storage_[MAX_INLINE_SIZE] = static_cast<char>(tag); }
+    bool is_shared() const { return tag() == SHARED_TAG; }
+    const shared_buf_t *shared_buf() const;
+    size_t shared_offset() const;
+    // The bytes of the shared buffer from the start of the string on.
+    const char *shared_data() const;
+    size_t shared_safety_boundary() const;
+
+    // The last byte is the tag.  If it's `SHARED_TAG`, the string starts with its
+    // length in varint encoding, followed by the actual string content, at a
+    // `uint32_t` offset into a `shared_buf_t` that we hold a reference to.  The
+    // pointer to the buffer and the offset are at the start of `storage_`.
+    // Otherwise `storage_` starts with the `tag` characters of the string.
+    alignas(void *) char storage_[MAX_INLINE_SIZE + 1];
 };
 
 datum_string_t concat(const datum_string_t &a, const datum_string_t &b);
 
+// Returns a `datum_string_t` with the given content, which shares its buffer with
+// the previous results for the same content on this thread where possible.  This
+// is meant for object keys, which tend to repeat from one object to the next.
+datum_string_t intern_datum_string(size_t size, const char *data);
+
 void debug_print(printf_buffer_t *buf, const datum_string_t &s);
 
 #endif  // RDB_PROTOCOL_DATUM_STRING_HPP_
@@ -1,22 +1,63 @@
 // Copyright 2010-2015 RethinkDB, all rights reserved.
 #include "rdb_protocol/env.hpp"
 
+#include <re2/re2.h>
+
 #include "concurrency/cross_thread_watchable.hpp"
+#include "config/args.hpp"
 #include "extproc/js_runner.hpp"
 #include "rdb_protocol/func.hpp"
 #include "rdb_protocol/minidriver.hpp"
 #include "rdb_protocol/term_walker.hpp"
 
 #include "debug.hpp"
+#include "thread_local.hpp"
 
-// This is a totally arbitrary constant limiting the size of the regex cache.  1000
-// was chosen out of a hat; if you have a good argument for it being something else
-// (apart from cache line concerns, which are irrelevant due to the implementation)
-// you're probably right.
-const size_t LRU_CACHE_SIZE = 1000;
+TLS_with_init(ql::regex_cache_t *, regex_cache, nullptr);
 
 namespace ql {
 
+regex_cache_t::regex_cache_t() : regexes(REGEX_CACHE_SIZE), total_cost(0) { }
+
+std::shared_ptr<re2::RE2> regex_cache_t::lookup(const std::string &pattern) {
+    std::shared_ptr<re2::RE2> *found;
+    if (!regexes.lookup(pattern, &found)) {
+        return std::shared_ptr<re2::RE2>();
+    }
+    return *found;
+}
+
+void regex_cache_t::insert(const std::string &pattern,
+                           std::shared_ptr<re2::RE2> regex) {
+    const size_t regex_cost = cost(pattern, *regex);
+    if (regex_cost > REGEX_CACHE_MAX_BYTES) {
+        return;
+    }
+    while (regexes.size() != 0
+           && (regexes.size() == regexes.max_size()
+               || total_cost + regex_cost > REGEX_CACHE_MAX_BYTES)) {
+        std::shared_ptr<re2::RE2> evicted;
+        guarantee(regexes.evict_oldest(&evicted));
+        total_cost -= cost(evicted->pattern(), *evicted);
+    }
+    if (regexes.insert(pattern, std::move(regex))) {
+        total_cost += regex_cost;
+    }
+}
+
+size_t regex_cache_t::cost(const std::string &pattern, const re2::RE2 &regex) {
+    // `ProgramSize()` counts the instructions of the compiled program.  The DFA
+    // states RE2 builds while matching aren't counted.
+    return pattern.size() + regex.ProgramSize() * REGEX_CACHE_BYTES_PER_INSTRUCTION;
+}
+
+regex_cache_t &env_t::regex_cache() {
+    if (TLS_get_regex_cache() == nullptr) {
+        TLS_set_regex_cache(new regex_cache_t());
+    }
+    return *TLS_get_regex_cache();
+}
+
 void env_t::set_eval_callback(eval_callback_t *callback) {
     eval_callback_ = callback;
 }
@@ -72,11 +113,12 @@ env_t::env_t(rdb_context_t *ctx,
       limits_(from_optargs(ctx, _interruptor, &serializable_.global_optargs,
                            serializable_.deterministic_time)),
       reql_version_(reql_version_t::LATEST),
-      regex_cache_(LRU_CACHE_SIZE),
       return_empty_normal_batches(_return_empty_normal_batches),
       interruptor(_interruptor),
       trace(_trace),
       evals_since_yield_(0),
+      resources_(nullptr),
+      memory_limit_(0),
       rdb_ctx_(ctx),
       eval_callback_(NULL) {
     rassert(ctx != NULL);
@@ -108,11 +150,12 @@ env_t::env_t(signal_t *_interruptor,
         auth::user_context_t(auth::permissions_t(tribool::False, tribool::False, tribool::False, tribool::False)),
         datum_t()},
       reql_version_(_reql_version),
-      regex_cache_(LRU_CACHE_SIZE),
       return_empty_normal_batches(_return_empty_normal_batches),
       interruptor(_interruptor),
       trace(NULL),
       evals_since_yield_(0),
+      resources_(nullptr),
+      memory_limit_(0),
       rdb_ctx_(NULL),
       eval_callback_(NULL) {
     rassert(interruptor != NULL);
@@ -120,8 +163,23 @@ env_t::env_t(signal_t *_interruptor,
 
 env_t::~env_t() { }
 
+void env_t::set_query_resources(query_resources_t *resources, uint64_t memory_limit) {
+    resources_ = resources;
+    memory_limit_ = memory_limit;
+}
+
 void env_t::maybe_yield() {
-    if (++evals_since_yield_ > EVALS_BEFORE_YIELD) {
+    ++evals_since_yield_;
+    coro_t *self = coro_t::self();
+    if (resources_ != nullptr && self->has_cpu_counter()) {
+        // Cheap terms can run for a long time without hogging the thread, while a
+        // few expensive ones can hog it long before EVALS_BEFORE_YIELD.
+        if (evals_since_yield_ % EVALS_BETWEEN_SLICE_CHECKS == 0
+            && self->running_ticks().nanos > QUERY_TIME_SLICE_MS * MILLION) {
+            evals_since_yield_ = 0;
+            coro_t::yield();
+        }
+    } else if (evals_since_yield_ > EVALS_BEFORE_YIELD) {
         evals_since_yield_ = 0;
         coro_t::yield();
     }
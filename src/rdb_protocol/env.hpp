@@ -19,6 +19,7 @@
 #include "rdb_protocol/error.hpp"
 #include "rdb_protocol/optargs.hpp"
 #include "rdb_protocol/protocol.hpp"
+#include "rdb_protocol/query_resources.hpp"
 #include "rdb_protocol/val.hpp"
 #include "rdb_protocol/var_types.hpp"
 #include "rdb_protocol/wire_func.hpp"
@@ -35,9 +36,23 @@ class term_t;
 
 scoped_ptr_t<profile::trace_t> maybe_make_profile_trace(profile_bool_t profile);
 
-struct regex_cache_t {
-    explicit regex_cache_t(size_t cache_size) : regexes(cache_size) {}
+// Compiled regexes, shared by the queries on a thread.  Bounded both by the number
+// of regexes and by an estimate of the memory their programs take.
+class regex_cache_t {
+public:
+    regex_cache_t();
+
+    // Returns an empty pointer if `pattern` isn't cached.
+    std::shared_ptr<re2::RE2> lookup(const std::string &pattern);
+    void insert(const std::string &pattern, std::shared_ptr<re2::RE2> regex);
+
+private:
+    static size_t cost(const std::string &pattern, const re2::RE2 &regex);
+
     lru_cache_t<std::string, std::shared_ptr<re2::RE2> > regexes;
+    size_t total_cost;
+
+    DISABLE_COPYING(regex_cache_t);
 };
 
 class env_t : public home_thread_mixin_t {
@@ -66,9 +81,21 @@ public:
 
     ~env_t();
 
-    // Will yield after EVALS_BEFORE_YIELD calls
+    // Called before each term is evaluated.  Yields once the query has used up its
+    // time slice (see `set_query_resources`), or else after EVALS_BEFORE_YIELD calls.
     void maybe_yield();
 
+    // Charges the query's CPU time and allocations to `resources` while it runs, and
+    // makes `maybe_yield` yield after `QUERY_TIME_SLICE_MS` of CPU time instead of
+    // after a fixed number of terms.  A non-zero `memory_limit` caps the bytes that
+    // may be allocated for one response.
+    void set_query_resources(query_resources_t *resources, uint64_t memory_limit);
+    bool over_memory_limit() const {
+        return memory_limit_ != 0 && resources_ != nullptr
+            && resources_->response_allocated_bytes > memory_limit_;
+    }
+    uint64_t memory_limit() const { return memory_limit_; }
+
     extproc_pool_t *get_extproc_pool();
 
     // Returns js_runner, but first calls js_runner->begin() if it hasn't
@@ -126,7 +153,8 @@ public:
         }
     }
 
-    regex_cache_t &regex_cache() { return regex_cache_; }
+    // The compiled regexes of `match`, shared by all the queries on this thread.
+    regex_cache_t &regex_cache();
 
     reql_version_t reql_version() const { return reql_version_; }
 
@@ -141,9 +169,6 @@ private:
     // earlier value.
     const reql_version_t reql_version_;
 
-    // query specific cache parameters; for example match regexes.
-    regex_cache_t regex_cache_;
-
 public:
     const return_empty_normal_batches_t return_empty_normal_batches;
 
@@ -159,8 +184,13 @@ public:
 
 private:
     static const uint32_t EVALS_BEFORE_YIELD = 256;
+    // How often a query with resources checks whether its time slice is used up.
+    static const uint32_t EVALS_BETWEEN_SLICE_CHECKS = 16;
     uint32_t evals_since_yield_;
 
+    query_resources_t *resources_;
+    uint64_t memory_limit_;
+
     rdb_context_t *const rdb_ctx_;
 
     js_runner_t js_runner_;
@@ -3,6 +3,7 @@
 
 #include "pprint/js_pprint.hpp"
 #include "pprint/pprint.hpp"
+#include "rdb_protocol/bytecode.hpp"
 #include "rdb_protocol/env.hpp"
 #include "rdb_protocol/minidriver.hpp"
 #include "rdb_protocol/pseudo_literal.hpp"
@@ -41,11 +42,13 @@ void func_t::assert_deterministic(constant_now_t cn, const char *extra_msg) cons
 
 reql_func_t::reql_func_t(const var_scope_t &_captured_scope,
                          std::vector<sym_t> _arg_names,
-                         counted_t<const term_t> _body)
+                         counted_t<const term_t> _body,
+                         counted_t<const bytecode_program_t> _program)
     : func_t(_body->backtrace()),
       captured_scope(_captured_scope),
       arg_names(std::move(_arg_names)),
-      body(std::move(_body)) { }
+      body(std::move(_body)),
+      program(std::move(_program)) { }
 
 reql_func_t::reql_func_t(scoped_ptr_t<term_storage_t> &&_storage,
                          const var_scope_t &_captured_scope,
@@ -55,7 +58,8 @@ reql_func_t::reql_func_t(scoped_ptr_t<term_storage_t> &&_storage,
       captured_scope(_captured_scope),
       arg_names(std::move(_arg_names)),
       term_storage(std::move(_storage)),
-      body(std::move(_body)) { }
+      body(std::move(_body)),
+      program(compile_bytecode(arg_names, body->get_src())) { }
 
 reql_func_t::~reql_func_t() { }
 
@@ -75,6 +79,20 @@ scoped_ptr_t<val_t> reql_func_t::call(env_t *env,
                          arg_names.size(),
                          (arg_names.size() == 1 ? "" : "s")));
 
+        // The bytecode bails out on anything unusual, so errors and profiling
+        // output always come from the term tree below.
+        if (program.has() && env->profile() == profile_bool_t::DONT_PROFILE) {
+            env->do_eval_callback();
+            if (env->interruptor->is_pulsed()) {
+                throw interrupted_exc_t();
+            }
+            env->maybe_yield();
+            datum_t result;
+            if (program->run(args, &result)) {
+                return make_scoped<val_t>(std::move(result), backtrace());
+            }
+        }
+
         var_scope_t new_scope = arg_names.size() == 0
             ? captured_scope
             : captured_scope.with_func_arg_list(arg_names, args);
@@ -99,6 +117,53 @@ bool reql_func_t::is_simple_selector() const {
     return body->is_simple_selector();
 }
 
+bool reql_func_t::arg_fields_only(std::vector<datum_string_t> *fields_out) const {
+    if (arg_names.size() != 1) {
+        return false;
+    }
+    if (program.has()) {
+        return program->arg_fields_only(fields_out);
+    }
+
+    // The functions `pluck` and `with_fields` (i.e. `has_fields` followed by
+    // `pluck`) add to a stream look like `function(x) { return x.pluck(...); }`.
+    const raw_term_t src = body->get_src();
+    if (src.type() != Term::PLUCK && src.type() != Term::HAS_FIELDS) {
+        return false;
+    }
+    bool bad_optarg = false;
+    src.each_optarg([&](const raw_term_t &, const std::string &name) {
+            bad_optarg = bad_optarg || name != "_NO_RECURSE_";
+        });
+    if (bad_optarg || src.num_args() < 2) {
+        return false;
+    }
+    const raw_term_t var = src.arg(0);
+    if (var.type() != Term::VAR || var.num_args() != 1
+        || var.arg(0).type() != Term::DATUM) {
+        return false;
+    }
+    const datum_t varnum = var.arg(0).datum();
+    if (varnum.get_type() != datum_t::R_NUM
+        || varnum.as_num() != static_cast<double>(arg_names[0].value)) {
+        return false;
+    }
+    std::vector<datum_string_t> fields;
+    for (size_t i = 1; i < src.num_args(); ++i) {
+        // Nested path specifications need more than the top-level field.
+        if (src.arg(i).type() != Term::DATUM) {
+            return false;
+        }
+        const datum_t field = src.arg(i).datum();
+        if (field.get_type() != datum_t::R_STR) {
+            return false;
+        }
+        fields.push_back(field.as_str());
+    }
+    fields_out->insert(fields_out->end(), fields.begin(), fields.end());
+    return true;
+}
+
 js_func_t::js_func_t(const std::string &_js_source,
                      uint64_t timeout_ms,
                      backtrace_id_t _backtrace)
@@ -136,6 +201,39 @@ scoped_ptr_t<val_t> js_func_t::call(
     }
 }
 
+std::vector<js_result_t> js_func_t::call_js_batch(
+        env_t *env, const std::vector<datum_t> &args) const {
+    js_runner_t::req_config_t config;
+    config.timeout_ms = js_timeout_ms;
+
+    r_sanity_check(!js_source.empty());
+    std::vector<std::vector<datum_t> > args_batch;
+    args_batch.reserve(args.size());
+    for (const datum_t &arg : args) {
+        args_batch.push_back(make_vector(arg));
+    }
+
+    try {
+        return env->get_js_runner()->call_batch(js_source, args_batch, config);
+    } catch (const extproc_worker_exc_t &e) {
+        rfail(base_exc_t::INTERNAL,
+              "Javascript query `%s` caused a crash in a worker process.",
+              js_source.c_str());
+        unreachable();
+    }
+}
+
+scoped_ptr_t<val_t> js_func_t::result_to_val(const js_result_t &result) const {
+    try {
+        return scoped_ptr_t<val_t>(
+                boost::apply_visitor(
+                        js_result_visitor_t(js_source, js_timeout_ms, this), result));
+    } catch (const datum_exc_t &e) {
+        rfail(e.get_type(), "%s", e.what());
+        unreachable();
+    }
+}
+
 optional<size_t> js_func_t::arity() const {
     return r_nullopt;
 }
@@ -210,6 +308,7 @@ func_term_t::func_term_t(compile_env_t *env, const raw_term_t &t)
         captures.implicit_is_captured = false;
     }
 
+    program = compile_bytecode(args, raw_body);
     arg_names = std::move(args);
     body = std::move(compiled_body);
     external_captures = std::move(captures);
@@ -228,7 +327,7 @@ scoped_ptr_t<val_t> func_term_t::term_eval(scope_env_t *env,
 
 counted_t<const func_t> func_term_t::eval_to_func(const var_scope_t &env_scope) const {
     return make_counted<reql_func_t>(env_scope.filtered_by_captures(external_captures),
-                                     arg_names, body);
+                                     arg_names, body, program);
 }
 
 deterministic_t func_term_t::is_deterministic() const {
@@ -317,14 +416,18 @@ bool js_func_t::filter_helper(env_t *env, datum_t arg) const {
     return d.as_bool();
 }
 
-bool func_t::filter_call(env_t *env, datum_t arg, counted_t<const func_t> default_filter_val) const {
+// Returns the result of `helper`, or the default filter value if `helper` runs into a
+// non-existence error.
+static bool filter_with_default(env_t *env,
+                                const std::function<bool()> &helper,
+                                const counted_t<const func_t> &default_filter_val) {
     // We have to catch every exception type and save it so we can rethrow it later
     // So we don't trigger a coroutine wait in a catch statement
     std::exception_ptr saved_exception;
     base_exc_t::type_t exception_type;
 
     try {
-        return filter_helper(env, arg);
+        return helper();
     } catch (const base_exc_t &e) {
         saved_exception = std::current_exception();
         exception_type = e.get_type();
@@ -361,6 +464,53 @@ bool func_t::filter_call(env_t *env, datum_t arg, counted_t<const func_t> defaul
     std::rethrow_exception(saved_exception);
 }
 
+bool func_t::filter_call(env_t *env, datum_t arg, counted_t<const func_t> default_filter_val) const {
+    return filter_with_default(env,
+                               [&]() { return filter_helper(env, arg); },
+                               default_filter_val);
+}
+
+void func_t::call_batch(env_t *env, std::vector<datum_t> *args) const {
+    for (auto it = args->begin(); it != args->end(); ++it) {
+        *it = call(env, *it)->as_datum();
+    }
+}
+
+std::vector<bool> func_t::filter_call_batch(
+        env_t *env,
+        const std::vector<datum_t> &args,
+        counted_t<const func_t> default_filter_val) const {
+    std::vector<bool> results;
+    results.reserve(args.size());
+    for (const datum_t &arg : args) {
+        results.push_back(filter_call(env, arg, default_filter_val));
+    }
+    return results;
+}
+
+void js_func_t::call_batch(env_t *env, std::vector<datum_t> *args) const {
+    std::vector<js_result_t> js_results = call_js_batch(env, *args);
+    for (size_t i = 0; i < js_results.size(); ++i) {
+        (*args)[i] = result_to_val(js_results[i])->as_datum();
+    }
+}
+
+std::vector<bool> js_func_t::filter_call_batch(
+        env_t *env,
+        const std::vector<datum_t> &args,
+        counted_t<const func_t> default_filter_val) const {
+    std::vector<js_result_t> js_results = call_js_batch(env, args);
+    std::vector<bool> results;
+    results.reserve(js_results.size());
+    for (const js_result_t &js_result : js_results) {
+        results.push_back(filter_with_default(
+            env,
+            [&]() { return result_to_val(js_result)->as_datum().as_bool(); },
+            default_filter_val));
+    }
+    return results;
+}
+
 counted_t<const func_t> new_constant_func(datum_t obj, backtrace_id_t bt) {
     minidriver_t r(bt);
     compile_env_t empty_compile_env((var_visibility_t()));
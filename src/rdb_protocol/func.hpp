@@ -24,6 +24,7 @@ class js_runner_t;
 
 namespace ql {
 
+class bytecode_program_t;
 class func_visitor_t;
 
 class func_t : public slow_atomic_countable_t<func_t>, public bt_rcheckable_t {
@@ -55,6 +56,15 @@ public:
                      datum_t arg,
                      counted_t<const func_t> default_filter_val) const;
 
+    // Call the function, or `filter_call` it, with each of `args` as its only
+    // argument.  `call_batch` replaces the arguments with the results.  `js_func_t`
+    // sends all of them to the JavaScript worker at once.
+    virtual void call_batch(env_t *env, std::vector<datum_t> *args) const;
+    virtual std::vector<bool> filter_call_batch(
+        env_t *env,
+        const std::vector<datum_t> &args,
+        counted_t<const func_t> default_filter_val) const;
+
     // These are simple, they call the vector version of call.
     scoped_ptr_t<val_t> call(env_t *env, eval_flags_t eval_flags = NO_FLAGS) const;
     scoped_ptr_t<val_t> call(env_t *env,
@@ -69,6 +79,19 @@ public:
         return false;
     }
 
+    // Returns true if the function takes a single argument and only ever looks at
+    // the top-level fields of it that it appends to `*fields_out`.  Calling it on
+    // an object holding just those fields then gives the same result as calling it
+    // on the whole object.  Used to avoid loading entire rows from disk.
+    virtual bool arg_fields_only(std::vector<datum_string_t> *) const {
+        return false;
+    }
+
+    // The bytecode the function is compiled to, if any.
+    virtual counted_t<const bytecode_program_t> get_bytecode() const {
+        return counted_t<const bytecode_program_t>();
+    }
+
 protected:
     explicit func_t(backtrace_id_t bt);
 
@@ -83,7 +106,9 @@ public:
     // Used when constructing in an existing environment - reusing another term storage
     reql_func_t(const var_scope_t &captured_scope,
                 std::vector<sym_t> arg_names,
-                counted_t<const term_t> body);
+                counted_t<const term_t> body,
+                counted_t<const bytecode_program_t> program
+                    = counted_t<const bytecode_program_t>());
 
     // Used when constructing from a function read off the wire
     reql_func_t(scoped_ptr_t<term_storage_t> &&_storage,
@@ -109,6 +134,11 @@ public:
 
     bool is_simple_selector() const final;
 
+    bool arg_fields_only(std::vector<datum_string_t> *fields_out) const final;
+    counted_t<const bytecode_program_t> get_bytecode() const final {
+        return program;
+    }
+
 private:
     template <cluster_version_t> friend class wire_func_serialization_visitor_t;
     bool filter_helper(env_t *env, datum_t arg) const;
@@ -126,6 +156,9 @@ private:
     // The body of the function, which gets ->eval(...) called when call(...) is called.
     counted_t<const term_t> body;
 
+    // If non-empty, `body` compiled to bytecode, which `call` tries first.
+    counted_t<const bytecode_program_t> program;
+
     DISABLE_COPYING(reql_func_t);
 };
 
@@ -142,6 +175,12 @@ public:
                              const std::vector<datum_t> &args,
                              eval_flags_t eval_flags) const;
 
+    void call_batch(env_t *env, std::vector<datum_t> *args) const final;
+    std::vector<bool> filter_call_batch(
+        env_t *env,
+        const std::vector<datum_t> &args,
+        counted_t<const func_t> default_filter_val) const final;
+
     optional<size_t> arity() const;
 
     deterministic_t is_deterministic() const;
@@ -155,6 +194,11 @@ private:
     template <cluster_version_t> friend class wire_func_serialization_visitor_t;
     bool filter_helper(env_t *env, datum_t arg) const;
 
+    // Makes one round trip to the worker for all of `args`.
+    std::vector<js_result_t> call_js_batch(env_t *env,
+                                           const std::vector<datum_t> &args) const;
+    scoped_ptr_t<val_t> result_to_val(const js_result_t &result) const;
+
     std::string js_source;
     uint64_t js_timeout_ms;
 
@@ -221,6 +265,7 @@ private:
 
     std::vector<sym_t> arg_names;
     counted_t<const term_t> body;
+    counted_t<const bytecode_program_t> program;
 
     var_captures_t external_captures;
 };
@@ -1,9 +1,12 @@
 // Copyright 2010-2015 RethinkDB, all rights reserved.
 #include "rdb_protocol/lazy_btree_val.hpp"
 
+#include <algorithm>
+
 #include "containers/archive/buffer_group_stream.hpp"
 #include "containers/archive/versioned.hpp"
 #include "rdb_protocol/blob_wrapper.hpp"
+#include "rdb_protocol/serialize_datum.hpp"
 
 ql::datum_t get_data(const rdb_value_t *value, buf_parent_t parent) {
     // TODO: Just use deserialize_from_blob?
@@ -34,6 +37,70 @@ const ql::datum_t &lazy_btree_val_t::get() const {
     return pointee->ptr;
 }
 
+// Returns false if the row isn't serialized as an object.
+static bool get_data_fields(
+        const rdb_value_t *value,
+        buf_parent_t parent,
+        const std::vector<datum_string_t> &keys,
+        std::vector<std::pair<datum_string_t, ql::datum_t> > *out) {
+    rdb_blob_wrapper_t blob(parent.cache()->max_block_size(),
+                            const_cast<rdb_value_t *>(value)->value_ref(),
+                            blob::btree_maxreflen);
+    // Only the blocks holding the parts of the blob we actually read get acquired.
+    auto read = [&](size_t offset, size_t size, char *buf_out) {
+        if (size == 0) {
+            return;
+        }
+        blob_acq_t acq_group;
+        buffer_group_t buffer_group;
+        blob.expose_region(parent, access_t::read, offset, size,
+                           &buffer_group, &acq_group);
+        buffer_group_t out_group;
+        out_group.add_buffer(size, buf_out);
+        buffer_group_copy_data(&out_group, const_view(&buffer_group));
+    };
+    return ql::datum_deserialize_fields(blob.valuesize(), read, keys, out);
+}
+
+ql::datum_t lazy_btree_val_t::get_fields(
+        const std::vector<datum_string_t> &keys) const {
+    guarantee(pointee.has());
+    if (pointee->ptr.has()) {
+        const ql::datum_t &row = pointee->ptr;
+        if (row.get_type() != ql::datum_t::R_OBJECT || row.is_ptype()) {
+            return ql::datum_t();
+        }
+        std::vector<std::pair<datum_string_t, ql::datum_t> > pairs;
+        for (const datum_string_t &key : keys) {
+            ql::datum_t val = row.get_field(key, ql::NOTHROW);
+            if (val.has()) {
+                pairs.push_back(std::make_pair(key, std::move(val)));
+            }
+        }
+        return ql::datum_t(std::move(pairs));
+    }
+
+    // We also look up `$reql_type$`, so that we can tell whether the row is a
+    // pseudotype without loading it.
+    const datum_string_t &reql_type = ql::datum_t::reql_type_string;
+    std::vector<datum_string_t> lookup_keys(keys);
+    auto it = std::lower_bound(lookup_keys.begin(), lookup_keys.end(), reql_type);
+    if (it == lookup_keys.end() || *it != reql_type) {
+        lookup_keys.insert(it, reql_type);
+    }
+
+    std::vector<std::pair<datum_string_t, ql::datum_t> > pairs;
+    if (!get_data_fields(pointee->rdb_value, pointee->parent, lookup_keys, &pairs)) {
+        return ql::datum_t();
+    }
+    for (const auto &pair : pairs) {
+        if (pair.first == reql_type) {
+            return ql::datum_t();
+        }
+    }
+    return ql::datum_t(std::move(pairs));
+}
+
 bool lazy_btree_val_t::references_parent() const {
     return pointee.has() && !pointee->parent.empty();
 }
@@ -2,6 +2,8 @@
 #ifndef RDB_PROTOCOL_LAZY_BTREE_VAL_HPP_
 #define RDB_PROTOCOL_LAZY_BTREE_VAL_HPP_
 
+#include <vector>
+
 #include "buffer_cache/alt.hpp"
 #include "buffer_cache/blob.hpp"
 #include "rdb_protocol/datum.hpp"
@@ -27,6 +29,8 @@ public:
     }
 };
 
+// Loads a whole row.  Writes, `erase_range` and index construction use it for the
+// modification reports, which need the whole row for the secondary indexes.
 ql::datum_t get_data(const rdb_value_t *value,
                      buf_parent_t parent);
 
@@ -63,7 +67,16 @@ public:
     lazy_btree_val_t(const rdb_value_t *rdb_value, buf_parent_t parent)
         : pointee(new lazy_btree_val_pointee_t(rdb_value, parent)) { }
 
+    // Loads the whole row.  Range reads use `get_fields()` instead where they can;
+    // geo reads always need the whole row for the index function.
     const ql::datum_t &get() const;
+
+    // Returns an object holding just those of the top-level fields `keys` (which
+    // must be sorted and unique) that the row has, copying only them out of the
+    // blob if the row hasn't been loaded yet.  Returns an empty datum if the row is
+    // not an ordinary object, in which case you need to use `get()`.
+    ql::datum_t get_fields(const std::vector<datum_string_t> &keys) const;
+
     bool references_parent() const;
     void reset();
 
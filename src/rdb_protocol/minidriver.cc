@@ -98,6 +98,13 @@ minidriver_t::reql_t minidriver_t::fun(dummy_var_t a,
                   std::move(body));
 }
 
+minidriver_t::reql_t minidriver_t::fun(const sym_t &a,
+                                       const minidriver_t::reql_t &body) {
+    return reql_t(this, Term::FUNC,
+                  reql_t(this, Term::MAKE_ARRAY, a.value),
+                  std::move(body));
+}
+
 minidriver_t::reql_t minidriver_t::null() {
     return reql_t(this, datum_t::null());
 }
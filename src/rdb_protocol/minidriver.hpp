@@ -154,6 +154,8 @@ public:
     reql_t fun(const reql_t &body);
     reql_t fun(dummy_var_t a, const reql_t &body);
     reql_t fun(dummy_var_t a, dummy_var_t b, const reql_t &body);
+    // For functions whose body refers to a variable of a user-supplied function.
+    reql_t fun(const sym_t &a, const reql_t &body);
 
     template <class... T>
     reql_t array(T &&... args) {
@@ -176,7 +178,7 @@ public:
 
     template <class T>
     reql_t error(T &&message) {
-        return reql_t(Term::ERROR, std::forward<T>(message));
+        return reql_t(this, Term::ERROR, std::forward<T>(message));
     }
 
     template <class Cond, class Then, class Else>
@@ -68,6 +68,7 @@ static const std::set<std::string> acceptable_optargs({
     "include_initial",
     "include_offsets",
     "include_states",
+    "include_tokens",
     "include_types",
     "index",
     "interleave",
@@ -78,6 +79,7 @@ static const std::set<std::string> acceptable_optargs({
     "max_batch_seconds",
     "max_dist",
     "max_results",
+    "memory_limit",
     "method",
     "min_batch_rows",
     "multi",
@@ -100,6 +102,7 @@ static const std::set<std::string> acceptable_optargs({
     "return_vals",
     "right_bound",
     "shards",
+    "since",
     "squash",
     "time_format",
     "timeout",
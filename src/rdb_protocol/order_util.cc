@@ -94,6 +94,30 @@ build_comparisons_from_optional_terms(const term_t *target,
 lt_cmp_t::lt_cmp_t(std::vector<std::pair<order_direction_t, counted_t<const func_t> > > _comparisons)
             : comparisons(std::move(_comparisons)) { }
 
+static datum_t eval_comparison(env_t *env, const func_t &f, const datum_t &row) {
+    try {
+        return f.call(env, row)->as_datum();
+    } catch (const base_exc_t &e) {
+        if (e.get_type() != base_exc_t::NON_EXISTENCE) {
+            throw;
+        }
+    }
+    return datum_t();
+}
+
+// Returns a negative number if `lval` comes first, a positive one if `rval` does.
+static int compare_vals(order_direction_t direction,
+                        const datum_t &lval,
+                        const datum_t &rval) {
+    int cmp_res;
+    if (!lval.has() || !rval.has()) {
+        cmp_res = static_cast<int>(lval.has()) - static_cast<int>(rval.has());
+    } else {
+        cmp_res = lval.cmp(rval);
+    }
+    return direction == DESC ? -cmp_res : cmp_res;
+}
+
 bool lt_cmp_t::operator()(env_t *env,
                           profile::sampler_t *sampler,
                           datum_t l,
@@ -104,40 +128,35 @@ bool lt_cmp_t::operator()(env_t *env,
     }
 
     for (auto it = comparisons.begin(); it != comparisons.end(); ++it) {
-        datum_t lval;
-        datum_t rval;
-        try {
-            lval = it->second->call(env, l)->as_datum();
-        } catch (const base_exc_t &e) {
-            if (e.get_type() != base_exc_t::NON_EXISTENCE) {
-                throw;
-            }
+        datum_t lval = eval_comparison(env, *it->second, l);
+        datum_t rval = eval_comparison(env, *it->second, r);
+        int cmp_res = compare_vals(it->first, lval, rval);
+        if (cmp_res != 0) {
+            return cmp_res < 0;
         }
+    }
 
-        try {
-            rval = it->second->call(env, r)->as_datum();
-        } catch (const base_exc_t &e) {
-            if (e.get_type() != base_exc_t::NON_EXISTENCE) {
-                throw;
-            }
-        }
+    return false;
+}
 
-        if (!lval.has() && !rval.has()) {
-            continue;
-        }
-        if (!lval.has()) {
-            return true != (it->first == DESC);
-        }
-        if (!rval.has()) {
-            return false != (it->first == DESC);
-        }
-        int cmp_res = lval.cmp(rval);
-        if (cmp_res == 0) {
-            continue;
-        }
-        return (cmp_res < 0) != (it->first == DESC);
+std::vector<datum_t> lt_cmp_t::key(env_t *env, const datum_t &row) const {
+    std::vector<datum_t> ret;
+    ret.reserve(comparisons.size());
+    for (const auto &pair : comparisons) {
+        ret.push_back(eval_comparison(env, *pair.second, row));
     }
+    return ret;
+}
 
+bool lt_cmp_t::key_lt(const std::vector<datum_t> &l,
+                      const std::vector<datum_t> &r) const {
+    r_sanity_check(l.size() == comparisons.size() && r.size() == comparisons.size());
+    for (size_t i = 0; i < comparisons.size(); ++i) {
+        int cmp_res = compare_vals(comparisons[i].first, l[i], r[i]);
+        if (cmp_res != 0) {
+            return cmp_res < 0;
+        }
+    }
     return false;
 }
 
@@ -54,6 +54,12 @@ public:
                     datum_t l,
                     datum_t r) const;
 
+    // Evaluates all of the comparison functions on `row` at once, so that rows can
+    // be ordered by `key_lt` without calling the functions again.  An element of
+    // the key is empty if `row` doesn't have the field.
+    std::vector<datum_t> key(env_t *env, const datum_t &row) const;
+    bool key_lt(const std::vector<datum_t> &l, const std::vector<datum_t> &r) const;
+
 private:
     const std::vector<std::pair<order_direction_t, counted_t<const func_t> > >
         comparisons;
@@ -2,16 +2,20 @@
 
 #include <inttypes.h>
 
+#include <algorithm>
 #include <limits>
+#include <vector>
 
 #include "errors.hpp"
 #include <boost/variant/static_visitor.hpp>
 
+#include "arch/runtime/coroutines.hpp"
 #include "containers/archive/stl_types.hpp"
 #include "logger.hpp"
 #include "rdb_protocol/math_utils.hpp"
 #include "rdb_protocol/datum.hpp"
 #include "rdb_protocol/env.hpp"
+#include "thread_local.hpp"
 
 namespace profile {
 
@@ -290,6 +294,95 @@ void disabler_t::init(trace_t *parent) {
     }
 }
 
+materialization_counter_t::materialization_counter_t(trace_t *parent) {
+    init(parent);
+}
+
+materialization_counter_t::materialization_counter_t(
+        const scoped_ptr_t<trace_t> &parent) {
+    init(parent.get_or_null());
+}
+
+void materialization_counter_t::init(trace_t *parent) {
+    parent_ = parent;
+    for (size_t i = 0; i < static_cast<size_t>(materialization_t::COUNT); ++i) {
+        counts_[i] = 0;
+    }
+}
+
+materialization_counter_t::~materialization_counter_t() {
+    if (parent_ == nullptr) {
+        return;
+    }
+    for (size_t i = 0; i < static_cast<size_t>(materialization_t::COUNT); ++i) {
+        if (counts_[i] == 0) {
+            continue;
+        }
+        const char *description;
+        switch (static_cast<materialization_t>(i)) {
+        case materialization_t::FULL_ROW:
+            description = "Load rows from disk."; break;
+        case materialization_t::PARTIAL_ROW:
+            description = "Load some fields of rows from disk."; break;
+        case materialization_t::SKIPPED_ROW:
+            description = "Skip rows without loading them from disk."; break;
+        case materialization_t::OBJECT:
+            description = "Unpack serialized objects."; break;
+        case materialization_t::ARRAY:
+            description = "Unpack serialized arrays."; break;
+        case materialization_t::COUNT:
+        default:
+            unreachable();
+        }
+        parent_->record_count(description, counts_[i]);
+    }
+}
+
+// The active `materialization_scope_t`s on this thread, innermost last.
+TLS_with_init(std::vector<materialization_scope_t *> *, materialization_scopes, nullptr);
+
+materialization_scope_t::materialization_scope_t(materialization_counter_t *counter)
+    : counter_(counter != nullptr && counter->enabled() ? counter : nullptr),
+      coro_(coro_t::self()),
+      thread_(get_thread_id()) {
+    if (counter_ == nullptr) {
+        return;
+    }
+    std::vector<materialization_scope_t *> *scopes = TLS_get_materialization_scopes();
+    if (scopes == nullptr) {
+        // This is never freed, like the rest of the thread's state.
+        scopes = new std::vector<materialization_scope_t *>();
+        TLS_set_materialization_scopes(scopes);
+    }
+    scopes->push_back(this);
+}
+
+materialization_scope_t::~materialization_scope_t() {
+    if (counter_ == nullptr) {
+        return;
+    }
+    guarantee(get_thread_id() == thread_);
+    std::vector<materialization_scope_t *> *scopes = TLS_get_materialization_scopes();
+    // Scopes of different coroutines don't have to be destroyed in order.
+    auto it = std::find(scopes->rbegin(), scopes->rend(), this);
+    guarantee(it != scopes->rend());
+    scopes->erase(std::next(it).base());
+}
+
+void record_materialization(materialization_t what) {
+    std::vector<materialization_scope_t *> *scopes = TLS_get_materialization_scopes();
+    if (scopes == nullptr || scopes->empty()) {
+        return;
+    }
+    coro_t *self = coro_t::self();
+    for (auto it = scopes->rbegin(); it != scopes->rend(); ++it) {
+        if ((*it)->coro_ == self) {
+            (*it)->counter_->record(what);
+            return;
+        }
+    }
+}
+
 trace_t::trace_t()
     : redirected_event_log_(NULL), disabled_ref_count_(0) { }
 
@@ -373,6 +466,11 @@ void trace_t::stop_sample(event_log_t *event_log) {
     }
 }
 
+void trace_t::record_count(const std::string &description, size_t count) {
+    if (disabled()) { return; }
+    event_log_target()->push_back(sample_t(description, ticks_t{0}, count));
+}
+
 void trace_t::disable() {
     disabled_ref_count_++;
 }
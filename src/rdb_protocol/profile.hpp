@@ -11,8 +11,11 @@
 #include "containers/counted.hpp"
 #include "containers/scoped.hpp"
 #include "rpc/serialize_macros.hpp"
+#include "threading.hpp"
 #include "time.hpp"
 
+class coro_t;
+
 namespace ql {
 class datum_t;
 } //namespace ql
@@ -80,6 +83,7 @@ private:
     friend class splitter_t;
     friend class sampler_t;
     friend class disabler_t;
+    friend class materialization_counter_t;
     void start(const std::string &description);
     void stop();
     void start_split();
@@ -88,6 +92,7 @@ private:
     void stop_sample(const std::string &description, ticks_t mean_duration,
         size_t n_samples, event_log_t *sample_event_log);
     void stop_sample(event_log_t *sample_event_log);
+    void record_count(const std::string &description, size_t count);
     void disable();
     void enable();
 
@@ -206,6 +211,66 @@ private:
     trace_t *parent_;
 };
 
+/* materialization_counter_t counts how often data had to be copied out of its
+ * serialized representation: rows loaded from disk (in full or just some of
+ * their fields), and objects and arrays unpacked from a buffer into a builder.
+ * When it's destroyed it adds the non-zero counts to the trace, as samples
+ * without a duration.  Rows are counted by calling `record` directly, while
+ * datum code calls `record_materialization`, which counts in the
+ * materialization_scope_t of the calling coroutine.  Example:
+ * {
+ *     materialization_counter_t counter(trace);
+ *     materialization_scope_t scope(&counter);
+ *
+ *     Evaluate the query in here
+ * }
+ */
+enum class materialization_t {
+    FULL_ROW = 0,
+    PARTIAL_ROW,
+    SKIPPED_ROW,
+    OBJECT,
+    ARRAY,
+    COUNT  // Not a kind of materialization, just the number of them.
+};
+
+void record_materialization(materialization_t what);
+
+class materialization_counter_t {
+public:
+    explicit materialization_counter_t(trace_t *parent);
+    explicit materialization_counter_t(const scoped_ptr_t<trace_t> &parent);
+    ~materialization_counter_t();
+
+    bool enabled() const { return parent_ != nullptr; }
+    void record(materialization_t what, uint64_t count = 1) {
+        counts_[static_cast<size_t>(what)] += count;
+    }
+private:
+    void init(trace_t *parent);
+    trace_t *parent_;
+    uint64_t counts_[static_cast<size_t>(materialization_t::COUNT)];
+
+    DISABLE_COPYING(materialization_counter_t);
+};
+
+/* While a materialization_scope_t exists, `record_materialization` calls made by
+ * the coroutine that constructed it are counted in `counter`.  Scopes must be
+ * destroyed on the thread they were constructed on.  If `counter` is null or not
+ * enabled, the scope does nothing. */
+class materialization_scope_t {
+public:
+    explicit materialization_scope_t(materialization_counter_t *counter);
+    ~materialization_scope_t();
+private:
+    friend void record_materialization(materialization_t what);
+    materialization_counter_t *counter_;
+    coro_t *coro_;
+    threadnum_t thread_;
+
+    DISABLE_COPYING(materialization_scope_t);
+};
+
 void print_event_log(const event_log_t &event_log);
 
 }  // namespace profile
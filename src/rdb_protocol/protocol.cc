@@ -736,6 +736,7 @@ void rdb_r_unshard_visitor_t::operator()(const changefeed_subscribe_t &) {
              it != res->server_uuids.end(); ++it) {
             out->server_uuids.insert(std::move(*it));
         }
+        out->filter_addrs.insert(res->filter_addrs.begin(), res->filter_addrs.end());
     }
 }
 
@@ -1471,12 +1472,12 @@ RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(
     rget_read_response_t, stamp_response, result, reql_version);
 RDB_IMPL_SERIALIZABLE_1_FOR_CLUSTER(nearest_geo_read_response_t, results_or_error);
 RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(distribution_read_response_t, region, key_counts);
-RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(
-    changefeed_subscribe_response_t, server_uuids, addrs);
+RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(
+    changefeed_subscribe_response_t, server_uuids, addrs, filter_addrs);
 RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(
     changefeed_limit_subscribe_response_t, shards, limit_addrs);
-RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(
-    shard_stamp_info_t, stamp, shard_region, last_read_start);
+RDB_IMPL_SERIALIZABLE_4_FOR_CLUSTER(
+    shard_stamp_info_t, stamp, shard_region, last_read_start, log);
 RDB_IMPL_SERIALIZABLE_1_FOR_CLUSTER(changefeed_stamp_response_t, stamp_infos);
 
 RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(
@@ -1550,8 +1551,9 @@ RDB_IMPL_SERIALIZABLE_7_FOR_CLUSTER(
     serializable_env,
     region,
     current_shard);
-RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(changefeed_stamp_t, addr, region);
-RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(changefeed_point_stamp_t, addr, key);
+RDB_IMPL_SERIALIZABLE_4_FOR_CLUSTER(
+    changefeed_stamp_t, addr, region, filter, resume_from);
+RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(changefeed_point_stamp_t, addr, key, filter);
 
 RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(read_t, read, profile, read_mode);
 
@@ -108,6 +108,9 @@ struct shard_stamp_info_t {
     region_t shard_region;
     // The starting points of the reads (assuming left to right traversal)
     store_key_t last_read_start;
+    // Set if the stamp read asked for the change log (see
+    // `changefeed_stamp_t::resume_from`).
+    optional<ql::changefeed::log_read_t> log;
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(shard_stamp_info_t);
 
@@ -168,6 +171,7 @@ struct changefeed_subscribe_response_t {
     changefeed_subscribe_response_t() { }
     std::set<uuid_u> server_uuids;
     std::set<ql::changefeed::server_t::addr_t> addrs;
+    std::set<ql::changefeed::server_t::filter_addr_t> filter_addrs;
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(changefeed_subscribe_response_t);
 
@@ -289,6 +293,13 @@ struct changefeed_stamp_t {
         : addr(std::move(_addr)), region(region_t::universe()) { }
     ql::changefeed::client_t::addr_t addr;
     region_t region;
+    // Set if the stamp is for a new subscription, which registers its filter with
+    // the changefeed servers this way.
+    optional<ql::changefeed::change_filter_t> filter;
+    // Set if the subscription wants to know the change log positions, by the
+    // `server_t` uuid.  Servers that are in the map also send the changes after the
+    // position in it.
+    optional<std::map<uuid_u, uint64_t> > resume_from;
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(changefeed_stamp_t);
 
@@ -477,6 +488,8 @@ RDB_DECLARE_SERIALIZABLE(changefeed_limit_subscribe_t);
 struct changefeed_point_stamp_t {
     ql::changefeed::client_t::addr_t addr;
     store_key_t key;
+    // See `changefeed_stamp_t::filter`.
+    optional<ql::changefeed::change_filter_t> filter;
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(changefeed_point_stamp_t);
 
@@ -1,7 +1,9 @@
 // Copyright 2010-2015 RethinkDB, all rights reserved.
 #include "rdb_protocol/query_cache.hpp"
 
+#include "rdb_protocol/configured_limits.hpp"
 #include "rdb_protocol/env.hpp"
+#include "rdb_protocol/profile.hpp"
 #include "rdb_protocol/pseudo_time.hpp"
 #include "rdb_protocol/response.hpp"
 #include "rdb_protocol/term_walker.hpp"
@@ -206,13 +208,29 @@ void query_cache_t::ref_t::fill_response(response_t *res) {
             serializable,
             trace.get_or_null());
 
-        if (entry->state == entry_t::state_t::START) {
-            run(&env, res);
-            entry->term_tree.reset();
+        uint64_t memory_limit = 0;
+        scoped_ptr_t<val_t> memory_limit_arg = env.get_optarg(&env, "memory_limit");
+        if (memory_limit_arg.has()) {
+            memory_limit = check_limit("memory limit", memory_limit_arg->as_int());
         }
+        entry->resources.start_response();
+        env.set_query_resources(&entry->resources, memory_limit);
+
+        {
+            // Counts the datums unpacked while evaluating the query on this node.
+            profile::materialization_counter_t materializations(trace);
+            profile::materialization_scope_t materialization_scope(&materializations);
+            // Charges the time and memory spent on this batch to the query.
+            query_resources_scope_t resources_scope(&entry->resources);
+
+            if (entry->state == entry_t::state_t::START) {
+                run(&env, res);
+                entry->term_tree.reset();
+            }
 
-        if (entry->state == entry_t::state_t::STREAM) {
-            serve(&env, res);
+            if (entry->state == entry_t::state_t::STREAM) {
+                serve(&env, res);
+            }
         }
 
         if (trace.has()) {
@@ -26,6 +26,7 @@
 #include "rdb_protocol/env.hpp"
 #include "rdb_protocol/ql2proto.hpp"
 #include "rdb_protocol/query_params.hpp"
+#include "rdb_protocol/query_resources.hpp"
 #include "rdb_protocol/term.hpp"
 #include "rdb_protocol/term_storage.hpp"
 #include "rdb_protocol/wire_func.hpp"
@@ -136,6 +137,9 @@ private:
         counted_t<datum_stream_t> stream;
         bool has_sent_batch;
 
+        // What the query has used so far, for the `rethinkdb.jobs` table.
+        query_resources_t resources;
+
         // The order of these is very important, do not move them around
         new_mutex_t mutex; // Only one coroutine may be using this query at a time
         auto_drainer_t drainer; // Keep this entry alive until all refs are destroyed
@@ -0,0 +1,48 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "rdb_protocol/query_resources.hpp"
+
+#include "arch/runtime/coroutines.hpp"
+
+namespace ql {
+
+query_resources_scope_t::query_resources_scope_t(query_resources_t *resources)
+    : resources_(resources),
+      coro_(coro_t::self()),
+      thread_(get_thread_id()),
+      previous_cpu_counter_(nullptr),
+      previous_scope_(nullptr) {
+    if (resources_ == nullptr) {
+        return;
+    }
+    guarantee(coro_ != nullptr);
+    previous_cpu_counter_ = coro_->set_cpu_counter(&resources_->cpu_time);
+    previous_scope_ = coro_->set_query_resources_scope(this);
+}
+
+query_resources_scope_t::~query_resources_scope_t() {
+    if (resources_ == nullptr) {
+        return;
+    }
+    guarantee(get_thread_id() == thread_);
+    guarantee(coro_t::self() == coro_);
+    coro_->set_cpu_counter(previous_cpu_counter_);
+    query_resources_scope_t *scope = coro_->set_query_resources_scope(previous_scope_);
+    guarantee(scope == this);
+}
+
+void record_datum_allocation(size_t bytes) {
+    coro_t *self = coro_t::self();
+    if (self == nullptr) {
+        return;
+    }
+    query_resources_scope_t *scope = self->query_resources_scope();
+    // The resources belong to the thread the scope was constructed on, so we don't
+    // count what the coroutine allocates while it visits other threads.
+    if (scope == nullptr || scope->thread_ != get_thread_id()) {
+        return;
+    }
+    scope->resources_->allocated_bytes += bytes;
+    scope->resources_->response_allocated_bytes += bytes;
+}
+
+}  // namespace ql
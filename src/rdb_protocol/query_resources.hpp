@@ -0,0 +1,60 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#ifndef RDB_PROTOCOL_QUERY_RESOURCES_HPP_
+#define RDB_PROTOCOL_QUERY_RESOURCES_HPP_
+
+#include "errors.hpp"
+#include "threading.hpp"
+#include "time.hpp"
+
+class coro_t;
+
+namespace ql {
+
+/* The resources a query has used so far, which `rethinkdb.jobs` shows while it runs.
+ * `cpu_time` is the time the query's coroutine spent running, and `allocated_bytes`
+ * counts the arrays, objects and strings it built.  Work the query hands to other
+ * coroutines isn't counted.  `response_allocated_bytes` only counts what was built
+ * for the response that's being computed, and is what the `memory_limit` optarg is
+ * checked against. */
+class query_resources_t {
+public:
+    query_resources_t()
+        : cpu_time(ticks_t{0}), allocated_bytes(0), response_allocated_bytes(0) { }
+
+    void start_response() { response_allocated_bytes = 0; }
+
+    ticks_t cpu_time;
+    uint64_t allocated_bytes;
+    uint64_t response_allocated_bytes;
+
+private:
+    DISABLE_COPYING(query_resources_t);
+};
+
+/* While a query_resources_scope_t exists, the time the coroutine that constructed it
+ * spends running, and the datums it allocates on this thread, are charged to
+ * `resources`.  Scopes must be destroyed by the coroutine that constructed them, on
+ * the thread they were constructed on.  If `resources` is null, the scope does
+ * nothing. */
+class query_resources_scope_t {
+public:
+    explicit query_resources_scope_t(query_resources_t *resources);
+    ~query_resources_scope_t();
+private:
+    friend void record_datum_allocation(size_t bytes);
+    query_resources_t *resources_;
+    coro_t *coro_;
+    threadnum_t thread_;
+    ticks_t *previous_cpu_counter_;
+    query_resources_scope_t *previous_scope_;
+
+    DISABLE_COPYING(query_resources_scope_t);
+};
+
+// Called by the datum code whenever it allocates memory for an array, an object or
+// a string.
+void record_datum_allocation(size_t bytes);
+
+}  // namespace ql
+
+#endif  // RDB_PROTOCOL_QUERY_RESOURCES_HPP_
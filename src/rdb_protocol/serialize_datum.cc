@@ -1,6 +1,7 @@
 // Copyright 2010-2014 RethinkDB, all rights reserved.
 #include "rdb_protocol/serialize_datum.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <functional>
 #include <limits>
@@ -866,6 +867,16 @@ std::pair<datum_string_t, datum_t> datum_deserialize_pair_from_buf(
     return std::make_pair(std::move(key), std::move(value));
 }
 
+size_t datum_get_array_serialized_size(const shared_buf_ref_t<char> &array) {
+    buffer_read_stream_t sz_read_stream(array.get(), array.get_safety_boundary());
+    uint64_t ser_size;
+    guarantee_deserialization(deserialize_varint_uint64(&sz_read_stream, &ser_size),
+                              "datum decode array");
+    const uint64_t total_size = sz_read_stream.tell() + ser_size;
+    guarantee(total_size <= array.get_safety_boundary());
+    return static_cast<size_t>(total_size);
+}
+
 /* The format of `array` is:
      varint ser_size
      varint num_elements
@@ -966,6 +977,176 @@ size_t datum_get_element_offset(const shared_buf_ref_t<char> &array, size_t inde
     }
 }
 
+// Random access to an object serialized by `datum_serialize`, for reading single
+// fields through the offset table without copying the whole serialization.
+class serialized_object_reader_t {
+public:
+    serialized_object_reader_t(
+            size_t _total_size,
+            const std::function<void(size_t, size_t, char *)> &_read)
+        : total_size(_total_size), read(_read), num_elements(0),
+          offset_table(0), offset_size(datum_offset_size_t::U8BIT),
+          serialized_offset_size(0), data_offset(0) { }
+
+    // Returns false if the datum isn't a `BUF_R_OBJECT`.
+    MUST_USE bool init() {
+        // The type, and the varints `ser_size` and `num_elements`.
+        char header[1 + 2 * 10];
+        const size_t header_size = std::min(total_size, sizeof(header));
+        read(0, header_size, header);
+        buffer_read_stream_t s(header, header_size);
+        datum_serialized_type_t type;
+        if (bad(datum_deserialize(&s, &type))
+            || type != datum_serialized_type_t::BUF_R_OBJECT) {
+            return false;
+        }
+        uint64_t ser_size;
+        guarantee_deserialization(deserialize_varint_uint64(&s, &ser_size),
+                                  "datum decode object");
+        guarantee(1 + varint_uint64_serialized_size(ser_size) + ser_size
+                  == total_size);
+        uint64_t num = 0;
+        guarantee_deserialization(deserialize_varint_uint64(&s, &num),
+                                  "datum decode object");
+        guarantee(num <= std::numeric_limits<size_t>::max());
+        num_elements = static_cast<size_t>(num);
+
+        offset_size = get_offset_size_from_inner_size(ser_size);
+        switch (offset_size) {
+        case datum_offset_size_t::U8BIT:
+            serialized_offset_size = serialize_universal_size_t<uint8_t>::value; break;
+        case datum_offset_size_t::U16BIT:
+            serialized_offset_size = serialize_universal_size_t<uint16_t>::value; break;
+        case datum_offset_size_t::U32BIT:
+            serialized_offset_size = serialize_universal_size_t<uint32_t>::value; break;
+        case datum_offset_size_t::U64BIT:
+            serialized_offset_size = serialize_universal_size_t<uint64_t>::value; break;
+        default:
+            unreachable();
+        }
+        offset_table = static_cast<size_t>(s.tell());
+        data_offset = num_elements == 0
+            ? offset_table
+            : offset_table + (num_elements - 1) * serialized_offset_size;
+        return true;
+    }
+
+    size_t size() const { return num_elements; }
+
+    size_t element_offset(size_t index) const {
+        guarantee(index < num_elements);
+        if (index == 0) {
+            return data_offset;
+        }
+        char buf[sizeof(uint64_t)];
+        read(offset_table + (index - 1) * serialized_offset_size,
+             serialized_offset_size, buf);
+        buffer_read_stream_t s(buf, serialized_offset_size);
+        uint64_t off;
+        archive_result_t res;
+        switch (offset_size) {
+        case datum_offset_size_t::U8BIT: {
+            uint8_t o = 0;
+            res = deserialize_universal(&s, &o);
+            off = o;
+        } break;
+        case datum_offset_size_t::U16BIT: {
+            uint16_t o = 0;
+            res = deserialize_universal(&s, &o);
+            off = o;
+        } break;
+        case datum_offset_size_t::U32BIT: {
+            uint32_t o = 0;
+            res = deserialize_universal(&s, &o);
+            off = o;
+        } break;
+        case datum_offset_size_t::U64BIT:
+            res = deserialize_universal(&s, &off);
+            break;
+        default:
+            unreachable();
+        }
+        guarantee_deserialization(res, "datum decode object offset");
+        guarantee(off <= total_size - data_offset);
+        return data_offset + static_cast<size_t>(off);
+    }
+
+    size_t element_end(size_t index) const {
+        return index + 1 < num_elements ? element_offset(index + 1) : total_size;
+    }
+
+    // Compares `key` to the key of the pair at `offset`.  Sets `*value_offset_out`
+    // to where the value of the pair starts.
+    int compare_key(const datum_string_t &key, size_t offset, size_t end,
+                    size_t *value_offset_out) const {
+        char size_buf[10];
+        const size_t size_buf_size = std::min(end - offset, sizeof(size_buf));
+        read(offset, size_buf_size, size_buf);
+        buffer_read_stream_t s(size_buf, size_buf_size);
+        uint64_t key_size;
+        guarantee_deserialization(deserialize_varint_uint64(&s, &key_size),
+                                  "datum decode object key");
+        const size_t key_offset = offset + static_cast<size_t>(s.tell());
+        guarantee(key_size <= end - key_offset);
+        std::string other(static_cast<size_t>(key_size), '\0');
+        read(key_offset, other.size(), &other[0]);
+        *value_offset_out = key_offset + other.size();
+        return key.compare(datum_string_t(other.size(), other.data()));
+    }
+
+    datum_t read_value(size_t offset, size_t end) const {
+        counted_t<shared_buf_t> buf = shared_buf_t::create(end - offset);
+        read(offset, end - offset, buf->data());
+        return datum_deserialize_from_buf(shared_buf_ref_t<char>(std::move(buf), 0), 0);
+    }
+
+private:
+    const size_t total_size;
+    const std::function<void(size_t, size_t, char *)> &read;
+    size_t num_elements;
+    size_t offset_table;
+    datum_offset_size_t offset_size;
+    size_t serialized_offset_size;
+    size_t data_offset;
+
+    DISABLE_COPYING(serialized_object_reader_t);
+};
+
+bool datum_deserialize_fields(
+        size_t total_size,
+        const std::function<void(size_t, size_t, char *)> &read,
+        const std::vector<datum_string_t> &keys,
+        std::vector<std::pair<datum_string_t, datum_t> > *fields_out) {
+    serialized_object_reader_t reader(total_size, read);
+    if (!reader.init()) {
+        return false;
+    }
+    // The pairs are sorted by key, and so are `keys`, so every search can start
+    // where the previous one ended.
+    size_t range_beg = 0;
+    for (const datum_string_t &key : keys) {
+        size_t range_end = reader.size();
+        while (range_beg < range_end) {
+            const size_t center = range_beg + ((range_end - range_beg) / 2);
+            const size_t end = reader.element_end(center);
+            size_t value_offset;
+            const int cmp_res = reader.compare_key(key, reader.element_offset(center),
+                                                   end, &value_offset);
+            if (cmp_res == 0) {
+                fields_out->push_back(
+                    std::make_pair(key, reader.read_value(value_offset, end)));
+                range_beg = center + 1;
+                break;
+            } else if (cmp_res < 0) {
+                range_end = center;
+            } else {
+                range_beg = center + 1;
+            }
+        }
+    }
+    return true;
+}
+
 size_t datum_serialized_size(const datum_string_t &s) {
     const size_t s_size = s.size();
     return varint_uint64_serialized_size(s_size) + s_size;
@@ -989,6 +1170,21 @@ MUST_USE archive_result_t datum_deserialize(
         return archive_result_t::RANGE_ERROR;
     }
 
+    if (sz <= datum_string_t::MAX_INLINE_SIZE) {
+        // Short strings are stored inline, so there's no point in allocating a
+        // buffer for them.
+        char data[datum_string_t::MAX_INLINE_SIZE];
+        int64_t num_read = force_read(s, data, sz);
+        if (num_read == -1) {
+            return archive_result_t::SOCK_ERROR;
+        }
+        if (static_cast<uint64_t>(num_read) < sz) {
+            return archive_result_t::SOCK_EOF;
+        }
+        *out = datum_string_t(static_cast<size_t>(sz), data);
+        return archive_result_t::SUCCESS;
+    }
+
     const size_t str_offset = varint_uint64_serialized_size(sz);
     counted_t<shared_buf_t> buf =
         shared_buf_t::create(str_offset + static_cast<size_t>(sz));
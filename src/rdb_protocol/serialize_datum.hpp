@@ -1,7 +1,9 @@
 #ifndef RDB_PROTOCOL_SERIALIZE_DATUM_HPP_
 #define RDB_PROTOCOL_SERIALIZE_DATUM_HPP_
 
+#include <functional>
 #include <utility>
+#include <vector>
 
 #include "containers/archive/archive.hpp"
 #include "containers/archive/buffer_group_stream.hpp"
@@ -57,6 +59,20 @@ std::pair<datum_string_t, datum_t> datum_deserialize_pair_from_buf(
 size_t datum_get_element_offset(const shared_buf_ref_t<char> &array, size_t index);
 // Reads the number of elements in the array stored in the buffer
 size_t datum_get_array_size(const shared_buf_ref_t<char> &array);
+// Returns the number of bytes the array (or object) stored in the buffer occupies
+// in it, not counting the type byte in front of it
+size_t datum_get_array_serialized_size(const shared_buf_ref_t<char> &array);
+
+// Reads the top-level fields `keys` (which must be sorted) of an object serialized
+// by `datum_serialize` through its offset table, without copying the rest of the
+// serialization.  `read(offset, size, out)` must copy `size` bytes at `offset` of
+// the `total_size` bytes long serialization to `out`.  Appends the fields that exist
+// to `*fields_out`.  Returns false if the datum isn't serialized as a `BUF_R_OBJECT`.
+bool datum_deserialize_fields(
+        size_t total_size,
+        const std::function<void(size_t, size_t, char *)> &read,
+        const std::vector<datum_string_t> &keys,
+        std::vector<std::pair<datum_string_t, datum_t> > *fields_out);
 
 size_t datum_serialized_size(const datum_string_t &s);
 serialization_result_t datum_serialize(write_message_t *wm, const datum_string_t &s);
@@ -1,6 +1,7 @@
 // Copyright 2010-2014 RethinkDB, all rights reserved.
 #include "rdb_protocol/shards.hpp"
 
+#include <unordered_map>
 #include <utility>
 
 #include "errors.hpp"
@@ -8,8 +9,10 @@
 
 #include "debug.hpp"
 #include "rdb_protocol/func.hpp"
+#include "rdb_protocol/order_util.hpp"
 #include "rdb_protocol/profile.hpp"
 #include "rdb_protocol/protocol.hpp"
+#include "random.hpp"
 
 bool reversed(sorting_t sorting) { return sorting == sorting_t::DESCENDING; }
 
@@ -67,6 +70,13 @@ void dprint(const char *s, const datum_t &t) {
 }
 #endif // NDEBUG
 
+// While accumulating we don't need the groups to be ordered (see the comment on
+// `grouped_t`), so we keep them in a hash table instead of comparing group keys
+// O(log(groups)) times for every row, and only sort them once at the end.
+template<class T>
+using grouped_acc_map_t =
+    std::unordered_map<datum_t, T, optional_datum_hash_t, optional_datum_equal_t>;
+
 template<class T>
 class grouped_acc_t : public accumulator_t {
 protected:
@@ -76,8 +86,11 @@ protected:
 
     virtual void finish_impl(continue_bool_t, result_t *out) {
         *out = grouped_t<T>();
-        boost::get<grouped_t<T> >(*out).swap(acc);
-        guarantee(acc.size() == 0);
+        grouped_t<T> *res = boost::get<grouped_t<T> >(out);
+        for (auto &&pair : acc) {
+            res->insert(std::make_pair(pair.first, std::move(pair.second)));
+        }
+        acc.clear();
     }
 private:
     virtual continue_bool_t operator()(
@@ -108,7 +121,7 @@ private:
 
     virtual void unshard(env_t *env, const std::vector<result_t *> &results) {
         guarantee(acc.size() == 0);
-        std::map<datum_t, std::vector<T *>, optional_datum_less_t> vecs;
+        grouped_acc_map_t<std::vector<T *> > vecs;
         r_sanity_check(results.size() != 0);
         for (auto res = results.begin(); res != results.end(); ++res) {
             guarantee(*res);
@@ -127,10 +140,10 @@ private:
 
 protected:
     const T *get_default_val() { return &default_val; }
-    grouped_t<T> *get_acc() { return &acc; }
+    grouped_acc_map_t<T> *get_acc() { return &acc; }
 private:
     const T default_val;
-    grouped_t<T> acc;
+    grouped_acc_map_t<T> acc;
 };
 
 class append_t : public grouped_acc_t<stream_t> {
@@ -511,7 +524,7 @@ protected:
     explicit terminal_t(T &&t) : grouped_acc_t<T>(std::move(t)) { }
 private:
     virtual void operator()(env_t *env, groups_t *groups) {
-        grouped_t<T> *_acc = grouped_acc_t<T>::get_acc();
+        grouped_acc_map_t<T> *_acc = grouped_acc_t<T>::get_acc();
         const T *_default_val = grouped_acc_t<T>::get_default_val();
         for (auto it = groups->begin(); it != groups->end(); ++it) {
             auto pair = _acc->insert(std::make_pair(it->first, *_default_val));
@@ -531,7 +544,7 @@ private:
                                              bool is_grouped,
                                              UNUSED const configured_limits_t &limits) {
         accumulator_t::mark_finished();
-        grouped_t<T> *_acc = grouped_acc_t<T>::get_acc();
+        grouped_acc_map_t<T> *_acc = grouped_acc_t<T>::get_acc();
         const T *_default_val = grouped_acc_t<T>::get_default_val();
         scoped_ptr_t<val_t> retval;
         if (is_grouped) {
@@ -556,21 +569,20 @@ private:
     virtual datum_t unpack(T *t) = 0;
 
     virtual void add_res(env_t *env, result_t *res, sorting_t) {
-        grouped_t<T> *_acc = grouped_acc_t<T>::get_acc();
-        const T *_default_val = grouped_acc_t<T>::get_default_val();
+        grouped_acc_map_t<T> *_acc = grouped_acc_t<T>::get_acc();
         if (auto e = boost::get<exc_t>(res)) {
             throw *e;
         }
         grouped_t<T> *gres = boost::get<grouped_t<T> >(res);
         r_sanity_check(gres);
-        if (_acc->size() == 0) {
-            _acc->swap(*gres);
-        } else {
-            // Order in fact does NOT matter here.  The reason is, each `kv->first`
-            // value is different, which means each operation works on a different
-            // key/value pair of `acc`.
-            for (auto kv = gres->begin(); kv != gres->end(); ++kv) {
-                auto t_it = _acc->insert(std::make_pair(kv->first, *_default_val)).first;
+        // Order in fact does NOT matter here.  The reason is, each `kv->first`
+        // value is different, which means each operation works on a different
+        // key/value pair of `acc`.
+        for (auto kv = gres->begin(); kv != gres->end(); ++kv) {
+            auto t_it = _acc->find(kv->first);
+            if (t_it == _acc->end()) {
+                _acc->insert(std::make_pair(kv->first, std::move(kv->second)));
+            } else {
                 unshard_impl(env, &t_it->second, &kv->second);
             }
         }
@@ -603,6 +615,12 @@ public:
         : terminal_t<uint64_t>(0) { }
 private:
     virtual bool uses_val() { return false; }
+    virtual bool counts_rows_only() { return true; }
+    virtual void add_count(uint64_t count) {
+        grouped_acc_map_t<uint64_t> *acc = get_acc();
+        auto it = acc->insert(std::make_pair(datum_t(), *get_default_val())).first;
+        it->second += count;
+    }
     virtual bool accumulate(env_t *,
                             const datum_t &,
                             uint64_t *out) {
@@ -709,6 +727,64 @@ private:
     }
 };
 
+class approx_count_distinct_terminal_t : public skip_terminal_t<hyperloglog_t> {
+public:
+    explicit approx_count_distinct_terminal_t(
+        const approx_count_distinct_wire_func_t &_f)
+        : skip_terminal_t<hyperloglog_t>(_f, hyperloglog_t()) { }
+private:
+    virtual void maybe_acc(env_t *env,
+                           const datum_t &el,
+                           hyperloglog_t *out,
+                           const acc_func_t &_f) {
+        out->add(sketch_hash(_f(env, el)));
+    }
+    virtual datum_t unpack(hyperloglog_t *h) {
+        return datum_t(static_cast<double>(h->estimate()));
+    }
+    virtual void unshard_impl(env_t *, hyperloglog_t *out, hyperloglog_t *el) {
+        out->merge(*el);
+    }
+};
+
+class approx_quantile_terminal_t : public skip_terminal_t<tdigest_t> {
+public:
+    explicit approx_quantile_terminal_t(const approx_quantile_wire_func_t &_f)
+        : skip_terminal_t<tdigest_t>(_f, tdigest_t()),
+          quantiles(_f.quantiles),
+          single(_f.single) { }
+private:
+    virtual void maybe_acc(env_t *env,
+                           const datum_t &el,
+                           tdigest_t *out,
+                           const acc_func_t &_f) {
+        out->add(_f(env, el).as_num());
+    }
+    virtual datum_t unpack(tdigest_t *t) {
+        rcheck_datum(!t->empty(), base_exc_t::NON_EXISTENCE,
+                     "Cannot take a quantile of an empty stream.  (If you passed "
+                     "`approx_quantile` a field name, it may be that no elements of "
+                     "the stream had that field.)");
+        if (single) {
+            r_sanity_check(quantiles.size() == 1);
+            return datum_t(t->quantile(quantiles[0]));
+        }
+        std::vector<datum_t> ret;
+        ret.reserve(quantiles.size());
+        for (double q : quantiles) {
+            ret.push_back(datum_t(t->quantile(q)));
+        }
+        // The quantiles came from an array, so they fit into one.
+        return datum_t(std::move(ret), datum_t::no_array_size_limit_check_t());
+    }
+    virtual void unshard_impl(env_t *, tdigest_t *out, tdigest_t *el) {
+        out->merge(el);
+    }
+
+    const std::vector<double> quantiles;
+    const bool single;
+};
+
 optimizer_t::optimizer_t() { }
 optimizer_t::optimizer_t(const datum_t &_row,
                          const datum_t &_val)
@@ -805,6 +881,193 @@ private:
     counted_t<const func_t> f;
 };
 
+class top_k_terminal_t : public terminal_t<top_k_t> {
+public:
+    explicit top_k_terminal_t(const top_k_wire_func_t &f)
+        : terminal_t<top_k_t>(top_k_t()),
+          n(f.n),
+          lt_cmp(f.compile_comparisons()),
+          bt(f.bt) { }
+private:
+    bool row_lt(const top_k_t::row_t &l, const top_k_t::row_t &r) const {
+        if (lt_cmp.key_lt(l.key, r.key)) {
+            return true;
+        } else if (lt_cmp.key_lt(r.key, l.key)) {
+            return false;
+        } else {
+            return l.tag < r.tag;
+        }
+    }
+    void push(top_k_t::row_t &&row, top_k_t *out) {
+        auto cmp = [this](const top_k_t::row_t &l, const top_k_t::row_t &r) {
+            return row_lt(l, r);
+        };
+        if (out->heap.size() < n) {
+            out->heap.push_back(std::move(row));
+            std::push_heap(out->heap.begin(), out->heap.end(), cmp);
+        } else if (n != 0 && row_lt(row, out->heap.front())) {
+            std::pop_heap(out->heap.begin(), out->heap.end(), cmp);
+            out->heap.back() = std::move(row);
+            std::push_heap(out->heap.begin(), out->heap.end(), cmp);
+        }
+    }
+    virtual bool accumulate(env_t *env,
+                            const datum_t &el,
+                            top_k_t *out) {
+        if (n != 0) {
+            top_k_t::row_t row;
+            try {
+                row.key = lt_cmp.key(env, el);
+            } catch (const datum_exc_t &e) {
+                throw exc_t(e, bt);
+            }
+            row.row = el;
+            row.tag = out->next_tag++;
+            push(std::move(row), out);
+        }
+        return true;
+    }
+    virtual datum_t unpack(top_k_t *t) {
+        std::sort_heap(t->heap.begin(), t->heap.end(),
+                       [this](const top_k_t::row_t &l, const top_k_t::row_t &r) {
+                           return row_lt(l, r);
+                       });
+        std::vector<datum_t> rows;
+        rows.reserve(t->heap.size());
+        for (auto &&row : t->heap) {
+            rows.push_back(std::move(row.row));
+        }
+        t->heap.clear();
+        // `n` was checked against the array size limit before the read was sent.
+        return datum_t(std::move(rows), datum_t::no_array_size_limit_check_t());
+    }
+    virtual void unshard_impl(env_t *, top_k_t *out, top_k_t *el) {
+        // The rows from `el` count as having arrived after the ones in `out`.
+        std::sort(el->heap.begin(), el->heap.end(),
+                  [](const top_k_t::row_t &l, const top_k_t::row_t &r) {
+                      return l.tag < r.tag;
+                  });
+        for (auto &&row : el->heap) {
+            row.tag = out->next_tag++;
+            push(std::move(row), out);
+        }
+        el->heap.clear();
+    }
+
+    const size_t n;
+    const lt_cmp_t lt_cmp;
+    backtrace_id_t bt;
+};
+
+class hash_distinct_terminal_t : public terminal_t<distinct_set_t> {
+public:
+    explicit hash_distinct_terminal_t(const hash_distinct_wire_func_t &f)
+        : terminal_t<distinct_set_t>(distinct_set_t()), bt(f.bt) { }
+private:
+    void check_size(env_t *env, const distinct_set_t &d) {
+        rcheck_src(bt,
+                   d.rows.size() <= env->limits().array_size_limit(),
+                   base_exc_t::RESOURCE,
+                   format_array_size_error(env->limits().array_size_limit()));
+    }
+    virtual bool accumulate(env_t *env,
+                            const datum_t &el,
+                            distinct_set_t *out) {
+        if (out->rows.insert(el).second) {
+            check_size(env, *out);
+        }
+        return true;
+    }
+    virtual datum_t unpack(distinct_set_t *d) {
+        std::vector<datum_t> rows(d->rows.begin(), d->rows.end());
+        d->rows.clear();
+        std::sort(rows.begin(), rows.end(), optional_datum_less_t());
+        // The size was checked as the rows got inserted.
+        return datum_t(std::move(rows), datum_t::no_array_size_limit_check_t());
+    }
+    virtual void unshard_impl(env_t *env, distinct_set_t *out, distinct_set_t *el) {
+        if (out->rows.empty()) {
+            out->rows.swap(el->rows);
+        } else {
+            for (auto &&row : el->rows) {
+                out->rows.insert(row);
+            }
+            el->rows.clear();
+        }
+        check_size(env, *out);
+    }
+
+    backtrace_id_t bt;
+};
+
+// Reservoir sampling (Algorithm R) on every shard.  Two reservoirs get merged by
+// drawing rows from them in proportion to the number of rows each has seen, which
+// gives a uniform sample of the union without the shards sending all of their rows.
+class sample_terminal_t : public terminal_t<reservoir_t> {
+public:
+    explicit sample_terminal_t(const sample_wire_func_t &f)
+        : terminal_t<reservoir_t>(reservoir_t()), n(f.n) { }
+private:
+    static void shuffle(std::vector<datum_t> *rows) {
+        for (size_t i = rows->size(); i > 1; --i) {
+            std::swap((*rows)[i - 1], (*rows)[randuint64(i)]);
+        }
+    }
+    virtual bool accumulate(env_t *,
+                            const datum_t &el,
+                            reservoir_t *out) {
+        out->seen += 1;
+        if (out->rows.size() < n) {
+            out->rows.push_back(el);
+        } else {
+            uint64_t i = randuint64(out->seen);
+            if (i < n) {
+                out->rows[i] = el;
+            }
+        }
+        return true;
+    }
+    virtual datum_t unpack(reservoir_t *r) {
+        shuffle(&r->rows);
+        // `n` was checked against the array size limit before the read was sent.
+        datum_t ret(std::move(r->rows), datum_t::no_array_size_limit_check_t());
+        r->rows.clear();
+        return ret;
+    }
+    virtual void unshard_impl(env_t *, reservoir_t *out, reservoir_t *el) {
+        if (el->seen == 0) {
+            return;
+        } else if (out->seen == 0) {
+            std::swap(*out, *el);
+            return;
+        }
+        // A random prefix of a shuffled uniform sample is a uniform sample too.
+        shuffle(&out->rows);
+        shuffle(&el->rows);
+        uint64_t left = out->seen, right = el->seen;
+        size_t i = 0, j = 0;
+        std::vector<datum_t> rows;
+        rows.reserve(std::min<uint64_t>(n, left + right));
+        while (rows.size() < n && left + right > 0) {
+            if (randuint64(left + right) < left) {
+                r_sanity_check(i < out->rows.size());
+                rows.push_back(std::move(out->rows[i++]));
+                --left;
+            } else {
+                r_sanity_check(j < el->rows.size());
+                rows.push_back(std::move(el->rows[j++]));
+                --right;
+            }
+        }
+        out->rows = std::move(rows);
+        out->seen += el->seen;
+        el->rows.clear();
+        el->seen = 0;
+    }
+
+    const size_t n;
+};
+
 template<class T>
 class terminal_visitor_t : public boost::static_visitor<T *> {
 public:
@@ -826,6 +1089,21 @@ public:
     T *operator()(const reduce_wire_func_t &f) const {
         return new reduce_terminal_t(f);
     }
+    T *operator()(const top_k_wire_func_t &f) const {
+        return new top_k_terminal_t(f);
+    }
+    T *operator()(const hash_distinct_wire_func_t &f) const {
+        return new hash_distinct_terminal_t(f);
+    }
+    T *operator()(const sample_wire_func_t &f) const {
+        return new sample_terminal_t(f);
+    }
+    T *operator()(const approx_count_distinct_wire_func_t &f) const {
+        return new approx_count_distinct_terminal_t(f);
+    }
+    T *operator()(const approx_quantile_wire_func_t &f) const {
+        return new approx_quantile_terminal_t(f);
+    }
     T *operator()(const limit_read_t &lr) const {
         return new limit_append_t(
             lr.is_primary,
@@ -987,9 +1265,8 @@ private:
     virtual void lst_transform(
         env_t *env, datums_t *lst, const std::function<datum_t()> &) {
         try {
-            for (auto it = lst->begin(); it != lst->end(); ++it) {
-                *it = f->call(env, *it)->as_datum();
-            }
+            // A JavaScript function evaluates the whole batch in one round trip.
+            f->call_batch(env, lst);
         } catch (const datum_exc_t &e) {
             throw exc_t(e, f->backtrace(), 1);
         }
@@ -1039,12 +1316,12 @@ public:
 private:
     virtual void lst_transform(
         env_t *env, datums_t *lst, const std::function<datum_t()> &) {
-        auto it = lst->begin();
-        auto loc = it;
+        auto loc = lst->begin();
         try {
-            for (it = lst->begin(); it != lst->end(); ++it) {
-                if (f->filter_call(env, *it, default_val)) {
-                    std::swap(*loc, *it);
+            std::vector<bool> keep = f->filter_call_batch(env, *lst, default_val);
+            for (size_t i = 0; i < keep.size(); ++i) {
+                if (keep[i]) {
+                    std::swap(*loc, (*lst)[i]);
                     ++loc;
                 }
             }
@@ -1128,6 +1405,75 @@ scoped_ptr_t<op_t> make_op(const transform_variant_t &tv) {
     return scoped_ptr_t<op_t>(boost::apply_visitor(transform_visitor_t(), tv));
 }
 
+bool row_pushdown_t::check(const datum_t &partial_row, bool *passes_out) const {
+    const std::vector<datum_t> args{partial_row};
+    datum_t res;
+    for (const auto &predicate : predicates) {
+        if (!predicate->run(args, &res)) {
+            return false;
+        }
+        // This is what `reql_func_t::filter_helper` does for non-object bodies.
+        if (!res.as_bool()) {
+            *passes_out = false;
+            return true;
+        }
+    }
+    // The projection will be evaluated on the partial row later, and must not
+    // fall back to the term tree there, since errors would print the partial row.
+    if (projection.has() && !projection->run(args, &res)) {
+        return false;
+    }
+    *passes_out = true;
+    return true;
+}
+
+optional<row_pushdown_t> make_row_pushdown(
+        const std::vector<transform_variant_t> &transforms,
+        bool accumulator_uses_val) {
+    if (transforms.empty()) {
+        return r_nullopt;
+    }
+    row_pushdown_t ret;
+    size_t i = 0;
+    for (; i < transforms.size(); ++i) {
+        if (const filter_wire_func_t *filter
+                = boost::get<filter_wire_func_t>(&transforms[i])) {
+            counted_t<const func_t> f = filter->filter_func.compile_wire_func();
+            if (!f->arg_fields_only(&ret.fields)) {
+                break;
+            }
+            // Predicates the bytecode can't handle (like the `has_fields` of
+            // `with_fields`) still only look at `fields`, so we just leave them to
+            // the transformations.
+            counted_t<const bytecode_program_t> program = f->get_bytecode();
+            if (program.has()) {
+                ret.predicates.push_back(std::move(program));
+            }
+        } else if (const map_wire_func_t *map
+                       = boost::get<map_wire_func_t>(&transforms[i])) {
+            counted_t<const func_t> f = map->compile_wire_func();
+            if (f->arg_fields_only(&ret.fields)) {
+                // Whatever comes after the `map` only sees its result.
+                ret.projection = f->get_bytecode();
+                ret.partial_rows_suffice = true;
+            }
+            break;
+        } else {
+            break;
+        }
+    }
+    if (i == transforms.size() && !accumulator_uses_val) {
+        ret.partial_rows_suffice = true;
+    }
+    if (!ret.partial_rows_suffice && ret.predicates.empty()) {
+        return r_nullopt;
+    }
+    std::sort(ret.fields.begin(), ret.fields.end());
+    ret.fields.erase(std::unique(ret.fields.begin(), ret.fields.end()),
+                     ret.fields.end());
+    return make_optional(std::move(ret));
+}
+
 RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(rget_item_t, key, sindex_key, data);
 RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(keyed_stream_t, stream, last_key);
 RDB_IMPL_SERIALIZABLE_1_FOR_CLUSTER(stream_t, substreams);
@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <limits>
 #include <map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -15,10 +16,12 @@
 #include "containers/archive/varint.hpp"
 #include "containers/uuid.hpp"
 #include "rdb_protocol/batching.hpp"
+#include "rdb_protocol/bytecode.hpp"
 #include "rdb_protocol/configured_limits.hpp"
 #include "rdb_protocol/datum.hpp"
 #include "rdb_protocol/datum_utils.hpp"
 #include "rdb_protocol/profile.hpp"
+#include "rdb_protocol/sketch.hpp"
 #include "rdb_protocol/wire_func.hpp"
 #include "region/region.hpp"
 #include "stl_utils.hpp"
@@ -149,6 +152,37 @@ archive_result_t deserialize_grouped(read_stream_t *s, optimizer_t *o) {
     return archive_result_t::SUCCESS;
 }
 
+// The state of a `top_k` terminal: a max-heap of the best rows seen so far.
+class top_k_t {
+public:
+    struct row_t {
+        datum_t row;
+        // The values of the `order_by` functions for `row` (see `lt_cmp_t::key`).
+        std::vector<datum_t> key;
+        // The order in which the rows arrived, so that ties are broken the same way
+        // that the stable in-memory sort breaks them.
+        uint64_t tag;
+    };
+    top_k_t() : next_tag(0) { }
+    std::vector<row_t> heap;
+    uint64_t next_tag;
+};
+
+// The state of a `hash_distinct` terminal: the distinct rows seen so far.
+class distinct_set_t {
+public:
+    std::unordered_set<datum_t, optional_datum_hash_t, optional_datum_equal_t> rows;
+};
+
+// The state of a `sample` terminal: a uniform sample of the rows seen so far, and how
+// many rows that was.
+class reservoir_t {
+public:
+    reservoir_t() : seen(0) { }
+    std::vector<datum_t> rows;
+    uint64_t seen;
+};
+
 // We write all of these serializations and deserializations explicitly because:
 // * It stops people from inadvertently using a new `grouped_t<T>` without thinking.
 // * Some grouped elements need specialized serialization.
@@ -220,6 +254,221 @@ archive_result_t deserialize_grouped(read_stream_t *s, datums_t *ds) {
     return deserialize<W>(s, ds);
 }
 
+template <cluster_version_t W>
+void serialize_grouped(write_message_t *wm, const top_k_t &t) {
+    serialize_varint_uint64(wm, t.heap.size());
+    for (const auto &row : t.heap) {
+        serialize<W>(wm, row.row);
+        serialize_varint_uint64(wm, row.key.size());
+        for (const auto &d : row.key) {
+            serialize_grouped<W>(wm, d);
+        }
+        serialize_varint_uint64(wm, row.tag);
+    }
+    serialize_varint_uint64(wm, t.next_tag);
+}
+template <cluster_version_t W>
+archive_result_t deserialize_grouped(read_stream_t *s, top_k_t *t) {
+    uint64_t sz;
+    archive_result_t res = deserialize_varint_uint64(s, &sz);
+    if (bad(res)) { return res; }
+    if (sz > std::numeric_limits<size_t>::max()) {
+        return archive_result_t::RANGE_ERROR;
+    }
+    t->heap.resize(sz);
+    for (auto &row : t->heap) {
+        res = deserialize<W>(s, &row.row);
+        if (bad(res)) { return res; }
+        uint64_t key_sz;
+        res = deserialize_varint_uint64(s, &key_sz);
+        if (bad(res)) { return res; }
+        if (key_sz > std::numeric_limits<size_t>::max()) {
+            return archive_result_t::RANGE_ERROR;
+        }
+        row.key.resize(key_sz);
+        for (auto &d : row.key) {
+            res = deserialize_grouped<W>(s, &d);
+            if (bad(res)) { return res; }
+        }
+        res = deserialize_varint_uint64(s, &row.tag);
+        if (bad(res)) { return res; }
+    }
+    return deserialize_varint_uint64(s, &t->next_tag);
+}
+
+template <cluster_version_t W>
+void serialize_grouped(write_message_t *wm, const reservoir_t &r) {
+    serialize_varint_uint64(wm, r.rows.size());
+    for (const auto &row : r.rows) {
+        serialize<W>(wm, row);
+    }
+    serialize_varint_uint64(wm, r.seen);
+}
+template <cluster_version_t W>
+archive_result_t deserialize_grouped(read_stream_t *s, reservoir_t *r) {
+    uint64_t sz;
+    archive_result_t res = deserialize_varint_uint64(s, &sz);
+    if (bad(res)) { return res; }
+    if (sz > std::numeric_limits<size_t>::max()) {
+        return archive_result_t::RANGE_ERROR;
+    }
+    r->rows.resize(sz);
+    for (uint64_t i = 0; i < sz; ++i) {
+        res = deserialize<W>(s, &r->rows[i]);
+        if (bad(res)) { return res; }
+    }
+    return deserialize_varint_uint64(s, &r->seen);
+}
+
+// Mostly empty HyperLogLog sketches (the ones of small groups) are sent as a list of
+// their non-zero registers, the others as all of their registers.
+template <cluster_version_t W>
+void serialize_grouped(write_message_t *wm, const hyperloglog_t &h) {
+    if (!h.is_dense()) {
+        // `max_sparse` registers always make for a sparse message.
+        serialize<W>(wm, true);
+        serialize_varint_uint64(wm, h.sparse.size());
+        size_t last = 0;
+        for (uint32_t entry : h.sparse) {
+            serialize_varint_uint64(wm, hyperloglog_t::sparse_index(entry) - last);
+            serialize<W>(wm, hyperloglog_t::sparse_rank(entry));
+            last = hyperloglog_t::sparse_index(entry);
+        }
+        return;
+    }
+    uint64_t nonzero = 0;
+    for (uint8_t r : h.registers) {
+        nonzero += (r != 0);
+    }
+    const bool sparse = nonzero * 3 < h.registers.size();
+    serialize<W>(wm, sparse);
+    if (sparse) {
+        serialize_varint_uint64(wm, nonzero);
+        size_t last = 0;
+        for (size_t i = 0; i < h.registers.size(); ++i) {
+            if (h.registers[i] != 0) {
+                serialize_varint_uint64(wm, i - last);
+                serialize<W>(wm, h.registers[i]);
+                last = i;
+            }
+        }
+    } else {
+        serialize<W>(wm, h.registers);
+    }
+}
+template <cluster_version_t W>
+archive_result_t deserialize_grouped(read_stream_t *s, hyperloglog_t *h) {
+    bool sparse;
+    archive_result_t res = deserialize<W>(s, &sparse);
+    if (bad(res)) { return res; }
+    h->sparse.clear();
+    if (!sparse) {
+        res = deserialize<W>(s, &h->registers);
+        if (bad(res)) { return res; }
+        if (!h->registers.empty()
+            && h->registers.size() != hyperloglog_t::num_registers) {
+            return archive_result_t::RANGE_ERROR;
+        }
+        return archive_result_t::SUCCESS;
+    }
+    uint64_t nonzero;
+    res = deserialize_varint_uint64(s, &nonzero);
+    if (bad(res)) { return res; }
+    if (nonzero > hyperloglog_t::num_registers) {
+        return archive_result_t::RANGE_ERROR;
+    }
+    h->registers.clear();
+    if (nonzero > hyperloglog_t::max_sparse) {
+        h->registers.resize(hyperloglog_t::num_registers, 0);
+    } else {
+        h->sparse.reserve(nonzero);
+    }
+    uint64_t index = 0;
+    for (uint64_t i = 0; i < nonzero; ++i) {
+        uint64_t delta;
+        res = deserialize_varint_uint64(s, &delta);
+        if (bad(res)) { return res; }
+        index += delta;
+        if (index >= hyperloglog_t::num_registers
+            || (i != 0 && delta == 0)) {
+            return archive_result_t::RANGE_ERROR;
+        }
+        uint8_t rank;
+        res = deserialize<W>(s, &rank);
+        if (bad(res)) { return res; }
+        if (h->is_dense()) {
+            h->registers[index] = rank;
+        } else {
+            h->sparse.push_back(hyperloglog_t::sparse_entry(index, rank));
+        }
+    }
+    return archive_result_t::SUCCESS;
+}
+
+template <cluster_version_t W>
+void serialize_grouped(write_message_t *wm, const tdigest_t &t) {
+    serialize_varint_uint64(wm, t.centroids.size());
+    for (const auto &c : t.centroids) {
+        serialize<W>(wm, c.mean);
+        serialize<W>(wm, c.weight);
+    }
+    serialize_varint_uint64(wm, t.unmerged);
+    serialize<W>(wm, t.total_weight);
+    serialize<W>(wm, t.min);
+    serialize<W>(wm, t.max);
+}
+template <cluster_version_t W>
+archive_result_t deserialize_grouped(read_stream_t *s, tdigest_t *t) {
+    uint64_t sz;
+    archive_result_t res = deserialize_varint_uint64(s, &sz);
+    if (bad(res)) { return res; }
+    if (sz > std::numeric_limits<size_t>::max()) {
+        return archive_result_t::RANGE_ERROR;
+    }
+    t->centroids.resize(sz);
+    for (auto &c : t->centroids) {
+        res = deserialize<W>(s, &c.mean);
+        if (bad(res)) { return res; }
+        res = deserialize<W>(s, &c.weight);
+        if (bad(res)) { return res; }
+    }
+    res = deserialize_varint_uint64(s, &t->unmerged);
+    if (bad(res)) { return res; }
+    if (t->unmerged > sz) {
+        return archive_result_t::RANGE_ERROR;
+    }
+    res = deserialize<W>(s, &t->total_weight);
+    if (bad(res)) { return res; }
+    res = deserialize<W>(s, &t->min);
+    if (bad(res)) { return res; }
+    return deserialize<W>(s, &t->max);
+}
+
+template <cluster_version_t W>
+void serialize_grouped(write_message_t *wm, const distinct_set_t &d) {
+    serialize_varint_uint64(wm, d.rows.size());
+    for (const auto &row : d.rows) {
+        serialize<W>(wm, row);
+    }
+}
+template <cluster_version_t W>
+archive_result_t deserialize_grouped(read_stream_t *s, distinct_set_t *d) {
+    uint64_t sz;
+    archive_result_t res = deserialize_varint_uint64(s, &sz);
+    if (bad(res)) { return res; }
+    if (sz > std::numeric_limits<size_t>::max()) {
+        return archive_result_t::RANGE_ERROR;
+    }
+    d->rows.reserve(sz);
+    for (uint64_t i = 0; i < sz; ++i) {
+        datum_t row;
+        res = deserialize<W>(s, &row);
+        if (bad(res)) { return res; }
+        d->rows.insert(std::move(row));
+    }
+    return archive_result_t::SUCCESS;
+}
+
 // This is basically a templated typedef with special serialization.
 template<class T>
 class grouped_t {
@@ -345,6 +594,11 @@ typedef boost::variant<
     grouped_t<ql::datum_t>, // Reduce (may be NULL)
     grouped_t<optimizer_t>, // min, max
     grouped_t<stream_t>, // No terminal.
+    grouped_t<top_k_t>, // order_by + limit
+    grouped_t<distinct_set_t>, // distinct without an index
+    grouped_t<reservoir_t>, // sample
+    grouped_t<hyperloglog_t>, // approx_count_distinct
+    grouped_t<tdigest_t>, // approx_quantile
     exc_t // Don't re-order (we don't want this to initialize to an error.)
     > result_t;
 
@@ -384,6 +638,11 @@ typedef boost::variant<count_wire_func_t,
                        min_wire_func_t,
                        max_wire_func_t,
                        reduce_wire_func_t,
+                       top_k_wire_func_t,
+                       hash_distinct_wire_func_t,
+                       sample_wire_func_t,
+                       approx_count_distinct_wire_func_t,
+                       approx_quantile_wire_func_t,
                        limit_read_t
                        > terminal_variant_t;
 
@@ -393,6 +652,10 @@ public:
     virtual ~accumulator_t();
     // May be overridden as an optimization (currently is for `count`).
     virtual bool uses_val() { return true; }
+    // Returns true if all the accumulator does is count rows, in which case the
+    // rows may be handed to `add_count` in bulk instead.
+    virtual bool counts_rows_only() { return false; }
+    virtual void add_count(uint64_t) { unreachable(); }
     virtual void stop_at_boundary(store_key_t &&) { }
     virtual bool should_send_batch() = 0;
     virtual continue_bool_t operator()(
@@ -432,6 +695,36 @@ scoped_ptr_t<eager_acc_t> make_to_array();
 scoped_ptr_t<eager_acc_t> make_eager_terminal(const terminal_variant_t &t);
 scoped_ptr_t<op_t> make_op(const transform_variant_t &tv);
 
+// Describes which parts of each row the transformations of a read look at, so that
+// the btree traversal can avoid loading entire rows from disk.  Only leading
+// `filter`s and a `map` (e.g. `pluck` or `with_fields`) on top-level fields qualify.
+class row_pushdown_t {
+public:
+    row_pushdown_t() : partial_rows_suffice(false) { }
+
+    // Runs the compiled predicates and projection on `partial_row`, which must hold
+    // `fields` of the row.  Returns false if one of them bailed out, in which case
+    // the whole row has to be loaded and transformed as usual.  Otherwise
+    // `*passes_out` says whether the row passes the predicates.
+    MUST_USE bool check(const datum_t &partial_row, bool *passes_out) const;
+
+    // The top-level fields of the row the transformations read (sorted, unique).
+    std::vector<datum_string_t> fields;
+    // Bytecode for the `filter`s at the front of the transformations, which can
+    // reject rows before they're loaded.
+    std::vector<counted_t<const bytecode_program_t> > predicates;
+    // Bytecode for the `map` following them, if any.
+    counted_t<const bytecode_program_t> projection;
+    // Whether the transformations and the accumulator only need `fields` of the
+    // rows that pass `predicates`.  If not, those rows have to be loaded in full.
+    bool partial_rows_suffice;
+};
+
+// Returns `r_nullopt` if the transformations don't allow any pushdown.
+optional<row_pushdown_t> make_row_pushdown(
+    const std::vector<transform_variant_t> &transforms,
+    bool accumulator_uses_val);
+
 } // namespace ql
 
 #endif  // RDB_PROTOCOL_SHARDS_HPP_
@@ -0,0 +1,250 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "rdb_protocol/sketch.hpp"
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "errors.hpp"
+
+namespace ql {
+
+const int hyperloglog_t::precision;
+const size_t hyperloglog_t::num_registers;
+const size_t hyperloglog_t::max_sparse;
+
+static_assert(hyperloglog_t::max_sparse * 3 < hyperloglog_t::num_registers,
+              "Sparse sketches should be serialized as such");
+
+uint64_t sketch_hash(const datum_t &d) {
+    // `datum_t::hash` doesn't mix its bits well enough for HyperLogLog (numbers
+    // mostly hash to themselves), so we run it through the SplitMix64 finalizer.
+    uint64_t h = d.hash();
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return h ^ (h >> 31);
+}
+
+void hyperloglog_t::add(uint64_t hash) {
+    size_t index = hash >> (64 - precision);
+    uint64_t rest = hash << precision;
+    uint8_t rank = rest == 0 ? (64 - precision + 1) : (__builtin_clzll(rest) + 1);
+    set_max(index, rank);
+}
+
+void hyperloglog_t::set_max(size_t index, uint8_t rank) {
+    if (is_dense()) {
+        registers[index] = std::max(registers[index], rank);
+        return;
+    }
+    auto it = std::lower_bound(sparse.begin(), sparse.end(), sparse_entry(index, 0));
+    if (it != sparse.end() && sparse_index(*it) == index) {
+        *it = std::max(*it, sparse_entry(index, rank));
+    } else {
+        sparse.insert(it, sparse_entry(index, rank));
+        if (sparse.size() > max_sparse) {
+            make_dense();
+        }
+    }
+}
+
+void hyperloglog_t::make_dense() {
+    if (is_dense()) {
+        return;
+    }
+    registers.resize(num_registers, 0);
+    for (uint32_t entry : sparse) {
+        registers[sparse_index(entry)] = sparse_rank(entry);
+    }
+    sparse.clear();
+    sparse.shrink_to_fit();
+}
+
+std::vector<uint8_t> hyperloglog_t::dense_registers() const {
+    if (is_dense()) {
+        return registers;
+    }
+    std::vector<uint8_t> ret(num_registers, 0);
+    for (uint32_t entry : sparse) {
+        ret[sparse_index(entry)] = sparse_rank(entry);
+    }
+    return ret;
+}
+
+size_t hyperloglog_t::memory_usage() const {
+    return registers.capacity() * sizeof(uint8_t)
+        + sparse.capacity() * sizeof(uint32_t);
+}
+
+void hyperloglog_t::merge(const hyperloglog_t &other) {
+    if (other.is_dense()) {
+        make_dense();
+        for (size_t i = 0; i < registers.size(); ++i) {
+            registers[i] = std::max(registers[i], other.registers[i]);
+        }
+    } else if (is_dense() || sparse.empty()) {
+        if (!is_dense()) {
+            sparse = other.sparse;
+        } else {
+            for (uint32_t entry : other.sparse) {
+                set_max(sparse_index(entry), sparse_rank(entry));
+            }
+        }
+    } else {
+        std::vector<uint32_t> merged;
+        merged.reserve(sparse.size() + other.sparse.size());
+        auto a = sparse.cbegin();
+        auto b = other.sparse.cbegin();
+        while (a != sparse.cend() || b != other.sparse.cend()) {
+            if (b == other.sparse.end()
+                || (a != sparse.end() && sparse_index(*a) < sparse_index(*b))) {
+                merged.push_back(*a++);
+            } else if (a == sparse.end() || sparse_index(*b) < sparse_index(*a)) {
+                merged.push_back(*b++);
+            } else {
+                merged.push_back(std::max(*a++, *b++));
+            }
+        }
+        sparse = std::move(merged);
+        if (sparse.size() > max_sparse) {
+            make_dense();
+        }
+    }
+}
+
+uint64_t hyperloglog_t::estimate() const {
+    if (!is_dense() && sparse.empty()) {
+        return 0;
+    }
+    const double m = num_registers;
+    // The non-zero registers are summed up in the same order either way, so that
+    // both give the same result.
+    double nonzero_sum = 0;
+    size_t zeros = 0;
+    if (is_dense()) {
+        for (uint8_t r : registers) {
+            if (r == 0) {
+                ++zeros;
+            } else {
+                nonzero_sum += ldexp(1.0, -static_cast<int>(r));
+            }
+        }
+    } else {
+        zeros = num_registers - sparse.size();
+        for (uint32_t entry : sparse) {
+            nonzero_sum += ldexp(1.0, -static_cast<int>(sparse_rank(entry)));
+        }
+    }
+    const double sum = zeros + nonzero_sum;
+    double e = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+    if (e <= 2.5 * m && zeros != 0) {
+        e = m * log(m / zeros);
+    }
+    return static_cast<uint64_t>(llround(e));
+}
+
+// The compression parameter of the digest.  It holds at most about
+// `compression / 2` centroids once compressed.
+static const double tdigest_compression = 200;
+// How many centroids we collect before merging them into the sorted ones.
+static const uint64_t tdigest_buffer_size = 1000;
+
+// The k_1 scale function, which makes centroids smaller towards the tails.
+static double tdigest_k(double q) {
+    q = std::min(1.0, std::max(0.0, q));
+    return tdigest_compression / (2 * M_PI) * asin(2 * q - 1);
+}
+
+void tdigest_t::add(double x) {
+    if (empty()) {
+        min = max = x;
+    } else {
+        min = std::min(min, x);
+        max = std::max(max, x);
+    }
+    centroids.push_back(centroid_t{x, 1});
+    total_weight += 1;
+    if (++unmerged >= tdigest_buffer_size) {
+        compress();
+    }
+}
+
+void tdigest_t::merge(tdigest_t *other) {
+    if (other->empty()) {
+        return;
+    }
+    if (empty()) {
+        min = other->min;
+        max = other->max;
+    } else {
+        min = std::min(min, other->min);
+        max = std::max(max, other->max);
+    }
+    centroids.insert(centroids.end(), other->centroids.begin(), other->centroids.end());
+    unmerged += other->centroids.size();
+    total_weight += other->total_weight;
+    other->centroids.clear();
+    other->unmerged = 0;
+    other->total_weight = 0;
+    compress();
+}
+
+void tdigest_t::compress() {
+    if (unmerged == 0) {
+        return;
+    }
+    std::sort(centroids.begin(), centroids.end(),
+              [](const centroid_t &l, const centroid_t &r) {
+                  return l.mean < r.mean;
+              });
+    std::vector<centroid_t> out;
+    out.reserve(static_cast<size_t>(tdigest_compression));
+    centroid_t cur = centroids[0];
+    double weight_before = 0;
+    for (size_t i = 1; i < centroids.size(); ++i) {
+        const centroid_t &c = centroids[i];
+        double proposed = cur.weight + c.weight;
+        if (tdigest_k((weight_before + proposed) / total_weight)
+            - tdigest_k(weight_before / total_weight) <= 1) {
+            cur.mean += (c.mean - cur.mean) * c.weight / proposed;
+            cur.weight = proposed;
+        } else {
+            weight_before += cur.weight;
+            out.push_back(cur);
+            cur = c;
+        }
+    }
+    out.push_back(cur);
+    centroids = std::move(out);
+    unmerged = 0;
+}
+
+double tdigest_t::quantile(double q) {
+    guarantee(!empty());
+    compress();
+    const double target = q * total_weight;
+    const centroid_t &first = centroids.front();
+    const centroid_t &last = centroids.back();
+    if (centroids.size() == 1) {
+        return first.mean;
+    } else if (target <= first.weight / 2) {
+        return min + (first.mean - min) * target / (first.weight / 2);
+    } else if (target >= total_weight - last.weight / 2) {
+        return max - (max - last.mean) * (total_weight - target) / (last.weight / 2);
+    }
+    // Interpolate between the midpoints of the two centroids around `target`.
+    double mid = first.weight / 2;
+    for (size_t i = 1; i < centroids.size(); ++i) {
+        double next_mid =
+            mid + centroids[i - 1].weight / 2 + centroids[i].weight / 2;
+        if (target <= next_mid) {
+            double t = (target - mid) / (next_mid - mid);
+            return centroids[i - 1].mean
+                + (centroids[i].mean - centroids[i - 1].mean) * t;
+        }
+        mid = next_mid;
+    }
+    return max;
+}
+
+}  // namespace ql
@@ -0,0 +1,91 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#ifndef RDB_PROTOCOL_SKETCH_HPP_
+#define RDB_PROTOCOL_SKETCH_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "rdb_protocol/datum.hpp"
+
+namespace ql {
+
+// Hashes a datum for `hyperloglog_t`.  Equal data get equal hashes on every server.
+uint64_t sketch_hash(const datum_t &d);
+
+/* A HyperLogLog sketch (Flajolet et al., with the linear counting correction for
+   small cardinalities) that estimates the number of distinct values added to it.
+   Sketches of disjoint or overlapping sets can be merged without losing accuracy.
+   The standard error is about 0.8%.
+
+   Every register holds the highest rank seen among the hashes that fell into it.
+   As long as only a few registers are non-zero (as in the sketches of the small
+   groups of a grouped `approx_count_distinct`), we only keep those, in `sparse`.
+   Past `max_sparse` of them we switch to keeping all the registers in `registers`.
+   Both give exactly the same estimates. */
+class hyperloglog_t {
+public:
+    static const int precision = 14;
+    static const size_t num_registers = size_t(1) << precision;
+    // A full sparse sketch takes a quarter of the memory of the dense one.
+    static const size_t max_sparse = num_registers / 16;
+
+    void add(uint64_t hash);
+    void merge(const hyperloglog_t &other);
+    uint64_t estimate() const;
+
+    bool is_dense() const { return !registers.empty(); }
+    // Returns all the registers, whichever way they're kept.
+    std::vector<uint8_t> dense_registers() const;
+    // The number of bytes the registers take.
+    size_t memory_usage() const;
+    // Keeps all the registers in `registers`.
+    void make_dense();
+
+    // Packs a sparse register as `index << 8 | rank`.
+    static uint32_t sparse_entry(size_t index, uint8_t rank) {
+        return static_cast<uint32_t>(index << 8 | rank);
+    }
+    static size_t sparse_index(uint32_t entry) { return entry >> 8; }
+    static uint8_t sparse_rank(uint32_t entry) { return entry & 0xff; }
+
+    // The non-zero registers sorted by their index, unless `registers` isn't empty.
+    std::vector<uint32_t> sparse;
+    // Either empty or `num_registers` long.
+    std::vector<uint8_t> registers;
+
+private:
+    void set_max(size_t index, uint8_t rank);
+};
+
+/* A merging t-digest (Dunning & Ertl) that estimates quantiles of the numbers added
+   to it.  Values near the tails get their own small centroids, so that quantiles
+   like p99 stay accurate while the digest never holds more than a few hundred
+   centroids. */
+class tdigest_t {
+public:
+    tdigest_t() : unmerged(0), total_weight(0), min(0), max(0) { }
+
+    void add(double x);
+    void merge(tdigest_t *other);
+    // Merges the unmerged centroids into the sorted ones.
+    void compress();
+    // `q` must be in [0, 1] and the digest must not be empty.
+    double quantile(double q);
+    bool empty() const { return total_weight == 0; }
+
+    struct centroid_t {
+        double mean;
+        double weight;
+    };
+    // The last `unmerged` centroids were added since the last `compress`; the ones
+    // before them are sorted by their means.
+    std::vector<centroid_t> centroids;
+    uint64_t unmerged;
+    double total_weight;
+    double min, max;
+};
+
+}  // namespace ql
+
+#endif  // RDB_PROTOCOL_SKETCH_HPP_
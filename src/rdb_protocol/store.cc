@@ -301,6 +301,7 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
         guarantee(res != NULL);
         res->server_uuids.insert(cserver.first->get_uuid());
         res->addrs.insert(cserver.first->get_stop_addr());
+        res->filter_addrs.insert(cserver.first->get_filter_stop_addr());
     }
 
     void operator()(const changefeed_limit_subscribe_t &s) {
@@ -404,14 +405,34 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
 
         auto cserver = store->changefeed_server(s.region);
         if (cserver.first != nullptr) {
-            if (optional<uint64_t> stamp
-                    = cserver.first->get_stamp(s.addr, cserver.second)) {
+            if (s.filter.has_value()) {
+                ql::changefeed::change_filter_t filter = *s.filter;
+                cserver.first->add_filter(s.addr, std::move(filter), cserver.second);
+            }
+            optional<ql::changefeed::log_read_t> log;
+            optional<uint64_t> since;
+            if (s.resume_from.has_value()) {
+                log.set(ql::changefeed::log_read_t());
+                auto it = s.resume_from->find(cserver.first->get_uuid());
+                if (it != s.resume_from->end()) {
+                    since.set(it->second);
+                }
+            }
+            // Subscriptions that ask for the log always come with a filter.
+            guarantee(!log.has_value() || s.filter.has_value());
+            if (optional<uint64_t> stamp = cserver.first->get_stamp(
+                    s.addr,
+                    cserver.second,
+                    log.has_value() ? &*log : nullptr,
+                    log.has_value() ? s.filter->sub : nil_uuid(),
+                    since)) {
                 changefeed_stamp_response_t out;
                 out.stamp_infos.set(std::map<uuid_u, shard_stamp_info_t>());
                 (*out.stamp_infos)[cserver.first->get_uuid()] = shard_stamp_info_t{
                     *stamp,
                     current_shard,
-                    read_start};
+                    read_start,
+                    std::move(log)};
                 return out;
             }
         }
@@ -431,6 +452,10 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
         auto *res = boost::get<changefeed_point_stamp_response_t>(&response->response);
         auto cserver = store->changefeed_server(s.key);
         if (cserver.first != nullptr) {
+            if (s.filter.has_value()) {
+                ql::changefeed::change_filter_t filter = *s.filter;
+                cserver.first->add_filter(s.addr, std::move(filter), cserver.second);
+            }
             res->resp.set(changefeed_point_stamp_response_t::valid_response_t());
             auto *vres = &*res->resp;
             if (optional<uint64_t> stamp
@@ -401,6 +401,8 @@ public:
     // `store.cc` can synchronize with the `rdb_modification_report_cb_t` in
     // `btree.cc`.
     rwlock_t cfeed_stamp_lock;
+    // Shared by the changefeed servers, which must be destroyed first.
+    ql::changefeed::server_stats_t changefeed_stats;
 
 private:
     rdb_context_t *ctx;
@@ -94,6 +94,9 @@ counted_t<const term_t> compile_on_current_stack(
     case Term::AVG:                return make_avg_term(env, t);
     case Term::MIN:                return make_min_term(env, t);
     case Term::MAX:                return make_max_term(env, t);
+    case Term::APPROX_COUNT_DISTINCT:
+        return make_approx_count_distinct_term(env, t);
+    case Term::APPROX_QUANTILE:    return make_approx_quantile_term(env, t);
     case Term::UNION:              return make_union_term(env, t);
     case Term::NTH:                return make_nth_term(env, t);
     case Term::BRACKET:            return make_bracket_term(env, t);
@@ -274,6 +277,11 @@ scoped_ptr_t<val_t> runtime_term_t::eval_on_current_stack(
         throw interrupted_exc_t();
     }
     env->env->maybe_yield();
+    rcheck(!env->env->over_memory_limit(), base_exc_t::RESOURCE,
+           strprintf("Query allocated more than its memory limit of %" PRIu64 " bytes "
+                     "for one batch.  Use the `memory_limit` option to `run` "
+                     "to change it.",
+                     env->env->memory_limit()));
     INC_DEPTH;
 
 #ifdef INSTRUMENT
@@ -286,6 +286,8 @@ bool term_type_is_valid(Term::TermType type) {
     case Term::COUNT:
     case Term::SUM:
     case Term::AVG:
+    case Term::APPROX_COUNT_DISTINCT:
+    case Term::APPROX_QUANTILE:
     case Term::MIN:
     case Term::MAX:
     case Term::UNION:
@@ -483,6 +485,8 @@ bool term_is_write_or_meta(Term::TermType type) {
     case Term::COUNT:
     case Term::SUM:
     case Term::AVG:
+    case Term::APPROX_COUNT_DISTINCT:
+    case Term::APPROX_QUANTILE:
     case Term::MIN:
     case Term::MAX:
     case Term::UNION:
@@ -612,6 +616,8 @@ bool term_forbids_writes(Term::TermType type) {
     case Term::COUNT:
     case Term::SUM:
     case Term::AVG:
+    case Term::APPROX_COUNT_DISTINCT:
+    case Term::APPROX_QUANTILE:
     case Term::MIN:
     case Term::MAX:
         return true;
@@ -0,0 +1,225 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "rdb_protocol/terminal_workers.hpp"
+
+#include "arch/runtime/coroutines.hpp"
+#include "arch/runtime/runtime.hpp"
+#include "concurrency/cross_thread_signal.hpp"
+#include "concurrency/interruptor.hpp"
+#include "config/args.hpp"
+#include "rdb_protocol/env.hpp"
+#include "rdb_protocol/protocol.hpp"
+#include "threading.hpp"
+
+namespace ql {
+
+// How many rows we send to a worker at a time.  Every batch costs two thread
+// switches, so this shouldn't be too small.
+static const size_t rows_per_batch = 256;
+
+class terminal_workers_t::worker_t {
+public:
+    worker_t(threadnum_t _thread, signal_t *_interruptor, serializable_env_t &&_s_env)
+        : thread(_thread),
+          interruptor(_interruptor, _thread),
+          s_env(std::move(_s_env)),
+          busy(false) { }
+    ~worker_t() {
+        if (env.has()) {
+            on_thread_t th(thread);
+            transformers.clear();
+            acc.reset();
+            env.reset();
+        }
+    }
+
+    const threadnum_t thread;
+    cross_thread_signal_t interruptor;
+    const serializable_env_t s_env;
+
+    // Whether the worker has a batch, and the batch itself.
+    bool busy;
+    datums_t rows;
+    new_semaphore_in_line_t slot;
+
+    // These are created on `thread` when the worker gets its first batch, and only
+    // used there.
+    scoped_ptr_t<env_t> env;
+    std::vector<scoped_ptr_t<op_t> > transformers;
+    scoped_ptr_t<accumulator_t> acc;
+    optional<exc_t> error;
+};
+
+// The threads that the other stores of the table don't run on, assuming that the
+// stores of a table are spread evenly over the threads.
+static std::vector<threadnum_t> spare_threads() {
+    const int num_threads = get_num_threads();
+    const int current = get_thread_id().threadnum;
+    std::vector<threadnum_t> threads;
+    for (int i = CPU_SHARDING_FACTOR; i < num_threads; i += CPU_SHARDING_FACTOR) {
+        threads.push_back(threadnum_t((current + i) % num_threads));
+    }
+    return threads;
+}
+
+scoped_ptr_t<terminal_workers_t> terminal_workers_t::maybe_make(
+        env_t *env,
+        const std::vector<transform_variant_t> &transforms,
+        const optional<terminal_variant_t> &terminal) {
+    if (!terminal.has_value()
+        || boost::get<limit_read_t>(&*terminal) != nullptr
+        // The workers can't report to the profiler.
+        || env->trace != nullptr
+        || env->get_rdb_ctx() == nullptr) {
+        return scoped_ptr_t<terminal_workers_t>();
+    }
+    for (const auto &transform : transforms) {
+        // An indexed `distinct` has to see all the rows in order.
+        if (boost::get<distinct_wire_func_t>(&transform) != nullptr) {
+            return scoped_ptr_t<terminal_workers_t>();
+        }
+    }
+    if (transforms.empty() && !make_terminal(*terminal)->uses_val()) {
+        // There's nothing to evaluate for the rows.
+        return scoped_ptr_t<terminal_workers_t>();
+    }
+    std::vector<threadnum_t> threads = spare_threads();
+    if (threads.empty()) {
+        return scoped_ptr_t<terminal_workers_t>();
+    }
+    return scoped_ptr_t<terminal_workers_t>(
+        new terminal_workers_t(env, transforms, *terminal, threads));
+}
+
+terminal_workers_t::terminal_workers_t(
+        env_t *_env,
+        const std::vector<transform_variant_t> &_transforms,
+        const terminal_variant_t &_terminal,
+        const std::vector<threadnum_t> &threads)
+    : env(_env),
+      transforms(_transforms),
+      terminal(_terminal),
+      idle_workers(threads.size()) {
+    for (threadnum_t thread : threads) {
+        serializable_env_t s_env = env->get_serializable_env();
+        workers.push_back(make_scoped<worker_t>(
+            thread, env->interruptor, std::move(s_env)));
+    }
+}
+
+terminal_workers_t::~terminal_workers_t() {
+    drainer.drain();
+}
+
+bool terminal_workers_t::add_row(const datum_t &row, size_t copies) {
+    if (error.has_value()) {
+        return false;
+    }
+    for (size_t i = 0; i < copies; ++i) {
+        batch.push_back(row);
+    }
+    if (batch.size() >= rows_per_batch) {
+        send_batch();
+    }
+    return !error.has_value();
+}
+
+void terminal_workers_t::send_batch() {
+    new_semaphore_in_line_t slot(&idle_workers, 1);
+    wait_interruptible(slot.acquisition_signal(), env->interruptor);
+    worker_t *worker = nullptr;
+    for (const auto &w : workers) {
+        if (!w->busy) {
+            worker = w.get();
+            break;
+        }
+    }
+    guarantee(worker != nullptr);
+    worker->busy = true;
+    worker->rows = std::move(batch);
+    worker->slot = std::move(slot);
+    batch = datums_t();
+    auto_drainer_t::lock_t keepalive(&drainer);
+    coro_t::spawn_sometime([this, worker, keepalive]() {
+        run_batch(worker, keepalive);
+    });
+}
+
+void terminal_workers_t::run_batch(worker_t *worker, auto_drainer_t::lock_t) {
+    {
+        on_thread_t th(worker->thread);
+        const std::function<datum_t()> no_sindex_val = []() { return datum_t(); };
+        try {
+            if (!worker->env.has()) {
+                worker->env.init(new env_t(env->get_rdb_ctx(),
+                                           return_empty_normal_batches_t::NO,
+                                           &worker->interruptor,
+                                           worker->s_env,
+                                           nullptr));
+                for (const auto &transform : transforms) {
+                    worker->transformers.push_back(make_op(transform));
+                }
+                worker->acc = make_terminal(terminal);
+            }
+            for (const datum_t &row : worker->rows) {
+                groups_t data = {{datum_t(), datums_t{row}}};
+                for (const auto &op : worker->transformers) {
+                    (*op)(worker->env.get(), &data, no_sindex_val);
+                }
+                (*worker->acc)(worker->env.get(), &data, store_key_t(), no_sindex_val);
+            }
+        } catch (const exc_t &e) {
+            worker->error.set(e);
+        } catch (const datum_exc_t &e) {
+            worker->error.set(exc_t(e, backtrace_id_t::empty()));
+        } catch (const interrupted_exc_t &) {
+            // The traversal on the store's thread gets interrupted as well.
+        }
+        worker->rows.clear();
+    }
+    if (worker->error.has_value() && !error.has_value()) {
+        error = worker->error;
+    }
+    worker->busy = false;
+    worker->slot.reset();
+}
+
+void terminal_workers_t::finish(accumulator_t *acc,
+                                continue_bool_t last_cb,
+                                result_t *out) {
+    if (!batch.empty() && !error.has_value()) {
+        send_batch();
+    }
+    {
+        // Wait for the batches that are still being processed.
+        new_semaphore_in_line_t all(&idle_workers, workers.size());
+        all.acquisition_signal()->wait();
+    }
+    if (error.has_value() && boost::get<exc_t>(out) == nullptr) {
+        *out = *error;
+    }
+    if (boost::get<exc_t>(out) != nullptr) {
+        acc->finish(last_cb, out);
+        return;
+    }
+
+    try {
+        std::vector<result_t> results(workers.size() + 1);
+        std::vector<result_t *> to_merge;
+        acc->finish(last_cb, &results[0]);
+        to_merge.push_back(&results[0]);
+        for (size_t i = 0; i < workers.size(); ++i) {
+            if (workers[i]->acc.has()) {
+                on_thread_t th(workers[i]->thread);
+                workers[i]->acc->finish(last_cb, &results[i + 1]);
+                to_merge.push_back(&results[i + 1]);
+            }
+        }
+        scoped_ptr_t<accumulator_t> merged = make_terminal(terminal);
+        merged->unshard(env, to_merge);
+        merged->finish(last_cb, out);
+    } catch (const exc_t &e) {
+        *out = e;
+    }
+}
+
+}  // namespace ql
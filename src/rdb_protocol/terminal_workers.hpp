@@ -0,0 +1,73 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#ifndef RDB_PROTOCOL_TERMINAL_WORKERS_HPP_
+#define RDB_PROTOCOL_TERMINAL_WORKERS_HPP_
+
+#include <vector>
+
+#include "concurrency/auto_drainer.hpp"
+#include "concurrency/new_semaphore.hpp"
+#include "containers/optional.hpp"
+#include "containers/scoped.hpp"
+#include "rdb_protocol/error.hpp"
+#include "rdb_protocol/shards.hpp"
+
+namespace ql {
+
+class env_t;
+
+/* Every table has `CPU_SHARDING_FACTOR` stores per server, so a single range read
+   with a terminal (e.g. `reduce` or `sum`) keeps at most that many threads busy, no
+   matter how many the server has.  `terminal_workers_t` spreads the work of such a
+   read over the threads that the other stores of the table don't use.  The btree
+   traversal still runs on the store's thread and hands the rows it loads over in
+   batches.  Each worker evaluates the transformations and the terminal for its
+   batches with its own accumulator, and the accumulators get merged at the end with
+   the same `unshard` logic that merges the results of different shards. */
+class terminal_workers_t {
+public:
+    // Returns an empty pointer if the read can't be split up, or if there are no
+    // spare threads to split it up over.
+    static scoped_ptr_t<terminal_workers_t> maybe_make(
+        env_t *env,
+        const std::vector<transform_variant_t> &transforms,
+        const optional<terminal_variant_t> &terminal);
+    ~terminal_workers_t();
+
+    // Hands `copies` copies of `row` to the workers.  Blocks while all of them are
+    // busy.  Returns false if one of them ran into an error, in which case the
+    // traversal should stop.
+    MUST_USE bool add_row(const datum_t &row, size_t copies);
+
+    // Waits for the workers and merges their results, and the result of `acc` (the
+    // accumulator that the rows would have gone into otherwise), into `*out`.
+    void finish(accumulator_t *acc, continue_bool_t last_cb, result_t *out);
+
+private:
+    class worker_t;
+
+    terminal_workers_t(env_t *env,
+                       const std::vector<transform_variant_t> &transforms,
+                       const terminal_variant_t &terminal,
+                       const std::vector<threadnum_t> &threads);
+
+    void send_batch();
+    void run_batch(worker_t *worker, auto_drainer_t::lock_t keepalive);
+
+    env_t *const env;
+    const std::vector<transform_variant_t> transforms;
+    const terminal_variant_t terminal;
+
+    std::vector<scoped_ptr_t<worker_t> > workers;
+    // Has one slot per worker; held by the batches being processed.
+    new_semaphore_t idle_workers;
+    datums_t batch;
+    optional<exc_t> error;
+
+    auto_drainer_t drainer;
+
+    DISABLE_COPYING(terminal_workers_t);
+};
+
+}  // namespace ql
+
+#endif  // RDB_PROTOCOL_TERMINAL_WORKERS_HPP_
@@ -6,6 +6,7 @@
 #include "rdb_protocol/error.hpp"
 #include "rdb_protocol/func.hpp"
 #include "rdb_protocol/op.hpp"
+#include "rdb_protocol/terms/terms.hpp"
 #include "stl_utils.hpp"
 
 #include "debug.hpp"
@@ -694,6 +695,9 @@ counted_t<term_t> make_slice_term(
 
 counted_t<term_t> make_limit_term(
     compile_env_t *env, const raw_term_t &term) {
+    if (is_orderby_limit_term(term)) {
+        return make_orderby_limit_term(env, term);
+    }
     return make_counted<limit_term_t>(env, term);
 }
 
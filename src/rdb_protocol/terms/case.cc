@@ -1,35 +1,69 @@
 // Copyright 2010-2015 RethinkDB, all rights reserved.
 #include "rdb_protocol/terms/terms.hpp"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "rdb_protocol/error.hpp"
 #include "rdb_protocol/op.hpp"
 
 namespace ql {
 
+// Flips the case of the ASCII letters in `[lo, hi]`, which is all that `::toupper`
+// and `::tolower` do in the "C" locale the server runs in.  Other bytes, including
+// those of multi-byte UTF-8 sequences, are left alone.  With SSE2 this converts 16
+// bytes at a time.
+static void flip_ascii_case(std::string *s, char lo, char hi) {
+    char *data = &(*s)[0];
+    const size_t size = s->size();
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i below_lo = _mm_set1_epi8(lo - 1);
+    const __m128i above_hi = _mm_set1_epi8(hi + 1);
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        // The comparisons are signed, so bytes >= 0x80 are never in range.
+        __m128i in_range = _mm_and_si128(_mm_cmpgt_epi8(chunk, below_lo),
+                                         _mm_cmplt_epi8(chunk, above_hi));
+        chunk = _mm_xor_si128(chunk, _mm_and_si128(in_range, case_bit));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i), chunk);
+    }
+#endif
+    for (; i < size; ++i) {
+        if (data[i] >= lo && data[i] <= hi) {
+            data[i] ^= 0x20;
+        }
+    }
+}
+
 class case_term_t : public op_term_t {
 public:
     case_term_t(compile_env_t *env, const raw_term_t &term,
-                const char *_name, int (*_f)(int))
-        : op_term_t(env, term, argspec_t(1)), name_(_name), f(_f) { }
+                const char *_name, char _lo, char _hi)
+        : op_term_t(env, term, argspec_t(1)), name_(_name), lo(_lo), hi(_hi) { }
 private:
     virtual scoped_ptr_t<val_t> eval_impl(scope_env_t *env, args_t *args, eval_flags_t) const {
         std::string s = args->arg(env, 0)->as_str().to_std();
-        std::transform(s.begin(), s.end(), s.begin(), f);
+        flip_ascii_case(&s, lo, hi);
         return new_val(datum_t(datum_string_t(s)));
     }
     virtual const char *name() const { return name_; }
 
     const char *const name_;
-    int (*const f)(int);
+    // The range of letters that get converted.
+    const char lo;
+    const char hi;
 };
 
 counted_t<term_t> make_upcase_term(
         compile_env_t *env, const raw_term_t &term) {
-    return make_counted<case_term_t>(env, term, "upcase", ::toupper);
+    return make_counted<case_term_t>(env, term, "upcase", 'a', 'z');
 }
 counted_t<term_t> make_downcase_term(
         compile_env_t *env, const raw_term_t &term) {
-    return make_counted<case_term_t>(env, term, "downcase", ::tolower);
+    return make_counted<case_term_t>(env, term, "downcase", 'A', 'Z');
 }
 
 }  // namespace ql
@@ -27,6 +27,7 @@ public:
                                   "attempts",
                                   "redirects",
                                   "verify",
+                                  "cache",
                                   "page",
                                   "page_limit",
                                   "auth",
@@ -449,6 +450,7 @@ void http_term_t::get_optargs(scope_env_t *env,
     get_attempts(env, args, &opts_out->attempts);
     get_redirects(env, args, &opts_out->max_redirects);
     get_bool_optarg("verify", env, args, &opts_out->verify);
+    get_bool_optarg("cache", env, args, &opts_out->cache);
 }
 
 // The `timeout` optarg specifies the number of seconds to wait before erroring
@@ -769,7 +771,7 @@ void http_term_t::get_redirects(scope_env_t *env,
 }
 
 // This is a generic function for parsing out a boolean optarg yet still providing a
-// helpful message.  At the moment, it is only used for `page` and `verify`.
+// helpful message.  At the moment, it is only used for `verify` and `cache`.
 void http_term_t::get_bool_optarg(const std::string &optarg_name,
                                   scope_env_t *env,
                                   args_t *args,
@@ -41,6 +41,17 @@ public:
             seq = v->as_seq(env->env);
         }
 
+        if (!seq->is_grouped() && !seq->is_infinite()) {
+            // Tables sample every shard separately and only send back the samples.
+            counted_t<datum_stream_t> new_ds = make_counted<array_datum_stream_t>(
+                seq->run_terminal(env->env,
+                                  sample_wire_func_t(num, backtrace()))->as_datum(),
+                backtrace());
+            return t.has()
+                ? new_val(make_counted<selection_t>(t, new_ds))
+                : new_val(env->env, new_ds);
+        }
+
         std::vector<datum_t> result;
         result.reserve(num);
         size_t element_number = 0;
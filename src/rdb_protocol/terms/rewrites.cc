@@ -47,77 +47,6 @@ private:
     counted_t<const term_t> real;
 };
 
-class inner_join_term_t : public rewrite_term_t {
-public:
-    inner_join_term_t(compile_env_t *env, const raw_term_t &term)
-        : rewrite_term_t(env, term, argspec_t(3), rewrite) { }
-
-    static minidriver_t::reql_t rewrite(const raw_term_t &in) {
-        minidriver_t r(in.bt());
-
-        raw_term_t left = in.arg(0);
-        raw_term_t right = in.arg(1);
-        raw_term_t func = in.arg(2);
-        auto n = minidriver_t::dummy_var_t::INNERJOIN_N;
-        auto m = minidriver_t::dummy_var_t::INNERJOIN_M;
-
-        minidriver_t::reql_t term =
-            r.expr(left).concat_map(
-                r.fun(n,
-                    r.expr(right).concat_map(
-                        r.fun(m,
-                            r.branch(
-                                r.expr(func)(r.var(n), r.var(m)),
-                                r.array(r.object(r.optarg("left", n),
-                                                 r.optarg("right", m))),
-                                r.array())))));
-
-        term.copy_optargs_from_term(in);
-        return term;
-    }
-
-    virtual const char *name() const { return "inner_join"; }
-};
-
-class outer_join_term_t : public rewrite_term_t {
-public:
-    outer_join_term_t(compile_env_t *env, const raw_term_t &term)
-        : rewrite_term_t(env, term, argspec_t(3), rewrite) { }
-
-    static minidriver_t::reql_t rewrite(const raw_term_t &in) {
-        minidriver_t r(in.bt());
-
-        raw_term_t left = in.arg(0);
-        raw_term_t right = in.arg(1);
-        raw_term_t func = in.arg(2);
-        auto n = minidriver_t::dummy_var_t::OUTERJOIN_N;
-        auto m = minidriver_t::dummy_var_t::OUTERJOIN_M;
-        auto lst = minidriver_t::dummy_var_t::OUTERJOIN_LST;
-
-        minidriver_t::reql_t inner_concat_map =
-            r.expr(right).concat_map(
-                r.fun(m,
-                    r.branch(
-                        r.expr(func)(r.var(n), r.var(m)),
-                        r.array(r.object(r.optarg("left", n),
-                                         r.optarg("right", m))),
-                        r.array())));
-
-        minidriver_t::reql_t term =
-            r.expr(left).concat_map(
-                r.fun(n,
-                    inner_concat_map.coerce_to("ARRAY").do_(lst,
-                        r.branch(r.var(lst).count() > 0,
-                                 r.var(lst),
-                                 r.array(r.object(r.optarg("left", n)))))));
-
-        term.copy_optargs_from_term(in);
-        return term;
-    }
-
-    virtual const char *name() const { return "outer_join"; }
-};
-
 class delete_term_t : public rewrite_term_t {
 public:
     delete_term_t(compile_env_t *env, const raw_term_t &term)
@@ -234,14 +163,6 @@ counted_t<term_t> make_skip_term(
         compile_env_t *env, const raw_term_t &term) {
     return make_counted<skip_term_t>(env, term);
 }
-counted_t<term_t> make_inner_join_term(
-        compile_env_t *env, const raw_term_t &term) {
-    return make_counted<inner_join_term_t>(env, term);
-}
-counted_t<term_t> make_outer_join_term(
-        compile_env_t *env, const raw_term_t &term) {
-    return make_counted<outer_join_term_t>(env, term);
-}
 counted_t<term_t> make_update_term(
         compile_env_t *env, const raw_term_t &term) {
     return make_counted<update_term_t>(env, term);
@@ -8,6 +8,7 @@
 #include "parsing/utf8.hpp"
 #include "rdb_protocol/datum_stream/eq_join.hpp"
 #include "rdb_protocol/datum_stream/fold.hpp"
+#include "rdb_protocol/datum_stream/join.hpp"
 #include "rdb_protocol/datum_stream/map.hpp"
 #include "rdb_protocol/datum_stream/ordered_union.hpp"
 #include "rdb_protocol/datum_stream/range.hpp"
@@ -16,6 +17,7 @@
 #include "rdb_protocol/error.hpp"
 #include "rdb_protocol/func.hpp"
 #include "rdb_protocol/math_utils.hpp"
+#include "rdb_protocol/minidriver.hpp"
 #include "rdb_protocol/op.hpp"
 #include "rdb_protocol/order_util.hpp"
 
@@ -127,6 +129,56 @@ private:
     virtual const char *name() const { return "max"; }
 };
 
+class approx_count_distinct_term_t
+    : public unindexable_map_acc_term_t<approx_count_distinct_wire_func_t> {
+public:
+    template<class... Args> approx_count_distinct_term_t(Args... args)
+        : unindexable_map_acc_term_t<approx_count_distinct_wire_func_t>(args...) { }
+private:
+    virtual const char *name() const { return "approx_count_distinct"; }
+};
+
+class approx_quantile_term_t : public grouped_seq_op_term_t {
+public:
+    approx_quantile_term_t(compile_env_t *env, const raw_term_t &term)
+        : grouped_seq_op_term_t(env, term, argspec_t(2, 3)) { }
+private:
+    double check_quantile(const datum_t &d) const {
+        double q = d.as_num();
+        rcheck(q >= 0 && q <= 1, base_exc_t::LOGIC,
+               strprintf("Quantile must be between 0 and 1, got `%s`.",
+                         d.print().c_str()));
+        return q;
+    }
+    virtual scoped_ptr_t<val_t> eval_impl(scope_env_t *env, args_t *args,
+                                          eval_flags_t) const {
+        scoped_ptr_t<val_t> v = args->arg(env, 0);
+        counted_t<const func_t> func;
+        if (args->num_args() == 3) {
+            func = args->arg(env, 1)->as_func(GET_FIELD_SHORTCUT);
+        }
+        datum_t qs = args->arg(env, args->num_args() - 1)->as_datum();
+        std::vector<double> quantiles;
+        const bool single = qs.get_type() != datum_t::R_ARRAY;
+        if (single) {
+            quantiles.push_back(check_quantile(qs));
+        } else {
+            quantiles.reserve(qs.arr_size());
+            for (size_t i = 0; i < qs.arr_size(); ++i) {
+                quantiles.push_back(check_quantile(qs.get(i)));
+            }
+        }
+        return v->as_seq(env->env)->run_terminal(
+            env->env,
+            func.has()
+                ? approx_quantile_wire_func_t(
+                    std::move(quantiles), single, backtrace(), func)
+                : approx_quantile_wire_func_t(
+                    std::move(quantiles), single, backtrace()));
+    }
+    virtual const char *name() const { return "approx_quantile"; }
+};
+
 class count_term_t : public grouped_seq_op_term_t {
 public:
     count_term_t(compile_env_t *env, const raw_term_t &term)
@@ -262,6 +314,156 @@ private:
     }
 };
 
+// Returns true if `term` refers to the variable `var` anywhere.
+static bool references_var(const raw_term_t &term, const sym_t &var) {
+    if (term.type() == Term::VAR) {
+        if (term.num_args() == 1 && term.arg(0).type() == Term::DATUM) {
+            datum_t d = term.arg(0).datum();
+            return d.get_type() == datum_t::R_NUM && d.as_num() == var.value;
+        }
+        return false;
+    }
+    for (size_t i = 0; i < term.num_args(); ++i) {
+        if (references_var(term.arg(i), var)) {
+            return true;
+        }
+    }
+    bool res = false;
+    term.each_optarg([&](const raw_term_t &optarg, const std::string &) {
+        res = res || references_var(optarg, var);
+    });
+    return res;
+}
+
+// Reads the argument names of a literal two-argument function.
+static bool get_join_func_args(const raw_term_t &func, sym_t *left, sym_t *right) {
+    if (func.type() != Term::FUNC || func.num_args() != 2) {
+        return false;
+    }
+    raw_term_t vars = func.arg(0);
+    std::vector<datum_t> nums;
+    if (vars.type() == Term::DATUM) {
+        datum_t d = vars.datum();
+        if (d.get_type() != datum_t::R_ARRAY) {
+            return false;
+        }
+        for (size_t i = 0; i < d.arr_size(); ++i) {
+            nums.push_back(d.get(i));
+        }
+    } else if (vars.type() == Term::MAKE_ARRAY) {
+        for (size_t i = 0; i < vars.num_args(); ++i) {
+            if (vars.arg(i).type() != Term::DATUM) {
+                return false;
+            }
+            nums.push_back(vars.arg(i).datum());
+        }
+    }
+    if (nums.size() != 2
+        || nums[0].get_type() != datum_t::R_NUM
+        || nums[1].get_type() != datum_t::R_NUM) {
+        return false;
+    }
+    *left = sym_t(nums[0].as_num());
+    *right = sym_t(nums[1].as_num());
+    return true;
+}
+
+class join_term_t : public op_term_t {
+public:
+    join_term_t(compile_env_t *env, const raw_term_t &term, bool _outer)
+        : op_term_t(env, term, argspec_t(3)), outer(_outer) {
+        for (size_t i = 0; i < term.num_args(); ++i) {
+            if (term.arg(i).type() == Term::ARGS) {
+                return;
+            }
+        }
+        minidriver_t r(term.bt());
+        right_term = make_counted<func_term_t>(
+            env, r.fun(r.expr(term.arg(1))).root_term());
+        compile_keys(env, term.arg(2));
+    }
+
+    virtual const char *name() const { return outer ? "outer_join" : "inner_join"; }
+
+private:
+    // If the predicate is `==` between an expression of only the left row and one
+    // of only the right row, compiles the two sides into `left_key_term` and
+    // `right_key_term`.
+    void compile_keys(compile_env_t *env, const raw_term_t &func) {
+        sym_t left_var, right_var;
+        if (!get_join_func_args(func, &left_var, &right_var)) {
+            return;
+        }
+        raw_term_t body = func.arg(1);
+        if (body.type() != Term::EQ
+            || body.num_args() != 2
+            || body.num_optargs() != 0) {
+            return;
+        }
+        raw_term_t a = body.arg(0);
+        raw_term_t b = body.arg(1);
+        bool a_left = references_var(a, left_var);
+        bool a_right = references_var(a, right_var);
+        bool b_left = references_var(b, left_var);
+        bool b_right = references_var(b, right_var);
+        minidriver_t r(func.bt());
+        if (a_left && !a_right && b_right && !b_left) {
+            left_key_term = make_counted<func_term_t>(
+                env, r.fun(left_var, r.expr(a)).root_term());
+            right_key_term = make_counted<func_term_t>(
+                env, r.fun(right_var, r.expr(b)).root_term());
+        } else if (b_left && !b_right && a_right && !a_left) {
+            left_key_term = make_counted<func_term_t>(
+                env, r.fun(left_var, r.expr(b)).root_term());
+            right_key_term = make_counted<func_term_t>(
+                env, r.fun(right_var, r.expr(a)).root_term());
+        } else {
+            return;
+        }
+        // We evaluate the keys once per row instead of once per pair of rows.
+        const term_t *left_key = left_key_term.get();
+        const term_t *right_key = right_key_term.get();
+        if (!left_key->is_deterministic().test(single_server_t::yes,
+                                               constant_now_t::yes)
+            || !right_key->is_deterministic().test(single_server_t::yes,
+                                                   constant_now_t::yes)) {
+            left_key_term.reset();
+            right_key_term.reset();
+        }
+    }
+
+    virtual scoped_ptr_t<val_t> eval_impl(
+        scope_env_t *env, args_t *args, eval_flags_t) const {
+        counted_t<datum_stream_t> left = args->arg(env, 0)->as_seq(env->env);
+        counted_t<const func_t> right_func;
+        counted_t<datum_stream_t> right;
+        if (right_term.has()) {
+            right_func = right_term->eval_to_func(env->scope);
+        } else {
+            right = args->arg(env, 1)->as_seq(env->env);
+        }
+        counted_t<const func_t> predicate = args->arg(env, 2)->as_func();
+        counted_t<const func_t> left_key, right_key;
+        if (left_key_term.has()) {
+            left_key = left_key_term->eval_to_func(env->scope);
+            right_key = right_key_term->eval_to_func(env->scope);
+        }
+        return new_val(env->env, make_counted<join_datum_stream_t>(
+                           std::move(left),
+                           std::move(right_func),
+                           std::move(right),
+                           std::move(predicate),
+                           std::move(left_key),
+                           std::move(right_key),
+                           outer));
+    }
+
+    const bool outer;
+    // Evaluates the right sequence.  Empty if the arguments use `r.args`.
+    counted_t<const func_term_t> right_term;
+    counted_t<const func_term_t> left_key_term, right_key_term;
+};
+
 class fold_term_t : public grouped_seq_op_term_t {
 public:
     fold_term_t(compile_env_t *env, const raw_term_t &term)
@@ -539,7 +741,9 @@ public:
                           "include_initial",
                           "include_offsets",
                           "include_states",
-                          "include_types"})) { }
+                          "include_tokens",
+                          "include_types",
+                          "since"})) { }
 private:
     virtual scoped_ptr_t<val_t> eval_impl(
         scope_env_t *env, args_t *args, eval_flags_t) const {
@@ -576,6 +780,24 @@ private:
             include_offsets = v->as_bool();
         }
 
+        // Resuming from a token replays the changes the feed missed, so it
+        // includes tokens as well.
+        bool include_tokens = false;
+        if (scoped_ptr_t<val_t> v = args->optarg(env, "include_tokens")) {
+            include_tokens = v->as_bool();
+        }
+        datum_t since;
+        if (scoped_ptr_t<val_t> v = args->optarg(env, "since")) {
+            since = v->as_datum();
+            include_tokens = true;
+        }
+        if (include_tokens) {
+            rcheck(!include_initial, base_exc_t::LOGIC,
+                   "Cannot use `include_initial` with `include_tokens` or `since`.");
+            rcheck(squash == datum_t::boolean(false), base_exc_t::LOGIC,
+                   "Cannot use `squash` with `include_tokens` or `since`.");
+        }
+
         scoped_ptr_t<val_t> v = args->arg(env, 0);
         configured_limits_t limits = env->env->limits_with_changefeed_queue_size(
                 args->optarg(env, "changefeed_queue_size"));
@@ -584,27 +806,32 @@ private:
             std::vector<counted_t<datum_stream_t> > streams;
             std::vector<changespec_t> changespecs = seq->get_changespecs();
             r_sanity_check(changespecs.size() >= 1);
+            // A token only covers the servers of one subscription.
+            rcheck(!include_tokens || changespecs.size() == 1, base_exc_t::LOGIC,
+                   "Cannot use `include_tokens` or `since` on a union of "
+                   "changefeeds.");
             for (auto &&changespec : changespecs) {
                 if (include_initial) {
                     r_sanity_check(changespec.stream.has());
                 }
                 boost::apply_visitor(rcheck_spec_visitor_t(env->env, backtrace()),
                                      changespec.keyspec.spec);
+                changefeed::streamspec_t ss(
+                    include_initial
+                        ? std::move(changespec.stream)
+                        : counted_t<datum_stream_t>(),
+                    changespec.keyspec.table_name,
+                    include_offsets,
+                    include_states,
+                    include_types,
+                    limits,
+                    squash,
+                    std::move(changespec.keyspec.spec));
+                ss.include_tokens = include_tokens;
+                ss.since = since;
                 streams.push_back(
                     changespec.keyspec.table->read_changes(
-                        env->env,
-                        changefeed::streamspec_t(
-                            include_initial
-                                ? std::move(changespec.stream)
-                                : counted_t<datum_stream_t>(),
-                            changespec.keyspec.table_name,
-                            include_offsets,
-                            include_states,
-                            include_types,
-                            limits,
-                            squash,
-                            std::move(changespec.keyspec.spec)),
-                        backtrace()));
+                        env->env, ss, backtrace()));
             }
             if (streams.size() == 1) {
                 return new_val(env->env, streams[0]);
@@ -619,6 +846,8 @@ private:
             }
         } else if (v->get_type().is_convertible(val_t::type_t::SINGLE_SELECTION)) {
             auto sel = v->as_single_selection();
+            rcheck(!include_tokens, base_exc_t::LOGIC,
+                   "Cannot include tokens for point subs.");
             return new_val(
                 env->env,
                 sel->get_tbl()->tbl->read_changes(
@@ -901,6 +1130,16 @@ counted_t<term_t> make_eq_join_term(
     return make_counted<eq_join_term_t>(env, term);
 }
 
+counted_t<term_t> make_inner_join_term(
+        compile_env_t *env, const raw_term_t &term) {
+    return make_counted<join_term_t>(env, term, false);
+}
+
+counted_t<term_t> make_outer_join_term(
+        compile_env_t *env, const raw_term_t &term) {
+    return make_counted<join_term_t>(env, term, true);
+}
+
 counted_t<term_t> make_fold_term(
         compile_env_t *env, const raw_term_t &term) {
     return make_counted<fold_term_t>(env, term);
@@ -945,6 +1184,16 @@ counted_t<term_t> make_max_term(
     return make_counted<max_term_t>(env, term);
 }
 
+counted_t<term_t> make_approx_count_distinct_term(
+        compile_env_t *env, const raw_term_t &term) {
+    return make_counted<approx_count_distinct_term_t>(env, term);
+}
+
+counted_t<term_t> make_approx_quantile_term(
+        compile_env_t *env, const raw_term_t &term) {
+    return make_counted<approx_quantile_term_t>(env, term);
+}
+
 counted_t<term_t> make_union_term(
         compile_env_t *env, const raw_term_t &term) {
     return make_counted<union_term_t>(env, term);
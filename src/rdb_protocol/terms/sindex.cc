@@ -154,7 +154,32 @@ ql::datum_t sindex_status_to_datum(
 class sindex_create_term_t : public op_term_t {
 public:
     sindex_create_term_t(compile_env_t *env, const raw_term_t &term)
-        : op_term_t(env, term, argspec_t(2, 3), optargspec_t({"multi", "geo"})) { }
+        : op_term_t(env, term, argspec_t(2, 3),
+                    optargspec_t({"multi", "geo", "filter"})) {
+        optional<raw_term_t> filter = term.optarg("filter");
+        if (!filter.has_value()) {
+            return;
+        }
+        minidriver_t r(term.bt());
+        auto x = minidriver_t::dummy_var_t::SINDEXCREATE_X;
+        optional<minidriver_t::reql_t> mapping;
+        if (term.num_args() == 2) {
+            mapping.set(r.var(x)[r.expr(term.arg(1))]);
+        } else if (term.arg(2).type() == Term::FUNC) {
+            mapping.set(r.expr(term.arg(2))(r.var(x)));
+        } else {
+            // We'll complain when we're evaluated.
+            return;
+        }
+        // The index function fails for rows that don't pass the filter, which
+        // leaves them out of the index.
+        filtered_func = make_counted<func_term_t>(
+            env,
+            r.fun(x, r.branch(r.expr(*filter)(r.var(x)),
+                              *mapping,
+                              r.error("Row does not pass the index filter."))
+            ).root_term());
+    }
 
     virtual scoped_ptr_t<val_t> eval_impl(
         scope_env_t *env, args_t *args, eval_flags_t) const {
@@ -203,6 +228,14 @@ public:
             config.func_version = reql_version_t::LATEST;
         }
 
+        /* Leave out the rows that don't pass the filter. */
+        if (args->optarg(env, "filter").has()) {
+            rcheck(filtered_func.has(), base_exc_t::LOGIC,
+                   "The index function must be a field name or a function to use "
+                   "`filter`.");
+            config.func = ql::map_wire_func_t(filtered_func->eval_to_func(env->scope));
+        }
+
         config.func.compile_wire_func()->assert_deterministic(
                 constant_now_t::no,
                 "Index functions must be deterministic.");
@@ -242,6 +275,10 @@ public:
     }
 
     virtual const char *name() const { return "sindex_create"; }
+
+private:
+    // The index function restricted to the rows that pass the `filter` optarg.
+    counted_t<const func_term_t> filtered_func;
 };
 
 class sindex_drop_term_t : public op_term_t {
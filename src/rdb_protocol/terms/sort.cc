@@ -1,11 +1,14 @@
 // Copyright 2010-2015 RethinkDB, all rights reserved.
 #include "rdb_protocol/terms/terms.hpp"
 
+#include <algorithm>
+#include <iterator>
 #include <string>
 #include <utility>
 
 #include "rdb_protocol/datum_stream.hpp"
 #include "rdb_protocol/datum_stream/array.hpp"
+#include "rdb_protocol/datum_stream/external_sort.hpp"
 #include "rdb_protocol/datum_stream/indexed_sort.hpp"
 #include "rdb_protocol/error.hpp"
 #include "rdb_protocol/func.hpp"
@@ -46,12 +49,38 @@ private:
     virtual const char *name() const { return "desc"; }
 };
 
+// Spilled runs are never shorter than this, no matter how small the array limit is,
+// so that we don't end up with lots of tiny temporary files.
+const size_t MIN_SORT_RUN_SIZE = 1000;
+
 class orderby_term_t : public op_term_t {
 public:
     orderby_term_t(compile_env_t *env, const raw_term_t &term)
         : op_term_t(env, term, argspec_t(1, -1),
-          optargspec_t({"index"})) { }
+          optargspec_t({"index"})),
+          limit_bt(backtrace_id_t::empty()) { }
+    // Compiles a `limit` on an unindexed `order_by` (see `is_orderby_limit_term`).
+    // Instead of sorting the whole sequence, we only keep the best rows, which for
+    // tables happens on the shards.
+    orderby_term_t(compile_env_t *env, const raw_term_t &term,
+                   const raw_term_t &limit_term)
+        : op_term_t(env, term, argspec_t(1, -1),
+          optargspec_t({"index"})),
+          limit(compile_term(env, limit_term.arg(1))),
+          limit_bt(limit_term.bt()) { }
 private:
+    virtual void accumulate_captures(var_captures_t *captures) const {
+        op_term_t::accumulate_captures(captures);
+        if (limit.has()) {
+            limit->accumulate_captures(captures);
+        }
+    }
+
+    virtual deterministic_t is_deterministic() const {
+        deterministic_t det = op_term_t::is_deterministic();
+        return limit.has() ? det.join(limit->is_deterministic()) : det;
+    }
+
     virtual scoped_ptr_t<val_t>
     eval_impl(scope_env_t *env, args_t *args, eval_flags_t) const {
         std::vector<std::pair<order_direction_t, counted_t<const func_t> > > comparisons
@@ -73,6 +102,13 @@ private:
         }
 
         scoped_ptr_t<val_t> index = args->optarg(env, "index");
+        optional<size_t> limit_n;
+        if (limit.has()) {
+            int32_t r = limit->eval(env)->as_int<int32_t>();
+            rcheck_src(limit_bt, r >= 0, base_exc_t::LOGIC,
+                       strprintf("LIMIT takes a non-negative argument (got %d)", r));
+            limit_n.set(r);
+        }
         if (seq.has() && seq->is_exhausted()){
             /* Do nothing for empty sequence */
             if (!index.has()) {
@@ -81,6 +117,7 @@ private:
             }
         /* Add a sorting to the table if we're doing indexed sorting. */
         } else if (index.has()) {
+            r_sanity_check(!limit.has());
             rcheck(tbl_slice.has(), base_exc_t::LOGIC,
                    "Indexed order_by can only be performed on a TABLE or TABLE_SLICE. Make sure order_by comes before any transformations (such as map) or filters.");
             rcheck(!seq.has(), base_exc_t::LOGIC,
@@ -105,7 +142,23 @@ private:
             }
             rcheck(!comparisons.empty(), base_exc_t::LOGIC,
                    "Must specify something to order by.");
+            if (limit_n && *limit_n <= env->env->limits().array_size_limit()
+                && !seq->is_infinite()) {
+                datum_t top = seq->run_terminal(
+                    env->env,
+                    top_k_wire_func_t(comparisons, *limit_n, backtrace()))->as_datum();
+                seq = make_counted<array_datum_stream_t>(std::move(top), backtrace());
+                return tbl_slice.has()
+                    ? new_val(make_counted<selection_t>(tbl_slice->get_tbl(), seq))
+                    : new_val(env->env, seq);
+            }
             std::vector<datum_t> to_sort;
+            // If there is more data than fits into an array, we sort it in runs
+            // that we spill to disk and merge afterwards.
+            counted_t<external_sort_datum_stream_t> external_sort;
+            const bool can_spill = external_sort_datum_stream_t::can_spill(env->env);
+            const size_t run_size =
+                std::max(env->env->limits().array_size_limit(), MIN_SORT_RUN_SIZE);
             batchspec_t batchspec = batchspec_t::user(batch_type_t::TERMINAL, env->env);
             for (;;) {
                 std::vector<datum_t> data
@@ -114,14 +167,40 @@ private:
                     break;
                 }
                 std::move(data.begin(), data.end(), std::back_inserter(to_sort));
+                if (!can_spill) {
+                    rcheck_array_size(to_sort, env->env->limits());
+                    continue;
+                }
+                while (to_sort.size() > run_size) {
+                    if (!external_sort.has()) {
+                        external_sort = make_counted<external_sort_datum_stream_t>(
+                            lt_cmp, backtrace());
+                    }
+                    std::vector<datum_t> rest(
+                        std::make_move_iterator(to_sort.begin() + run_size),
+                        std::make_move_iterator(to_sort.end()));
+                    to_sort.resize(run_size);
+                    external_sort->add_run(env->env, std::move(to_sort));
+                    to_sort = std::move(rest);
+                }
+            }
+            if (external_sort.has()) {
+                if (!to_sort.empty()) {
+                    external_sort->add_run(env->env, std::move(to_sort));
+                }
+                seq = external_sort;
+            } else {
                 rcheck_array_size(to_sort, env->env->limits());
+                profile::sampler_t sampler("Sorting in-memory.", env->env->trace);
+                auto fn = std::bind(lt_cmp, env->env, &sampler, ph::_1, ph::_2);
+                std::stable_sort(to_sort.begin(), to_sort.end(), fn);
+                seq = make_counted<array_datum_stream_t>(
+                    datum_t(std::move(to_sort), env->env->limits()),
+                    backtrace());
             }
-            profile::sampler_t sampler("Sorting in-memory.", env->env->trace);
-            auto fn = std::bind(lt_cmp, env->env, &sampler, ph::_1, ph::_2);
-            std::stable_sort(to_sort.begin(), to_sort.end(), fn);
-            seq = make_counted<array_datum_stream_t>(
-                datum_t(std::move(to_sort), env->env->limits()),
-                backtrace());
+        }
+        if (limit_n) {
+            seq = seq->slice(0, *limit_n);
         }
         return tbl_slice.has()
             ? new_val(make_counted<selection_t>(tbl_slice->get_tbl(), seq))
@@ -129,6 +208,10 @@ private:
     }
 
     virtual const char *name() const { return "orderby"; }
+
+    // The argument of the `limit` this term was compiled from, if any.
+    counted_t<const term_t> limit;
+    backtrace_id_t limit_bt;
 };
 
 class distinct_term_t : public op_term_t {
@@ -166,23 +249,8 @@ private:
         rcheck(!idx, base_exc_t::LOGIC,
                "Can only perform an indexed distinct on a TABLE.");
         counted_t<datum_stream_t> s = v->as_seq(env->env);
-        // The reql_version matters here, because we copy `results` into `toret`
-        // in ascending order.
-        std::set<datum_t, optional_datum_less_t> results;
-        batchspec_t batchspec = batchspec_t::user(batch_type_t::TERMINAL, env->env);
-        {
-            profile::sampler_t sampler("Evaluating elements in distinct.",
-                                       env->env->trace);
-            datum_t d;
-            while (d = s->next(env->env, batchspec), d.has()) {
-                results.insert(std::move(d));
-                rcheck_array_size(results, env->env->limits());
-                sampler.new_sample();
-            }
-        }
-        std::vector<datum_t> toret;
-        std::move(results.begin(), results.end(), std::back_inserter(toret));
-        return new_val(datum_t(std::move(toret), env->env->limits()));
+        // Tables deduplicate on the shards; the result comes out in ascending order.
+        return s->run_terminal(env->env, hash_distinct_wire_func_t(backtrace()));
     }
 
     virtual const char *name() const { return "distinct"; }
@@ -192,6 +260,21 @@ counted_t<term_t> make_orderby_term(
         compile_env_t *env, const raw_term_t &term) {
     return make_counted<orderby_term_t>(env, term);
 }
+bool is_orderby_limit_term(const raw_term_t &term) {
+    if (term.type() != Term::LIMIT
+        || term.num_args() != 2
+        || term.num_optargs() != 0
+        || term.arg(1).type() == Term::ARGS) {
+        return false;
+    }
+    raw_term_t orderby = term.arg(0);
+    return orderby.type() == Term::ORDER_BY && !orderby.optarg("index");
+}
+counted_t<term_t> make_orderby_limit_term(
+        compile_env_t *env, const raw_term_t &term) {
+    r_sanity_check(is_orderby_limit_term(term));
+    return make_counted<orderby_term_t>(env, term.arg(0), term);
+}
 counted_t<term_t> make_distinct_term(
         compile_env_t *env, const raw_term_t &term) {
     return make_counted<distinct_term_t>(env, term);
@@ -2,6 +2,7 @@
 #include "rdb_protocol/terms/terms.hpp"
 
 #include <re2/re2.h>
+#include <string.h>
 
 #include <algorithm>
 
@@ -45,16 +46,110 @@ bool is_in_a_range(closed_char32_range *begin, closed_char32_range *end, char32_
 // Combining characters in Unicode have a character class starting with M. There
 // are three types, which affect layout; we don't distinguish between them here.
 static bool is_combining_character(char32_t c) {
+    if (c < combining_char_ranges[0].lo) {
+        return false;
+    }
     size_t n = sizeof(combining_char_ranges) / sizeof(combining_char_ranges[0]);
     return is_in_a_range(combining_char_ranges, combining_char_ranges + n, c);
 }
 
 // Equivalent to the ICU `u_isUWhiteSpace` which is the Unicode White_Space property.
 static bool is_whitespace_character(char32_t c) {
+    if (c < 128) {
+        return c == ' ' || (c >= '\t' && c <= '\r');
+    }
     size_t n = sizeof(whitespace_ranges) / sizeof(whitespace_ranges[0]);
     return is_in_a_range(whitespace_ranges, whitespace_ranges + n, c);
 }
 
+// Finds the first occurrence of `[needle, needle + needle_size)` in `[begin, end)`, or
+// returns `end`.  `memchr` (which libc vectorizes) skips ahead to the candidates for
+// the needle's first byte, so this is a lot faster than `std::search`.
+static const char *find_substring(const char *begin, const char *end,
+                                  const char *needle, size_t needle_size) {
+    if (needle_size == 0) {
+        return begin;
+    }
+    const char *pos = begin;
+    while (static_cast<size_t>(end - pos) >= needle_size) {
+        const void *candidate = memchr(pos, needle[0], (end - pos) - needle_size + 1);
+        if (candidate == nullptr) {
+            break;
+        }
+        pos = static_cast<const char *>(candidate);
+        if (memcmp(pos + 1, needle + 1, needle_size - 1) == 0) {
+            return pos;
+        }
+        ++pos;
+    }
+    return end;
+}
+
+// An ASCII pattern with no special characters, apart from a leading `^` and a
+// trailing `$`, matches the same text as a plain string comparison or search, so
+// `match` doesn't need RE2 for it.  (ASCII bytes never occur inside a multi-byte
+// UTF-8 sequence, so searching bytes finds the same match as RE2 does.)
+struct literal_pattern_t {
+    std::string literal;
+    bool anchored_at_start;
+    bool anchored_at_end;
+};
+
+static bool parse_literal_pattern(const std::string &re, literal_pattern_t *out) {
+    size_t begin = 0;
+    size_t end = re.size();
+    out->anchored_at_start = (begin < end && re[begin] == '^');
+    if (out->anchored_at_start) {
+        ++begin;
+    }
+    out->anchored_at_end = (begin < end && re[end - 1] == '$');
+    if (out->anchored_at_end) {
+        --end;
+    }
+    for (size_t i = begin; i < end; ++i) {
+        const unsigned char c = re[i];
+        if (c >= 128 || c == '\0' || strchr("\\^$.|?*+()[]{}", c) != nullptr) {
+            return false;
+        }
+    }
+    out->literal = re.substr(begin, end - begin);
+    return true;
+}
+
+static bool match_literal(const std::string &str,
+                          const literal_pattern_t &pattern,
+                          re2::StringPiece *match_out) {
+    const std::string &literal = pattern.literal;
+    size_t pos;
+    if (pattern.anchored_at_start && pattern.anchored_at_end) {
+        if (str != literal) {
+            return false;
+        }
+        pos = 0;
+    } else if (pattern.anchored_at_start) {
+        if (str.compare(0, literal.size(), literal) != 0) {
+            return false;
+        }
+        pos = 0;
+    } else if (pattern.anchored_at_end) {
+        if (str.size() < literal.size()
+            || str.compare(str.size() - literal.size(), literal.size(), literal) != 0) {
+            return false;
+        }
+        pos = str.size() - literal.size();
+    } else {
+        const char *end = str.data() + str.size();
+        const char *found = find_substring(str.data(), end,
+                                           literal.data(), literal.size());
+        if (found == end && !literal.empty()) {
+            return false;
+        }
+        pos = found - str.data();
+    }
+    *match_out = re2::StringPiece(str.data() + pos, literal.size());
+    return true;
+}
+
 class match_term_t : public op_term_t {
 public:
     match_term_t(compile_env_t *env, const raw_term_t &term)
@@ -63,27 +158,36 @@ private:
     virtual scoped_ptr_t<val_t> eval_impl(scope_env_t *env, args_t *args, eval_flags_t) const {
         std::string str = args->arg(env, 0)->as_str().to_std();
         std::string re = args->arg(env, 1)->as_str().to_std();
-        std::shared_ptr<re2::RE2> regexp;
-        regex_cache_t &cache = env->env->regex_cache();
-        std::shared_ptr<re2::RE2> *found;
-        if (!cache.regexes.lookup(re, &found)) {
-            regexp.reset(new re2::RE2(re, re2::RE2::Quiet));
-            if (!regexp->ok()) {
-                rfail(base_exc_t::LOGIC,
-                      "Error in regexp `%s` (portion `%s`): %s",
-                      regexp->pattern().c_str(),
-                      regexp->error_arg().c_str(),
-                      regexp->error().c_str());
-            }
-            cache.regexes.insert(re, regexp);
+        int ngroups;
+        scoped_array_t<re2::StringPiece> groups;
+        bool matched;
+        literal_pattern_t literal;
+        if (parse_literal_pattern(re, &literal)) {
+            ngroups = 1;
+            groups.init(ngroups);
+            matched = match_literal(str, literal, &groups[0]);
         } else {
-            regexp = *found;
+            regex_cache_t &cache = env->env->regex_cache();
+            std::shared_ptr<re2::RE2> regexp = cache.lookup(re);
+            if (!regexp) {
+                regexp.reset(new re2::RE2(re, re2::RE2::Quiet));
+                if (!regexp->ok()) {
+                    rfail(base_exc_t::LOGIC,
+                          "Error in regexp `%s` (portion `%s`): %s",
+                          regexp->pattern().c_str(),
+                          regexp->error_arg().c_str(),
+                          regexp->error().c_str());
+                }
+                cache.insert(re, regexp);
+            }
+            r_sanity_check(static_cast<bool>(regexp));
+            // We add 1 to account for $0.
+            ngroups = regexp->NumberOfCapturingGroups() + 1;
+            groups.init(ngroups);
+            matched = regexp->Match(str, 0, str.size(), re2::RE2::UNANCHORED,
+                                    groups.data(), ngroups);
         }
-        r_sanity_check(static_cast<bool>(regexp));
-        // We add 1 to account for $0.
-        int ngroups = regexp->NumberOfCapturingGroups() + 1;
-        scoped_array_t<re2::StringPiece> groups(ngroups);
-        if (regexp->Match(str, 0, str.size(), re2::RE2::UNANCHORED, groups.data(), ngroups)) {
+        if (matched) {
             datum_object_builder_t match;
             // We use `b` to store whether or not we got a conflict when writing
             // to an object.  This should never happen here because we aren't
@@ -195,7 +299,10 @@ private:
                 current = with_combining;
                 done = (current == end);
             } else if (delim) {
-                auto next = std::search(current, end, delim->begin(), delim->end());
+                const char *found = find_substring(s.data() + (current - s.cbegin()),
+                                                   s.data() + s.size(),
+                                                   delim->data(), delim->size());
+                auto next = s.cbegin() + (found - s.data());
                 push_datum(&res, current, next);
                 if (next == end) {
                     current = end;
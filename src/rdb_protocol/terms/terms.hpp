@@ -275,6 +275,10 @@ counted_t<term_t> make_min_term(
     compile_env_t *env, const raw_term_t &term);
 counted_t<term_t> make_max_term(
     compile_env_t *env, const raw_term_t &term);
+counted_t<term_t> make_approx_count_distinct_term(
+    compile_env_t *env, const raw_term_t &term);
+counted_t<term_t> make_approx_quantile_term(
+    compile_env_t *env, const raw_term_t &term);
 counted_t<term_t> make_union_term(
     compile_env_t *env, const raw_term_t &term);
 counted_t<term_t> make_zip_term(
@@ -305,6 +309,11 @@ counted_t<term_t> make_sindex_rename_term(
 // sort.cc
 counted_t<term_t> make_orderby_term(
     compile_env_t *env, const raw_term_t &term);
+// True if `term` is a `limit` directly on an unindexed `order_by`, which
+// `make_orderby_limit_term` compiles into a single top-k selection.
+bool is_orderby_limit_term(const raw_term_t &term);
+counted_t<term_t> make_orderby_limit_term(
+    compile_env_t *env, const raw_term_t &term);
 counted_t<term_t> make_distinct_term(
     compile_env_t *env, const raw_term_t &term);
 counted_t<term_t> make_asc_term(
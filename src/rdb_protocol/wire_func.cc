@@ -272,6 +272,24 @@ archive_result_t deserialize(read_stream_t *s, maybe_wire_func_t *mwf) {
 
 INSTANTIATE_SERIALIZABLE_SINCE_v1_13(maybe_wire_func_t);
 
+template <cluster_version_t W>
+void serialize(write_message_t *wm, const approx_quantile_wire_func_t &f) {
+    serialize<W>(wm, static_cast<const maybe_wire_func_t &>(f));
+    serialize<W>(wm, f.quantiles);
+    serialize<W>(wm, f.single);
+}
+
+template <cluster_version_t W>
+archive_result_t deserialize(read_stream_t *s, approx_quantile_wire_func_t *f) {
+    archive_result_t res = deserialize<W>(s, static_cast<maybe_wire_func_t *>(f));
+    if (bad(res)) { return res; }
+    res = deserialize<W>(s, &f->quantiles);
+    if (bad(res)) { return res; }
+    return deserialize<W>(s, &f->single);
+}
+
+INSTANTIATE_SERIALIZABLE_FOR_CLUSTER(approx_quantile_wire_func_t);
+
 counted_t<const func_t> maybe_wire_func_t::compile_wire_func_or_null() const {
     if (wrapped.has()) {
         return wrapped.compile_wire_func();
@@ -324,4 +342,32 @@ RDB_IMPL_SERIALIZABLE_2_SINCE_v1_13(filter_wire_func_t, filter_func, default_fil
 
 RDB_MAKE_SERIALIZABLE_1_FOR_CLUSTER(distinct_wire_func_t, use_index);
 
+top_k_wire_func_t::top_k_wire_func_t(
+        const std::vector<std::pair<order_direction_t, counted_t<const func_t> > >
+            &_comparisons,
+        size_t _n,
+        backtrace_id_t _bt)
+    : n(_n), bt(_bt) {
+    comparisons.reserve(_comparisons.size());
+    for (const auto &pair : _comparisons) {
+        comparisons.push_back(std::make_pair(pair.first, wire_func_t(pair.second)));
+    }
+}
+
+std::vector<std::pair<order_direction_t, counted_t<const func_t> > >
+top_k_wire_func_t::compile_comparisons() const {
+    std::vector<std::pair<order_direction_t, counted_t<const func_t> > > ret;
+    ret.reserve(comparisons.size());
+    for (const auto &pair : comparisons) {
+        ret.push_back(std::make_pair(pair.first, pair.second.compile_wire_func()));
+    }
+    return ret;
+}
+
+ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(order_direction_t, int8_t, ASC, DESC);
+RDB_MAKE_SERIALIZABLE_3_FOR_CLUSTER(top_k_wire_func_t, comparisons, n, bt);
+
+RDB_MAKE_SERIALIZABLE_1_FOR_CLUSTER(hash_distinct_wire_func_t, bt);
+RDB_MAKE_SERIALIZABLE_2_FOR_CLUSTER(sample_wire_func_t, n, bt);
+
 }  // namespace ql
@@ -2,12 +2,14 @@
 #ifndef RDB_PROTOCOL_WIRE_FUNC_HPP_
 #define RDB_PROTOCOL_WIRE_FUNC_HPP_
 
+#include <utility>
 #include <vector>
 
 #include "containers/counted.hpp"
 #include "containers/optional.hpp"
 #include "rdb_protocol/sym.hpp"
 #include "rdb_protocol/error.hpp"
+#include "rdb_protocol/order_util.hpp"
 #include "rpc/serialize_macros.hpp"
 #include "version.hpp"
 
@@ -176,6 +178,67 @@ public:
     template <class... Args>
     explicit max_wire_func_t(Args... args) : skip_wire_func_t(args...) { }
 };
+class approx_count_distinct_wire_func_t : public skip_wire_func_t {
+public:
+    template <class... Args>
+    explicit approx_count_distinct_wire_func_t(Args... args)
+        : skip_wire_func_t(args...) { }
+};
+class approx_quantile_wire_func_t : public skip_wire_func_t {
+public:
+    approx_quantile_wire_func_t() : single(false) { }
+    template <class... Args>
+    approx_quantile_wire_func_t(std::vector<double> &&_quantiles,
+                                bool _single,
+                                Args... args)
+        : skip_wire_func_t(args...),
+          quantiles(std::move(_quantiles)),
+          single(_single) { }
+    std::vector<double> quantiles;
+    // If true, the result is the one quantile rather than an array of them.
+    bool single;
+};
+RDB_DECLARE_SERIALIZABLE(approx_quantile_wire_func_t);
+
+// An unindexed `order_by` followed by a `limit`.  Each shard only keeps the `n` best
+// rows according to `comparisons`, and the results get merged on the parsing node.
+class top_k_wire_func_t {
+public:
+    top_k_wire_func_t() : n(0), bt(backtrace_id_t::empty()) { }
+    top_k_wire_func_t(
+        const std::vector<std::pair<order_direction_t, counted_t<const func_t> > >
+            &_comparisons,
+        size_t _n,
+        backtrace_id_t _bt);
+    std::vector<std::pair<order_direction_t, counted_t<const func_t> > >
+    compile_comparisons() const;
+
+    std::vector<std::pair<order_direction_t, wire_func_t> > comparisons;
+    uint64_t n;
+    backtrace_id_t bt;
+};
+RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(top_k_wire_func_t);
+
+// An unindexed `distinct`.  Each shard removes the duplicates among its rows with a
+// hash set, and the sets get merged and sorted on the parsing node.
+class hash_distinct_wire_func_t {
+public:
+    hash_distinct_wire_func_t() : bt(backtrace_id_t::empty()) { }
+    explicit hash_distinct_wire_func_t(backtrace_id_t _bt) : bt(_bt) { }
+    backtrace_id_t bt;
+};
+RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(hash_distinct_wire_func_t);
+
+// `sample` on a stream.  Each shard keeps a reservoir of at most `n` rows along with
+// the number of rows it has seen, and the reservoirs get merged on the parsing node.
+class sample_wire_func_t {
+public:
+    sample_wire_func_t() : n(0), bt(backtrace_id_t::empty()) { }
+    sample_wire_func_t(size_t _n, backtrace_id_t _bt) : n(_n), bt(_bt) { }
+    uint64_t n;
+    backtrace_id_t bt;
+};
+RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(sample_wire_func_t);
 
 }  // namespace ql
 
@@ -4,6 +4,7 @@
 #include "arch/runtime/runtime.hpp"
 #include "concurrency/auto_drainer.hpp"
 #include "config/args.hpp"
+#include "time.hpp"
 #include "unittest/gtest.hpp"
 #include "unittest/unittest_utils.hpp"
 #include "utils.hpp"
@@ -106,6 +107,41 @@ TEST(CoroutinesTest, NotifyNow) {
     });
 }
 
+// Keeps the CPU busy for `ms` milliseconds.
+static void spin_for_ms(int64_t ms) {
+    ticks_t start = get_ticks();
+    while (get_ticks().nanos - start.nanos < ms * MILLION) { }
+}
+
+TEST(CoroutinesTest, CpuCounter) {
+    // Tests that a coroutine's CPU counter only gets the time it spends running, also
+    // when it switches away without `wait()`.
+    run_in_thread_pool([&]() {
+        ticks_t counter{0};
+        ASSERT_TRUE(coro_t::self()->set_cpu_counter(&counter) == nullptr);
+        ASSERT_TRUE(coro_t::self()->has_cpu_counter());
+        spin_for_ms(20);
+        coro_t::spawn_sometime([&]() {
+            spin_for_ms(100);
+        });
+        coro_t::yield();
+        {
+            ASSERT_FINITE_CORO_WAITING;
+            coro_t::spawn_now_dangerously([&]() {
+                spin_for_ms(100);
+            });
+        }
+        ASSERT_EQ(&counter, coro_t::self()->set_cpu_counter(nullptr));
+        ASSERT_FALSE(coro_t::self()->has_cpu_counter());
+        ASSERT_GE(counter.nanos, 20 * MILLION);
+        ASSERT_LT(counter.nanos, 100 * MILLION);
+
+        // Nothing gets charged without a counter.
+        spin_for_ms(5);
+        ASSERT_LT(counter.nanos, 100 * MILLION);
+    });
+}
+
 // The following test does not work on 32 bit architectures because it will exceed
 // their virtual memory.
 #if defined (__x86_64__) || defined (_WIN64)
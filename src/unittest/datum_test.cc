@@ -4,6 +4,9 @@
 #include "rdb_protocol/datum.hpp"
 #include "rdb_protocol/datum_string.hpp"
 #include "rdb_protocol/env.hpp"
+#include "rdb_protocol/pseudo_time.hpp"
+#include "rdb_protocol/serialize_datum.hpp"
+#include "time.hpp"
 #include "unittest/gtest.hpp"
 
 
@@ -205,4 +208,230 @@ TEST(DatumTest, OffsetScaling) {
     }
 }
 
+TEST(DatumTest, FieldDeserialization) {
+    auto check_fields = [](const ql::datum_t &datum) {
+        string_stream_t write_stream;
+        write_message_t wm;
+        ql::datum_serialize(&wm, datum, ql::check_datum_serialization_errors_t::NO);
+        ASSERT_EQ(0, send_write_message(&write_stream, &wm));
+        const std::string serialized = write_stream.str();
+        auto read = [&](size_t offset, size_t size, char *out) {
+            ASSERT_LE(offset + size, serialized.size());
+            memcpy(out, serialized.data() + offset, size);
+        };
+
+        const std::vector<datum_string_t> keys{
+            datum_string_t("a"), datum_string_t("missing"), datum_string_t("z")};
+        std::vector<std::pair<datum_string_t, ql::datum_t> > fields;
+        ASSERT_TRUE(ql::datum_deserialize_fields(serialized.size(), read, keys,
+                                                 &fields));
+        std::vector<std::pair<datum_string_t, ql::datum_t> > expected;
+        for (const datum_string_t &key : keys) {
+            ql::datum_t val = datum.get_field(key, ql::NOTHROW);
+            if (val.has()) {
+                expected.push_back(std::make_pair(key, val));
+            }
+        }
+        ASSERT_EQ(expected, fields);
+    };
+
+    check_fields(ql::datum_t(std::map<datum_string_t, ql::datum_t>()));
+    for (size_t sz : {1, 300, 70000}) {
+        ql::datum_t test_string(datum_string_t(std::string(sz, 'A')));
+        check_fields(ql::datum_t(std::map<datum_string_t, ql::datum_t>
+                {std::make_pair(datum_string_t("a"), ql::datum_t(1.5)),
+                 std::make_pair(datum_string_t("m"), test_string),
+                 std::make_pair(datum_string_t("z"), ql::datum_t(
+                     std::map<datum_string_t, ql::datum_t>
+                     {std::make_pair(datum_string_t("s"), test_string)}))}));
+    }
+
+    // Anything that isn't an object has to be deserialized the usual way.
+    string_stream_t write_stream;
+    write_message_t wm;
+    ql::datum_serialize(&wm, ql::datum_t(1.0),
+                        ql::check_datum_serialization_errors_t::NO);
+    ASSERT_EQ(0, send_write_message(&write_stream, &wm));
+    const std::string serialized = write_stream.str();
+    std::vector<std::pair<datum_string_t, ql::datum_t> > fields;
+    ASSERT_FALSE(ql::datum_deserialize_fields(
+        serialized.size(),
+        [&](size_t offset, size_t size, char *out) {
+            memcpy(out, serialized.data() + offset, size);
+        },
+        std::vector<datum_string_t>{datum_string_t("a")},
+        &fields));
+}
+
+ql::datum_t serialization_round_trip(const ql::datum_t &datum) {
+    string_stream_t write_stream;
+    write_message_t wm;
+    serialize<cluster_version_t::LATEST_OVERALL>(&wm, datum);
+    EXPECT_EQ(0, send_write_message(&write_stream, &wm));
+    string_read_stream_t read_stream(std::move(write_stream.str()), 0);
+    ql::datum_t res;
+    EXPECT_EQ(archive_result_t::SUCCESS,
+              deserialize<cluster_version_t::LATEST_OVERALL>(&read_stream, &res));
+    return res;
+}
+
+TEST(DatumTest, BufferFieldAccess) {
+    std::map<datum_string_t, ql::datum_t> map;
+    for (int i = 0; i < 100; ++i) {
+        map.insert(std::make_pair(datum_string_t(strprintf("field%d", i)),
+                                  ql::datum_t(static_cast<double>(i))));
+    }
+    const ql::datum_t object(std::move(map));
+    const ql::datum_t buffered = serialization_round_trip(object);
+    ASSERT_TRUE(buffered.get_buf_ref() != NULL);
+
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_EQ(ql::datum_t(static_cast<double>(i)),
+                  buffered.get_field(strprintf("field%d", i).c_str()));
+    }
+    ASSERT_FALSE(buffered.get_field("field", ql::NOTHROW).has());
+    ASSERT_FALSE(buffered.get_field("field99x", ql::NOTHROW).has());
+
+    // Two copies of the same serialization compare equal without being unpacked,
+    // and still compare correctly against other representations.
+    ASSERT_EQ(0, buffered.cmp(serialization_round_trip(object)));
+    ASSERT_EQ(0, buffered.cmp(object));
+    ql::datum_object_builder_t builder(object);
+    builder.overwrite("field50", ql::datum_t(-1.0));
+    const ql::datum_t changed = serialization_round_trip(std::move(builder).to_datum());
+    ASSERT_LT(0, buffered.cmp(changed));
+    ASSERT_GT(0, changed.cmp(buffered));
+}
+
+TEST(DatumTest, BufferMerge) {
+    std::map<datum_string_t, ql::datum_t> map;
+    map.insert(std::make_pair(datum_string_t("a"), ql::datum_t(1.0)));
+    map.insert(std::make_pair(datum_string_t("b"),
+                              ql::datum_t(std::map<datum_string_t, ql::datum_t>{
+                                  std::make_pair(datum_string_t("c"),
+                                                 ql::datum_t(2.0))})));
+    const ql::datum_t buffered = serialization_round_trip(ql::datum_t(std::move(map)));
+    ASSERT_TRUE(buffered.get_buf_ref() != NULL);
+
+    // Merging nothing in keeps the buffer.
+    ql::datum_t merged = buffered.merge(ql::datum_t::empty_object());
+    ASSERT_TRUE(merged.get_buf_ref() != NULL);
+    ASSERT_EQ(buffered.get_buf_ref()->get(), merged.get_buf_ref()->get());
+
+    // Fields that don't get merged into stay buffer-backed.
+    merged = buffered.merge(ql::datum_t(std::map<datum_string_t, ql::datum_t>{
+        std::make_pair(datum_string_t("a"), ql::datum_t(3.0))}));
+    ASSERT_EQ(ql::datum_t(3.0), merged.get_field("a"));
+    ASSERT_TRUE(merged.get_field("b").get_buf_ref() != NULL);
+    ASSERT_EQ(0, merged.get_field("b").cmp(buffered.get_field("b")));
+}
+
+TEST(DatumTest, InlineStrings) {
+    // Inlining strings doesn't make datums any bigger.
+    ASSERT_EQ(16u, sizeof(datum_string_t));
+    ASSERT_EQ(24u, sizeof(ql::datum_t));
+    for (size_t sz : {0, 1, 14, 15, 16, 300}) {
+        const std::string str(sz, 'x');
+        datum_string_t s(str);
+        ASSERT_EQ(sz, s.size());
+        ASSERT_EQ(str, s.to_std());
+
+        // Copies, moves and concatenations keep the contents, whichever way the
+        // strings are stored.
+        datum_string_t copy(s);
+        datum_string_t moved(std::move(copy));
+        ASSERT_EQ(s, moved);
+        ASSERT_TRUE(copy.empty());
+        copy = moved;
+        ASSERT_EQ(s, copy);
+        ASSERT_EQ(str + str, concat(s, copy).to_std());
+        ASSERT_GT(0, s.compare(concat(s, datum_string_t("a"))));
+
+        test_datum_serialization(ql::datum_t(s));
+        test_datum_serialization(ql::datum_t(std::map<datum_string_t, ql::datum_t>
+            {std::make_pair(s, ql::datum_t(1.0))}));
+    }
+}
+
+TEST(DatumTest, InternedStrings) {
+    const std::string key(40, 'k');
+    datum_string_t a = intern_datum_string(key.size(), key.data());
+    datum_string_t b = intern_datum_string(key.size(), key.data());
+    ASSERT_EQ(key, a.to_std());
+    // Both share the same buffer.
+    ASSERT_EQ(a.data(), b.data());
+    const std::string other(40, 'o');
+    ASSERT_EQ(other, intern_datum_string(other.size(), other.data()).to_std());
+}
+
+TEST(DatumTest, Hash) {
+    auto check_equal = [](const ql::datum_t &a, const ql::datum_t &b) {
+        ASSERT_EQ(0, a.cmp(b));
+        ASSERT_EQ(a.hash(), b.hash());
+    };
+    check_equal(ql::datum_t(0.0), ql::datum_t(-0.0));
+    // Times only compare by their epoch time.
+    check_equal(ql::pseudo::make_time(1000.0, "+00:00"),
+                ql::pseudo::make_time(1000.0, "-07:00"));
+
+    std::map<datum_string_t, ql::datum_t> map{
+        std::make_pair(datum_string_t("a"), ql::datum_t(1.0)),
+        std::make_pair(datum_string_t("b"), ql::datum_t(std::vector<ql::datum_t>{
+            ql::datum_t("x"), ql::datum_t::null()}, ql::configured_limits_t()))};
+    const ql::datum_t object(std::move(map));
+    check_equal(object, serialization_round_trip(object));
+
+    ASSERT_NE(ql::datum_t(1.0).hash(), ql::datum_t(2.0).hash());
+    ASSERT_NE(ql::datum_t("a").hash(), ql::datum_t("b").hash());
+}
+
+#ifdef NDEBUG
+// Not a real test, but prints how long building and comparing typical documents
+// takes, so that changes to the datum representation can be compared.
+TEST(DatumTest, Benchmark) {
+    const int NUM_DOCUMENTS = 100000;
+    const char *const keys[] = {"id", "name", "status", "age", "created_at",
+                                "a_somewhat_longer_field_name"};
+    auto time_it = [](const char *description, const std::function<void()> &f) {
+        ticks_t start_ticks = get_ticks();
+        f();
+        printf("%s: %f s\n", description,
+               ticks_to_secs(ticks_t{get_ticks().nanos - start_ticks.nanos}));
+    };
+
+    std::vector<ql::datum_t> documents;
+    documents.reserve(NUM_DOCUMENTS);
+    time_it("Build documents", [&]() {
+        for (int i = 0; i < NUM_DOCUMENTS; ++i) {
+            ql::datum_object_builder_t builder;
+            for (const char *key : keys) {
+                builder.overwrite(
+                    intern_datum_string(strlen(key), key),
+                    ql::datum_t(datum_string_t(strprintf("value %d", i))));
+            }
+            documents.push_back(std::move(builder).to_datum());
+        }
+    });
+    time_it("Access fields", [&]() {
+        size_t total_size = 0;
+        for (const ql::datum_t &doc : documents) {
+            for (const char *key : keys) {
+                total_size += doc.get_field(key).as_str().size();
+            }
+        }
+        ASSERT_LT(0u, total_size);
+    });
+    time_it("Compare documents", [&]() {
+        for (int i = 1; i < NUM_DOCUMENTS; ++i) {
+            ASSERT_NE(documents[i - 1], documents[i]);
+        }
+    });
+    time_it("Serialize and deserialize documents", [&]() {
+        for (const ql::datum_t &doc : documents) {
+            test_datum_serialization(doc);
+        }
+    });
+}
+#endif  // NDEBUG
+
 }  // namespace unittest
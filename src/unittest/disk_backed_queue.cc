@@ -74,6 +74,45 @@ TEST(DiskBackedQueue, BigVals) {
     unittest::run_in_thread_pool(&run_big_values_test, 2);
 }
 
+void run_many_queues_test() {
+    static const int NUM_QUEUES = 10;
+    static const int NUM_ELTS_PER_QUEUE = 500;
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+
+    const serializer_filepath_t serializer_path = dbq_serializer_path();
+
+    internal_disk_backed_queue_t queue(&io_backender, serializer_path,
+                                       &get_global_perfmon_collection());
+    std::vector<size_t> ids;
+    for (int q = 0; q < NUM_QUEUES; ++q) {
+        ids.push_back(q == 0 ? 0 : queue.add_queue());
+    }
+
+    // Interleave the pushes, so that the queues' blocks are interleaved in the file.
+    for (int i = 0; i < NUM_ELTS_PER_QUEUE; ++i) {
+        for (int q = 0; q < NUM_QUEUES; ++q) {
+            scoped_array_t<write_message_t> wms(1);
+            serialize<cluster_version_t::LATEST_OVERALL>(&wms[0], q * NUM_ELTS_PER_QUEUE + i);
+            queue.push(ids[q], wms);
+        }
+    }
+
+    for (int q = NUM_QUEUES - 1; q >= 0; --q) {
+        ASSERT_EQ(NUM_ELTS_PER_QUEUE, queue.size(ids[q]));
+        for (int i = 0; i < NUM_ELTS_PER_QUEUE; ++i) {
+            int x;
+            deserializing_viewer_t<int> viewer(&x);
+            queue.pop(ids[q], &viewer);
+            EXPECT_EQ(q * NUM_ELTS_PER_QUEUE + i, x);
+        }
+        EXPECT_EQ(0, queue.size(ids[q]));
+    }
+}
+
+TEST(DiskBackedQueue, ManyQueues) {
+    unittest::run_in_thread_pool(&run_many_queues_test, 2);
+}
+
 static void randomly_delay(int, signal_t *) {
     nap(randint(100));
 }
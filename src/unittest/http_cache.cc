@@ -0,0 +1,53 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include <map>
+#include <string>
+
+#include "extproc/http_runner.hpp"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+static ql::datum_t response_header(const std::string &cache_control,
+                                    const std::string &vary = "",
+                                    const std::string &age = "",
+                                    const std::string &set_cookie = "") {
+    std::map<datum_string_t, ql::datum_t> fields;
+    fields[datum_string_t("cache-control")] =
+        ql::datum_t(datum_string_t(cache_control));
+    if (!vary.empty()) {
+        fields[datum_string_t("vary")] = ql::datum_t(datum_string_t(vary));
+    }
+    if (!age.empty()) {
+        fields[datum_string_t("age")] = ql::datum_t(datum_string_t(age));
+    }
+    if (!set_cookie.empty()) {
+        fields[datum_string_t("set-cookie")] = ql::datum_t(datum_string_t(set_cookie));
+    }
+    return ql::datum_t(std::move(fields));
+}
+
+TEST(HttpCache, MaxAge) {
+    EXPECT_EQ(60u, *http_cache_max_age(response_header("max-age=60")));
+    EXPECT_EQ(60u, *http_cache_max_age(response_header("public, Max-Age=\"60\"")));
+    EXPECT_EQ(5u, *http_cache_max_age(response_header("max-age=60, s-maxage=5")));
+    EXPECT_EQ(60u, *http_cache_max_age(response_header("max-age=60", "accept")));
+    EXPECT_EQ(45u, *http_cache_max_age(response_header("max-age=60", "", "15")));
+    EXPECT_EQ(60u, *http_cache_max_age(response_header("max-age=60", "", "x")));
+}
+
+TEST(HttpCache, NotCacheable) {
+    EXPECT_FALSE(http_cache_max_age(ql::datum_t::empty_object()).has_value());
+    EXPECT_FALSE(http_cache_max_age(response_header("public")).has_value());
+    EXPECT_FALSE(http_cache_max_age(response_header("max-age=0")).has_value());
+    EXPECT_FALSE(http_cache_max_age(response_header("max-age=x")).has_value());
+    EXPECT_FALSE(http_cache_max_age(response_header("max-age=60, no-cache")).has_value());
+    EXPECT_FALSE(http_cache_max_age(response_header("no-store, max-age=60")).has_value());
+    EXPECT_FALSE(http_cache_max_age(response_header("private, max-age=60")).has_value());
+    EXPECT_FALSE(http_cache_max_age(response_header("max-age=60", "*")).has_value());
+    EXPECT_FALSE(http_cache_max_age(response_header("max-age=60", "", "60")).has_value());
+    EXPECT_FALSE(http_cache_max_age(response_header("max-age=60", "", "90")).has_value());
+    EXPECT_FALSE(http_cache_max_age(
+        response_header("max-age=60", "", "", "id=1")).has_value());
+}
+
+}  // namespace unittest
@@ -1,7 +1,11 @@
 // Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "arch/timing.hpp"
+#include "config/args.hpp"
+#include "concurrency/cond_var.hpp"
 #include "containers/archive/archive.hpp"
 #include "extproc/extproc_pool.hpp"
 #include "extproc/extproc_spawner.hpp"
+#include "extproc/js_job.hpp"
 #include "extproc/js_runner.hpp"
 #include "rpc/serialize_macros.hpp"
 #include "unittest/extproc_test.hpp"
@@ -332,3 +336,308 @@ SPAWNER_TEST(JSProc, Passthrough) {
         passthrough_test_internal(&pool, nested_datum);
     }
 }
+
+SPAWNER_TEST(JSProc, InProcessEvalAndCall) {
+    extproc_pool_t extproc_pool(1, true);
+    js_runner_t js_runner;
+    ql::configured_limits_t limits;
+
+    js_runner.begin(&extproc_pool, nullptr, limits);
+
+    const std::string source_code = "(function (x) { return x + 1; })";
+
+    js_runner_t::req_config_t config;
+    config.timeout_ms = 10000;
+    js_result_t result = js_runner.eval(source_code, config);
+    ASSERT_TRUE(js_runner.connected());
+    ASSERT_TRUE(boost::get<js_id_t>(&result) != nullptr);
+
+    result = js_runner.call(source_code,
+                            std::vector<ql::datum_t>(1, ql::datum_t(41.0)),
+                            config);
+    ql::datum_t *res_datum = boost::get<ql::datum_t>(&result);
+    ASSERT_TRUE(res_datum != nullptr);
+    ASSERT_EQ(res_datum->as_int(), 42);
+}
+
+SPAWNER_TEST(JSProc, InProcessCallTimeout) {
+    extproc_pool_t extproc_pool(1, true);
+    js_runner_t js_runner;
+    ql::configured_limits_t limits;
+
+    js_runner.begin(&extproc_pool, nullptr, limits);
+
+    const std::string loop_source = "(function () { for (var x = 0; x < 4e10; x++) {}})";
+
+    js_runner_t::req_config_t config;
+    config.timeout_ms = 10000;
+
+    js_result_t result = js_runner.eval(loop_source, config);
+    ASSERT_TRUE(boost::get<js_id_t>(&result) != nullptr);
+
+    config.timeout_ms = 10;
+
+    result = js_runner.call(loop_source, std::vector<ql::datum_t>(), config);
+    std::string value = boost::get<std::string>(result);
+    ASSERT_EQ(strprintf("JavaScript query `%s` timed out after 0.010 seconds.", loop_source.c_str()), value);
+    ASSERT_FALSE(js_runner.connected());
+
+    // The isolate of the thread can still be used afterwards.
+    js_runner.begin(&extproc_pool, nullptr, limits);
+    config.timeout_ms = 10000;
+    result = js_runner.eval("1 + 1", config);
+    ql::datum_t *res_datum = boost::get<ql::datum_t>(&result);
+    ASSERT_TRUE(res_datum != nullptr);
+    ASSERT_EQ(res_datum->as_int(), 2);
+}
+
+SPAWNER_TEST(JSProc, InProcessInfiniteRecursion) {
+    extproc_pool_t extproc_pool(1, true);
+    js_runner_t js_runner;
+    ql::configured_limits_t limits;
+
+    js_runner.begin(&extproc_pool, nullptr, limits);
+
+    const std::string source_code = "(function f(x) { x = x + f(x); return x; })";
+
+    js_runner_t::req_config_t config;
+    config.timeout_ms = 60000;
+    js_result_t result = js_runner.eval(source_code, config);
+    ASSERT_TRUE(boost::get<js_id_t>(&result) != nullptr);
+
+    // V8 has to stop at the end of the coroutine's stack.
+    result = js_runner.call(source_code,
+                            std::vector<ql::datum_t>(1, ql::datum_t(1.0)),
+                            config);
+    std::string *err_msg = boost::get<std::string>(&result);
+    ASSERT_TRUE(err_msg != nullptr);
+    ASSERT_EQ(*err_msg, std::string("RangeError: Maximum call stack size exceeded"));
+}
+
+SPAWNER_TEST(JSProc, InProcessHeapLimit) {
+    extproc_pool_t extproc_pool(1, true);
+    js_runner_t js_runner;
+    ql::configured_limits_t limits;
+
+    js_runner.begin(&extproc_pool, nullptr, limits);
+
+    // This has to hit the limit before it runs into `JS_IN_PROCESS_MAX_RUN_MS`.
+    const std::string source_code = "(function f() {"
+                                     "  var res = [];"
+                                     "  while (true) {"
+                                     "    res.push(new Array(50000));"
+                                     "  }"
+                                     "})";
+
+    js_runner_t::req_config_t config;
+    config.timeout_ms = 60000;
+    js_result_t result = js_runner.eval(source_code, config);
+    ASSERT_TRUE(boost::get<js_id_t>(&result) != nullptr);
+
+    result = js_runner.call(source_code, std::vector<ql::datum_t>(), config);
+    std::string *err_msg = boost::get<std::string>(&result);
+    ASSERT_TRUE(err_msg != nullptr);
+    ASSERT_EQ(*err_msg,
+              strprintf("JavaScript query ran out of memory (the limit is %lld MB "
+                        "per thread).", JS_IN_PROCESS_HEAP_LIMIT / MEGABYTE));
+}
+
+SPAWNER_TEST(JSProc, InProcessSlowCallMovesToWorker) {
+    extproc_pool_t extproc_pool(1, true);
+    js_runner_t js_runner;
+    ql::configured_limits_t limits;
+
+    js_runner.begin(&extproc_pool, nullptr, limits);
+
+    const std::string source_code = strprintf(
+        "(function (x) {"
+        "  var end = Date.now() + %d;"
+        "  while (Date.now() < end) {}"
+        "  return x + 1;"
+        "})", static_cast<int>(2 * JS_IN_PROCESS_MAX_RUN_MS));
+
+    js_runner_t::req_config_t config;
+    config.timeout_ms = 10000;
+    js_result_t result = js_runner.eval(source_code, config);
+    ASSERT_TRUE(boost::get<js_id_t>(&result) != nullptr);
+
+    // The first call gets stopped in-process and runs again in the worker, the
+    // second one runs in the worker right away.
+    for (int i = 0; i < 2; ++i) {
+        result = js_runner.call(source_code,
+                                std::vector<ql::datum_t>(1, ql::datum_t(41.0)),
+                                config);
+        ql::datum_t *res_datum = boost::get<ql::datum_t>(&result);
+        ASSERT_TRUE(res_datum != nullptr);
+        ASSERT_EQ(res_datum->as_int(), 42);
+        ASSERT_TRUE(js_runner.connected());
+    }
+}
+
+SPAWNER_TEST(JSProc, InProcessSlowReturnedFunctionMovesToWorker) {
+    extproc_pool_t extproc_pool(1, true);
+    ql::configured_limits_t limits;
+    // `js_runner_t` only calls functions by their source, so we use the job to call
+    // the function that another one returns.
+    cond_t interruptor;
+    js_job_t js_job(&extproc_pool, &interruptor, limits);
+
+    const std::string source_code = strprintf(
+        "(function (y) {"
+        "  return function (x) {"
+        "    var end = Date.now() + %d;"
+        "    while (Date.now() < end) {}"
+        "    return x + y;"
+        "  };"
+        "})", static_cast<int>(2 * JS_IN_PROCESS_MAX_RUN_MS));
+
+    const uint64_t timeout_ms = 60000;
+    js_result_t result = js_job.eval(source_code, timeout_ms);
+    js_id_t *outer_id = boost::get<js_id_t>(&result);
+    ASSERT_TRUE(outer_id != nullptr);
+    result = js_job.call(*outer_id, std::vector<ql::datum_t>(1, ql::datum_t(1.0)),
+                         timeout_ms);
+    js_id_t *inner_id_ptr = boost::get<js_id_t>(&result);
+    ASSERT_TRUE(inner_id_ptr != nullptr);
+    js_id_t inner_id = *inner_id_ptr;
+
+    // The returned function gets stopped in-process like any other and made again in
+    // the worker, instead of blocking the thread for the whole timeout.
+    for (int i = 0; i < 2; ++i) {
+        ticks_t start = get_ticks();
+        result = js_job.call(inner_id, std::vector<ql::datum_t>(1, ql::datum_t(41.0)),
+                             timeout_ms);
+        ql::datum_t *res_datum = boost::get<ql::datum_t>(&result);
+        ASSERT_TRUE(res_datum != nullptr);
+        ASSERT_EQ(res_datum->as_int(), 42);
+        ASSERT_LT(get_ticks().nanos - start.nanos, 30 * BILLION);
+    }
+    ASSERT_FALSE(js_job.timed_out());
+
+    js_job.release(inner_id);
+    js_job.release(*outer_id);
+    js_job.exit();
+}
+
+SPAWNER_TEST(JSProc, InProcessLongCallIsInterruptible) {
+    extproc_pool_t extproc_pool(1, true);
+    js_runner_t js_runner;
+    ql::configured_limits_t limits;
+
+    // The timer can only go off if the script doesn't block the thread.
+    signal_timer_t interruptor;
+    interruptor.start(500);
+    js_runner.begin(&extproc_pool, &interruptor, limits);
+
+    const std::string source_code = "(function () { while (true) {} })";
+
+    js_runner_t::req_config_t config;
+    config.timeout_ms = 60000;
+    js_result_t result = js_runner.eval(source_code, config);
+    ASSERT_TRUE(boost::get<js_id_t>(&result) != nullptr);
+
+    ticks_t start = get_ticks();
+    ASSERT_THROW(js_runner.call(source_code, std::vector<ql::datum_t>(), config),
+                 interrupted_exc_t);
+    ASSERT_LT(get_ticks().nanos - start.nanos, 30 * BILLION);
+}
+
+SPAWNER_TEST(JSProc, InProcessPassthrough) {
+    extproc_pool_t pool(1, true);
+    ql::configured_limits_t limits;
+
+    passthrough_test_internal(&pool, ql::datum_t(99.9999));
+    passthrough_test_internal(&pool, ql::datum_t("string str"));
+    passthrough_test_internal(&pool, ql::datum_t::boolean(true));
+
+    std::map<datum_string_t, ql::datum_t> object_data;
+    object_data.insert(std::make_pair(datum_string_t("a"),
+                                      ql::datum_t(std::vector<ql::datum_t>(
+                                          3, ql::datum_t(1.0)), limits)));
+    passthrough_test_internal(&pool, ql::datum_t(std::move(object_data)));
+}
+
+void run_call_batch_test(bool js_in_process) {
+    extproc_pool_t extproc_pool(1, js_in_process);
+    js_runner_t js_runner;
+    ql::configured_limits_t limits;
+
+    js_runner.begin(&extproc_pool, nullptr, limits);
+
+    const std::string source_code =
+        "(function (x) { if (x < 0) { throw 'negative'; } return x * 2; })";
+
+    js_runner_t::req_config_t config;
+    config.timeout_ms = 10000;
+
+    std::vector<std::vector<ql::datum_t> > args_batch;
+    for (int i = 0; i < 100; ++i) {
+        ql::datum_t arg(i == 50 ? -1.0 : static_cast<double>(i));
+        args_batch.push_back(std::vector<ql::datum_t>(1, arg));
+    }
+
+    std::vector<js_result_t> results =
+        js_runner.call_batch(source_code, args_batch, config);
+    ASSERT_TRUE(js_runner.connected());
+    ASSERT_EQ(args_batch.size(), results.size());
+    for (int i = 0; i < 100; ++i) {
+        if (i == 50) {
+            // A failing call doesn't affect the others.
+            std::string *err_msg = boost::get<std::string>(&results[i]);
+            ASSERT_TRUE(err_msg != nullptr);
+            ASSERT_EQ(std::string("negative"), *err_msg);
+        } else {
+            ql::datum_t *res_datum = boost::get<ql::datum_t>(&results[i]);
+            ASSERT_TRUE(res_datum != nullptr);
+            ASSERT_EQ(i * 2, res_datum->as_int());
+        }
+    }
+}
+
+SPAWNER_TEST(JSProc, CallBatch) {
+    run_call_batch_test(false);
+}
+
+SPAWNER_TEST(JSProc, InProcessCallBatch) {
+    run_call_batch_test(true);
+}
+
+SPAWNER_TEST(JSProc, CallBatchTimeoutIsPerCall) {
+    extproc_pool_t extproc_pool(1);
+    js_runner_t js_runner;
+    ql::configured_limits_t limits;
+
+    js_runner.begin(&extproc_pool, nullptr, limits);
+
+    const std::string loop_source =
+        "(function (x) { for (var i = 0; x == 3 && i < 4e10; i++) {} return x; })";
+
+    js_runner_t::req_config_t config;
+    config.timeout_ms = 100;
+
+    std::vector<std::vector<ql::datum_t> > args_batch;
+    for (int i = 0; i < 50; ++i) {
+        args_batch.push_back(
+            std::vector<ql::datum_t>(1, ql::datum_t(static_cast<double>(i))));
+    }
+
+    // Without a timeout per call, the loop would get the time of all 50 calls.
+    std::vector<js_result_t> results =
+        js_runner.call_batch(loop_source, args_batch, config);
+    ASSERT_EQ(args_batch.size(), results.size());
+    for (int i = 0; i < 3; ++i) {
+        ql::datum_t *res_datum = boost::get<ql::datum_t>(&results[i]);
+        ASSERT_TRUE(res_datum != nullptr);
+        ASSERT_EQ(i, res_datum->as_int());
+    }
+    std::string *err_msg = boost::get<std::string>(&results[3]);
+    ASSERT_TRUE(err_msg != nullptr);
+    ASSERT_EQ(strprintf("JavaScript query `%s` timed out after 0.100 seconds.",
+                        loop_source.c_str()), *err_msg);
+
+    // The worker is still usable.
+    ASSERT_TRUE(js_runner.connected());
+    results = js_runner.call_batch(
+        loop_source, std::vector<std::vector<ql::datum_t> >(1, args_batch[7]), config);
+    ASSERT_EQ(7, boost::get<ql::datum_t>(results[0]).as_int());
+}
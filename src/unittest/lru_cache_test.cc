@@ -38,4 +38,41 @@ TEST(LRUCacheTest, Basic) {
     EXPECT_FALSE(res);
 }
 
+TEST(LRUCacheTest, Erase) {
+    lru_cache_t<std::string, std::string> cache(2);
+    EXPECT_TRUE(cache.insert("1", "a"));
+    EXPECT_TRUE(cache.insert("2", "b"));
+    EXPECT_TRUE(cache.erase("1"));
+    EXPECT_FALSE(cache.erase("1"));
+    EXPECT_EQ(1, cache.size());
+    std::string *p;
+    EXPECT_FALSE(cache.lookup("1", &p));
+    // The erased key can be inserted again, without evicting "2".
+    EXPECT_TRUE(cache.insert("1", "c"));
+    EXPECT_EQ(2, cache.size());
+    ASSERT_TRUE(cache.lookup("2", &p));
+    EXPECT_EQ("b", *p);
+    ASSERT_TRUE(cache.lookup("1", &p));
+    EXPECT_EQ("c", *p);
+}
+
+TEST(LRUCacheTest, EvictOldest) {
+    lru_cache_t<std::string, std::string> cache(4);
+    std::string v;
+    EXPECT_FALSE(cache.evict_oldest(&v));
+    EXPECT_TRUE(cache.insert("1", "a"));
+    EXPECT_TRUE(cache.insert("2", "b"));
+    EXPECT_TRUE(cache.insert("3", "c"));
+    std::string *p;
+    ASSERT_TRUE(cache.lookup("1", &p));
+    // Usage ordering is now 2 3 1.
+    ASSERT_TRUE(cache.evict_oldest(&v));
+    EXPECT_EQ("b", v);
+    ASSERT_TRUE(cache.evict_oldest());
+    EXPECT_EQ(1, cache.size());
+    EXPECT_FALSE(cache.lookup("3", &p));
+    ASSERT_TRUE(cache.lookup("1", &p));
+    EXPECT_EQ("a", *p);
+}
+
 } // namespace unittest
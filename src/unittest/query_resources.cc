@@ -0,0 +1,71 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "arch/runtime/coroutines.hpp"
+#include "concurrency/cond_var.hpp"
+#include "config/args.hpp"
+#include "rdb_protocol/datum.hpp"
+#include "rdb_protocol/env.hpp"
+#include "rdb_protocol/query_resources.hpp"
+#include "time.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+TPTEST(QueryResources, AllocationsOfTheQueryCoroutine) {
+    ql::query_resources_t resources;
+    uint64_t other_coro_bytes = 0;
+    {
+        ql::query_resources_scope_t scope(&resources);
+        ql::datum_t str(datum_string_t(std::string(1000, 'a')));
+        ASSERT_GE(resources.allocated_bytes, 1000u);
+        ASSERT_EQ(resources.allocated_bytes, resources.response_allocated_bytes);
+
+        // Another coroutine's allocations belong to whatever it is doing.
+        uint64_t before = resources.allocated_bytes;
+        coro_t::spawn_sometime([&]() {
+            ql::datum_t other(datum_string_t(std::string(1000, 'b')));
+            other_coro_bytes = resources.allocated_bytes - before;
+        });
+        coro_t::yield();
+        ASSERT_EQ(0u, other_coro_bytes);
+        ASSERT_EQ(before, resources.allocated_bytes);
+
+        resources.start_response();
+        ASSERT_EQ(0u, resources.response_allocated_bytes);
+    }
+    uint64_t after_scope = resources.allocated_bytes;
+    ql::datum_t str(datum_string_t(std::string(1000, 'c')));
+    ASSERT_EQ(after_scope, resources.allocated_bytes);
+}
+
+TPTEST(QueryResources, LongQueryLetsOthersRun) {
+    cond_t interruptor;
+    ql::env_t env(&interruptor,
+                  ql::return_empty_normal_batches_t::NO,
+                  reql_version_t::LATEST);
+    ql::query_resources_t resources;
+    env.set_query_resources(&resources, 0);
+
+    bool other_ran = false;
+    coro_t::spawn_sometime([&]() {
+        other_ran = true;
+    });
+
+    // Every term of this query (think of a `map` with an expensive function) takes a
+    // millisecond.  Counting terms alone, the query would only yield after 256 of
+    // them.
+    int evals = 0;
+    {
+        ql::query_resources_scope_t scope(&resources);
+        while (!other_ran) {
+            ASSERT_LT(evals, 256);
+            ticks_t start = get_ticks();
+            while (get_ticks().nanos - start.nanos < MILLION) { }
+            env.maybe_yield();
+            ++evals;
+        }
+    }
+    ASSERT_GE(resources.cpu_time.nanos, QUERY_TIME_SLICE_MS * MILLION);
+}
+
+}  // namespace unittest
@@ -0,0 +1,106 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "rdb_protocol/bytecode.hpp"
+#include "rdb_protocol/minidriver.hpp"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+ql::datum_t make_row(double age, const char *status) {
+    ql::datum_object_builder_t builder;
+    UNUSED bool b1 = builder.add("age", ql::datum_t(age));
+    UNUSED bool b2 = builder.add("status", ql::datum_t(status));
+    return std::move(builder).to_datum();
+}
+
+TEST(RDBBytecode, Predicate) {
+    ql::minidriver_t r(ql::backtrace_id_t::empty());
+    const ql::sym_t row(1);
+    // row('status') == 'x' && row('age') > 30
+    ql::raw_term_t body =
+        ((r.var(row)["status"] == r.expr("x")) && (r.var(row)["age"] > r.expr(30.0)))
+        .root_term();
+
+    counted_t<const ql::bytecode_program_t> program =
+        ql::compile_bytecode(std::vector<ql::sym_t>{row}, body);
+    ASSERT_TRUE(program.has());
+
+    ql::datum_t out;
+    ASSERT_TRUE(program->run(std::vector<ql::datum_t>{make_row(40, "x")}, &out));
+    ASSERT_EQ(ql::datum_t::boolean(true), out);
+    ASSERT_TRUE(program->run(std::vector<ql::datum_t>{make_row(20, "x")}, &out));
+    ASSERT_EQ(ql::datum_t::boolean(false), out);
+    // `and` short-circuits, so the second comparison is never evaluated.
+    ASSERT_TRUE(program->run(std::vector<ql::datum_t>{make_row(40, "y")}, &out));
+    ASSERT_EQ(ql::datum_t::boolean(false), out);
+}
+
+TEST(RDBBytecode, Arithmetic) {
+    ql::minidriver_t r(ql::backtrace_id_t::empty());
+    const ql::sym_t row(1);
+    ql::raw_term_t body =
+        ((r.var(row)["age"] + r.expr(2.0)) / r.expr(4.0)).root_term();
+
+    counted_t<const ql::bytecode_program_t> program =
+        ql::compile_bytecode(std::vector<ql::sym_t>{row}, body);
+    ASSERT_TRUE(program.has());
+
+    ql::datum_t out;
+    ASSERT_TRUE(program->run(std::vector<ql::datum_t>{make_row(10, "x")}, &out));
+    ASSERT_EQ(ql::datum_t(3.0), out);
+}
+
+TEST(RDBBytecode, BailsOut) {
+    ql::minidriver_t r(ql::backtrace_id_t::empty());
+    const ql::sym_t row(1);
+    ql::raw_term_t body = (r.var(row)["missing"] == r.expr(1.0)).root_term();
+
+    counted_t<const ql::bytecode_program_t> program =
+        ql::compile_bytecode(std::vector<ql::sym_t>{row}, body);
+    ASSERT_TRUE(program.has());
+
+    // Missing fields and non-objects are left to the term tree.
+    ql::datum_t out;
+    ASSERT_FALSE(program->run(std::vector<ql::datum_t>{make_row(10, "x")}, &out));
+    ASSERT_FALSE(program->run(std::vector<ql::datum_t>{ql::datum_t(1.0)}, &out));
+    ASSERT_FALSE(out.has());
+}
+
+TEST(RDBBytecode, ArgFields) {
+    ql::minidriver_t r(ql::backtrace_id_t::empty());
+    const ql::sym_t row(1);
+
+    counted_t<const ql::bytecode_program_t> program = ql::compile_bytecode(
+        std::vector<ql::sym_t>{row},
+        ((r.var(row)["status"] == r.expr("x")) && (r.var(row)["age"] > r.expr(30.0)))
+        .root_term());
+    ASSERT_TRUE(program.has());
+    std::vector<datum_string_t> fields;
+    ASSERT_TRUE(program->arg_fields_only(&fields));
+    ASSERT_EQ((std::vector<datum_string_t>{datum_string_t("status"),
+                                           datum_string_t("age")}), fields);
+
+    // Comparing the row itself needs more than its fields.
+    program = ql::compile_bytecode(
+        std::vector<ql::sym_t>{row},
+        ((r.var(row)["age"] > r.expr(30.0)) && (r.var(row) == r.expr(1.0)))
+        .root_term());
+    ASSERT_TRUE(program.has());
+    ASSERT_FALSE(program->arg_fields_only(&fields));
+}
+
+TEST(RDBBytecode, Unsupported) {
+    ql::minidriver_t r(ql::backtrace_id_t::empty());
+    const ql::sym_t row(1);
+    const ql::sym_t captured(2);
+
+    // Variables from an enclosing scope.
+    ASSERT_FALSE(ql::compile_bytecode(
+        std::vector<ql::sym_t>{row},
+        (r.var(captured) == r.var(row)["age"]).root_term()).has());
+    // Sequence operations.
+    ASSERT_FALSE(ql::compile_bytecode(
+        std::vector<ql::sym_t>{row},
+        r.var(row)["tags"].contains(r.expr("x")).root_term()).has());
+}
+
+}  // namespace unittest
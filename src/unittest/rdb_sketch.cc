@@ -0,0 +1,102 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "rdb_protocol/sketch.hpp"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+TEST(RDBSketch, HyperLogLogEstimate) {
+    ql::hyperloglog_t h;
+    ASSERT_EQ(0u, h.estimate());
+    for (int i = 0; i < 200000; ++i) {
+        h.add(ql::sketch_hash(ql::datum_t(static_cast<double>(i))));
+        // Duplicates don't change anything.
+        h.add(ql::sketch_hash(ql::datum_t(static_cast<double>(i / 2))));
+    }
+    uint64_t e = h.estimate();
+    ASSERT_LT(194000u, e);
+    ASSERT_GT(206000u, e);
+}
+
+TEST(RDBSketch, HyperLogLogMerge) {
+    ql::hyperloglog_t all, left, right;
+    for (int i = 0; i < 50000; ++i) {
+        uint64_t hash = ql::sketch_hash(ql::datum_t(static_cast<double>(i)));
+        all.add(hash);
+        // The two halves overlap.
+        if (i < 30000) {
+            left.add(hash);
+        }
+        if (i >= 20000) {
+            right.add(hash);
+        }
+    }
+    left.merge(right);
+    ASSERT_EQ(all.dense_registers(), left.dense_registers());
+    ASSERT_EQ(all.estimate(), left.estimate());
+}
+
+TEST(RDBSketch, HyperLogLogSparse) {
+    // Small sketches, like the ones of the groups of a grouped
+    // `approx_count_distinct`, only keep their non-zero registers.
+    ql::hyperloglog_t empty;
+    ASSERT_EQ(0u, empty.memory_usage());
+    for (int n : {1, 10, 100, 1000}) {
+        ql::hyperloglog_t h, dense;
+        dense.make_dense();
+        for (int i = 0; i < n; ++i) {
+            uint64_t hash = ql::sketch_hash(ql::datum_t(static_cast<double>(i)));
+            h.add(hash);
+            h.add(hash);
+            dense.add(hash);
+        }
+        ASSERT_FALSE(h.is_dense());
+        ASSERT_GE(4 * ql::hyperloglog_t::max_sparse, h.memory_usage());
+        ASSERT_GE(static_cast<size_t>(8 * n), h.memory_usage());
+        // Linear counting is very accurate for so few values, and both kinds of
+        // sketches agree exactly.
+        ASSERT_NEAR(n, static_cast<double>(h.estimate()), 1 + n / 50.0);
+        ASSERT_EQ(dense.estimate(), h.estimate());
+        ASSERT_EQ(dense.dense_registers(), h.dense_registers());
+    }
+
+    // Merging two sparse sketches keeps them sparse while they're small.
+    ql::hyperloglog_t a, b;
+    for (int i = 0; i < 600; ++i) {
+        a.add(ql::sketch_hash(ql::datum_t(static_cast<double>(i))));
+        b.add(ql::sketch_hash(ql::datum_t(static_cast<double>(i + 300))));
+    }
+    a.merge(b);
+    ASSERT_FALSE(a.is_dense());
+    ASSERT_NEAR(900, static_cast<double>(a.estimate()), 18);
+
+    // Past `max_sparse` registers, the sketch switches to dense registers.
+    for (int i = 0; i < 5000; ++i) {
+        a.add(ql::sketch_hash(ql::datum_t(static_cast<double>(i))));
+    }
+    ASSERT_TRUE(a.is_dense());
+    ASSERT_TRUE(a.sparse.empty());
+    ASSERT_NEAR(5000, static_cast<double>(a.estimate()), 100);
+}
+
+TEST(RDBSketch, TDigestQuantiles) {
+    ql::tdigest_t shards[4];
+    for (int i = 0; i < 100000; ++i) {
+        // Spread the values over the shards in an unsorted way.
+        shards[(i * 7) % 4].add((i * 7919) % 100000);
+    }
+    ql::tdigest_t t;
+    for (auto &shard : shards) {
+        t.merge(&shard);
+        ASSERT_TRUE(shard.empty());
+    }
+    ASSERT_EQ(100000, t.total_weight);
+    ASSERT_EQ(0, t.quantile(0));
+    ASSERT_EQ(99999, t.quantile(1));
+    ASSERT_NEAR(50000, t.quantile(0.5), 500);
+    ASSERT_NEAR(99000, t.quantile(0.99), 100);
+    ASSERT_NEAR(1000, t.quantile(0.01), 100);
+    // The digest stays small.
+    ASSERT_GT(200u, t.centroids.size());
+}
+
+}  // namespace unittest
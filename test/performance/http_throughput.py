@@ -0,0 +1,96 @@
+#!/usr/bin/python
+# Copyright 2010-2015 RethinkDB, all rights reserved.
+
+'''Measures the requests per second of `table.map(r.http(...))` against a local stub
+server, with responses that can't be cached and with responses that can.'''
+
+from __future__ import print_function
+
+import os
+import sys
+import threading
+import time
+
+try:
+    from BaseHTTPServer import BaseHTTPRequestHandler, HTTPServer
+    from SocketServer import ThreadingMixIn
+except ImportError:
+    from http.server import BaseHTTPRequestHandler, HTTPServer
+    from socketserver import ThreadingMixIn
+
+sys.path.append(os.path.abspath(os.path.join(os.path.dirname(__file__), os.path.pardir, 'common')))
+import driver, utils
+
+r = utils.import_python_driver()
+
+rows = 2000 # Rows mapped over per run
+runs = 3
+
+class StubHandler(BaseHTTPRequestHandler):
+    # Keep-alive needs HTTP/1.1
+    protocol_version = 'HTTP/1.1'
+    connections = set()
+    connections_lock = threading.Lock()
+
+    def do_GET(self):
+        with self.connections_lock:
+            self.connections.add(self.client_address)
+        body = ('{"path": "%s"}' % self.path).encode('utf-8')
+        self.send_response(200)
+        self.send_header('Content-Type', 'application/json')
+        self.send_header('Content-Length', str(len(body)))
+        if self.path.startswith('/cached'):
+            self.send_header('Cache-Control', 'public, max-age=600')
+        else:
+            self.send_header('Cache-Control', 'no-store')
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, *args):
+        pass
+
+class StubServer(ThreadingMixIn, HTTPServer):
+    daemon_threads = True
+
+def measure(conn, table, url):
+    results = []
+    for i in range(runs):
+        start = time.time()
+        table.map(lambda row: r.http(url + '/' + row['id'].coerce_to('string'))).count().run(conn)
+        results.append(rows / (time.time() - start))
+    return max(results)
+
+def main(data_dir):
+    stub = StubServer(('localhost', 0), StubHandler)
+    stub_thread = threading.Thread(target=stub.serve_forever)
+    stub_thread.daemon = True
+    stub_thread.start()
+    base_url = 'http://localhost:%d' % stub.server_address[1]
+
+    executable_path = utils.find_rethinkdb_executable()
+    with driver.Process(name=os.path.join(data_dir, "http_throughput"),
+                        executable_path=executable_path) as server:
+        conn = r.connect(host="localhost", port=server.driver_port)
+        r.db_create("test").run(conn)
+        r.db("test").table_create("http").run(conn)
+        table = r.db("test").table("http")
+        table.insert(r.range(rows).map({'id': r.row})).run(conn)
+
+        print("Measuring...", end=' ')
+        sys.stdout.flush()
+        uncached = measure(conn, table, base_url + '/uncached')
+        cached = measure(conn, table, base_url + '/cached')
+        print("Done.")
+
+    print("%-10s %14s" % ("responses", "requests/sec"))
+    print("%-10s %14.0f" % ("uncached", uncached))
+    print("%-10s %14.0f" % ("cached", cached))
+    print("%d requests used %d connections" % (
+        2 * runs * rows, len(StubHandler.connections)))
+    stub.shutdown()
+
+if __name__ == "__main__":
+    data_dir = './'
+    if len(sys.argv) > 1:
+        data_dir = sys.argv[1]
+    main(data_dir)
@@ -0,0 +1,78 @@
+#!/usr/bin/python
+# Copyright 2010-2015 RethinkDB, all rights reserved.
+
+'''Compares the latency of `r.js` calls in extproc workers with `--js-in-process`.'''
+
+from __future__ import print_function
+
+import os
+import sys
+import time
+
+sys.path.append(os.path.abspath(os.path.join(os.path.dirname(__file__), os.path.pardir, 'common')))
+import driver, utils
+
+r = utils.import_python_driver()
+
+try:
+    xrange
+except NameError:
+    xrange = range
+
+calls = 1000 # Single calls per mode
+rows = 100000 # Rows mapped over in one query per mode
+
+modes = [
+    {"name": "extproc", "extra_options": []},
+    {"name": "in-process", "extra_options": ["--js-in-process"]}
+]
+
+func = '(function (x) { return x + 1; })'
+
+def measure(conn):
+    durations = []
+    for i in xrange(calls):
+        start = time.time()
+        r.expr(i).do(r.js(func)).run(conn)
+        durations.append(time.time() - start)
+    durations.sort()
+
+    start = time.time()
+    r.range(rows).map(r.js(func)).count().run(conn)
+    per_row = (time.time() - start) / rows
+
+    return {
+        "call_average": sum(durations) / len(durations),
+        "call_median": durations[len(durations) // 2],
+        "call_last_centile": durations[len(durations) * 99 // 100],
+        "map_per_row": per_row
+    }
+
+def main(data_dir):
+    executable_path = utils.find_rethinkdb_executable()
+    results = {}
+    for mode in modes:
+        print("Measuring %s..." % mode["name"], end=' ')
+        sys.stdout.flush()
+        with driver.Process(name=os.path.join(data_dir, "js_latency_" + mode["name"]),
+                            executable_path=executable_path,
+                            extra_options=mode["extra_options"]) as server:
+            conn = r.connect(host="localhost", port=server.driver_port)
+            # Warm up the workers and the function caches
+            for i in xrange(100):
+                r.expr(i).do(r.js(func)).run(conn)
+            results[mode["name"]] = measure(conn)
+        print("Done.")
+
+    print("%-12s %12s %12s %12s %14s" % ("mode", "call avg", "call p50", "call p99", "map per row"))
+    for mode in modes:
+        res = results[mode["name"]]
+        print("%-12s %10.3fms %10.3fms %10.3fms %12.3fus" % (
+            mode["name"], res["call_average"] * 1000, res["call_median"] * 1000,
+            res["call_last_centile"] * 1000, res["map_per_row"] * 1000000))
+
+if __name__ == "__main__":
+    data_dir = './'
+    if len(sys.argv) > 1:
+        data_dir = sys.argv[1]
+    main(data_dir)
@@ -62,6 +62,18 @@ table_queries = [
         "query": "r.db('test').table(table['name']).filter(r.row['field0'].gt('5'))",
         "tag": "filter_string_5"
     },
+    {
+        "query": "r.db('test').table(table['name']).filter(r.row['field0'].eq('5').and_(r.row['int'].gt(30)))",
+        "tag": "filter_eq_and_gt"
+    },
+    {
+        "query": "r.db('test').table(table['name']).filter(r.row['field0'].ne('5').or_(r.row['float'].le(r.row['int'] / 2)))",
+        "tag": "filter_ne_or_arith"
+    },
+    {
+        "query": "r.db('test').table(table['name']).filter(lambda doc: (doc['int'] * 3 + 1).ge(50).and_(doc['obj']['nested0'].ne('')))",
+        "tag": "filter_lambda_nested"
+    },
     {
         "query": "r.db('test').table(table['name']).limit(10).inner_join(r.db('test').table(table['name']), lambda left, right: left['id'] == right['id'])",
         "tag": "inner_join"
@@ -106,6 +118,10 @@ table_queries = [
         "query": "r.db('test').table(table['name']).order_by(index='id')",
         "tag": "order_by_id_index"
     },
+    {
+        "query": "r.db('test').table(table['name']).order_by(r.row['int']).limit(10)",
+        "tag": "order_by_int_limit"
+    },
     {
         "query": "r.db('test').table(table['name']).skip(0)",
         "tag": "skip_0"
@@ -152,9 +168,66 @@ table_queries = [
         "tag": "count-sindex-between",
         "imax": 100
     },
+    {
+        # Pagination: the size of the remaining range of the table
+        "query": "r.db('test').table(table['name']).between(table['ids'][i], r.maxval).count()",
+        "tag": "count-pk-between-open-ended",
+        "imax": 100
+    },
+    {
+        # Pagination: a page from the middle of the table
+        "query": "r.db('test').table(table['name']).order_by(index='id').skip(1000).limit(10)",
+        "tag": "order_by_id_skip_1000_limit_10"
+    },
+    {
+        "query": "r.db('test').table(table['name']).order_by(index='id').nth(1000)",
+        "tag": "order_by_id_nth_1000"
+    },
+    {
+        "query": "r.db('test').table(table['name']).between(table['ids'][i], table['ids'][i+100], index='field0').pluck('id', 'int')",
+        "tag": "sindex-between-pluck",
+        "imax": 100
+    },
     {
         "query": "r.db('test').table(table['name']).filter(r.expr(True)).count()",
         "tag": "filter-true-count"
+    },
+    {
+        "query": "r.db('test').table(table['name']).filter(r.row['int'] > 500).count()",
+        "tag": "filter-field-count"
+    },
+    {
+        "query": "r.db('test').table(table['name']).filter(r.row['boolean'] == True).pluck('id', 'int')",
+        "tag": "filter_pluck"
+    },
+    {
+        "query": "r.db('test').table(table['name']).map(r.row['int']).distinct()",
+        "tag": "map-distinct"
+    },
+    {
+        "query": "r.db('test').table(table['name']).sample(100)",
+        "tag": "sample"
+    },
+    {
+        "query": "r.db('test').table(table['name']).approx_count_distinct('int')",
+        "tag": "approx-count-distinct"
+    },
+    {
+        "query": "r.db('test').table(table['name']).approx_quantile('int', [0.5, 0.99])",
+        "tag": "approx-quantile"
+    },
+    {
+        "query": "r.db('test').table(table['name']).map(lambda x: x['int'] * x['float']).reduce(lambda a, b: a + b)",
+        "tag": "map-reduce"
+    },
+    {
+        # One group per row
+        "query": "r.db('test').table(table['name']).group('id').count()",
+        "tag": "group-id-count"
+    },
+    {
+        "query": "r.db('test').table(table['name']).group('int').sum('int')",
+        "tag": "group-int-sum"
     }
 ]
 
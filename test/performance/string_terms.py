@@ -0,0 +1,61 @@
+#!/usr/bin/python
+# Copyright 2010-2015 RethinkDB, all rights reserved.
+
+'''Measures the rows per second of the string terms (`match`, `split`, `upcase` and
+`downcase`) mapped over a table of strings.'''
+
+from __future__ import print_function
+
+import os
+import sys
+import time
+
+sys.path.append(os.path.abspath(os.path.join(os.path.dirname(__file__), os.path.pardir, 'common')))
+import driver, utils
+
+r = utils.import_python_driver()
+
+rows = 20000 # Rows in the table
+runs = 3
+
+text = "The quick brown fox jumps over the lazy dog, again and again, row "
+
+queries = [
+    ("match literal", lambda row: row['s'].match('lazy dog')),
+    ("match prefix", lambda row: row['s'].match('^The quick')),
+    ("match regex", lambda row: row['s'].match('b(r|x)own [a-z]+')),
+    ("split char", lambda row: row['s'].split(',')),
+    ("split string", lambda row: row['s'].split(' again')),
+    ("split spaces", lambda row: row['s'].split()),
+    ("upcase", lambda row: row['s'].upcase()),
+    ("downcase", lambda row: row['s'].downcase())
+]
+
+def measure(conn, table, func):
+    results = []
+    for i in range(runs):
+        start = time.time()
+        table.map(func).count().run(conn)
+        results.append(rows / (time.time() - start))
+    return max(results)
+
+def main(data_dir):
+    executable_path = utils.find_rethinkdb_executable()
+    with driver.Process(name=os.path.join(data_dir, "string_terms"),
+                        executable_path=executable_path) as server:
+        conn = r.connect(host="localhost", port=server.driver_port)
+        r.db_create("test").run(conn)
+        r.db("test").table_create("strings").run(conn)
+        table = r.db("test").table("strings")
+        table.insert(r.range(rows).map(
+            lambda i: {'id': i, 's': r.expr(text * 4).add(i.coerce_to('string'))})).run(conn)
+
+        print("%-14s %12s" % ("term", "rows/sec"))
+        for name, func in queries:
+            print("%-14s %12.0f" % (name, measure(conn, table, func)))
+
+if __name__ == "__main__":
+    data_dir = './'
+    if len(sys.argv) > 1:
+        data_dir = sys.argv[1]
+    main(data_dir)
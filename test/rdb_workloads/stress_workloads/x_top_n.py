@@ -0,0 +1,41 @@
+#!/usr/bin/env python
+import sys, os, random, x_stress_util
+
+sys.path.insert(0, os.path.abspath(os.path.join(os.path.dirname(__file__), os.path.pardir, 'common')))
+import utils
+r = utils.import_python_driver()
+
+# Keeps an `order_by.limit` changefeed open on every connection and churns the top of
+# it: every op deletes the newest rows and inserts a row at a random point in the
+# last month, which lands in the top rows, just beyond them, or far away.
+class Workload:
+    def __init__(self, options):
+        self.db = options["db"]
+        self.table = options["table"]
+        self.limit = int(os.getenv("X_TOP_N_LIMIT", "10"))
+        self.churn = int(os.getenv("X_TOP_N_CHURN", "1"))
+        self.conn = None
+        self.feed = None
+
+    def run(self, conn):
+        table = r.db(self.db).table(self.table)
+        if self.conn is not conn:
+            self.conn = conn
+            self.feed = table.order_by(index=r.desc("datetime")).limit(self.limit).changes().run(conn)
+
+        table.order_by(index=r.desc("datetime")).limit(self.churn).delete().run(conn)
+        rql_res = table.insert({"customer_id": "customer%03d" % random.randint(0, 999),
+                                "type": "type0",
+                                "datetime": r.now() - random.randint(0, 30 * 24 * 3600)}).run(conn)
+
+        # Drain the changes the feed has for us so far.
+        try:
+            while True:
+                self.feed.next(wait=False)
+        except r.ReqlTimeoutError:
+            pass
+
+        result = {}
+        if rql_res["errors"] > 0:
+            result["errors"] = [rql_res["first_error"]]
+        return result